@@ -0,0 +1,445 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for an arena store, memory that is allocated in order and released all 
+at once.
+Each function is documented in the comment block above its definition.
+
+Each snapshot store has an arena store that owns the memory of the snapshot store and its 
+descendants that isn't resized.
+The arena store is described in arena.h.
+
+-
+create_arena_store()
+
+Create an arena store or die.
+-
+
+-
+init_arena_store()
+
+Initialize an arena store.
+-
+
+-
+take_arena_bytes()
+
+Take bytes from an arena store's blocks, allocating a new block if necessary, or die.
+-
+
+-
+arena_alloc()
+
+Allocate uninitialized memory for an array from an arena store or die.
+-
+
+-
+arena_calloc()
+
+Allocate zeroed memory for an array from an arena store or die.
+-
+
+-
+reset_arena_store()
+
+Reset an arena store so that its memory can be allocated again.
+-
+
+-
+print_arena_stats()
+
+Print a one line summary of an arena store's statistics.
+-
+
+-
+print_arena_store()
+
+Print an arena store.
+-
+
+-
+free_arena_store()
+
+Free an arena store and all its memory.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "arena.h"
+
+
+
+/* the number of bytes of a block's header. the block's memory follows it, aligned. */
+#define ARENA_HEADER_BYTES   \
+	( ( sizeof( struct arena_block ) + ARENA_ALIGNMENT - 1 ) & ~(size_t)( ARENA_ALIGNMENT - 1 ) )
+
+
+
+static void *take_arena_bytes( 
+	struct arena *const store,   // in, out
+	const size_t count,   // in
+	const size_t size,   // in
+	struct arena_block **const block   // out
+);
+
+
+
+/* create_arena_store()
+Create an arena store or die.
+*/
+void create_arena_store( 
+	struct arena **const out   // out deref
+)
+{
+	struct arena *store = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate an arena store */
+	store = must_calloc( 1, sizeof( *store ) );
+	
+	
+	*out = store;
+	return;
+}
+
+
+
+/* init_arena_store()
+Initialize an arena store.
+
+'block_bytes' is the minimum number of bytes of memory in each of the arena's blocks. An allocation 
+larger than that gets a block of its own. No memory is allocated until the first allocation.
+*/
+void init_arena_store( 
+	struct arena *const store,   // in, out
+	const size_t block_bytes   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	FAIL_IF( !block_bytes );
+	
+	
+	store->block_bytes = block_bytes;
+	
+	/* this store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return;
+}
+
+
+
+/* take_arena_bytes()
+Take bytes from an arena store's blocks, allocating a new block if necessary, or die.
+
+The bytes are taken from the current block. If it doesn't have enough room left then the blocks 
+after it, which haven't been used since the arena was last reset, are tried in order. If none of 
+them has enough room then a new block is allocated and added to the end of the list. The room left 
+in the blocks that are passed over is not used until the arena is reset.
+
+'*block' receives the block the bytes were taken from.
+
+returns a pointer to the bytes, which are aligned to ARENA_ALIGNMENT
+*/
+static void *take_arena_bytes( 
+	struct arena *const store,   // in, out
+	const size_t count,   // in
+	const size_t size,   // in
+	struct arena_block **const block   // out
+)
+{
+	size_t bytes = 0;
+	struct arena_block *current = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The arena store must be initialized.
+	FAIL_IF( !block );
+	
+	FAIL_IF( size && ( count > ( (size_t)-1 - ARENA_ALIGNMENT ) / size ) );   // overflow
+	
+	
+	/* round up to the alignment. a zero byte allocation still gets a unique pointer. */
+	bytes = count * size;
+	bytes = ( bytes ? bytes : 1 );
+	bytes = ( bytes + ARENA_ALIGNMENT - 1 ) & ~(size_t)( ARENA_ALIGNMENT - 1 );
+	
+	for( current = store->current; current; current = current->next )
+	{
+		/* the blocks after the current block haven't been used since the arena was last reset */
+		if( current != store->current )
+			current->used_bytes = 0;
+		
+		if( ( current->max_bytes - current->used_bytes ) >= bytes )
+			break;
+	}
+	
+	if( !current ) // allocate a new block
+	{
+		size_t max_bytes = ( ( bytes > store->block_bytes ) ? bytes : store->block_bytes );
+		
+		
+		FAIL_IF( max_bytes > ( (size_t)-1 - ARENA_HEADER_BYTES ) );   // overflow
+		
+		/* calloc so that the block's memory starts out zeroed */
+		current = must_calloc( 1, ARENA_HEADER_BYTES + max_bytes );
+		current->max_bytes = max_bytes;
+		
+		if( store->tail )
+			store->tail->next = current;
+		else
+			store->head = current;
+		
+		store->tail = current;
+		
+		++store->block_count;
+		store->reserved_bytes += max_bytes;
+	}
+	
+	store->current = current;
+	
+	*block = current;
+	current->used_bytes += bytes;
+	
+	++store->alloc_count;
+	++store->alloc_total;
+	store->used_bytes += bytes;
+	
+	if( store->peak_bytes < store->used_bytes )
+		store->peak_bytes = store->used_bytes;
+	
+	return (char *)current + ARENA_HEADER_BYTES + ( current->used_bytes - bytes );
+}
+
+
+
+/* arena_alloc()
+Allocate uninitialized memory for an array from an arena store or die.
+
+The memory may have been used by a previous allocation before the arena was reset. Use this instead 
+of arena_calloc() only if every element is written before it's read.
+
+The memory is owned by the arena and must not be freed.
+
+returns a pointer to the memory
+*/
+void *arena_alloc( 
+	struct arena *const store,   // in, out
+	const size_t count,   // in
+	const size_t size   // in
+)
+{
+	struct arena_block *block = NULL;
+	void *p = NULL;
+	size_t end = 0;
+	
+	
+	p = take_arena_bytes( store, count, size, &block );
+	
+	end = block->used_bytes;
+	
+	if( block->dirty_bytes < end )
+		block->dirty_bytes = end;
+	
+	return p;
+}
+
+
+
+/* arena_calloc()
+Allocate zeroed memory for an array from an arena store or die.
+
+Only the part of the memory that has been allocated before is zeroed. The rest is still zeroed from 
+when its block was allocated, so a large allocation from a new block doesn't touch its pages.
+
+The memory is owned by the arena and must not be freed.
+
+returns a pointer to the memory
+*/
+void *arena_calloc( 
+	struct arena *const store,   // in, out
+	const size_t count,   // in
+	const size_t size   // in
+)
+{
+	struct arena_block *block = NULL;
+	char *p = NULL;
+	size_t begin = 0, end = 0;
+	
+	
+	p = take_arena_bytes( store, count, size, &block );
+	
+	end = block->used_bytes;
+	begin = (size_t)( p - ( (char *)block + ARENA_HEADER_BYTES ) );
+	
+	if( block->dirty_bytes > begin )
+		ZeroMemory( p, ( ( block->dirty_bytes < end ) ? block->dirty_bytes : end ) - begin );
+	
+	if( block->dirty_bytes < end )
+		block->dirty_bytes = end;
+	
+	return p;
+}
+
+
+
+/* reset_arena_store()
+Reset an arena store so that its memory can be allocated again.
+
+This takes constant time. The blocks are kept and each is marked unused when it's next reached. All 
+memory that was allocated from the arena before the reset must no longer be used.
+*/
+void reset_arena_store( 
+	struct arena *const store   // in, out
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The arena store must be initialized.
+	
+	
+	store->current = store->head;
+	
+	if( store->current )
+		store->current->used_bytes = 0;
+	
+	store->alloc_count = 0;
+	store->used_bytes = 0;
+	++store->reset_count;
+	
+	return;
+}
+
+
+
+/* print_arena_stats()
+Print a one line summary of an arena store's statistics.
+
+'name' is what the arena is for, eg "Snapshot arena".
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_arena_stats( 
+	const struct arena *const store,   // in
+	const char *const name   // in
+)
+{
+	FAIL_IF( !name );
+	
+	
+	if( !store )
+		return;
+	
+	printf( "%s: %u allocations, %Iu bytes used, %Iu bytes peak. "
+		"%Iu bytes in %u blocks. %I64u allocations, %u resets total.\n", 
+		name, 
+		store->alloc_count, 
+		store->used_bytes, 
+		store->peak_bytes, 
+		store->reserved_bytes, 
+		store->block_count, 
+		store->alloc_total, 
+		store->reset_count 
+	);
+	
+	return;
+}
+
+
+
+/* print_arena_store()
+Print an arena store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_arena_store( 
+	const struct arena *const store   // in
+)
+{
+	const char *const objname = "Arena Store";
+	const struct arena_block *block = NULL;
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->block_bytes: %Iu\n", store->block_bytes );
+	printf( "store->block_count: %u\n", store->block_count );
+	printf( "store->reserved_bytes: %Iu\n", store->reserved_bytes );
+	printf( "store->alloc_count: %u\n", store->alloc_count );
+	printf( "store->used_bytes: %Iu\n", store->used_bytes );
+	printf( "store->peak_bytes: %Iu\n", store->peak_bytes );
+	printf( "store->alloc_total: %I64u\n", store->alloc_total );
+	printf( "store->reset_count: %u\n", store->reset_count );
+	
+	for( block = store->head; block; block = block->next )
+	{
+		printf( "block 0x%p: %Iu bytes, %Iu used, %Iu dirty%s\n", 
+			block, 
+			block->max_bytes, 
+			block->used_bytes, 
+			block->dirty_bytes, 
+			( ( block == store->current ) ? " (current)" : "" ) 
+		);
+	}
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_arena_store()
+Free an arena store and all its memory.
+
+this function then sets the arena store pointer to NULL and returns
+if( !in || !*in ) then this function returns.
+*/
+void free_arena_store( 
+	struct arena **const in   // in deref
+)
+{
+	struct arena_block *current = NULL, *next = NULL;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	for( current = (*in)->head; current; current = next )
+	{
+		next = current->next;
+		free( current );
+	}
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,152 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <windows.h>
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** A block of memory in an arena store.
+The block's memory immediately follows this header.
+*/
+struct arena_block
+{
+	/* the next block in the arena */
+	struct arena_block *next;
+	
+	/* the number of bytes of memory in this block */
+	size_t max_bytes;
+	
+	/* the number of bytes of memory in this block that have been allocated since the arena was 
+	last reset
+	*/
+	size_t used_bytes;
+	
+	/* the number of bytes at the start of this block that have ever been allocated. the memory 
+	past this is still zeroed from when the block was allocated.
+	*/
+	size_t dirty_bytes;
+};
+
+
+
+/** The arena store.
+An arena store owns memory that is allocated from it in order and is all released at once, either 
+by resetting the arena to reuse its memory or by freeing the arena.
+
+Memory is allocated from the arena's blocks. A new block is allocated when no block has enough 
+room left, and the blocks are kept when the arena is reset.
+*/
+struct arena
+{
+	/* a linked list of the arena's blocks, in the order they were allocated */
+	struct arena_block *head;   // calloc(), free()
+	
+	/* the last block in the list */
+	struct arena_block *tail;
+	
+	/* the block that memory is currently allocated from */
+	struct arena_block *current;
+	
+	/* the minimum number of bytes of memory in a block */
+	size_t block_bytes;
+	
+	/* the number of blocks and the total number of bytes of memory in them */
+	unsigned block_count;
+	size_t reserved_bytes;
+	
+	/* the number of allocations and the number of bytes allocated since the arena was last reset */
+	unsigned alloc_count;
+	size_t used_bytes;
+	
+	/* the most bytes that have been allocated between resets */
+	size_t peak_bytes;
+	
+	/* the total number of allocations and the number of times the arena was reset */
+	unsigned __int64 alloc_total;
+	unsigned reset_count;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/* the alignment of each allocation from an arena. this is the same as the heap's alignment. */
+#define ARENA_ALIGNMENT   MEMORY_ALLOCATION_ALIGNMENT
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in arena.c
+*/
+void create_arena_store( 
+	struct arena **const out   // out deref
+);
+
+void init_arena_store( 
+	struct arena *const store,   // in, out
+	const size_t block_bytes   // in
+);
+
+void *arena_alloc( 
+	struct arena *const store,   // in, out
+	const size_t count,   // in
+	const size_t size   // in
+);
+
+void *arena_calloc( 
+	struct arena *const store,   // in, out
+	const size_t count,   // in
+	const size_t size   // in
+);
+
+void reset_arena_store( 
+	struct arena *const store   // in, out
+);
+
+void print_arena_stats( 
+	const struct arena *const store,   // in
+	const char *const name   // in
+);
+
+void print_arena_store( 
+	const struct arena *const store   // in
+);
+
+void free_arena_store( 
+	struct arena **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ARENA_H
@@ -0,0 +1,942 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a cache store, information about the system that persists across 
+snapshots.
+Each function is documented in the comment block above its definition.
+
+For now there is only one cache store and it's a global store (G->cache).
+The cache store is described in cache.h.
+
+-
+create_cache_store()
+
+Create a cache store and its descendants or die.
+-
+
+-
+init_cache_store()
+
+Initialize a cache store's thread cache and process cache.
+-
+
+-
+init_global_cache_store()
+
+Initialize the global cache store according to the user's configuration.
+-
+
+-
+hash_thread()
+
+Hash a thread's identity to its home slot in a cache store's thread cache.
+-
+
+-
+begin_cache_generation()
+
+Begin a new generation in a cache store. This is called at the start of each snapshot.
+-
+
+-
+rewind_cache_stats()
+
+Take back the statistics counted so far in a cache store's current generation.
+-
+
+-
+find_thread_cache_entry()
+
+Search a cache store's thread cache for a thread.
+-
+
+-
+add_thread_cache_entry()
+
+Add a thread to a cache store's thread cache, or update it if it's already there.
+-
+
+-
+evict_exited_threads()
+
+Evict the threads that weren't seen in the current generation from a cache store's thread cache.
+-
+
+-
+hash_process()
+
+Hash a process' identity to its home slot in a cache store's process cache.
+-
+
+-
+find_process_cache_entry()
+
+Search a cache store's process cache for a process.
+-
+
+-
+open_cached_process()
+
+Get a handle to a process from a cache store's process cache, or open the process and cache it.
+-
+
+-
+skip_process()
+
+Check whether a process' threads can be skipped without reading them, and mark the process as seen.
+-
+
+-
+evict_exited_processes()
+
+Evict the processes that weren't seen in the current generation from a cache store's process cache 
+and close their handles.
+-
+
+-
+print_cache_stats()
+
+Print a summary of a cache store's statistics.
+-
+
+-
+print_cache_store()
+
+Print a cache store.
+-
+
+-
+print_global_cache_store()
+
+Print the global cache store.
+-
+
+-
+free_cache_store()
+
+Free a cache store.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "cache.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+static unsigned hash_thread( 
+	const struct cache *const store,   // in
+	const unsigned __int64 pid,   // in
+	const unsigned __int64 tid,   // in
+	const __int64 CreateTime   // in
+);
+
+static unsigned hash_process( 
+	const struct cache *const store,   // in
+	const unsigned __int64 pid,   // in
+	const __int64 CreateTime   // in
+);
+
+
+
+/* create_cache_store()
+Create a cache store and its descendants or die.
+*/
+void create_cache_store( 
+	struct cache **const out   // out deref
+)
+{
+	struct cache *store = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a cache store */
+	store = must_calloc( 1, sizeof( *store ) );
+	
+	
+	*out = store;
+	return;
+}
+
+
+
+/* init_cache_store()
+Initialize a cache store's thread cache and process cache.
+
+'max_threads' is the maximum number of threads that can be held in a snapshot.
+
+The thread cache has the smallest power of 2 number of slots that is at least twice the maximum 
+number of threads. It's never filled past three quarters, and a thread that can't be added is just 
+not cached.
+
+The process cache has the smallest power of 2 number of slots that is at least twice 
+CACHE_PROCESS_MAX. It holds at most CACHE_PROCESS_MAX processes.
+*/
+void init_cache_store( 
+	struct cache *const store,   // in, out
+	const unsigned max_threads   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	FAIL_IF( !max_threads );
+	
+	
+	for( store->thread_bits = 1; store->thread_bits < 31; ++store->thread_bits )
+	{
+		if( ( ( 1u << store->thread_bits ) / 2 ) >= max_threads )
+			break;
+	}
+	
+	store->thread_max = 1u << store->thread_bits;
+	
+	store->thread = must_calloc( store->thread_max, sizeof( *store->thread ) );
+	store->thread_spare = must_calloc( store->thread_max, sizeof( *store->thread_spare ) );
+	
+	for( store->process_bits = 1; store->process_bits < 31; ++store->process_bits )
+	{
+		if( ( ( 1u << store->process_bits ) / 2 ) >= CACHE_PROCESS_MAX )
+			break;
+	}
+	
+	store->process_max = 1u << store->process_bits;
+	
+	store->process = must_calloc( store->process_max, sizeof( *store->process ) );
+	store->process_spare = must_calloc( store->process_max, sizeof( *store->process_spare ) );
+	
+	/* if the session id can't be found then processes aren't skipped by session */
+	store->is_session_known = 
+		ProcessIdToSessionId( GetCurrentProcessId(), &store->session_id );
+	
+	/* this store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return;
+}
+
+
+
+/* init_global_cache_store()
+Initialize the global cache store according to the user's configuration.
+
+The thread cache is sized by the maximum number of threads, the 't' option.
+
+This function must only be called from the main thread.
+'G->cache' depends on the global program (G->prog) and configuration (G->config) stores.
+*/
+void init_global_cache_store( void )
+{
+	FAIL_IF( !G );   // The global store must exist.
+	
+	FAIL_IF( G->cache->init_time );   // Fail if this store has already been initialized.
+	
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	init_cache_store( G->cache, G->config->max_threads );
+	
+	return;
+}
+
+
+
+/* hash_thread()
+Hash a thread's identity to its home slot in a cache store's thread cache.
+
+The process id, thread id and creation time are folded and then Fibonacci hashed, which takes the 
+top 'thread_bits' bits of the product. Thread ids are multiples of 4 and the low bits of the 
+creation time vary the most, so all of them are mixed before the multiply.
+
+returns the index of the home slot in the thread cache
+*/
+static unsigned hash_thread( 
+	const struct cache *const store,   // in
+	const unsigned __int64 pid,   // in
+	const unsigned __int64 tid,   // in
+	const __int64 CreateTime   // in
+)
+{
+	DWORD folded = (DWORD)tid 
+		^ ( (DWORD)pid * 2246822519u ) 
+		^ (DWORD)CreateTime 
+		^ (DWORD)( (unsigned __int64)CreateTime >> 32 );
+	
+	
+	return (unsigned)( ( folded * 2654435761u ) >> ( 32 - store->thread_bits ) );
+}
+
+
+
+/* begin_cache_generation()
+Begin a new generation in a cache store. This is called at the start of each snapshot.
+
+Every thread or process that is found in or added to the cache is marked as seen in the new 
+generation.
+*/
+void begin_cache_generation( 
+	struct cache *const store   // in, out
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cache store must be initialized.
+	
+	
+	/* generation zero marks an empty slot so skip it */
+	if( !++store->generation )
+		++store->generation;
+	
+	store->generation_hit_count = 0;
+	store->generation_miss_count = 0;
+	store->generation_open_count = 0;
+	store->generation_reuse_count = 0;
+	store->generation_skip_process_count = 0;
+	store->generation_skip_thread_count = 0;
+	
+	return;
+}
+
+
+
+/* rewind_cache_stats()
+Take back the statistics counted so far in a cache store's current generation.
+
+This is called each time a snapshot's threads are about to be traversed, so that if the traversal is 
+retried (eg the spi buffer was grown) the processes and threads that were already looked up aren't 
+counted again. The current generation's counts are subtracted from the totals and then zeroed. The 
+generation itself isn't changed so the entries that were found are still marked as seen.
+*/
+void rewind_cache_stats( 
+	struct cache *const store   // in, out
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cache store must be initialized.
+	
+	
+	store->thread_hit_count -= store->generation_hit_count;
+	store->thread_miss_count -= store->generation_miss_count;
+	store->process_open_count -= store->generation_open_count;
+	store->process_reuse_count -= store->generation_reuse_count;
+	store->skip_process_count -= store->generation_skip_process_count;
+	store->skip_thread_count -= store->generation_skip_thread_count;
+	
+	store->generation_hit_count = 0;
+	store->generation_miss_count = 0;
+	store->generation_open_count = 0;
+	store->generation_reuse_count = 0;
+	store->generation_skip_process_count = 0;
+	store->generation_skip_thread_count = 0;
+	
+	return;
+}
+
+
+
+/* find_thread_cache_entry()
+Search a cache store's thread cache for a thread.
+
+If the thread is found it's marked as seen in the current generation. A thread that isn't a GUI 
+thread is only found for CACHE_NEGATIVE_TTL generations after it was added, after which it must be 
+read and added again.
+
+returns the thread's entry if found, else NULL
+*/
+const struct thread_cache_entry *find_thread_cache_entry( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const unsigned __int64 tid,   // in
+	const __int64 CreateTime   // in
+)
+{
+	unsigned i = 0;
+	const unsigned mask = store->thread_max - 1;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cache store must be initialized.
+	
+	
+	for( i = hash_thread( store, pid, tid, CreateTime ); ; i = ( i + 1 ) & mask )
+	{
+		struct thread_cache_entry *const entry = &store->thread[ i ];
+		
+		
+		if( !entry->generation ) // empty slot
+			break;
+		
+		if( ( entry->tid == tid ) && ( entry->pid == pid ) && ( entry->CreateTime == CreateTime ) )
+		{
+			entry->generation = store->generation;
+			
+			if( !entry->pvWin32ThreadInfo && ( store->generation >= entry->expires ) )
+				break;
+			
+			++store->thread_hit_count;
+			++store->generation_hit_count;
+			return entry;
+		}
+	}
+	
+	++store->thread_miss_count;
+	++store->generation_miss_count;
+	return NULL;
+}
+
+
+
+/* add_thread_cache_entry()
+Add a thread to a cache store's thread cache, or update it if it's already there.
+
+The thread is marked as seen in the current generation.
+
+returns nonzero on success.
+returns zero if the thread cache is too full to add the thread.
+*/
+int add_thread_cache_entry( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const unsigned __int64 tid,   // in
+	const __int64 CreateTime,   // in
+	const void *const pvTeb,   // in, optional
+	const void *const pvWin32ThreadInfo   // in, optional
+)
+{
+	unsigned i = 0;
+	struct thread_cache_entry *entry = NULL;
+	const unsigned mask = store->thread_max - 1;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cache store must be initialized.
+	
+	
+	for( i = hash_thread( store, pid, tid, CreateTime ); ; i = ( i + 1 ) & mask )
+	{
+		entry = &store->thread[ i ];
+		
+		if( !entry->generation ) // empty slot
+		{
+			/* keep the load factor at most 75% so searches stay short */
+			if( store->thread_count >= ( store->thread_max - ( store->thread_max / 4 ) ) )
+				return FALSE;
+			
+			entry->pid = pid;
+			entry->tid = tid;
+			entry->CreateTime = CreateTime;
+			++store->thread_count;
+			break;
+		}
+		
+		if( ( entry->tid == tid ) && ( entry->pid == pid ) && ( entry->CreateTime == CreateTime ) )
+			break;
+	}
+	
+	entry->pvTeb = pvTeb;
+	entry->pvWin32ThreadInfo = pvWin32ThreadInfo;
+	entry->generation = store->generation;
+	entry->expires = store->generation + CACHE_NEGATIVE_TTL;
+	
+	return TRUE;
+}
+
+
+
+/* evict_exited_threads()
+Evict the threads that weren't seen in the current generation from a cache store's thread cache.
+
+This must only be called after a snapshot has been taken successfully, otherwise threads that 
+haven't exited may be evicted. The threads that were seen are copied to the spare table, which then 
+becomes the thread cache.
+
+returns the number of threads evicted
+*/
+unsigned evict_exited_threads( 
+	struct cache *const store   // in, out
+)
+{
+	unsigned i = 0, count = 0, evicted = 0;
+	const unsigned mask = store->thread_max - 1;
+	struct thread_cache_entry *temp = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cache store must be initialized.
+	
+	
+	ZeroMemory( store->thread_spare, store->thread_max * sizeof( *store->thread_spare ) );
+	
+	for( i = 0; i < store->thread_max; ++i )
+	{
+		const struct thread_cache_entry *const entry = &store->thread[ i ];
+		unsigned j = 0;
+		
+		
+		if( !entry->generation ) // empty slot
+			continue;
+		
+		if( entry->generation != store->generation ) // the thread has exited
+		{
+			++evicted;
+			continue;
+		}
+		
+		for( j = hash_thread( store, entry->pid, entry->tid, entry->CreateTime ); 
+			store->thread_spare[ j ].generation; 
+			j = ( j + 1 ) & mask 
+		)
+			;
+		
+		store->thread_spare[ j ] = *entry;
+		++count;
+	}
+	
+	temp = store->thread;
+	store->thread = store->thread_spare;
+	store->thread_spare = temp;
+	
+	store->thread_count = count;
+	store->thread_evict_count += evicted;
+	
+	return evicted;
+}
+
+
+
+/* hash_process()
+Hash a process' identity to its home slot in a cache store's process cache.
+
+This is the same as hash_thread() without the thread id, and takes the top 'process_bits' bits of 
+the product.
+
+returns the index of the home slot in the process cache
+*/
+static unsigned hash_process( 
+	const struct cache *const store,   // in
+	const unsigned __int64 pid,   // in
+	const __int64 CreateTime   // in
+)
+{
+	DWORD folded = ( (DWORD)pid * 2246822519u ) 
+		^ (DWORD)CreateTime 
+		^ (DWORD)( (unsigned __int64)CreateTime >> 32 );
+	
+	
+	return (unsigned)( ( folded * 2654435761u ) >> ( 32 - store->process_bits ) );
+}
+
+
+
+/* find_process_cache_entry()
+Search a cache store's process cache for a process.
+
+If the process is found it's marked as seen in the current generation. Every process in a snapshot 
+must be searched for, even if none of its threads need to be read, otherwise its handle is closed 
+by evict_exited_processes() as if it had exited.
+
+returns the process' entry if found, else NULL
+*/
+const struct process_cache_entry *find_process_cache_entry( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const __int64 CreateTime   // in
+)
+{
+	unsigned i = 0;
+	const unsigned mask = store->process_max - 1;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cache store must be initialized.
+	
+	
+	for( i = hash_process( store, pid, CreateTime ); ; i = ( i + 1 ) & mask )
+	{
+		struct process_cache_entry *const entry = &store->process[ i ];
+		
+		
+		if( !entry->generation ) // empty slot
+			break;
+		
+		if( ( entry->pid == pid ) && ( entry->CreateTime == CreateTime ) )
+		{
+			entry->generation = store->generation;
+			return entry;
+		}
+	}
+	
+	return NULL;
+}
+
+
+
+/* open_cached_process()
+Get a handle to a process from a cache store's process cache, or open the process and cache it.
+
+The process is opened with PROCESS_VM_READ access. If it can't be opened that is cached as well, 
+for CACHE_NEGATIVE_TTL generations, so that a process that can't be opened (eg a protected process) 
+isn't tried again every snapshot. The process is marked as seen in the current generation.
+
+'*is_cached' receives nonzero if the returned handle is owned by the process cache, in which case 
+the caller must not close it. The handle stays open until the process exits or the cache store is 
+freed. If the process cache is full then '*is_cached' receives zero and the caller must close the 
+returned handle.
+
+returns a handle to the process, or NULL if the process couldn't be opened
+*/
+HANDLE open_cached_process( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const __int64 CreateTime,   // in
+	BOOL *const is_cached   // out
+)
+{
+	unsigned i = 0;
+	struct process_cache_entry *entry = NULL;
+	HANDLE process = NULL;
+	const unsigned mask = store->process_max - 1;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cache store must be initialized.
+	FAIL_IF( !is_cached );
+	
+	
+	*is_cached = FALSE;
+	
+	for( i = hash_process( store, pid, CreateTime ); ; i = ( i + 1 ) & mask )
+	{
+		entry = &store->process[ i ];
+		
+		if( !entry->generation ) // empty slot
+			break;
+		
+		if( ( entry->pid == pid ) && ( entry->CreateTime == CreateTime ) )
+			break;
+	}
+	
+	if( entry->generation ) // the process is in the process cache
+	{
+		entry->generation = store->generation;
+		
+		if( entry->process || ( store->generation < entry->expires ) )
+		{
+			++store->process_reuse_count;
+			++store->generation_reuse_count;
+			
+			*is_cached = TRUE;
+			return entry->process;
+		}
+	}
+	
+	
+	SetLastError( 0 ); // error code is evaluated on success
+	process = OpenProcess( PROCESS_VM_READ, FALSE, (DWORD)pid );
+	
+	++store->process_open_count;
+	++store->generation_open_count;
+	
+	if( !entry->generation ) // empty slot
+	{
+		/* if the process cache is full then the caller owns the handle */
+		if( store->process_count >= CACHE_PROCESS_MAX )
+			return process;
+		
+		entry->pid = pid;
+		entry->CreateTime = CreateTime;
+		++store->process_count;
+	}
+	
+	entry->process = process;
+	entry->generation = store->generation;
+	entry->expires = store->generation + CACHE_NEGATIVE_TTL;
+	
+	if( process )
+		++store->process_handle_count;
+	
+	*is_cached = TRUE;
+	return process;
+}
+
+
+
+/* skip_process()
+Check whether a process' threads can be skipped without reading them, and mark the process as seen.
+
+This is called once for each process in a snapshot before any of its threads are looked up, instead 
+of find_process_cache_entry(). A process is skipped if it's in a session other than this program's. 
+Its threads can't be on any desktop in this program's window station, so none of them can be the 
+owner, origin or target of a HOOK in the snapshot.
+
+A process isn't skipped because its threads weren't GUI threads in earlier snapshots. A thread 
+becomes a GUI thread on its first GUI call, which may be the SetWindowsHookEx() that sets a hook, 
+without the process' thread count changing.
+
+A process in another session isn't marked as seen, so if it was in the process cache its handle is 
+closed by evict_exited_processes().
+
+'session_id' and 'thread_count' are from the process' SYSTEM_PROCESS_INFORMATION.
+
+returns nonzero if the process' threads should be skipped
+*/
+int skip_process( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const __int64 CreateTime,   // in
+	const unsigned session_id,   // in
+	const unsigned thread_count   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cache store must be initialized.
+	
+	
+	if( !store->is_session_known || ( session_id == store->session_id ) )
+	{
+		find_process_cache_entry( store, pid, CreateTime );
+		return FALSE;
+	}
+	
+	++store->skip_process_count;
+	++store->generation_skip_process_count;
+	store->skip_thread_count += thread_count;
+	store->generation_skip_thread_count += thread_count;
+	
+	return TRUE;
+}
+
+
+
+/* evict_exited_processes()
+Evict the processes that weren't seen in the current generation from a cache store's process cache 
+and close their handles.
+
+This must only be called after a snapshot has been taken successfully, otherwise processes that 
+haven't exited may be evicted. The processes that were seen are copied to the spare table, which 
+then becomes the process cache.
+
+returns the number of processes evicted
+*/
+unsigned evict_exited_processes( 
+	struct cache *const store   // in, out
+)
+{
+	unsigned i = 0, count = 0, evicted = 0;
+	const unsigned mask = store->process_max - 1;
+	struct process_cache_entry *temp = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cache store must be initialized.
+	
+	
+	ZeroMemory( store->process_spare, store->process_max * sizeof( *store->process_spare ) );
+	
+	for( i = 0; i < store->process_max; ++i )
+	{
+		const struct process_cache_entry *const entry = &store->process[ i ];
+		unsigned j = 0;
+		
+		
+		if( !entry->generation ) // empty slot
+			continue;
+		
+		if( entry->generation != store->generation ) // the process has exited
+		{
+			if( entry->process )
+			{
+				CloseHandle( entry->process );
+				
+				--store->process_handle_count;
+				++store->process_close_count;
+			}
+			
+			++evicted;
+			continue;
+		}
+		
+		for( j = hash_process( store, entry->pid, entry->CreateTime ); 
+			store->process_spare[ j ].generation; 
+			j = ( j + 1 ) & mask 
+		)
+			;
+		
+		store->process_spare[ j ] = *entry;
+		++count;
+	}
+	
+	temp = store->process;
+	store->process = store->process_spare;
+	store->process_spare = temp;
+	
+	store->process_count = count;
+	
+	return evicted;
+}
+
+
+
+/* print_cache_stats()
+Print a summary of a cache store's statistics, one line for each cache.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_cache_stats( 
+	const struct cache *const store   // in
+)
+{
+	if( !store )
+		return;
+	
+	printf( "Thread cache: %u hits, %u misses this snapshot. %u cached. "
+		"%I64u hits, %I64u misses, %I64u evicted total.\n", 
+		store->generation_hit_count, 
+		store->generation_miss_count, 
+		store->thread_count, 
+		store->thread_hit_count, 
+		store->thread_miss_count, 
+		store->thread_evict_count 
+	);
+	
+	printf( "Process cache: %u opened, %u reused this snapshot. %u handles open. "
+		"%I64u opened, %I64u reused, %I64u closed total.\n", 
+		store->generation_open_count, 
+		store->generation_reuse_count, 
+		store->process_handle_count, 
+		store->process_open_count, 
+		store->process_reuse_count, 
+		store->process_close_count 
+	);
+	
+	printf( "Session filter: %u processes (%u threads) in another session skipped this snapshot. "
+		"%I64u processes (%I64u threads) skipped total.\n", 
+		store->generation_skip_process_count, 
+		store->generation_skip_thread_count, 
+		store->skip_process_count, 
+		store->skip_thread_count 
+	);
+	
+	return;
+}
+
+
+
+/* print_cache_store()
+Print a cache store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_cache_store( 
+	const struct cache *const store   // in
+)
+{
+	const char *const objname = "Cache Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->thread_max: %u\n", store->thread_max );
+	printf( "store->thread_bits: %u\n", store->thread_bits );
+	printf( "store->thread_count: %u\n", store->thread_count );
+	printf( "store->process_max: %u\n", store->process_max );
+	printf( "store->process_bits: %u\n", store->process_bits );
+	printf( "store->process_count: %u\n", store->process_count );
+	printf( "store->process_handle_count: %u\n", store->process_handle_count );
+	printf( "store->generation: %u\n", store->generation );
+	printf( "store->thread_hit_count: %I64u\n", store->thread_hit_count );
+	printf( "store->thread_miss_count: %I64u\n", store->thread_miss_count );
+	printf( "store->thread_evict_count: %I64u\n", store->thread_evict_count );
+	printf( "store->generation_hit_count: %u\n", store->generation_hit_count );
+	printf( "store->generation_miss_count: %u\n", store->generation_miss_count );
+	printf( "store->process_open_count: %I64u\n", store->process_open_count );
+	printf( "store->process_reuse_count: %I64u\n", store->process_reuse_count );
+	printf( "store->process_close_count: %I64u\n", store->process_close_count );
+	printf( "store->generation_open_count: %u\n", store->generation_open_count );
+	printf( "store->generation_reuse_count: %u\n", store->generation_reuse_count );
+	printf( "store->session_id: %u\n", (unsigned)store->session_id );
+	printf( "store->is_session_known: %s\n", ( store->is_session_known ? "TRUE" : "FALSE" ) );
+	printf( "store->skip_process_count: %I64u\n", store->skip_process_count );
+	printf( "store->skip_thread_count: %I64u\n", store->skip_thread_count );
+	printf( "store->generation_skip_process_count: %u\n", store->generation_skip_process_count );
+	printf( "store->generation_skip_thread_count: %u\n", store->generation_skip_thread_count );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* print_global_cache_store()
+Print the global cache store.
+*/
+void print_global_cache_store( void )
+{
+	print_cache_store( G->cache );
+	return;
+}
+
+
+
+/* free_cache_store()
+Free a cache store.
+
+The process handles held open by the process cache are closed.
+
+this function then sets the cache store pointer to NULL and returns
+if( !in || !*in ) then this function returns.
+*/
+void free_cache_store( 
+	struct cache **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->process )
+	{
+		for( i = 0; i < (*in)->process_max; ++i )
+		{
+			if( (*in)->process[ i ].generation && (*in)->process[ i ].process )
+				CloseHandle( (*in)->process[ i ].process );
+		}
+	}
+	
+	free( (*in)->process_spare );
+	free( (*in)->process );
+	free( (*in)->thread_spare );
+	free( (*in)->thread );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
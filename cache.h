@@ -0,0 +1,291 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <windows.h>
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** A thread cache entry.
+The TEB and Win32ThreadInfo addresses of a thread are stable for the life of the thread, so once 
+they're read they're kept here and reused by every snapshot after.
+
+A thread is identified by its process id, its thread id and its creation time. Ids are reused by the 
+system, but not by two threads created at the same time.
+*/
+struct thread_cache_entry
+{
+	/* the thread's process id */
+	unsigned __int64 pid;
+	
+	/* the thread's id */
+	unsigned __int64 tid;
+	
+	/* the thread's creation time from SYSTEM_THREAD_INFORMATION */
+	__int64 CreateTime;
+	
+	/* the address of the thread's TEB. NULL if the thread doesn't have one. */
+	const void *pvTeb;
+	
+	/* the address of the thread's Win32ThreadInfo. NULL if the thread isn't a GUI thread. */
+	const void *pvWin32ThreadInfo;
+	
+	/* the cache generation (snapshot) the thread was last seen in.
+	this is zero if the entry is empty.
+	*/
+	unsigned generation;
+	
+	/* if pvWin32ThreadInfo is NULL then it must be read again at this generation or later.
+	a thread isn't a GUI thread until it makes its first GUI call, which may be after it was cached.
+	*/
+	unsigned expires;
+};
+
+
+
+/** A process cache entry.
+A handle to a process with PROCESS_VM_READ access is kept open across snapshots so that the process 
+doesn't have to be opened again each time one of its threads is read.
+
+A process is identified by its process id and its creation time. While the handle is open the 
+process id can't be reused, but the creation time is compared anyway since a process that couldn't 
+be opened has no handle.
+*/
+struct process_cache_entry
+{
+	/* the process id */
+	unsigned __int64 pid;
+	
+	/* the process' creation time from SYSTEM_PROCESS_INFORMATION */
+	__int64 CreateTime;
+	
+	/* a handle to the process with PROCESS_VM_READ access. NULL if the process couldn't be opened. */
+	HANDLE process;   // OpenProcess(), CloseHandle()
+	
+	/* the cache generation (snapshot) the process was last seen in.
+	this is zero if the entry is empty.
+	*/
+	unsigned generation;
+	
+	/* if process is NULL then the process must be opened again at this generation or later */
+	unsigned expires;
+};
+
+
+
+/** The cache store.
+The cache store holds information about the system that persists across snapshots.
+
+Each snapshot is a new generation. A thread that isn't seen in a generation has exited and its entry 
+is evicted after the snapshot has been taken. Likewise a process that isn't seen in a generation has 
+exited and its handle is closed.
+*/
+struct cache
+{
+	/* the thread cache. an open addressing hash table of thread cache entries. */
+	struct thread_cache_entry *thread;   // calloc(), free()
+	
+	/* a second table the same size as the thread cache. exited threads are evicted by copying 
+	those that haven't exited to this table and then swapping the tables.
+	*/
+	struct thread_cache_entry *thread_spare;   // calloc(), free()
+	
+	/* the number of slots in the thread cache. this is a power of 2. */
+	unsigned thread_max;
+	
+	/* log2 of thread_max */
+	unsigned thread_bits;
+	
+	/* the number of slots in use in the thread cache */
+	unsigned thread_count;
+	
+	/* the process cache. an open addressing hash table of process cache entries. */
+	struct process_cache_entry *process;   // calloc(), free()
+	
+	/* a second table the same size as the process cache, used the same way as thread_spare */
+	struct process_cache_entry *process_spare;   // calloc(), free()
+	
+	/* the number of slots in the process cache. this is a power of 2. */
+	unsigned process_max;
+	
+	/* log2 of process_max */
+	unsigned process_bits;
+	
+	/* the number of slots in use in the process cache. this is at most CACHE_PROCESS_MAX. */
+	unsigned process_count;
+	
+	/* the number of process handles held open by the process cache */
+	unsigned process_handle_count;
+	
+	/* the current generation. this is incremented at the start of each snapshot. */
+	unsigned generation;
+	
+	/* the number of times a thread was found, not found, or evicted from the thread cache */
+	unsigned __int64 thread_hit_count;
+	unsigned __int64 thread_miss_count;
+	unsigned __int64 thread_evict_count;
+	
+	/* the number of times a thread was found or not found in the current generation */
+	unsigned generation_hit_count;
+	unsigned generation_miss_count;
+	
+	/* the number of times a process was opened, a process cache entry was used instead of opening 
+	the process, or a cached process handle was closed because the process exited
+	*/
+	unsigned __int64 process_open_count;
+	unsigned __int64 process_reuse_count;
+	unsigned __int64 process_close_count;
+	
+	/* the number of times a process was opened or a process cache entry was used instead of opening 
+	the process in the current generation
+	*/
+	unsigned generation_open_count;
+	unsigned generation_reuse_count;
+	
+	/* the session id of this program, and nonzero if it's known. a process in another session can't 
+	have a thread on a desktop in this program's window station, so skip_process() skips it.
+	*/
+	DWORD session_id;
+	BOOL is_session_known;
+	
+	/* the number of processes and their threads that skip_process() skipped */
+	unsigned __int64 skip_process_count;
+	unsigned __int64 skip_thread_count;
+	
+	/* the number of processes and their threads that skip_process() skipped in the current 
+	generation
+	*/
+	unsigned generation_skip_process_count;
+	unsigned generation_skip_thread_count;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/* the number of generations (snapshots) a thread that isn't a GUI thread is cached for before its 
+Win32ThreadInfo is read again.
+*/
+#define CACHE_NEGATIVE_TTL   4
+
+/* the maximum number of processes in the process cache, which is also the maximum number of process 
+handles it holds open. a process that can't be cached is opened and closed each time it's needed.
+*/
+#define CACHE_PROCESS_MAX   1024
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in cache.c
+*/
+void create_cache_store( 
+	struct cache **const out   // out deref
+);
+
+void init_cache_store( 
+	struct cache *const store,   // in, out
+	const unsigned max_threads   // in
+);
+
+void init_global_cache_store( void );
+
+void begin_cache_generation( 
+	struct cache *const store   // in, out
+);
+
+void rewind_cache_stats( 
+	struct cache *const store   // in, out
+);
+
+const struct thread_cache_entry *find_thread_cache_entry( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const unsigned __int64 tid,   // in
+	const __int64 CreateTime   // in
+);
+
+int add_thread_cache_entry( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const unsigned __int64 tid,   // in
+	const __int64 CreateTime,   // in
+	const void *const pvTeb,   // in, optional
+	const void *const pvWin32ThreadInfo   // in, optional
+);
+
+unsigned evict_exited_threads( 
+	struct cache *const store   // in, out
+);
+
+const struct process_cache_entry *find_process_cache_entry( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const __int64 CreateTime   // in
+);
+
+HANDLE open_cached_process( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const __int64 CreateTime,   // in
+	BOOL *const is_cached   // out
+);
+
+int skip_process( 
+	struct cache *const store,   // in, out
+	const unsigned __int64 pid,   // in
+	const __int64 CreateTime,   // in
+	const unsigned session_id,   // in
+	const unsigned thread_count   // in
+);
+
+unsigned evict_exited_processes( 
+	struct cache *const store   // in, out
+);
+
+void print_cache_stats( 
+	const struct cache *const store   // in
+);
+
+void print_cache_store( 
+	const struct cache *const store   // in
+);
+
+void print_global_cache_store( void );
+
+void free_cache_store( 
+	struct cache **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CACHE_H
@@ -0,0 +1,537 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a capture store, a thread that captures the system process info.
+Each function is documented in the comment block above its definition.
+
+For now there is only one capture store and it's a global store (G->capture). It's only initialized 
+if the user specified pipelined capture and monitor mode.
+The capture store is described in capture.h.
+
+-
+create_capture_store()
+
+Create a capture store and its descendants or die.
+-
+
+-
+init_capture_store()
+
+Initialize a capture store by creating its capture thread.
+-
+
+-
+init_global_capture_store()
+
+Initialize the global capture store according to the user's configuration.
+-
+
+-
+capture_thread()
+
+The thread function of the capture thread.
+-
+
+-
+start_capture()
+
+Start the capture thread filling its buffer for the next snapshot.
+-
+
+-
+take_capture()
+
+Exchange a spi buffer for the capture thread's filled buffer.
+-
+
+-
+print_capture_stats()
+
+Print the number of captures that were taken, too old or had failed. No newline.
+-
+
+-
+print_capture_store()
+
+Print a capture store.
+-
+
+-
+print_global_capture_store()
+
+Print the global capture store.
+-
+
+-
+free_capture_store()
+
+Stop a capture store's capture thread and free the store.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+/* traverse_threads() */
+#include "nt_independent_sysprocinfo_structs.h"
+#include "traverse_threads.h"
+
+#include "capture.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+static DWORD WINAPI capture_thread( 
+	LPVOID lpParameter   // in
+);
+
+
+
+/* create_capture_store()
+Create a capture store and its descendants or die.
+*/
+void create_capture_store( 
+	struct capture **const out   // out deref
+)
+{
+	struct capture *store = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a capture store */
+	store = must_calloc( 1, sizeof( *store ) );
+	
+	
+	*out = store;
+	return;
+}
+
+
+
+/* init_capture_store()
+Initialize a capture store by creating its capture thread.
+
+The capture thread's buffer isn't allocated until the first call to take_capture().
+
+'flags' are the flags the capture thread passes to traverse_threads().
+'max_age_ms' is the age in milliseconds after which a capture is too old to be used.
+
+If the capture thread can't be created then its events are left for free_capture_store() to close.
+
+returns nonzero on success
+*/
+int init_capture_store( 
+	struct capture *const store,   // in, out
+	const DWORD flags,   // in
+	const unsigned max_age_ms   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	FAIL_IF( flags & TRAVERSE_FLAG_RECYCLE );
+	
+	
+	store->flags = flags;
+	store->max_age = (__int64)max_age_ms * 10000;
+	
+	/* both events are auto-reset and initially nonsignaled */
+	store->start = CreateEvent( NULL, FALSE, FALSE, NULL );
+	store->done = CreateEvent( NULL, FALSE, FALSE, NULL );
+	
+	if( !store->start || !store->done )
+	{
+		MSG_ERROR_GLE( "CreateEvent() failed." );
+		return FALSE;
+	}
+	
+	store->thread = CreateThread( NULL, 0, capture_thread, store, 0, NULL );
+	
+	if( !store->thread )
+	{
+		MSG_ERROR_GLE( "CreateThread() failed." );
+		return FALSE;
+	}
+	
+	/* this store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* init_global_capture_store()
+Initialize the global capture store according to the user's configuration.
+
+The capture store is only initialized if the user specified the 'b' option and monitor mode. It 
+isn't initialized if the user specified to go completely passive since then no process info is 
+queried.
+
+A capture is started CAPTURE_LEAD_MS before the deadline of the poll it's for, and it's too old to 
+be used if it began more than twice that long before it was taken. The hooks are read when the 
+snapshot is taken, so the thread info they're matched to must be about as recent. A capture that 
+took longer than that, or that was started before a poll that overran, isn't used.
+
+This function must only be called from the main thread.
+'G->capture' depends on the global program (G->prog) and configuration (G->config) stores.
+*/
+void init_global_capture_store( void )
+{
+	unsigned interval_ms = 0;
+	DWORD flags = 0;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	
+	FAIL_IF( G->capture->init_time );   // Fail if this store has already been initialized.
+	
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( !( G->config->flags & CFG_PIPELINED_CAPTURE ) 
+		|| ( G->config->flags & CFG_COMPLETELY_PASSIVE ) 
+		|| ( G->config->polling < POLLING_MIN ) 
+	)
+		return;
+	
+	/* these must track with the flags init_snapshot_store() passes to traverse_threads() */
+	flags = ( TRAVERSE_FLAG_EXTENDED | TRAVERSE_FLAG_INDEX );
+	
+	if( !init_capture_store( G->capture, flags, ( CAPTURE_LEAD_MS * 2 ) ) )
+	{
+		MSG_FATAL( "init_capture_store() failed." );
+		exit( 1 );
+	}
+	
+	return;
+}
+
+
+
+/* capture_thread()
+The thread function of the capture thread.
+
+The capture thread waits to be started, calls traverse_threads() to fill its buffer with the system 
+process info and then signals that it's done. It exits when it's started and the quit flag is set.
+
+returns zero
+*/
+static DWORD WINAPI capture_thread( 
+	LPVOID lpParameter   // in
+)
+{
+	struct capture *const store = (struct capture *)lpParameter;
+	LARGE_INTEGER begin, end;
+	
+	
+	for( ;; )
+	{
+		WaitForSingleObject( store->start, INFINITE );
+		
+		if( store->quit )
+			break;
+		
+		GetSystemTimeAsFileTime( (FILETIME *)&store->capture_time );
+		QueryPerformanceCounter( &begin );
+		
+		/* there's no callback. the spi array is written to the buffer, checked and indexed */
+		store->status = 0;
+		store->ret = traverse_threads( 
+			NULL, 
+			NULL, 
+			store->spi, 
+			store->spi_bytes, 
+			store->flags, 
+			&store->status 
+		);
+		
+		QueryPerformanceCounter( &end );
+		store->capture_ticks = end.QuadPart - begin.QuadPart;
+		
+		SetEvent( store->done );
+	}
+	
+	return 0;
+}
+
+
+
+/* start_capture()
+Start the capture thread filling its buffer for the next snapshot.
+
+This is called by the main thread CAPTURE_LEAD_MS before the deadline of the next poll, so that the 
+capture is only about that old when take_capture() takes it. 
+
+If a capture is still pending, because the last poll was skipped, then it's waited for, counted as 
+too old, and the capture thread is started again on the same buffer. Nothing is started before the 
+first call to take_capture().
+
+This function must only be called from the main thread.
+*/
+void start_capture( 
+	struct capture *const store   // in, out
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The capture store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	/* traverse_threads() gets the address of NtQuerySystemInformation() the first time it's 
+	called, so the capture thread isn't started until the main thread has called it once.
+	*/
+	if( !store->primed )
+		return;
+	
+	if( store->pending )
+	{
+		WaitForSingleObject( store->done, INFINITE );
+		++store->stale_count;
+	}
+	
+	store->pending = TRUE;
+	++store->capture_count;
+	SetEvent( store->start );
+	
+	return;
+}
+
+
+
+/* take_capture()
+Exchange a spi buffer for the capture thread's filled buffer.
+
+If a capture is pending then this function waits for it to finish and exchanges the buffer and its 
+size in bytes for the capture thread's buffer and its size. The capture thread is left idle until 
+start_capture() is called before the next poll.
+
+The first call only allocates the capture thread's buffer, the same size as the caller's. The 
+caller calls traverse_threads() on its own buffer after that, so captures can be started.
+
+'spi' and 'spi_bytes' are the caller's buffer and its size. if the buffers were exchanged then they 
+receive the capture thread's buffer and its size.
+
+'capture_time' and 'capture_ticks' are optional. if the capture can be traversed then they receive 
+the system utc time in FILETIME format when the capture began, and the ticks of the performance 
+counter that its query took. Otherwise they receive zero.
+
+This function must only be called from the main thread.
+
+returns nonzero if the buffers were exchanged and the caller's buffer has a capture that can be 
+traversed with TRAVERSE_FLAG_RECYCLE. If the capture failed or is too old then the buffers are still 
+exchanged, but the caller must call traverse_threads() on the buffer without TRAVERSE_FLAG_RECYCLE.
+*/
+int take_capture( 
+	struct capture *const store,   // in, out
+	SYSTEM_PROCESS_INFORMATION **const spi,   // in, out
+	size_t *const spi_bytes,   // in, out
+	__int64 *const capture_time,   // out, optional
+	__int64 *const capture_ticks   // out, optional
+)
+{
+	int captured = FALSE;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The capture store must be initialized.
+	FAIL_IF( !spi || !*spi );
+	FAIL_IF( !spi_bytes || !*spi_bytes );
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( capture_time )
+		*capture_time = 0;
+	
+	if( capture_ticks )
+		*capture_ticks = 0;
+	
+	if( !store->spi )
+	{
+		store->spi = must_calloc( *spi_bytes, 1 );
+		store->spi_bytes = *spi_bytes;
+		store->primed = TRUE;
+		return FALSE;
+	}
+	
+	if( store->pending )
+	{
+		SYSTEM_PROCESS_INFORMATION *const temp_spi = *spi;
+		const size_t temp_bytes = *spi_bytes;
+		__int64 now = 0;
+		
+		
+		WaitForSingleObject( store->done, INFINITE );
+		store->pending = FALSE;
+		
+		GetSystemTimeAsFileTime( (FILETIME *)&now );
+		
+		if( store->ret != TRAVERSE_SUCCESS )
+			++store->failed_count;
+		else if( ( now - store->capture_time ) > store->max_age )
+			++store->stale_count;
+		else
+		{
+			++store->taken_count;
+			captured = TRUE;
+			
+			if( capture_time )
+				*capture_time = store->capture_time;
+			
+			if( capture_ticks )
+				*capture_ticks = store->capture_ticks;
+		}
+		
+		/* exchange the buffers whole. the capture thread's sanity struct records its buffer's 
+		address and size, which must be the same when the buffer is recycled.
+		*/
+		*spi = store->spi;
+		*spi_bytes = store->spi_bytes;
+		
+		store->spi = temp_spi;
+		store->spi_bytes = temp_bytes;
+	}
+	
+	return captured;
+}
+
+
+
+/* print_capture_stats()
+Print the number of captures that were taken, too old or had failed. No newline.
+
+if 'store' is NULL or not initialized this function returns without having printed anything.
+*/
+void print_capture_stats( 
+	const struct capture *const store   // in
+)
+{
+	if( !store || !store->init_time )
+		return;
+	
+	printf( "Capture: %I64u captures, %I64u taken, %I64u too old, %I64u failed.", 
+		store->capture_count, 
+		store->taken_count, 
+		store->stale_count, 
+		store->failed_count 
+	);
+	
+	return;
+}
+
+
+
+/* print_capture_store()
+Print a capture store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_capture_store( 
+	const struct capture *const store   // in
+)
+{
+	const char *const objname = "Capture Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->spi_bytes: %Iu\n", store->spi_bytes );
+	printf( "store->flags: 0x%lX\n", store->flags );
+	printf( "store->ret: %d\n", store->ret );
+	printf( "store->status: 0x%08lX\n", store->status );
+	print_init_time( "store->capture_time", store->capture_time );
+	printf( "store->capture_ticks: %I64d\n", store->capture_ticks );
+	printf( "store->max_age: %I64d\n", store->max_age );
+	printf( "store->pending: %u\n", store->pending );
+	printf( "store->primed: %u\n", store->primed );
+	printf( "store->quit: %ld\n", store->quit );
+	printf( "store->capture_count: %I64u\n", store->capture_count );
+	printf( "store->taken_count: %I64u\n", store->taken_count );
+	printf( "store->stale_count: %I64u\n", store->stale_count );
+	printf( "store->failed_count: %I64u\n", store->failed_count );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* print_global_capture_store()
+Print the global capture store.
+*/
+void print_global_capture_store( void )
+{
+	print_capture_store( G->capture );
+	return;
+}
+
+
+
+/* free_capture_store()
+Stop a capture store's capture thread and free the store.
+
+The capture thread is started with the quit flag set, and then waited on until it exits. If a 
+capture is pending the thread exits after it's done.
+
+this function then sets the capture store pointer to NULL and returns
+if( !in || !*in ) then this function returns.
+*/
+void free_capture_store( 
+	struct capture **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	InterlockedExchange( &(*in)->quit, 1 );
+	
+	if( (*in)->thread )
+	{
+		SetEvent( (*in)->start );
+		WaitForSingleObject( (*in)->thread, INFINITE );
+		CloseHandle( (*in)->thread );
+	}
+	
+	if( (*in)->start )
+		CloseHandle( (*in)->start );
+	
+	if( (*in)->done )
+		CloseHandle( (*in)->done );
+	
+	free( (*in)->spi );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
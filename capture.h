@@ -0,0 +1,168 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <windows.h>
+
+/* SYSTEM_THREAD_INFORMATION,
+SYSTEM_EXTENDED_THREAD_INFORMATION,
+SYSTEM_PROCESS_INFORMATION
+*/
+#include "nt_independent_sysprocinfo_structs.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* how many milliseconds before the deadline of a poll the capture is started. the capture overlaps 
+only this much of the wait, so its thread info is about this old when the snapshot is taken.
+*/
+#define CAPTURE_LEAD_MS   50
+
+
+
+/** The capture store.
+The capture store is a capture thread that queries the system process info (spi) into a buffer of 
+its own while the main thread waits for the deadline of the next poll. 
+
+Shortly before the deadline the main thread starts the capture thread with start_capture(). When 
+the main thread takes the snapshot it exchanges its spi buffer for the capture thread's filled one 
+with take_capture(). The buffers are exchanged as a whole, address and size, so the buffer the main 
+thread gets is the same buffer traverse_threads() was called on by the capture thread. Its sanity 
+struct is valid and it can be traversed again with TRAVERSE_FLAG_RECYCLE instead of waiting for 
+NtQuerySystemInformation().
+*/
+struct capture
+{
+	/* the capture thread */
+	HANDLE thread;   // CreateThread(), CloseHandle()
+	
+	/* signaled by the main thread when the capture thread has a buffer to fill */
+	HANDLE start;   // CreateEvent(), CloseHandle()
+	
+	/* signaled by the capture thread when it has filled the buffer */
+	HANDLE done;   // CreateEvent(), CloseHandle()
+	
+	/* the buffer that the capture thread fills. the capture thread only accesses the buffer 
+	between the start and done events, the rest of the time it belongs to the main thread.
+	*/
+	SYSTEM_PROCESS_INFORMATION *spi;   // calloc(), free()
+	
+	/* the allocated size of the buffer in bytes */
+	size_t spi_bytes;
+	
+	/* the flags the capture thread passes to traverse_threads(). the main thread must pass the 
+	same TRAVERSE_FLAG_EXTENDED flag when it recycles the buffer.
+	*/
+	DWORD flags;
+	
+	/* the return code and the status of the last capture's call to traverse_threads() */
+	int ret;
+	LONG status;
+	
+	/* the system utc time in FILETIME format when the last capture began */
+	__int64 capture_time;
+	
+	/* the ticks of the performance counter that the last capture's call to traverse_threads() took */
+	__int64 capture_ticks;
+	
+	/* the age in 100-nanosecond intervals after which a capture is too old to be used */
+	__int64 max_age;
+	
+	/* nonzero if a capture was started and hasn't been taken */
+	unsigned pending;
+	
+	/* nonzero if the main thread has called traverse_threads() itself, so that a capture can be 
+	started. the first snapshot is taken by the main thread while the capture thread waits.
+	this is set by the first call to take_capture(), which is made just before that call.
+	*/
+	unsigned primed;
+	
+	/* nonzero when the capture thread must exit */
+	volatile LONG quit;
+	
+	/* the number of captures that were started, and that were taken and used, or were too old or 
+	had failed when they were taken.
+	*/
+	unsigned __int64 capture_count;
+	unsigned __int64 taken_count;
+	unsigned __int64 stale_count;
+	unsigned __int64 failed_count;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in capture.c
+*/
+void create_capture_store( 
+	struct capture **const out   // out deref
+);
+
+int init_capture_store( 
+	struct capture *const store,   // in, out
+	const DWORD flags,   // in
+	const unsigned max_age_ms   // in
+);
+
+void init_global_capture_store( void );
+
+void start_capture( 
+	struct capture *const store   // in, out
+);
+
+int take_capture( 
+	struct capture *const store,   // in, out
+	SYSTEM_PROCESS_INFORMATION **const spi,   // in, out
+	size_t *const spi_bytes,   // in, out
+	__int64 *const capture_time,   // out, optional
+	__int64 *const capture_ticks   // out, optional
+);
+
+void print_capture_stats( 
+	const struct capture *const store   // in
+);
+
+void print_capture_store( 
+	const struct capture *const store   // in
+);
+
+void print_global_capture_store( void );
+
+void free_capture_store( 
+	struct capture **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CAPTURE_H
@@ -37,6 +37,12 @@ get_next_arg()
 Get the next argument in the array of command line arguments.
 -
 
+-
+str_to_ms()
+
+Convert a string of whole seconds, or of milliseconds ending in ms, to milliseconds.
+-
+
 -
 init_global_config_store()
 
@@ -86,6 +92,11 @@ Free a configuration store and all its descendants.
 
 
 
+static int str_to_ms( 
+	unsigned *const ms,   // out
+	const char *const str   // in
+);
+
 static void print_config_store( 
 	struct config *store   // in
 );
@@ -243,6 +254,54 @@ unsigned get_next_arg(
 
 
 
+/* str_to_ms()
+Convert a string of whole seconds, or of milliseconds ending in ms, to milliseconds.
+
+For example "7" is 7000 milliseconds and "100ms" is 100 milliseconds. The interval can't be more than 
+POLLING_MAX seconds.
+
+returns nonzero on success
+*/
+static int str_to_ms( 
+	unsigned *const ms,   // out
+	const char *const str   // in
+)
+{
+	char buffer[ 32 ];
+	size_t len = 0;
+	unsigned num = 0;
+	
+	FAIL_IF( !ms );
+	FAIL_IF( !str );
+	
+	
+	*ms = 0;
+	
+	len = strlen( str );
+	if( ( len > 2 ) && !_stricmp( str + len - 2, "ms" ) )
+	{
+		if( ( len - 2 ) >= sizeof( buffer ) )
+			return FALSE;
+		
+		memcpy( buffer, str, len - 2 );
+		buffer[ len - 2 ] = '\0';
+		
+		if( ( str_to_uint( &num, buffer ) != NUM_POS ) || ( num > ( POLLING_MAX * 1000u ) ) )
+			return FALSE;
+		
+		*ms = num;
+		return TRUE;
+	}
+	
+	if( ( str_to_uint( &num, str ) != NUM_POS ) || ( num > POLLING_MAX ) )
+		return FALSE;
+	
+	*ms = num * 1000;
+	return TRUE;
+}
+
+
+
 /* init_global_config_store()
 Initialize the global configuration store by parsing command line arguments.
 
@@ -254,6 +313,7 @@ void init_global_config_store( void )
 {
 	int i = 0;
 	unsigned arf = 0;
+	size_t len = 0;
 	char *debugstr = NULL;
 	
 	FAIL_IF( !G );   // The global store must exist.
@@ -272,6 +332,7 @@ void init_global_config_store( void )
 	G->config->polling = POLLING_DEFAULT;
 	G->config->verbose = VERBOSE_DEFAULT;
 	G->config->max_threads = MAX_THREADS_DEFAULT;
+	G->config->worker_threads = WORKER_THREADS_DEFAULT;
 	
 	/* parse command line arguments */
 	i = 0;
@@ -362,6 +423,7 @@ void init_global_config_store( void )
 				}
 				
 				G->config->polling = POLLING_ENABLED_DEFAULT;
+				G->config->polling_ms = POLLING_ENABLED_DEFAULT * 1000;
 				
 				/* since this option may or may not have an associated argument, 
 				test for both an option's argument(optarg) or the next option
@@ -373,6 +435,29 @@ void init_global_config_store( void )
 				
 				/* option argument found */
 				
+				/* if the argument ends in ms then the interval is in milliseconds */
+				len = strlen( G->prog->argv[ i ] );
+				if( ( len > 2 ) && !_stricmp( G->prog->argv[ i ] + len - 2, "ms" ) )
+				{
+					if( !str_to_ms( &G->config->polling_ms, G->prog->argv[ i ] ) )
+					{
+						MSG_FATAL( "Option 'm': milliseconds invalid." );
+						printf( "ms: %s\n", G->prog->argv[ i ] );
+						printf( "POLLING_MAX: %d seconds\n", POLLING_MAX );
+						exit( 1 );
+					}
+					
+					G->config->polling = (int)( G->config->polling_ms / 1000 );
+					
+					if( G->config->polling_ms == 0 )
+					{
+						MSG_WARNING( "Option 'm': an interval of 0 uses too much CPU time." );
+						printf( "ms: %s\n", G->prog->argv[ i ] );
+					}
+					
+					continue;
+				}
+				
 				if( !str_to_int( &G->config->polling, G->prog->argv[ i ] ) )
 				{
 					MSG_FATAL( "Option 'm': the string is not an integer representation." );
@@ -407,6 +492,55 @@ void init_global_config_store( void )
 					exit( 1 );
 				}
 				
+				G->config->polling_ms = (unsigned)G->config->polling * 1000;
+				
+				continue;
+			}
+			
+			
+			
+			/** 
+			adaptive monitor option
+			*/
+			case 'a':
+			case 'A':
+			{
+				if( G->config->adaptive_max_ms )
+				{
+					MSG_FATAL( "Option 'a': this option has already been specified." );
+					printf( "min ms: %u\n", G->config->adaptive_min_ms );
+					printf( "max ms: %u\n", G->config->adaptive_max_ms );
+					exit( 1 );
+				}
+				
+				/* this option must have two associated arguments (optarg), the minimum and the 
+				maximum interval. if an optarg is not found get_next_arg() will exit(1)
+				*/
+				arf = get_next_arg( &i, OPTARG );
+				
+				if( !str_to_ms( &G->config->adaptive_min_ms, G->prog->argv[ i ] ) 
+					|| !G->config->adaptive_min_ms 
+				)
+				{
+					MSG_FATAL( "Option 'a': minimum interval invalid." );
+					printf( "min: %s\n", G->prog->argv[ i ] );
+					exit( 1 );
+				}
+				
+				arf = get_next_arg( &i, OPTARG );
+				
+				if( !str_to_ms( &G->config->adaptive_max_ms, G->prog->argv[ i ] ) 
+					|| ( G->config->adaptive_max_ms < G->config->adaptive_min_ms ) 
+				)
+				{
+					MSG_FATAL( "Option 'a': maximum interval invalid." );
+					printf( "max: %s\n", G->prog->argv[ i ] );
+					printf( "The maximum must be at least the minimum, %u ms.\n", 
+						G->config->adaptive_min_ms 
+					);
+					exit( 1 );
+				}
+				
 				continue;
 			}
 			
@@ -681,6 +815,175 @@ void init_global_config_store( void )
 			
 			
 			
+			/**
+			worker threads option (advanced)
+			*/
+			case 'j':
+			case 'J':
+			{
+				if( G->config->worker_threads != WORKER_THREADS_DEFAULT )
+				{
+					MSG_FATAL( "Option 'j': this option has already been specified." );
+					printf( "worker threads: %u\n", G->config->worker_threads );
+					exit( 1 );
+				}
+				
+				/* this option must have an associated argument (optarg). 
+				if an optarg is not found get_next_arg() will exit(1)
+				*/
+				arf = get_next_arg( &i, OPTARG );
+				
+				/* option argument found */
+				
+				/* if the string is not a positive integer representation > 0 */
+				if( ( str_to_uint( &G->config->worker_threads, G->prog->argv[ i ] ) != NUM_POS ) 
+					|| ( G->config->worker_threads <= 0 ) 
+					|| ( G->config->worker_threads > WORKER_THREADS_MAX ) 
+				)
+				{
+					MSG_FATAL( "Option 'j': number of worker threads invalid." );
+					printf( "num: %s\n", G->prog->argv[ i ] );
+					printf( "WORKER_THREADS_MAX: %u\n", WORKER_THREADS_MAX );
+					exit( 1 );
+				}
+				
+				continue;
+			}
+			
+			
+			
+			/**
+			write snapshots option (advanced)
+			*/
+			case 'w':
+			case 'W':
+			{
+				if( G->config->snapshot_file )
+				{
+					MSG_FATAL( "Option 'w': this option has already been specified." );
+					printf( "file: %ls\n", G->config->snapshot_file );
+					exit( 1 );
+				}
+				
+				/* this option must have an associated argument (optarg). 
+				if an optarg is not found get_next_arg() will exit(1)
+				*/
+				arf = get_next_arg( &i, OPTARG );
+				
+				/* option argument found */
+				
+				/* make the file name as a wide character string */
+				if( !get_wstr_from_mbstr( &G->config->snapshot_file, G->prog->argv[ i ] ) )
+				{
+					MSG_FATAL( "get_wstr_from_mbstr() failed." );
+					printf( "file: %s\n", G->prog->argv[ i ] );
+					exit( 1 );
+				}
+				
+				continue;
+			}
+			
+			
+			
+			/**
+			output file option
+			*/
+			case 'o':
+			case 'O':
+			{
+				if( G->config->output_file )
+				{
+					MSG_FATAL( "Option 'o': this option has already been specified." );
+					printf( "file: %ls\n", G->config->output_file );
+					exit( 1 );
+				}
+				
+				/* this option must have an associated argument (optarg). 
+				if an optarg is not found get_next_arg() will exit(1)
+				*/
+				arf = get_next_arg( &i, OPTARG );
+				
+				/* option argument found */
+				
+				/* make the file name as a wide character string */
+				if( !get_wstr_from_mbstr( &G->config->output_file, G->prog->argv[ i ] ) )
+				{
+					MSG_FATAL( "get_wstr_from_mbstr() failed." );
+					printf( "file: %s\n", G->prog->argv[ i ] );
+					exit( 1 );
+				}
+				
+				continue;
+			}
+			
+			
+			
+			/**
+			timing summary option (advanced)
+			*/
+			case 's':
+			case 'S':
+			{
+				if( G->config->timing_file )
+				{
+					MSG_FATAL( "Option 's': this option has already been specified." );
+					printf( "file: %ls\n", G->config->timing_file );
+					exit( 1 );
+				}
+				
+				/* this option must have an associated argument (optarg). 
+				if an optarg is not found get_next_arg() will exit(1)
+				*/
+				arf = get_next_arg( &i, OPTARG );
+				
+				/* option argument found */
+				
+				/* make the file name as a wide character string */
+				if( !get_wstr_from_mbstr( &G->config->timing_file, G->prog->argv[ i ] ) )
+				{
+					MSG_FATAL( "get_wstr_from_mbstr() failed." );
+					printf( "file: %s\n", G->prog->argv[ i ] );
+					exit( 1 );
+				}
+				
+				continue;
+			}
+			
+			
+			
+			/**
+			replay option
+			*/
+			case 'l':
+			case 'L':
+			{
+				if( G->config->replay_path )
+				{
+					MSG_FATAL( "Option 'l': this option has already been specified." );
+					printf( "path: %ls\n", G->config->replay_path );
+					exit( 1 );
+				}
+				
+				/* this option must have an associated argument (optarg). 
+				if an optarg is not found get_next_arg() will exit(1)
+				*/
+				arf = get_next_arg( &i, OPTARG );
+				
+				/* option argument found */
+				
+				/* make the path as a wide character string */
+				if( !get_wstr_from_mbstr( &G->config->replay_path, G->prog->argv[ i ] ) )
+				{
+					MSG_FATAL( "get_wstr_from_mbstr() failed." );
+					printf( "path: %s\n", G->prog->argv[ i ] );
+					exit( 1 );
+				}
+				
+				continue;
+			}
+			
+			
+			
 			/**
 			test mode include option (advanced)
 			*/
@@ -821,6 +1124,32 @@ void init_global_config_store( void )
 			
 			
 			
+			/**
+			option to skip snapshots when no HOOK has changed (advanced)
+			*/
+			case 'q':
+			case 'Q':
+			{
+				G->config->flags |= CFG_SKIP_UNCHANGED;
+				arf = get_next_arg( &i, OPT );
+				continue;
+			}
+			
+			
+			
+			/**
+			option to query the system process info on a capture thread (advanced)
+			*/
+			case 'b':
+			case 'B':
+			{
+				G->config->flags |= CFG_PIPELINED_CAPTURE;
+				arf = get_next_arg( &i, OPT );
+				continue;
+			}
+			
+			
+			
 			default:
 			{
 				MSG_FATAL( "Unknown option." );
@@ -832,6 +1161,32 @@ void init_global_config_store( void )
 	
 	
 	
+	/* adaptive polling enables monitor mode. it starts at the maximum interval unless the user 
+	specified an interval, which is kept within the minimum and maximum.
+	*/
+	if( G->config->adaptive_max_ms )
+	{
+		if( G->config->polling == POLLING_DEFAULT )
+			G->config->polling_ms = G->config->adaptive_max_ms;
+		else if( G->config->polling_ms < G->config->adaptive_min_ms )
+			G->config->polling_ms = G->config->adaptive_min_ms;
+		else if( G->config->polling_ms > G->config->adaptive_max_ms )
+			G->config->polling_ms = G->config->adaptive_max_ms;
+		
+		G->config->polling = (int)( G->config->polling_ms / 1000 );
+	}
+	
+	
+	
+	/* replayed snapshots are not written to a snapshot file */
+	if( G->config->replay_path && G->config->snapshot_file )
+	{
+		MSG_FATAL( "Option 'l' is not compatible with option 'w'." );
+		exit( 1 );
+	}
+	
+	
+	
 	if( ( G->config->proglist->type == LIST_INCLUDE_PROG )
 		|| ( G->config->proglist->type == LIST_EXCLUDE_PROG )
 	)
@@ -886,6 +1241,12 @@ void print_config_flags(
 	if( flags & CFG_COMPLETELY_PASSIVE )
 		printf( "CFG_COMPLETELY_PASSIVE " );
 	
+	if( flags & CFG_SKIP_UNCHANGED )
+		printf( "CFG_SKIP_UNCHANGED " );
+	
+	if( flags & CFG_PIPELINED_CAPTURE )
+		printf( "CFG_PIPELINED_CAPTURE " );
+	
 	if( flags & CFG_DEBUG )
 		printf( "CFG_DEBUG " );
 	
@@ -922,8 +1283,25 @@ static void print_config_store(
 		printf( " (Taking only one snapshot)" );
 	printf( "\n" );
 	
+	printf( "store->polling_ms: %u\n", store->polling_ms );
+	printf( "store->adaptive_min_ms: %u\n", store->adaptive_min_ms );
+	printf( "store->adaptive_max_ms: %u\n", store->adaptive_max_ms );
+	
 	printf( "store->verbose: %d\n", store->verbose );
 	printf( "store->max_threads: %u\n", store->max_threads );
+	printf( "store->worker_threads: %u\n", store->worker_threads );
+	printf( "store->snapshot_file: %ls\n", 
+		( store->snapshot_file ? store->snapshot_file : L"<NULL>" ) 
+	);
+	printf( "store->replay_path: %ls\n", 
+		( store->replay_path ? store->replay_path : L"<NULL>" ) 
+	);
+	printf( "store->output_file: %ls\n", 
+		( store->output_file ? store->output_file : L"<NULL>" ) 
+	);
+	printf( "store->timing_file: %ls\n", 
+		( store->timing_file ? store->timing_file : L"<NULL>" ) 
+	);
 	
 	printf( "store->flags: " );
 	PRINT_HEX_BARE( store->flags );
@@ -986,6 +1364,11 @@ void free_config_store(
 	free_list_store( &(*in)->hooklist );
 	free_list_store( &(*in)->desklist );
 	
+	free( (*in)->snapshot_file );
+	free( (*in)->replay_path );
+	free( (*in)->output_file );
+	free( (*in)->timing_file );
+	
 	free( (*in) );
 	*in = NULL;
 	
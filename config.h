@@ -47,6 +47,19 @@ struct config
 	#define POLLING_DEFAULT   ( POLLING_MIN - 1 )
 	int polling;
 	
+	/* how many milliseconds to wait between taking snapshots. this is polling * 1000 unless the 
+	user specified milliseconds (eg -m 100ms), in which case polling is the whole seconds.
+	this is only valid if polling is enabled (polling >= POLLING_MIN).
+	*/
+	unsigned polling_ms;
+	
+	/* the minimum and maximum milliseconds to wait between taking snapshots if polling is adaptive.
+	the interval is shortened to the minimum when a snapshot has changes and doubled for each 
+	snapshot that doesn't, up to the maximum. by default polling isn't adaptive and these are 0.
+	*/
+	unsigned adaptive_min_ms;
+	unsigned adaptive_max_ms;
+	
 	
 	/* verbosity level. the higher the level the more information.
 	by default verbose is disabled and this program will not print extra information.
@@ -65,6 +78,36 @@ struct config
 	unsigned max_threads;
 	
 	
+	/* the number of worker threads that find the GUI threads in each snapshot.
+	by default the GUI threads are found on the main thread and there are no worker threads.
+	the maximum is MAXIMUM_WAIT_OBJECTS, the most threads that can be waited on at once.
+	*/
+	#define WORKER_THREADS_DEFAULT   1
+	#define WORKER_THREADS_MAX   MAXIMUM_WAIT_OBJECTS
+	unsigned worker_threads;
+	
+	
+	/* the name of the file to append each snapshot to, in the binary snapshot file format.
+	by default snapshots are not written to a file.
+	*/
+	WCHAR *snapshot_file;   // get_wstr_from_mbstr(), free()
+	
+	/* the name of a snapshot file, or a directory of snapshot files, to replay instead of taking 
+	snapshots of the system. by default there is no replay.
+	*/
+	WCHAR *replay_path;   // get_wstr_from_mbstr(), free()
+	
+	/* the name of a file to write the output to instead of the console.
+	by default the output is written to the console.
+	*/
+	WCHAR *output_file;   // get_wstr_from_mbstr(), free()
+	
+	/* the name of a file to write a summary of the time taken by each phase of each poll to when 
+	the program exits. by default there is no timing summary.
+	*/
+	WCHAR *timing_file;   // get_wstr_from_mbstr(), free()
+	
+	
 	
 	/** flags
 	*/
@@ -102,9 +145,20 @@ struct config
 	*/
 	#define CFG_COMPLETELY_PASSIVE   ( 1u << 5 )
 	
+	/* skip unchanged snapshots: in monitor mode fingerprint the HOOK entries in the handle table 
+	before each snapshot, and if the fingerprint is the same as the last snapshot's then don't take 
+	a snapshot. the threads aren't traversed and nothing is diffed.
+	*/
+	#define CFG_SKIP_UNCHANGED   ( 1u << 6 )
+	
+	/* pipelined capture: in monitor mode query the system process info for the next snapshot on a 
+	capture thread while the main thread processes the current one.
+	*/
+	#define CFG_PIPELINED_CAPTURE   ( 1u << 7 )
+	
 	/* general purpose debug flag to handle my whims */
-	#define CFG_DEBUG   ( 1u << 6 )
-	#define CFG_VALID   ( ~( (unsigned)(-1) << 7 ) )
+	#define CFG_DEBUG   ( 1u << 8 )
+	#define CFG_VALID   ( ~( (unsigned)(-1) << 9 ) )
 	
 	unsigned flags;
 	
@@ -66,6 +66,24 @@ Add all desktops in the current window station.
 Calls EnumDesktopsW() to call EnumDesktopProc().
 -
 
+-
+compare_desktop_range()
+
+Compare two desktop ranges according to their base address.
+-
+
+-
+build_desktop_range_array()
+
+Build a desktop store's array of desktop heap ranges, sorted by base address.
+-
+
+-
+find_desktop_range()
+
+Search a sorted array of desktop heap ranges for the desktop heap that holds an object.
+-
+
 -
 init_global_desktop_store()
 
@@ -141,6 +159,11 @@ static int add_all_desktops(
 	struct desktop_list *store   // out
 );
 
+static int compare_desktop_range( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
 static void print_desktop_store( 
 	const struct desktop_list *const store   // in
 );
@@ -751,6 +774,140 @@ static int add_all_desktops(
 
 
 
+/* compare_desktop_range()
+Compare two desktop ranges according to their base address.
+
+qsort() callback: this function is called to sort the range array
+
+returns -1 if p1's base is less than p2's base
+returns 1 if p1's base is greater than p2's base
+returns 0 if p1's base is the same as p2's base
+*/
+static int compare_desktop_range( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct desktop_range *const a = p1;
+	const struct desktop_range *const b = p2;
+	
+	
+	if( a->base < b->base )
+		return -1;
+	else if( a->base > b->base )
+		return 1;
+	else
+		return 0;
+}
+
+
+
+/* build_desktop_range_array()
+Build a desktop store's array of desktop heap ranges, sorted by base address.
+
+This is called by init_global_desktop_store() after all desktops have been attached. A heap range 
+doesn't change while a desktop is attached, so the array is only built once. Any existing array is 
+freed first.
+*/
+void build_desktop_range_array( 
+	struct desktop_list *const store   // in, out
+)
+{
+	unsigned i = 0;
+	struct desktop_item *d = NULL;
+	
+	FAIL_IF( !store );
+	
+	
+	free( store->range );
+	store->range = NULL;
+	store->range_count = 0;
+	
+	for( d = store->head; d; d = d->next )
+		++store->range_count;
+	
+	if( !store->range_count )
+		return;
+	
+	store->range = must_calloc( store->range_count, sizeof( *store->range ) );
+	
+	for( i = 0, d = store->head; d; ++i, d = d->next )
+	{
+		store->range[ i ].base = (uintptr_t)d->pDeskInfo->pvDesktopBase;
+		store->range[ i ].limit = (uintptr_t)d->pDeskInfo->pvDesktopLimit;
+		store->range[ i ].desktop = d;
+	}
+	
+	qsort( store->range, store->range_count, sizeof( *store->range ), compare_desktop_range );
+	
+	/* desktop heaps are separate allocations so they shouldn't overlap. if they did then the binary 
+	search in find_desktop_range() could miss a desktop that a linear search would find.
+	*/
+	for( i = 1; i < store->range_count; ++i )
+	{
+		if( store->range[ i ].base < store->range[ i - 1 ].limit )
+		{
+			MSG_WARNING( "Desktop heaps overlap." );
+			printf( "desktop: %ls\n", store->range[ i - 1 ].desktop->pwszDesktopName );
+			printf( "desktop: %ls\n", store->range[ i ].desktop->pwszDesktopName );
+		}
+	}
+	
+	return;
+}
+
+
+
+/* find_desktop_range()
+Search a sorted array of desktop heap ranges for the desktop heap that holds an object.
+
+'range' is an array of 'range_count' desktop heap ranges sorted by base address.
+'addr' is the kernel address of an object.
+'size' is the size of the object.
+
+The object is considered to be on a desktop if base <= addr < limit - size.
+
+This is a branchless binary search for the range with the greatest base <= addr. There is usually 
+only a handful of desktops, and the loop runs log2(range_count) times without any unpredictable 
+branches.
+
+returns the index in 'range' of the desktop heap that holds the object.
+returns -1 if the object isn't on any of the desktops.
+*/
+int find_desktop_range( 
+	const struct desktop_range *const range,   // in
+	const unsigned range_count,   // in
+	const uintptr_t addr,   // in
+	const size_t size   // in
+)
+{
+	unsigned n = range_count;
+	const struct desktop_range *r = range;
+	
+	
+	if( !range || !range_count )
+		return -1;
+	
+	while( n > 1 )
+	{
+		const unsigned half = n / 2;
+		
+		
+		r = ( r[ half ].base <= addr ) ? &r[ half ] : r;
+		n -= half;
+	}
+	
+	if( ( addr >= r->base ) 
+		&& ( r->limit > size ) 
+		&& ( addr < ( r->limit - size ) ) 
+	)
+		return (int)( r - range );
+	
+	return -1;
+}
+
+
+
 /* init_global_desktop_store()
 Initialize the global desktop store by attaching to the user-specified or default desktop(s).
 Calls add_all_desktops(), or calls add_desktop_item() for each desktop if not adding all.
@@ -825,6 +982,9 @@ void init_global_desktop_store( void )
 	}
 	
 	
+	/* sort the attached desktops' heap ranges for find_desktop_range() */
+	build_desktop_range_array( G->desktops );
+	
 	/* G->desktops has been initialized */
 	GetSystemTimeAsFileTime( (FILETIME *)&G->desktops->init_time );
 	return;
@@ -918,6 +1078,22 @@ static void print_desktop_store(
 	
 	PRINT_HEX( store->tail );
 	
+	printf( "store->range_count: %u\n", store->range_count );
+	if( store->range )
+	{
+		unsigned i = 0;
+		
+		
+		for( i = 0; i < store->range_count; ++i )
+		{
+			printf( "store->range[ %u ]: ", i );
+			PRINT_HEX_BARE( store->range[ i ].base );
+			printf( " - " );
+			PRINT_HEX_BARE( store->range[ i ].limit );
+			printf( " '%ls'\n", store->range[ i ].desktop->pwszDesktopName );
+		}
+	}
+	
 	PRINT_DBLSEP_END( objname );
 	
 	return;
@@ -1022,6 +1198,8 @@ void free_desktop_store(
 		}
 	}
 	
+	free( (*in)->range );
+	
 	free( (*in) );
 	*in = NULL;
 	
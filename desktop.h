@@ -83,6 +83,24 @@ struct desktop_item
 
 
 
+/** This is the heap range of an attached to desktop.
+The desktop store has an array of these sorted by base address so that the desktop a kernel address 
+is on can be found by binary search instead of by walking the desktop list.
+*/
+struct desktop_range
+{
+	/* DESKTOPINFO.pvDesktopBase. The kernel address of the start of the desktop's heap. */
+	uintptr_t base;
+	
+	/* DESKTOPINFO.pvDesktopLimit. The kernel address of the end of the desktop's heap. */
+	uintptr_t limit;
+	
+	/* The desktop */
+	struct desktop_item *desktop;
+};
+
+
+
 /** The desktop store type.
 The different types of lists that can be held by the store.
 */
@@ -110,6 +128,14 @@ struct desktop_list
 	/* the desktop list type */
 	enum desktop_type type;
 	
+	/* an array of the heap ranges of the desktops in the list, sorted by base address.
+	this is written by build_desktop_range_array() after all desktops have been attached.
+	*/
+	struct desktop_range *range;   // calloc(), free()
+	
+	/* the number of elements in the range array. this is also the number of items in the list. */
+	unsigned range_count;
+	
 	/* the system utc time in FILETIME format immediately after this store has been initialized.
 	this is nonzero when this store has been initialized.
 	*/
@@ -125,6 +151,17 @@ void create_desktop_store(
 	struct desktop_list **const out   // out deref
 );
 
+void build_desktop_range_array( 
+	struct desktop_list *const store   // in, out
+);
+
+int find_desktop_range( 
+	const struct desktop_range *const range,   // in
+	const unsigned range_count,   // in
+	const uintptr_t addr,   // in
+	const size_t size   // in
+);
+
 void init_global_desktop_store( void );
 
 void print_desktop_item( 
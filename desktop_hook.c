@@ -73,12 +73,72 @@ compare_hook()
 Compare two hook structs according their HANDLEENTRY info.
 -
 
+-
+get_hook_key()
+
+Get the sort key of a hook struct.
+-
+
+-
+compare_hook_key()
+
+Compare two hook keys.
+-
+
+-
+build_hook_keys()
+
+Build a desktop hook item's hook key array from its hook array.
+-
+
+-
+radix_sort_hook_keys()
+
+Sort an array of hook sort elements by key with an LSD radix sort.
+-
+
+-
+sort_hook_array()
+
+Sort a desktop hook item's hook array and build its hook key array.
+-
+
+-
+hash_HOOK()
+
+Hash the bytes of a HOOK struct.
+-
+
+-
+add_hook_fingerprint()
+
+Add a HOOK entry and the bytes of its HOOK to a fingerprint.
+-
+
 -
 init_desktop_hook_store()
 
 Initialize the desktop hook store by recording the hooks for each desktop.
 -
 
+-
+is_hook_fingerprint_unchanged()
+
+Check whether the HOOKs are the same as when a desktop hook store was initialized.
+-
+
+-
+get_unfound_hook_thread()
+
+Get one of a hook's owner, origin or target THREADINFOs if it wasn't found in the gui array.
+-
+
+-
+is_hook_thread_missing()
+
+Check whether a new or changed hook's thread can't be any thread in the parent snapshot's spi array.
+-
+
 -
 print_hook_anomalies()
 
@@ -124,13 +184,18 @@ Free a desktop hook store and all its descendants.
 */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "util.h"
 
 #include "snapshot.h"
 
+#include "handle_table.h"
+
 #include "desktop_hook.h"
 
+#include "output.h"
+
 /* the global stores */
 #include "global.h"
 
@@ -141,6 +206,28 @@ static struct desktop_hook_item *add_desktop_hook_item(
 	struct desktop_item *const desktop   // in
 );
 
+static struct hook_sort *radix_sort_hook_keys( 
+	struct hook_sort *src,   // in, out
+	struct hook_sort *dst,   // out
+	const unsigned count   // in
+);
+
+static unsigned hash_HOOK( 
+	const HOOK *const object   // in
+);
+
+static unsigned __int64 add_hook_fingerprint( 
+	unsigned __int64 fingerprint,   // in
+	const unsigned index,   // in
+	const HANDLEENTRY *const entry,   // in
+	const HOOK *const object   // in
+);
+
+static const void *get_unfound_hook_thread( 
+	const struct hook *const hook,   // in
+	const unsigned n   // in
+);
+
 static void free_desktop_hook_item( 
 	struct desktop_hook_item **const in   // in deref
 );
@@ -149,9 +236,13 @@ static void free_desktop_hook_item(
 
 /* create_desktop_hook_store()
 Create a desktop hook store and its descendants or die.
+
+If 'arena' is not NULL then the desktop hook items and their arrays are allocated from it when the 
+store is initialized, and are released with the arena instead of when the store is freed.
 */
 void create_desktop_hook_store( 
-	struct desktop_hook_list **const out   // out deref
+	struct desktop_hook_list **const out,   // out deref
+	struct arena *const arena   // in, optional
 )
 {
 	struct desktop_hook_list *desktop_hooks = NULL;
@@ -163,6 +254,8 @@ void create_desktop_hook_store(
 	/* allocate a desktop hook store */
 	desktop_hooks = must_calloc( 1, sizeof( *desktop_hooks ) );
 	
+	desktop_hooks->arena = arena;
+	
 	
 	*out = desktop_hooks;
 	return;
@@ -198,7 +291,10 @@ static struct desktop_hook_item *add_desktop_hook_item(
 	
 	/* create a new item and add it to the list */
 	
-	item = must_calloc( 1, sizeof( *item ) );
+	if( store->arena )
+		item = arena_calloc( store->arena, 1, sizeof( *item ) );
+	else
+		item = must_calloc( 1, sizeof( *item ) );
 	
 	item->desktop = desktop;
 	
@@ -210,8 +306,20 @@ static struct desktop_hook_item *add_desktop_hook_item(
 	*/
 	item->hook_max = 65535;
 	
-	/* allocate an array of hook structs */
-	item->hook = must_calloc( item->hook_max, sizeof( *item->hook ) );
+	/* allocate an array of hook structs.
+	the arena's memory isn't zeroed since every member of a hook is written before hook_count is 
+	incremented, and zeroing an array this large each time the arena is reused would be wasted.
+	*/
+	if( store->arena )
+		item->hook = arena_alloc( store->arena, item->hook_max, sizeof( *item->hook ) );
+	else
+		item->hook = must_calloc( item->hook_max, sizeof( *item->hook ) );
+	
+	/* allocate an array of hook keys. each key is written after its hook is sorted. */
+	if( store->arena )
+		item->key = arena_alloc( store->arena, item->hook_max, sizeof( *item->key ) );
+	else
+		item->key = must_calloc( item->hook_max, sizeof( *item->key ) );
 	
 	
 	/* the desktop hook item is initialized. add the new item to the end of the list */
@@ -483,6 +591,371 @@ int compare_hook(
 
 
 
+/* get_hook_key()
+Get the sort key of a hook struct.
+
+Comparing the keys of two hooks with compare_hook_key() has the same result as comparing the hooks 
+with compare_hook().
+*/
+void get_hook_key( 
+	const struct hook *const hook,   // in
+	struct hook_key *const key   // out
+)
+{
+	FAIL_IF( !hook );
+	FAIL_IF( !key );
+	
+	
+	key->hi = (uintptr_t)hook->entry.pHead;
+	key->lo = ( (unsigned __int64)hook->entry_index << 32 ) | (DWORD)(uintptr_t)hook->object.head.h;
+	
+	return;
+}
+
+
+
+/* compare_hook_key()
+Compare two hook keys.
+
+qsort() callback: this function can be called to sort a hook key array
+
+returns -1 if p1's key is less than p2's key
+returns 1 if p1's key is greater than p2's key
+returns 0 if p1's key is the same as p2's key
+*/
+int compare_hook_key( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct hook_key *const a = p1;
+	const struct hook_key *const b = p2;
+	
+	
+	if( a->hi < b->hi )
+		return -1;
+	else if( a->hi > b->hi )
+		return 1;
+	else if( a->lo < b->lo )
+		return -1;
+	else if( a->lo > b->lo )
+		return 1;
+	else
+		return 0;
+}
+
+
+
+/* build_hook_keys()
+Build a desktop hook item's hook key array from its hook array.
+
+This must be called whenever the hook array is written or reordered.
+*/
+void build_hook_keys( 
+	struct desktop_hook_item *const item   // in, out
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !item );
+	FAIL_IF( item->hook_count > item->hook_max );
+	FAIL_IF( item->hook_count && !item->key );
+	
+	
+	for( i = 0; i < item->hook_count; ++i )
+		get_hook_key( &item->hook[ i ], &item->key[ i ] );
+	
+	return;
+}
+
+
+
+/* radix_sort_hook_keys()
+Sort an array of hook sort elements by key with an LSD radix sort.
+
+The key is sorted one byte at a time starting with the least significant byte of 'lo' and ending 
+with the most significant byte of 'hi', which is 16 passes at most. The counts for every byte are 
+taken in a single pass over the array first, and a pass is skipped when all the elements have the 
+same value for that byte. That's common since the pHeads of the hooks on a desktop are all in the 
+same desktop heap and the high bytes of the handles are usually zero. Each pass is stable so the 
+result is the same order as compare_hook_key().
+
+'src' is the array to sort.
+'dst' is an array with at least as many elements as 'src' that's used for the passes.
+'count' is the number of elements in each array.
+
+returns the array that holds the sorted elements, which is either 'src' or 'dst'
+*/
+static struct hook_sort *radix_sort_hook_keys( 
+	struct hook_sort *src,   // in, out
+	struct hook_sort *dst,   // out
+	const unsigned count   // in
+)
+{
+	/* the counts for each value of each byte of the key. this is 16KB */
+	unsigned histogram[ 16 ][ 256 ];
+	unsigned digit = 0, i = 0;
+	
+	FAIL_IF( count && ( !src || !dst ) );
+	
+	
+	if( count < 2 )
+		return src;
+	
+	memset( histogram, 0, sizeof( histogram ) );
+	
+	for( i = 0; i < count; ++i )
+	{
+		const unsigned __int64 lo = src[ i ].key.lo;
+		const unsigned __int64 hi = src[ i ].key.hi;
+		
+		for( digit = 0; digit < 8; ++digit )
+		{
+			++histogram[ digit ][ (unsigned)( lo >> ( digit * 8 ) ) & 0xFF ];
+			++histogram[ digit + 8 ][ (unsigned)( hi >> ( digit * 8 ) ) & 0xFF ];
+		}
+	}
+	
+	for( digit = 0; digit < 16; ++digit )
+	{
+		unsigned *const offset = histogram[ digit ];
+		const unsigned shift = ( digit & 7 ) * 8;
+		unsigned total = 0;
+		struct hook_sort *temp = NULL;
+		
+		
+		/* if every element has the same value for this byte then this pass wouldn't move anything */
+		if( offset[ ( (unsigned)( ( digit < 8 ) ? src[ 0 ].key.lo : src[ 0 ].key.hi ) >> shift ) & 0xFF ] 
+			== count 
+		)
+			continue;
+		
+		/* convert the counts to the offset in 'dst' of each value's first element */
+		for( i = 0; i < 256; ++i )
+		{
+			const unsigned n = offset[ i ];
+			
+			offset[ i ] = total;
+			total += n;
+		}
+		
+		if( digit < 8 )
+		{
+			for( i = 0; i < count; ++i )
+				dst[ offset[ (unsigned)( src[ i ].key.lo >> shift ) & 0xFF ]++ ] = src[ i ];
+		}
+		else
+		{
+			for( i = 0; i < count; ++i )
+				dst[ offset[ (unsigned)( src[ i ].key.hi >> shift ) & 0xFF ]++ ] = src[ i ];
+		}
+		
+		temp = src;
+		src = dst;
+		dst = temp;
+	}
+	
+	return src;
+}
+
+
+
+/* sort_hook_array()
+Sort a desktop hook item's hook array and build its hook key array.
+
+The hooks are sorted in the same order as compare_hook(). Instead of calling qsort() with 
+compare_hook(), which reads two whole hook structs for each comparison, the key of each hook is 
+packed into a hook_key by get_hook_key() and the keys are radix sorted along with the index of the 
+hook each came from. The hook array is then reordered in place by following those indexes, so each 
+hook struct is moved only once. If the keys are already in order, which is usually the case when 
+the HANDLEENTRYs of a desktop's HOOKs were found in the same order as their pHeads, then nothing is 
+sorted.
+
+The sort arrays are in the desktop hook store and are reused from one call to the next.
+
+If the general purpose debug flag is set (environment variable GETHOOKS_DEBUG=1) the sorted hook 
+array is checked with compare_hook(). If it's out of order an error is printed and the hook array is 
+sorted again using qsort() with compare_hook().
+*/
+void sort_hook_array( 
+	struct desktop_hook_list *const store,   // in, out
+	struct desktop_hook_item *const item   // in, out
+)
+{
+	struct hook_sort *sorted = NULL;
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !item );
+	FAIL_IF( item->hook_count > item->hook_max );
+	FAIL_IF( item->hook_count && ( !item->hook || !item->key ) );
+	
+	
+	/* the key array is in the same order as the unsorted hook array */
+	build_hook_keys( item );
+	
+	for( i = 1; i < item->hook_count; ++i )
+	{
+		if( compare_hook_key( &item->key[ i - 1 ], &item->key[ i ] ) > 0 )
+			break;
+	}
+	
+	if( i >= item->hook_count )
+		return; // already sorted
+	
+	if( item->hook_count > store->sort_max )
+	{
+		free( store->sort );
+		free( store->sort_spare );
+		
+		store->sort_max = item->hook_max;
+		store->sort = must_calloc( store->sort_max, sizeof( *store->sort ) );
+		store->sort_spare = must_calloc( store->sort_max, sizeof( *store->sort_spare ) );
+	}
+	
+	for( i = 0; i < item->hook_count; ++i )
+	{
+		store->sort[ i ].key = item->key[ i ];
+		store->sort[ i ].index = i;
+	}
+	
+	sorted = radix_sort_hook_keys( store->sort, store->sort_spare, item->hook_count );
+	
+	/* write the sorted keys and reorder the hook array in place.
+	sorted[ i ].index is the index of the hook that belongs at i. each hook that's out of place is in 
+	a cycle of hooks that have to be moved; the first hook in the cycle is saved, every other hook is 
+	moved to its place, and then the first hook is moved to the last place that was vacated. once a 
+	hook is in place its index is set to its own position so the cycle isn't followed again.
+	*/
+	for( i = 0; i < item->hook_count; ++i )
+	{
+		unsigned j = i;
+		struct hook temp;
+		
+		item->key[ i ] = sorted[ i ].key;
+		
+		if( sorted[ i ].index == i )
+			continue;
+		
+		temp = item->hook[ i ];
+		
+		for( ;; )
+		{
+			const unsigned next = sorted[ j ].index;
+			
+			sorted[ j ].index = j;
+			
+			if( next == i )
+			{
+				item->hook[ j ] = temp;
+				break;
+			}
+			
+			item->hook[ j ] = item->hook[ next ];
+			j = next;
+		}
+	}
+	
+	if( G->config->flags & CFG_DEBUG )
+	{
+		for( i = 1; i < item->hook_count; ++i )
+		{
+			if( compare_hook( &item->hook[ i - 1 ], &item->hook[ i ] ) > 0 )
+			{
+				MSG_ERROR( "The radix sorted hook array is out of order. Sorting with qsort()." );
+				printf( "Hook at index %u:\n", i - 1 );
+				print_hook( &item->hook[ i - 1 ] );
+				printf( "Hook at index %u:\n", i );
+				print_hook( &item->hook[ i ] );
+				
+				qsort( item->hook, item->hook_count, sizeof( *item->hook ), compare_hook );
+				build_hook_keys( item );
+				break;
+			}
+		}
+	}
+	
+	return;
+}
+
+
+
+/* hash_HOOK()
+Hash the bytes of a HOOK struct.
+
+This is FNV-1a applied to each DWORD of the struct instead of each byte. Any padding is hashed as 
+well, which is fine since it's only compared to the hash of the same HOOK in the previous snapshot.
+
+returns the hash
+*/
+static unsigned hash_HOOK( 
+	const HOOK *const object   // in
+)
+{
+	const DWORD *const p = (const DWORD *)object;
+	unsigned hash = 2166136261u;
+	unsigned i = 0;
+	
+	
+	for( i = 0; i < ( sizeof( *object ) / sizeof( *p ) ); ++i )
+	{
+		hash ^= p[ i ];
+		hash *= 16777619u;
+	}
+	
+	return hash;
+}
+
+
+
+/* FNV-1a 64 bit offset basis and prime, for the fingerprint */
+#define HOOK_FINGERPRINT_BASIS   ( ( (unsigned __int64)0xCBF29CE4 << 32 ) | 0x84222325 )
+#define HOOK_FINGERPRINT_PRIME   ( ( (unsigned __int64)1 << 40 ) | 0x1B3 )
+
+/* add_hook_fingerprint()
+Add a HOOK entry and the bytes of its HOOK to a fingerprint.
+
+This is FNV-1a applied to each member of the entry and each DWORD of the HOOK instead of each byte. 
+Every DWORD of the HOOK is folded into the 64 bit fingerprint instead of the HOOK's 32 bit hash, so a 
+collision in hash_HOOK() can't hide a modified HOOK. The entries are added in the order of their 
+index so the same entries always make the same fingerprint.
+
+'fingerprint' is the fingerprint so far, HOOK_FINGERPRINT_BASIS if there isn't one yet
+'index' is the HANDLEENTRY's index in the list of user handles
+'entry' is the HANDLEENTRY for the HOOK
+'object' is the HOOK struct, or a copy of it
+
+returns the fingerprint
+*/
+static unsigned __int64 add_hook_fingerprint( 
+	unsigned __int64 fingerprint,   // in
+	const unsigned index,   // in
+	const HANDLEENTRY *const entry,   // in
+	const HOOK *const object   // in
+)
+{
+	const DWORD *p = NULL;
+	unsigned i = 0;
+	
+	FAIL_IF( !entry );
+	FAIL_IF( !object );
+	
+	
+	fingerprint = ( fingerprint ^ index ) * HOOK_FINGERPRINT_PRIME;
+	fingerprint = ( fingerprint ^ entry->wUniq ) * HOOK_FINGERPRINT_PRIME;
+	fingerprint = ( fingerprint ^ entry->bFlags ) * HOOK_FINGERPRINT_PRIME;
+	fingerprint = ( fingerprint ^ (uintptr_t)entry->pHead ) * HOOK_FINGERPRINT_PRIME;
+	fingerprint = ( fingerprint ^ (uintptr_t)entry->pOwner ) * HOOK_FINGERPRINT_PRIME;
+	
+	p = (const DWORD *)object;
+	for( i = 0; i < ( sizeof( *object ) / sizeof( *p ) ); ++i )
+		fingerprint = ( fingerprint ^ p[ i ] ) * HOOK_FINGERPRINT_PRIME;
+	
+	return fingerprint;
+}
+
+
+
 /* init_desktop_hook_store()
 Initialize the desktop hook store by recording the hooks for each desktop.
 
@@ -490,14 +963,27 @@ The desktop hook store depends on all global stores.
 The spi and gui info from its parent snapshot store is used to identify the threads associated with 
 each hook and is optional.
 
+'previous' is the desktop hook store from the previous snapshot, and is optional. Each HANDLEENTRY 
+and HOOK is compared to the record from the previous store. If neither has changed then 
+hook->unchanged is set, which lets the diff skip comparing the HOOK's fields. Each HOOK is copied 
+from the desktop heap once, and the hash and compare use that copy. The HOOK's hash is only used to 
+reject a changed HOOK early. A copy whose hash matches is compared byte for byte to the previous 
+store's copy, so a hash collision can't hide a change.
+
+Each HOOK entry on an accessible desktop is also added to the store's fingerprint, which 
+is_hook_fingerprint_unchanged() compares to the handle table before the next snapshot.
+
 returns nonzero on success
 */
 int init_desktop_hook_store( 
-	const struct snapshot *const parent   // in
+	const struct snapshot *const parent,   // in
+	const struct desktop_hook_list *const previous   // in, optional
 )
 {
-	unsigned i = 0;
+	unsigned i = 0, j = 0;
+	unsigned entry_count = 0, candidate_count = 0;
 	__int64 first_fail_time = 0;
+	__int64 ticks = 0;
 	struct desktop_hook_list *store = NULL;
 	struct desktop_hook_item *item = NULL;
 	
@@ -519,8 +1005,12 @@ retry:
 	item = NULL;
 	store = parent->desktop_hooks;
 	
-	/* this store is reused. do a soft reset */
+	/* this store is reused. do a soft reset.
+	incrementing the generation invalidates all the records written by the last initialization.
+	*/
 	store->init_time = 0;
+	store->generation++;
+	store->fingerprint = HOOK_FINGERPRINT_BASIS;
 	
 	/* if the desktop hook store does not have a list of desktops yet create it */
 	if( !store->head )
@@ -530,6 +1020,26 @@ retry:
 		/* add the desktops from the global desktop store */
 		for( current = G->desktops->head; current; current = current->next )
 			add_desktop_hook_item( store, current );
+		
+		/* map the global desktop store's sorted heap ranges to their desktop hook items.
+		one extra element so that the allocation is never zero bytes.
+		*/
+		if( store->arena )
+		{
+			store->item_by_range = 
+				arena_calloc( store->arena, G->desktops->range_count + 1, sizeof( *store->item_by_range ) );
+		}
+		else
+		{
+			store->item_by_range = 
+				must_calloc( G->desktops->range_count + 1, sizeof( *store->item_by_range ) );
+		}
+		
+		for( i = 0; i < G->desktops->range_count; ++i )
+		{
+			store->item_by_range[ i ] = 
+				add_desktop_hook_item( store, G->desktops->range[ i ].desktop );
+		}
 	}
 	else // the desktop hook list already exists. reuse it.
 	{
@@ -541,15 +1051,61 @@ retry:
 	}
 	
 	
+	/* the number of handle entries can change. read it once so the scan and the copies agree */
+	entry_count = *G->prog->pcHandleEntries;
+	
+	if( entry_count > store->candidate_max )
+	{
+		free( store->candidate );
+		free( store->record );
+		
+		/* 65536 is the maximum number of user handles. allocate at least that many */
+		store->candidate_max = ( ( entry_count > 65536 ) ? entry_count : 65536 );
+		store->candidate = must_calloc( store->candidate_max, sizeof( *store->candidate ) );
+		store->record = must_calloc( store->candidate_max, sizeof( *store->record ) );
+	}
+	
 	SwitchToThread();
+	
+	ticks = get_timing_ticks( G->timing );
+	
+	/* find the handle entries that are for HOOK objects. if printing every HANDLEENTRY then every 
+	entry is a candidate.
+	*/
+	if( G->config->verbose >= 9 )
+	{
+		for( j = 0; j < entry_count; ++j )
+			store->candidate[ j ] = j;
+		
+		candidate_count = entry_count;
+	}
+	else
+	{
+		candidate_count = scan_handle_table( 
+			store->candidate, 
+			store->candidate_max, 
+			G->prog->pSharedInfo->aheList, 
+			entry_count, 
+			TYPE_HOOK 
+		);
+	}
+	
+	ticks = add_timing( G->timing, TIMING_SCAN, ticks );
+	
 	/* for every handle if it is a HOOK then add it to the desktop's hook array */
-	for( i = 0; i < *G->prog->pcHandleEntries; ++i )
+	for( j = 0; j < candidate_count; ++j )
 	{
 		/* copy the HANDLEENTRY struct from the list of entries in the shared info section.
-		the info may change so it can't just be pointed to.
+		the info may change so it can't just be pointed to. the entry may have changed since the 
+		scan so its type is checked again.
 		*/
-		HANDLEENTRY entry = G->prog->pSharedInfo->aheList[ i ];
+		HANDLEENTRY entry = G->prog->pSharedInfo->aheList[ store->candidate[ j ] ];
 		struct hook *hook = NULL;
+		const struct hook_record *record = NULL;
+		const HOOK *object = NULL;
+		int range = 0;
+		
+		i = store->candidate[ j ];
 		
 		if( G->config->verbose >= 9 )
 		{
@@ -562,15 +1118,14 @@ retry:
 			continue;
 		
 		/* Check to see if the HOOK is located on a desktop we're attached to */
-		for( item = store->head; item; item = item->next )
-		{
-			if( ( (uintptr_t)entry.pHead 
-					< ( (uintptr_t)item->desktop->pDeskInfo->pvDesktopLimit - sizeof( HOOK ) ) 
-				)
-				&& ( (uintptr_t)entry.pHead >= (uintptr_t)item->desktop->pDeskInfo->pvDesktopBase )
-			) /* The HOOK is on an accessible desktop */
-				break;
-		}
+		range = find_desktop_range( 
+			G->desktops->range, 
+			G->desktops->range_count, 
+			(uintptr_t)entry.pHead, 
+			sizeof( HOOK ) 
+		);
+		
+		item = ( ( range >= 0 ) ? store->item_by_range[ range ] : NULL );
 		
 		if( !item ) /* The HOOK is on an inaccessible desktop */
 		{
@@ -594,11 +1149,36 @@ retry:
 		hook->entry_index = i;
 		hook->entry = entry;
 		
-		/* copy the HOOK struct from the desktop heap.
-		the info may change so it can't just be pointed to.
+		/* the HOOK struct in the desktop heap */
+		object = (HOOK *)( (uintptr_t)hook->entry.pHead - (uintptr_t)item->desktop->pvClientDelta );
+		
+		/* copy the HOOK struct. the info may change so it can't just be pointed to. the HOOK is read 
+		from the desktop heap only this once. the hash and the compare below use the copy, so a change 
+		made while the HOOK is read can't make the copy differ from what was compared.
 		*/
-		hook->object = 
-			*(HOOK *)( (uintptr_t)hook->entry.pHead - (uintptr_t)item->desktop->pvClientDelta );
+		hook->object = *object;
+		
+		hook->hash = hash_HOOK( &hook->object );
+		
+		store->fingerprint = add_hook_fingerprint( store->fingerprint, i, &hook->entry, &hook->object );
+		
+		/* if the previous snapshot has a valid record for this index */
+		if( previous 
+			&& previous->init_time 
+			&& ( i < previous->candidate_max ) 
+			&& ( previous->record[ i ].generation == previous->generation ) 
+		)
+			record = &previous->record[ i ];
+		
+		hook->unchanged = ( record 
+			&& ( record->hash == hook->hash )
+			&& ( record->entry.pHead == entry.pHead )
+			&& ( record->entry.pOwner == entry.pOwner )
+			&& ( record->entry.bType == entry.bType )
+			&& ( record->entry.bFlags == entry.bFlags )
+			&& ( record->entry.wUniq == entry.wUniq )
+			&& !memcmp( &record->hook->object, &hook->object, sizeof( hook->object ) )
+		);
 		
 		/* search the gui threads to find the owner origin and target of the HOOK.
 		the HANDLEENTRY and HOOK must be copied before calling find_Win32ThreadInfo()
@@ -630,17 +1210,14 @@ retry:
 		}
 	}
 	
+	ticks = add_timing( G->timing, TIMING_COPY, ticks );
+	
 	
 	/* sort the hook array for each desktop according to its position in the heap */
 	for( item = store->head; item; item = item->next )
 	{
-		/* sort according to HANDLEENTRY's entry.pHead */
-		qsort( 
-			item->hook, 
-			item->hook_count, 
-			sizeof( *item->hook ), 
-			compare_hook
-		);
+		/* sort according to HANDLEENTRY's entry.pHead. this also builds the hook key array */
+		sort_hook_array( store, item );
 		
 		/* search for invalid or duplicate entry.pHead */
 		for( i = 1; i < item->hook_count; ++i )
@@ -686,7 +1263,7 @@ retry:
 					)
 					MSG_WARNING( "Duplicate pHead detected. Retrying..." );
 
-				if( G->config->polling != 0 )
+				if( ( G->config->polling != 0 ) || G->config->polling_ms )
 					Sleep( 1 ); // so as not to suck up cpu
 
 				goto retry;
@@ -716,6 +1293,25 @@ retry:
 		}
 	}
 	
+	/* record each hook by its HANDLEENTRY index for the next snapshot. 
+	the hook array has been sorted so this must be done last.
+	*/
+	for( item = store->head; item; item = item->next )
+	{
+		for( i = 0; i < item->hook_count; ++i )
+		{
+			const struct hook *const hook = &item->hook[ i ];
+			struct hook_record *const record = &store->record[ hook->entry_index ];
+			
+			record->entry = hook->entry;
+			record->hash = hook->hash;
+			record->generation = store->generation;
+			record->hook = hook;
+		}
+	}
+	
+	add_timing( G->timing, TIMING_SORT, ticks );
+	
 	
 	/* the desktop hook store has been initialized */
 	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
@@ -724,6 +1320,215 @@ retry:
 
 
 
+/* is_hook_fingerprint_unchanged()
+Check whether the HOOKs are the same as when a desktop hook store was initialized.
+
+The handle table is scanned for HOOK entries, and each entry on an accessible desktop is added to a 
+fingerprint with the bytes of its HOOK, the same way init_desktop_hook_store() adds the hooks it 
+records. If the fingerprint is the same as the store's then no HOOK has been added, removed or 
+modified since the store was initialized and another snapshot would have the same hooks. This 
+doesn't traverse any threads, so it's much cheaper than taking a snapshot.
+
+The store's candidate array is used to scan the handle table. The store's hooks and records are not 
+modified.
+
+returns nonzero if the fingerprint is the same. if the store isn't initialized, or every HANDLEENTRY 
+is printed at verbosity level 9, this function returns zero.
+*/
+int is_hook_fingerprint_unchanged( 
+	struct desktop_hook_list *const store   // in, out
+)
+{
+	unsigned j = 0;
+	unsigned entry_count = 0, candidate_count = 0;
+	unsigned __int64 fingerprint = HOOK_FINGERPRINT_BASIS;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->desktops->init_time );   // The desktop store must be initialized.
+	
+	FAIL_IF( !store );
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( !store->init_time || ( G->config->verbose >= 9 ) )
+		return FALSE;
+	
+	/* if the handle table has grown past the candidate array then the next snapshot grows it */
+	entry_count = *G->prog->pcHandleEntries;
+	if( entry_count > store->candidate_max )
+		return FALSE;
+	
+	candidate_count = scan_handle_table( 
+		store->candidate, 
+		store->candidate_max, 
+		G->prog->pSharedInfo->aheList, 
+		entry_count, 
+		TYPE_HOOK 
+	);
+	
+	for( j = 0; j < candidate_count; ++j )
+	{
+		const unsigned i = store->candidate[ j ];
+		const HANDLEENTRY entry = G->prog->pSharedInfo->aheList[ i ];
+		const struct desktop_hook_item *item = NULL;
+		int range = 0;
+		
+		
+		if( entry.bType != TYPE_HOOK )
+			continue;
+		
+		/* only the HOOKs on desktops we're attached to are recorded */
+		range = find_desktop_range( 
+			G->desktops->range, 
+			G->desktops->range_count, 
+			(uintptr_t)entry.pHead, 
+			sizeof( HOOK ) 
+		);
+		
+		item = ( ( range >= 0 ) ? store->item_by_range[ range ] : NULL );
+		
+		if( !item )
+			continue;
+		
+		fingerprint = add_hook_fingerprint( fingerprint, i, &entry, 
+			(HOOK *)( (uintptr_t)entry.pHead - (uintptr_t)item->desktop->pvClientDelta ) 
+		);
+	}
+	
+	return ( fingerprint == store->fingerprint );
+}
+
+
+
+/* the number of THREADINFOs a hook has: its owner, origin and target */
+#define HOOK_THREAD_COUNT   3
+
+/* get_unfound_hook_thread()
+Get one of a hook's owner, origin or target THREADINFOs if it wasn't found in the gui array.
+
+'n' is 0 for the owner, 1 for the origin and 2 for the target.
+
+returns the THREADINFO, or NULL if the hook doesn't have it or it was found
+*/
+static const void *get_unfound_hook_thread( 
+	const struct hook *const hook,   // in
+	const unsigned n   // in
+)
+{
+	FAIL_IF( !hook );
+	FAIL_IF( n >= HOOK_THREAD_COUNT );
+	
+	
+	if( ( n == 0 ) && !hook->owner )
+		return hook->entry.pOwner;
+	else if( ( n == 1 ) && !hook->origin )
+		return hook->object.pti;
+	else if( ( n == 2 ) && !hook->target )
+		return hook->object.ptiHooked;
+	else
+		return NULL;
+}
+
+
+
+/* is_hook_thread_missing()
+Check whether a new or changed hook's thread can't be any thread in the parent snapshot's spi array.
+
+A hook's owner, origin and target are THREADINFOs. Each should be a GUI thread in the parent 
+snapshot's gui array. One that wasn't found is either a thread in the spi array that wasn't read 
+(eg its process couldn't be opened) or a thread that isn't in the spi array at all because it was 
+created after the thread info was queried. Only the second is found by querying again. A THREADINFO 
+can't be matched to a thread that wasn't read, so if there are more different THREADINFOs that 
+weren't found than threads that weren't read then at least one isn't in the spi array.
+
+This is only checked if a hook that's new or changed since the previous snapshot has a THREADINFO 
+that wasn't found. Otherwise a thread that isn't found (eg it has exited) would have the threads 
+queried again every snapshot.
+
+'unread_count' is the number of threads in the spi array that may be GUI threads but weren't read
+
+returns nonzero if a new or changed hook's thread may be missing from the spi array
+*/
+int is_hook_thread_missing( 
+	const struct desktop_hook_list *const store,   // in
+	const unsigned unread_count   // in
+)
+{
+	const struct desktop_hook_item *item = NULL;
+	const void **seen = NULL;
+	unsigned seen_count = 0, unfound_count = 0;
+	int is_new = FALSE, is_missing = FALSE;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The desktop hook store must be initialized.
+	
+	
+	/* count the THREADINFOs that weren't found, and whether a new or changed hook has one */
+	for( item = store->head; item; item = item->next )
+	{
+		unsigned i = 0, n = 0;
+		
+		
+		for( i = 0; i < item->hook_count; ++i )
+		{
+			for( n = 0; n < HOOK_THREAD_COUNT; ++n )
+			{
+				if( !get_unfound_hook_thread( &item->hook[ i ], n ) )
+					continue;
+				
+				++unfound_count;
+				
+				if( !item->hook[ i ].unchanged )
+					is_new = TRUE;
+			}
+		}
+	}
+	
+	if( !is_new || ( unfound_count <= unread_count ) )
+		return FALSE;
+	
+	/* the same THREADINFO is usually in more than one hook. count the different ones until there 
+	are more than the threads that weren't read.
+	*/
+	seen = must_calloc( unread_count + 1, sizeof( *seen ) );
+	
+	for( item = store->head; item && !is_missing; item = item->next )
+	{
+		unsigned i = 0, n = 0, j = 0;
+		
+		
+		for( i = 0; ( i < item->hook_count ) && !is_missing; ++i )
+		{
+			for( n = 0; ( n < HOOK_THREAD_COUNT ) && !is_missing; ++n )
+			{
+				const void *const thread = get_unfound_hook_thread( &item->hook[ i ], n );
+				
+				
+				if( !thread )
+					continue;
+				
+				for( j = 0; ( j < seen_count ) && ( seen[ j ] != thread ); ++j )
+					;
+				
+				if( j < seen_count )
+					continue;
+				
+				if( seen_count == unread_count )
+					is_missing = TRUE;
+				else
+					seen[ seen_count++ ] = thread;
+			}
+		}
+	}
+	
+	free( seen );
+	return is_missing;
+}
+
+
+
 /* print_hook_anomalies()
 Print any anomalies found in a hook struct.
 
@@ -738,20 +1543,20 @@ void print_hook_anomalies(
 	
 	if( hook->entry.pHead && hook->object.pSelf && ( hook->entry.pHead != hook->object.pSelf ) )
 	{
-		printf( "ERROR: The HOOK's pointer to itself is incorrect.\n" );
-		PRINT_HEX( hook->entry.pHead );
-		PRINT_HEX( hook->object.pSelf );
+		output_printf( "ERROR: The HOOK's pointer to itself is incorrect.\n" );
+		OUTPUT_HEX( hook->entry.pHead );
+		OUTPUT_HEX( hook->object.pSelf );
 	}
 	
 	print_HOOK_anomalies( &hook->object );
 	
 	if( ( hook->object.flags & HF_GLOBAL ) && hook->target )
 	{
-		printf( "ERROR: The global HOOK " );
-		PRINT_HEX_BARE( hook->object.head.h );
-		printf( " @ " );
-		PRINT_HEX_BARE( hook->entry.pHead );
-		printf( " has a target address even though global HOOKs aren't supposed to have them.\n" );
+		output_printf( "ERROR: The global HOOK " );
+		OUTPUT_HEX_BARE( hook->object.head.h );
+		output_printf( " @ " );
+		OUTPUT_HEX_BARE( hook->entry.pHead );
+		output_printf( " has a target address even though global HOOKs aren't supposed to have them.\n" );
 	}
 	
 	if( hook->entry.pHead ) // there is a HANDLEENTRY for this HOOK
@@ -760,11 +1565,11 @@ void print_hook_anomalies(
 			|| ( ( (DWORD)hook->object.head.h >> 16 ) != hook->entry.wUniq )
 		)
 		{
-			printf( "ERROR: The handle check failed for HOOK handle " );
-			PRINT_HEX_BARE( hook->object.head.h );
-			printf( " @ " );
-			PRINT_HEX_BARE( hook->entry.pHead );
-			printf( ".\n" );
+			output_printf( "ERROR: The handle check failed for HOOK handle " );
+			OUTPUT_HEX_BARE( hook->object.head.h );
+			output_printf( " @ " );
+			OUTPUT_HEX_BARE( hook->entry.pHead );
+			output_printf( ".\n" );
 		}
 	}
 	
@@ -791,6 +1596,8 @@ void print_hook(
 	PRINT_SEP_BEGIN( objname );
 	
 	printf( "hook->ignore: %s\n", ( hook->ignore ? "TRUE" : "FALSE" ) );
+	printf( "hook->unchanged: %s\n", ( hook->unchanged ? "TRUE" : "FALSE" ) );
+	printf( "hook->hash: 0x%08X\n", hook->hash );
 	
 	printf( "\nhook->entry_index: %u\n", hook->entry_index );
 	print_HANDLEENTRY( &hook->entry );
@@ -947,6 +1754,8 @@ static void free_desktop_hook_item(
 	if( !in || !*in )
 		return;
 	
+	free( (*in)->key );
+	
 	free( (*in)->hook );
 	
 	free( (*in) );
@@ -973,7 +1782,8 @@ void free_desktop_hook_store(
 	if( !in || !*in )
 		return;
 	
-	if( (*in)->head )
+	/* the items and item_by_range are freed with the arena they were allocated from */
+	if( (*in)->head && !(*in)->arena )
 	{
 		struct desktop_hook_item *current = NULL, *p = NULL;
 		
@@ -985,6 +1795,17 @@ void free_desktop_hook_store(
 		}
 	}
 	
+	if( !(*in)->arena )
+		free( (*in)->item_by_range );
+	
+	free( (*in)->candidate );
+	
+	free( (*in)->record );
+	
+	free( (*in)->sort );
+	
+	free( (*in)->sort_spare );
+	
 	free( (*in) );
 	*in = NULL;
 	
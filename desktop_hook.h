@@ -29,6 +29,9 @@ along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
 /* desktop store (linked list of desktops' heap and thread info) */
 #include "desktop.h"
 
+/* arena store (memory allocated in order and released all at once) */
+#include "arena.h"
+
 /* snapshot store (system process info, gui threads, desktop hooks) */
 #include "snapshot.h"
 
@@ -62,6 +65,14 @@ struct hook
 	/* a copy of the HOOK struct */
 	HOOK object;
 	
+	/* a hash of the bytes of the copy of the HOOK struct */
+	unsigned hash;
+	
+	/* nonzero if the HANDLEENTRY and the HOOK are the same as they were in the previous snapshot. 
+	the HOOK was compared byte for byte to the previous snapshot's copy.
+	*/
+	unsigned unchanged;
+	
 	/* the thread that owns the handle entry to the HOOK */
 	const struct gui *owner;
 	
@@ -74,6 +85,57 @@ struct hook
 
 
 
+/** The sort key of a hook struct.
+The key packs the members of a hook struct that compare_hook() compares into 128 bits, so that 
+hooks can be compared by their keys alone without reading the rest of the hook struct.
+
+'hi' is the HANDLEENTRY's pHead.
+'lo' is the HANDLEENTRY's index in the high 32 bits and the HOOK's handle in the low 32 bits. USER 
+handles are 32 bit values that are sign extended on 64 bit Windows, so truncating them keeps their 
+order.
+*/
+struct hook_key
+{
+	unsigned __int64 hi;
+	unsigned __int64 lo;
+};
+
+
+
+/** This is an element of the arrays that the hook keys are radix sorted in.
+'index' is the index in the unsorted hook array of the hook that 'key' was made from.
+*/
+struct hook_sort
+{
+	struct hook_key key;
+	unsigned index;
+};
+
+
+
+/** This is the info recorded for each HANDLEENTRY that was for a HOOK in a snapshot.
+The records are indexed by the HANDLEENTRY's index in the list of user handles, so the next 
+snapshot can check whether an entry has changed without searching.
+*/
+struct hook_record
+{
+	/* a copy of the HANDLEENTRY struct for the HOOK */
+	HANDLEENTRY entry;
+	
+	/* the hash of the HOOK struct */
+	unsigned hash;
+	
+	/* the generation of the desktop hook store when this record was written.
+	the record is valid only if this is the same as the store's current generation.
+	*/
+	unsigned generation;
+	
+	/* the hook in the desktop hook store */
+	const struct hook *hook;
+};
+
+
+
 /** This is the info needed for each item in the desktop hook list.
 Each item has information on a desktop and its hooks.
 */
@@ -87,13 +149,19 @@ struct desktop_hook_item
 	/** an array of hook structs. these are the hooks on desktop.
 	*/
 	/* the hook array */
-	struct hook *hook;   // calloc(), free()
+	struct hook *hook;   // calloc(), free() or arena_alloc()
+	
+	/* the hook key array. key[ i ] is the sort key of hook[ i ]. the hooks are compared by their 
+	keys when two snapshots are diffed, and the hook array is only read when the keys match or a 
+	hook is added or removed.
+	*/
+	struct hook_key *key;   // calloc(), free() or arena_alloc()
 	
-	/* the allocated/maximum number of elements in the hook array */
+	/* the allocated/maximum number of elements in the hook array and the hook key array */
 	unsigned hook_max;
 	
 	/* how many handle entries for HOOK objects were found.
-	this is also the number of elements written to in the hook array.
+	this is also the number of elements written to in the hook array and the hook key array.
 	*/
 	unsigned hook_count;
 	
@@ -113,11 +181,53 @@ struct desktop_hook_list
 	/* linked list of desktop_hook_item.
 	this is a pointer to the first item in the desktop hook list.
 	*/
-	struct desktop_hook_item *head;   // items calloc'd. the list is freed when the store is freed.
+	struct desktop_hook_item *head;   // items calloc'd or arena_calloc'd. freed with the store.
 	
 	/* the last item in the desktop hook list */
 	struct desktop_hook_item *tail;
 	
+	/* an array of pointers to the items in the list, in the same order as the global desktop 
+	store's range array. this maps a desktop heap found by find_desktop_range() to its item.
+	*/
+	struct desktop_hook_item **item_by_range;   // calloc(), free() or arena_calloc()
+	
+	/* the arena that the desktop hook items, their hook arrays and item_by_range are allocated from. 
+	this is the parent snapshot store's arena. if this is NULL they're allocated from the heap.
+	*/
+	struct arena *arena;
+	
+	/* the indexes of the handle entries that were for HOOK objects when the handle table was last 
+	scanned. this is written by scan_handle_table().
+	*/
+	unsigned *candidate;   // calloc(), free()
+	
+	/* the allocated number of elements in the candidate array */
+	unsigned candidate_max;
+	
+	/* an array of hook records indexed by HANDLEENTRY index.
+	the allocated number of elements is the same as candidate_max.
+	*/
+	struct hook_record *record;   // calloc(), free()
+	
+	/* the arrays that sort_hook_array() radix sorts the hook keys in. the sorted keys end up in one 
+	or the other depending on how many passes were needed.
+	*/
+	struct hook_sort *sort;   // calloc(), free()
+	struct hook_sort *sort_spare;   // calloc(), free()
+	
+	/* the allocated number of elements in the sort array and the spare sort array */
+	unsigned sort_max;
+	
+	/* incremented each time the store is initialized. a record is only valid if its generation is 
+	the same as this generation.
+	*/
+	unsigned generation;
+	
+	/* a fingerprint of the HOOK entries in the handle table and the HOOKs they point to when this 
+	store was initialized. see is_hook_fingerprint_unchanged().
+	*/
+	unsigned __int64 fingerprint;
+	
 	/* the desktop list type */
 	//enum desktop_hook_type type;
 	
@@ -133,7 +243,8 @@ struct desktop_hook_list
 these functions are documented in the comment block above their definitions in desktop_hook.c
 */
 void create_desktop_hook_store( 
-	struct desktop_hook_list **const out   // out deref
+	struct desktop_hook_list **const out,   // out deref
+	struct arena *const arena   // in, optional
 );
 
 int match_hook_process_name(
@@ -164,8 +275,37 @@ int compare_hook(
 	const void *const p2   // in
 );
 
+void get_hook_key( 
+	const struct hook *const hook,   // in
+	struct hook_key *const key   // out
+);
+
+int compare_hook_key( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+void build_hook_keys( 
+	struct desktop_hook_item *const item   // in, out
+);
+
+void sort_hook_array( 
+	struct desktop_hook_list *const store,   // in, out
+	struct desktop_hook_item *const item   // in, out
+);
+
 int init_desktop_hook_store( 
-	const struct snapshot *const parent   // in
+	const struct snapshot *const parent,   // in
+	const struct desktop_hook_list *const previous   // in, optional
+);
+
+int is_hook_fingerprint_unchanged( 
+	struct desktop_hook_list *const store   // in, out
+);
+
+int is_hook_thread_missing( 
+	const struct desktop_hook_list *const store,   // in
+	const unsigned unread_count   // in
 );
 
 void print_hook_anomalies(
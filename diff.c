@@ -22,12 +22,22 @@ along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
 This file contains functions for comparing two snapshots for differences in hook information.
 Each function is documented in the comment block above its definition.
 
+Comparing two snapshots makes an array of diff events (HOOKs found, added, removed or modified and 
+which of their fields changed) in a diff event store that is reused for each comparison. Printing 
+the HOOK notices is one consumer of the events and is separate from the comparison.
+
 -
 print_unknown_address()
 
 Print a pointed to address as unknown. No newline.
 -
 
+-
+set_hook_notice_time()
+
+Set the time printed in each hook [begin] header instead of the current time.
+-
+
 -
 print_brief_thread_info()
 
@@ -46,34 +56,88 @@ print_hook_notice_end()
 Helper function to print a hook [end] header.
 -
 
+-
+is_gui_diff()
+
+Compare two gui structs for any significant differences. Helper function for get_diff_hook_fields()
+-
+
 -
 print_diff_gui()
 
-Compare two gui structs and print any significant differences. Helper function for print_diff_hook()
+Print the old and new gui thread info of a modified HOOK. Helper function for print_diff_event()
 -
 
 -
-print_diff_hook()
+create_diff_event_store()
 
-Compare two hook structs, both for the same HOOK object, and print any significant differences.
+Create a diff event store and its descendants or die.
 -
 
 -
-print_diff_desktop_hook_items()
+add_diff_event()
 
-Print the HOOKs that have been added/removed/modified from a single desktop between snapshots.
+Append a diff event to a diff event store or die.
 -
 
 -
-print_diff_desktop_hook_lists()
+init_HOOK_compare_masks()
 
-Print the HOOKs that have been added/removed/modified from all desktops between snapshots.
+Initialize the masks for the word by word compare of two HOOKs. Helper function for is_same_HOOK()
+-
+
+-
+is_same_HOOK()
+
+Check whether the HANDLEENTRY and HOOK of two hook structs have the same fields.
+-
+
+-
+get_diff_HOOK_fields()
+
+Compare the HANDLEENTRY and HOOK of two hook structs field by field.
+-
+
+-
+get_diff_hook_fields()
+
+Compare two hook structs, both for the same HOOK object, for any significant differences.
+-
+
+-
+diff_desktop_hook_items()
+
+Add diff events for the HOOKs that have been added/removed/modified from a single desktop.
+-
+
+-
+diff_desktop_hook_lists()
+
+Get the diff events for the HOOKs that have been added/removed/modified from all desktops.
+-
+
+-
+diff_initial_desktop_hook_list()
+
+Get the diff events for the HOOKs that have been found on all desktops in an initial snapshot.
+-
+
+-
+print_diff_event()
+
+Print a diff event as a HOOK notice.
+-
+
+-
+print_diff_events()
+
+Print each diff event in a diff event store as a HOOK notice.
 -
 
 -
-print_initial_desktop_hook_item()
+print_diff_desktop_hook_lists()
 
-Print the HOOKs that have been found on a single desktop in an initial snapshot.
+Print the HOOKs that have been added/removed/modified from all desktops between snapshots.
 -
 
 -
@@ -82,9 +146,23 @@ print_initial_desktop_hook_list()
 Print the HOOKs that have been found on all desktops in an initial snapshot.
 -
 
+-
+print_diff_event_store()
+
+Print a diff event store.
+-
+
+-
+free_diff_event_store()
+
+Free a diff event store and all its descendants.
+-
+
 */
 
 #include <stdio.h>
+#include <limits.h>
+#include <stddef.h>
 
 #include "util.h"
 
@@ -92,23 +170,45 @@ Print the HOOKs that have been found on all desktops in an initial snapshot.
 
 #include "diff.h"
 
+#include "output.h"
+
 /* the global stores */
 #include "global.h"
 
 
 
+/* the utc time in FILETIME format to print in each hook [begin] header.
+if this is zero then the current time is printed.
+*/
+static __int64 hook_notice_time;
+
+/* the number of words in a HOOK */
+#define HOOK_WORD_COUNT   ( sizeof( HOOK ) / sizeof( size_t ) )
+
+/* the masks of the HOOK fields compared by is_same_HOOK(), with and without the lock count.
+see init_HOOK_compare_masks()
+*/
+static size_t hook_compare_mask[ 2 ][ HOOK_WORD_COUNT ];
+static int hook_compare_mask_init;
+
 static void print_unknown_address(
 	const void *const address   // in, optional
 );
 
-static int print_diff_gui(
+static int is_gui_diff(
 	const struct hook *const oldhook,   // in
 	const struct hook *const newhook,   // in
-	const enum threadtype threadtype,   // in
-	const WCHAR *const deskname,   // in
-	unsigned *const modified_header   // in, out
+	const enum threadtype threadtype   // in
+);
+
+static void print_diff_gui(
+	const struct hook *const oldhook,   // in
+	const struct hook *const newhook,   // in
+	const enum threadtype threadtype   // in
 );
 
+static void init_HOOK_compare_masks( void );
+
 
 
 /* print_unknown_address()
@@ -125,9 +225,28 @@ static void print_unknown_address(
 	const void *const address   // in, optional
 )
 {
-	printf( " <unknown> (<unknown> @ " );
-	PRINT_HEX_BARE( address );
-	printf( ")" );
+	output_printf( " <unknown> (<unknown> @ " );
+	OUTPUT_HEX_BARE( address );
+	output_printf( ")" );
+	
+	return;
+}
+
+
+
+/* set_hook_notice_time()
+Set the time printed in each hook [begin] header instead of the current time.
+
+When snapshots are replayed from a file the time a HOOK was found or changed is the time its 
+snapshot was taken, not the time the notice is printed.
+
+'utc' is the utc time in FILETIME format. if it's zero then the current time is printed.
+*/
+void set_hook_notice_time( 
+	const __int64 utc   // in
+)
+{
+	hook_notice_time = utc;
 	
 	return;
 }
@@ -148,7 +267,7 @@ void print_brief_thread_info(
 	
 	if( threadtype == THREAD_OWNER )
 	{
-		printf( "Owner: " );
+		output_printf( "Owner: " );
 		
 		if( hook->owner )
 			print_gui_brief( hook->owner );
@@ -157,7 +276,7 @@ void print_brief_thread_info(
 	}
 	else if( threadtype == THREAD_ORIGIN )
 	{
-		printf( "Origin: " );
+		output_printf( "Origin: " );
 		
 		if( hook->origin )
 			print_gui_brief( hook->origin );
@@ -166,10 +285,10 @@ void print_brief_thread_info(
 	}
 	else if( threadtype == THREAD_TARGET )
 	{
-		printf( "Target: " );
+		output_printf( "Target: " );
 		
 		if( hook->object.flags & HF_GLOBAL )
-			printf( "<GLOBAL> " );
+			output_printf( "<GLOBAL> " );
 		
 		if( hook->target )
 			print_gui_brief( hook->target );
@@ -183,7 +302,7 @@ void print_brief_thread_info(
 		exit( 1 );
 	}
 	
-	printf( "\n" );
+	output_printf( "\n" );
 	
 	return;
 }
@@ -211,8 +330,8 @@ void print_hook_notice_begin(
 	
 	
 	//PRINT_SEP_BEGIN( "" );
-	printf( "\n" );
-	printf( "----------------------------------------------------------------------------[b]\n" );
+	output_printf( "\n" );
+	output_printf( "----------------------------------------------------------------------------[b]\n" );
 	
 	if( difftype == HOOK_FOUND )
 		diffname = "Found";
@@ -230,53 +349,53 @@ void print_hook_notice_begin(
 	}
 	
 	
-	printf( "[%s]", diffname );
+	output_printf( "[%s]", diffname );
 	
-	printf( " [HOOK 0x%08I64X @ ", (UINT64)( *(UINT_PTR *)&hook->object.head.h ) );
+	output_printf( " [HOOK 0x%08I64X @ ", (UINT64)( *(UINT_PTR *)&hook->object.head.h ) );
 	if( hook->entry.pHead )
-		PRINT_HEX_BARE( hook->entry.pHead );
+		OUTPUT_HEX_BARE( hook->entry.pHead );
 	else
-		printf( "<unknown>" );
-	printf( "]" );
+		output_printf( "<unknown>" );
+	output_printf( "]" );
 	
-	printf( " [" );
-	print_time();
-	printf( "]" );
+	output_printf( " [" );
+	print_time( hook_notice_time );
+	output_printf( "]" );
 	
-	printf( "\n" );
+	output_printf( "\n" );
 	
 	print_hook_anomalies( hook );
 	
-	printf( "\n" );
+	output_printf( "\n" );
 	
 	
-	printf( "Id: " );
+	output_printf( "Id: " );
 	print_HOOK_id( hook->object.iHook );
-	printf( "\n" );
+	output_printf( "\n" );
 	
 	//printf( "%p, %p, %p\n", hook->owner, hook->origin, hook->target );
 	
 	if( hook->object.flags )
 	{
-		printf( "Flags: " );
+		output_printf( "Flags: " );
 		print_HOOK_flags( hook->object.flags );
-		printf( "\n" );
+		output_printf( "\n" );
 	}
 	
 	if( hook->object.head.cLockObj )
-		printf( "Lock count: %u\n", hook->object.head.cLockObj );
+		output_printf( "Lock count: %u\n", hook->object.head.cLockObj );
 	
 	/* exactly what rpdesk2 does is unclear */
 	if( hook->object.rpdesk2 )
 	{
-		PRINT_HEX_NAME( "rpdesk1", hook->object.rpdesk1 );
+		OUTPUT_HEX_NAME( "rpdesk1", hook->object.rpdesk1 );
 		
-		printf( "rpdesk2: " );
-		PRINT_HEX_BARE( hook->object.rpdesk2 );
-		printf( " (HOOK faulted? chain faulted? locked? owner destroyed?)\n" );
+		output_printf( "rpdesk2: " );
+		OUTPUT_HEX_BARE( hook->object.rpdesk2 );
+		output_printf( " (HOOK faulted? chain faulted? locked? owner destroyed?)\n" );
 	}
 	
-	printf( "Desktop: %ls\n", deskname );
+	output_printf( "Desktop: %ls\n", deskname );
 	
 	/**
 	When the desktop hook store is initialized this program matches the Win32ThreadInfo kernel 
@@ -295,13 +414,13 @@ void print_hook_notice_begin(
 	if( ( hook->owner == hook->origin ) && ( hook->entry.pOwner == hook->object.pti ) )
 	{
 		// owner and origin have the same user mode info and kernel address and will be consolidated
-		printf( "Owner/" );
+		output_printf( "Owner/" );
 		
 		if( ( hook->owner == hook->target ) 
 			&& ( hook->entry.pOwner == hook->object.ptiHooked ) 
 			&& !( hook->object.flags & HF_GLOBAL )
 		)  // the owner/origin is the same as the target and will be further consolidated
-			printf( "Origin/" );
+			output_printf( "Origin/" );
 		else // the owner/origin info or address must be on a separate line from the target
 			print_brief_thread_info( hook, THREAD_ORIGIN );
 	}
@@ -324,7 +443,7 @@ void print_hook_notice_begin(
 		print_hook( hook ); // this calls print_HOOK()
 	
 	if( difftype == HOOK_MODIFIED )
-		printf( "\n" );
+		output_printf( "\n" );
 	
 	return;
 }
@@ -337,34 +456,25 @@ Helper function to print a hook [end] header.
 void print_hook_notice_end( void )
 {
 	//PRINT_SEP_END( "" );
-	printf( "----------------------------------------------------------------------------[e]\n" );
-	fflush( stdout );
+	output_printf( "----------------------------------------------------------------------------[e]\n" );
 	return;
 }
 
 
 
-/* print_diff_gui()
-Compare two gui structs and print any significant differences. Helper function for print_diff_hook()
+/* is_gui_diff()
+Compare two gui structs for any significant differences. Helper function for get_diff_hook_fields()
 
 'oldhook' is the old hook info
 'newhook' is the new hook info
 'threadtype' is the gui thread info in the hook struct to compare eg THREAD_TARGET (hook->target)
-'deskname' is the name of the desktop the hook is on
-
-'*modified_header' receives nonzero if the "Modified HOOK" header is printed by this function.
-the header is printed before any difference in the gui structs has been printed.
-if '*modified_header' is nonzero when this function is called then the header was already printed.
 
-returns nonzero if any difference was printed. 
-if this function returns nonzero then '*modified_header' is also nonzero.
+returns nonzero if there is any significant difference.
 */
-static int print_diff_gui(
+static int is_gui_diff(
 	const struct hook *const oldhook,   // in
 	const struct hook *const newhook,   // in
-	const enum threadtype threadtype,   // in
-	const WCHAR *const deskname,   // in
-	unsigned *const modified_header   // in, out
+	const enum threadtype threadtype   // in
 )
 {
 	/* oldhook's gui thread owner, origin, or target */
@@ -373,8 +483,6 @@ static int print_diff_gui(
 	/* newhook's gui thread owner, origin, or target */
 	const struct gui *b = NULL;
 	
-	const char *threadname = NULL;
-	
 	WCHAR empty1[] = L"<unknown>";
 	WCHAR empty2[] = L"<unknown>";
 	
@@ -405,25 +513,20 @@ static int print_diff_gui(
 	FAIL_IF( !oldhook );
 	FAIL_IF( !newhook );
 	FAIL_IF( !threadtype );
-	FAIL_IF( !deskname );
-	FAIL_IF( !modified_header );
 	
 	
 	if( threadtype == THREAD_OWNER )
 	{
-		threadname = "owner";
 		a = oldhook->owner;
 		b = newhook->owner;
 	}
 	else if( threadtype == THREAD_ORIGIN )
 	{
-		threadname = "origin";
 		a = oldhook->origin;
 		b = newhook->origin;
 	}
 	else if( threadtype == THREAD_TARGET )
 	{
-		threadname = "target";
 		a = oldhook->target;
 		b = newhook->target;
 	}
@@ -511,294 +614,357 @@ static int print_diff_gui(
 	)
 		return FALSE;
 	
+	return TRUE;
+}
+
+
+
+/* print_diff_gui()
+Print the old and new gui thread info of a modified HOOK. Helper function for print_diff_event()
+
+'oldhook' is the old hook info
+'newhook' is the new hook info
+'threadtype' is the gui thread info in the hook struct that changed eg THREAD_TARGET (hook->target)
+*/
+static void print_diff_gui(
+	const struct hook *const oldhook,   // in
+	const struct hook *const newhook,   // in
+	const enum threadtype threadtype   // in
+)
+{
+	const char *threadname = NULL;
+	
+	FAIL_IF( !oldhook );
+	FAIL_IF( !newhook );
+	FAIL_IF( !threadtype );
+	
 	
-	/* If the modified header has not yet been printed by another function then print it.
-	if !*modified_header then this gui diff is the first encountered between the two hook structs.
-	*/
-	if( !*modified_header )
+	if( threadtype == THREAD_OWNER )
+		threadname = "owner";
+	else if( threadtype == THREAD_ORIGIN )
+		threadname = "origin";
+	else if( threadtype == THREAD_TARGET )
+		threadname = "target";
+	else
 	{
-		print_hook_notice_begin( newhook, deskname, HOOK_MODIFIED );
-		*modified_header = TRUE;
+		MSG_FATAL( "Unknown thread type." );
+		printf( "threadtype: %d\n", threadtype );
+		exit( 1 );
 	}
 	
+	output_printf( "\nThe associated gui %s thread information has changed.\n", threadname );
 	
-	printf( "\nThe associated gui %s thread information has changed.\n", threadname );
-	
-	printf( "Old " );
+	output_printf( "Old " );
 	print_brief_thread_info( oldhook, threadtype );
 	
-	printf( "New " );
+	output_printf( "New " );
 	print_brief_thread_info( newhook, threadtype );
 	
+	return;
+}
+
+
+
+/* create_diff_event_store()
+Create a diff event store and its descendants or die.
+*/
+void create_diff_event_store( 
+	struct diff_event_list **const out   // out deref
+)
+{
+	struct diff_event_list *store = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
 	
-	return TRUE;
+	
+	/* allocate a diff event store */
+	store = must_calloc( 1, sizeof( *store ) );
+	
+	/* allocate the array of diff events. it grows as needed. */
+	store->event_max = 256;
+	store->event = must_calloc( store->event_max, sizeof( *store->event ) );
+	
+	
+	*out = store;
+	return;
 }
 
 
 
-/* print_diff_hook()
-Compare two hook structs, both for the same HOOK object, and print any significant differences.
+/* add_diff_event()
+Append a diff event to a diff event store or die.
 
-'a' is the old hook info
-'b' is the new hook info
-'deskname' is the name of the desktop the HOOK is on
+The array of events is grown as needed and is not shrunk, so once it's large enough for the events 
+between two snapshots it's reused without any allocation.
 
-returns nonzero if any difference was printed. 
+'store' is the diff event store
+'type' is the diff type
+'fields' is the DIFF_* bitmask of the fields that changed. zero unless 'type' is HOOK_MODIFIED.
+'a' is the old hook info. NULL if 'type' is HOOK_FOUND or HOOK_ADDED.
+'b' is the new hook info. NULL if 'type' is HOOK_REMOVED.
+'deskname' is the name of the desktop the HOOK is on
 */
-int print_diff_hook( 
-	const struct hook *const a,   // in
-	const struct hook *const b,   // in
+void add_diff_event( 
+	struct diff_event_list *const store,   // in
+	const enum difftype type,   // in
+	const unsigned fields,   // in
+	const struct hook *const a,   // in, optional
+	const struct hook *const b,   // in, optional
 	const WCHAR *const deskname   // in
 )
 {
-	/* modified_header is set nonzero if/when the "Modified HOOK" header has been printed */
-	unsigned modified_header = FALSE;
+	struct diff_event *event = NULL;
 	
-	FAIL_IF( !a );
-	FAIL_IF( !b );
+	FAIL_IF( !store );
+	FAIL_IF( !type );
+	FAIL_IF( !a && !b );
 	FAIL_IF( !deskname );
+	FAIL_IF( ( type == HOOK_MODIFIED ) && ( !a || !b || !fields ) );
 	
 	
-	if( a->entry.bFlags != b->entry.bFlags )
+	if( store->event_count >= store->event_max )
 	{
-		BYTE temp = 0;
-		
-		
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
+		struct diff_event *temp = NULL;
 		
-		printf( "\nThe associated HANDLEENTRY's flags have changed.\n" );
 		
-		temp = (BYTE)( a->entry.bFlags & b->entry.bFlags );
-		if( temp )
-		{
-			printf( "Flags same: " );
-			print_HANDLEENTRY_flags( temp );
-			printf( "\n" );
-		}
+		FAIL_IF( store->event_max > ( UINT_MAX / 2 ) );
 		
-		temp = (BYTE)( a->entry.bFlags & ~b->entry.bFlags );
-		if( temp )
-		{
-			printf( "Flags removed: " );
-			print_HANDLEENTRY_flags( temp );
-			printf( "\n" );
-		}
+		temp = must_calloc( store->event_max * 2, sizeof( *temp ) );
+		memcpy( temp, store->event, ( store->event_count * sizeof( *temp ) ) );
 		
-		temp = (BYTE)( b->entry.bFlags & ~a->entry.bFlags );
-		if( temp )
-		{
-			printf( "Flags added: " );
-			print_HANDLEENTRY_flags( temp );
-			printf( "\n" );
-		}
+		free( store->event );
+		store->event = temp;
+		store->event_max *= 2;
 	}
 	
-	/* compare entry.pOwner
-	print any significant differences in the owner of the HOOK
-	*/
-	print_diff_gui( a, b, THREAD_OWNER, deskname, &modified_header );
+	event = &store->event[ store->event_count++ ];
 	
-	if( a->object.head.h != b->object.head.h )
+	event->type = type;
+	event->fields = fields;
+	event->a = a;
+	event->b = b;
+	event->deskname = deskname;
+	
+	return;
+}
+
+
+
+/* init_HOOK_compare_masks()
+Initialize the masks for the word by word compare of two HOOKs. Helper function for is_same_HOOK()
+
+Each mask has all bits set in the bytes of the HOOK fields that get_diff_HOOK_fields() compares and 
+no bits set in the bytes of the other fields and of any padding. The first mask has the lock count 
+and the second doesn't.
+*/
+static void init_HOOK_compare_masks( void )
+{
+	unsigned i = 0;
+	HOOK object;
+	
+	const struct
 	{
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nThe HOOK's handle has changed.\n" );
-		PRINT_HEX_NAME( "Old", a->object.head.h );
-		PRINT_HEX_NAME( "New", b->object.head.h );
+		size_t offset;
+		size_t size;
+	} field[] = 
+	{
+		{ offsetof( HOOK, head.h ), sizeof( object.head.h ) }, 
+		{ offsetof( HOOK, rpdesk1 ), sizeof( object.rpdesk1 ) }, 
+		{ offsetof( HOOK, pSelf ), sizeof( object.pSelf ) }, 
+		{ offsetof( HOOK, phkNext ), sizeof( object.phkNext ) }, 
+		{ offsetof( HOOK, iHook ), sizeof( object.iHook ) }, 
+		{ offsetof( HOOK, offPfn ), sizeof( object.offPfn ) }, 
+		{ offsetof( HOOK, flags ), sizeof( object.flags ) }, 
+		{ offsetof( HOOK, ihmod ), sizeof( object.ihmod ) }, 
+		{ offsetof( HOOK, rpdesk2 ), sizeof( object.rpdesk2 ) }
+	};
+	
+	FAIL_IF( sizeof( HOOK ) % sizeof( size_t ) );
+	
+	
+	ZeroMemory( hook_compare_mask, sizeof( hook_compare_mask ) );
+	
+	for( i = 0; i < ( sizeof( field ) / sizeof( field[ 0 ] ) ); ++i )
+	{
+		memset( (BYTE *)hook_compare_mask[ 0 ] + field[ i ].offset, 0xFF, field[ i ].size );
+		memset( (BYTE *)hook_compare_mask[ 1 ] + field[ i ].offset, 0xFF, field[ i ].size );
 	}
 	
+	memset( (BYTE *)hook_compare_mask[ 0 ] + offsetof( HOOK, head.cLockObj ), 
+		0xFF, 
+		sizeof( object.head.cLockObj ) 
+	);
+	
+	hook_compare_mask_init = TRUE;
+	return;
+}
+
+
+
+/* is_same_HOOK()
+Check whether the HANDLEENTRY and HOOK of two hook structs have the same fields.
+
+This is the fast path of get_diff_hook_fields(). Most HOOKs don't change between snapshots, so 
+instead of comparing each field the HOOKs are compared a word at a time through a mask of the fields 
+that get_diff_HOOK_fields() compares. The lock count is not compared if the user requested to ignore 
+lock counts.
+
+'a' is the old hook info
+'b' is the new hook info
+
+returns nonzero if get_diff_HOOK_fields() would return zero
+*/
+int is_same_HOOK( 
+	const struct hook *const a,   // in
+	const struct hook *const b   // in
+)
+{
+	const size_t *x = NULL;
+	const size_t *y = NULL;
+	const size_t *mask = NULL;
+	size_t diff = 0;
+	unsigned i = 0;
+	
+	FAIL_IF( !a );
+	FAIL_IF( !b );
+	
+	
+	if( a->entry.bFlags != b->entry.bFlags )
+		return FALSE;
+	
+	if( !hook_compare_mask_init )
+		init_HOOK_compare_masks();
+	
+	mask = hook_compare_mask[ ( ( G->config->flags & CFG_IGNORE_LOCK_COUNTS ) ? 1 : 0 ) ];
+	x = (const size_t *)&a->object;
+	y = (const size_t *)&b->object;
+	
+	for( i = 0; i < HOOK_WORD_COUNT; ++i )
+		diff |= ( ( x[ i ] ^ y[ i ] ) & mask[ i ] );
+	
+	return !diff;
+}
+
+
+
+/* get_diff_HOOK_fields()
+Compare the HANDLEENTRY and HOOK of two hook structs field by field.
+
+This doesn't compare the associated gui threads. Call get_diff_hook_fields() for that.
+
+'a' is the old hook info
+'b' is the new hook info
+
+returns a DIFF_* bitmask of the HANDLEENTRY and HOOK fields that are different. zero if none.
+*/
+unsigned get_diff_HOOK_fields( 
+	const struct hook *const a,   // in
+	const struct hook *const b   // in
+)
+{
+	unsigned fields = 0;
+	
+	FAIL_IF( !a );
+	FAIL_IF( !b );
+	
+	
+	if( a->entry.bFlags != b->entry.bFlags )
+		fields |= DIFF_ENTRY_FLAGS;
+	
+	if( a->object.head.h != b->object.head.h )
+		fields |= DIFF_HANDLE;
+	
 	/* the object may be locked and unlocked frequently and that creates a lot of modification 
 	notices. this modification can be ignored by the user.
 	*/
 	if( ( a->object.head.cLockObj != b->object.head.cLockObj )
 		&& !( G->config->flags & CFG_IGNORE_LOCK_COUNTS )
 	)
-	{
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nThe HOOK's lock count has changed.\n" );
-		printf( "Old: %u\n", a->object.head.cLockObj );
-		printf( "New: %u\n", b->object.head.cLockObj );
-	}
-	
-	/* compare object.pti
-	print any significant differences in the origin of the HOOK
-	*/
-	print_diff_gui( a, b, THREAD_ORIGIN, deskname, &modified_header );
+		fields |= DIFF_LOCK_COUNT;
 	
 	if( a->object.rpdesk1 != b->object.rpdesk1 )
-	{
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nrpdesk1 has changed. The desktop that the HOOK is on has changed?\n" );
-		PRINT_HEX_NAME( "Old", a->object.rpdesk1 );
-		PRINT_HEX_NAME( "New", b->object.rpdesk1 );
-	}
+		fields |= DIFF_RPDESK1;
 	
 	if( a->object.pSelf != b->object.pSelf )
-	{
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nThe HOOK's kernel address has changed.\n" );
-		PRINT_HEX_NAME( "Old", a->object.pSelf );
-		PRINT_HEX_NAME( "New", b->object.pSelf );
-	}
+		fields |= DIFF_SELF;
 	
 	if( a->object.phkNext != b->object.phkNext )
-	{
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nThe HOOK's chain has been modified.\n" );
-		PRINT_HEX_NAME( "Old", a->object.phkNext );
-		PRINT_HEX_NAME( "New", b->object.phkNext );
-	}
+		fields |= DIFF_NEXT;
 	
 	if( a->object.iHook != b->object.iHook )
-	{
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nThe HOOK's id has changed.\n" );
-		
-		printf( "Old: " );
-		print_HOOK_id( a->object.iHook );
-		printf( "\n" );
-		
-		printf( "New: " );
-		print_HOOK_id( b->object.iHook );
-		printf( "\n" );
-	}
+		fields |= DIFF_ID;
 	
 	if( a->object.offPfn != b->object.offPfn )
-	{
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nThe HOOK's function offset has changed.\n" );
-		PRINT_HEX_NAME( "Old", a->object.offPfn );
-		PRINT_HEX_NAME( "New", b->object.offPfn );
-	}
+		fields |= DIFF_OFFPFN;
 	
 	if( a->object.flags != b->object.flags )
-	{
-		BYTE temp = 0;
-		
-		
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nThe HOOK's flags have changed.\n" );
-		
-		temp = (BYTE)( a->object.flags & b->object.flags );
-		if( temp )
-		{
-			printf( "Flags same: " );
-			print_HOOK_flags( temp );
-			printf( "\n" );
-		}
-		
-		temp = (BYTE)( a->object.flags & ~b->object.flags );
-		if( temp )
-		{
-			printf( "Flags removed: " );
-			print_HOOK_flags( temp );
-			printf( "\n" );
-		}
-		
-		temp = (BYTE)( b->object.flags & ~a->object.flags );
-		if( temp )
-		{
-			printf( "Flags added: " );
-			print_HOOK_flags( temp );
-			printf( "\n" );
-		}
-	}
+		fields |= DIFF_FLAGS;
 	
 	if( a->object.ihmod != b->object.ihmod )
-	{
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nThe HOOK's function module atom index has changed.\n" );
-		printf( "Old: %d\n", a->object.ihmod );
-		printf( "New: %d\n", b->object.ihmod );
-	}
+		fields |= DIFF_IHMOD;
+	
+	if( a->object.rpdesk2 != b->object.rpdesk2 )
+		fields |= DIFF_RPDESK2;
 	
-	/* compare object.ptiHooked
-	print any significant differences in the target of the HOOK
+	return fields;
+}
+
+
+
+/* get_diff_hook_fields()
+Compare two hook structs, both for the same HOOK object, for any significant differences.
+
+'a' is the old hook info
+'b' is the new hook info
+
+returns a DIFF_* bitmask of the fields that have significant differences. zero if none.
+*/
+unsigned get_diff_hook_fields( 
+	const struct hook *const a,   // in
+	const struct hook *const b   // in
+)
+{
+	unsigned fields = 0;
+	
+	FAIL_IF( !a );
+	FAIL_IF( !b );
+	
+	
+	/* compare entry.pOwner, object.pti and object.ptiHooked
+	any significant differences in the owner, origin and target threads of the HOOK
 	*/
-	print_diff_gui( a, b, THREAD_TARGET, deskname, &modified_header );
+	if( is_gui_diff( a, b, THREAD_OWNER ) )
+		fields |= DIFF_OWNER;
 	
-	if( a->object.rpdesk2 != b->object.rpdesk2 )
-	{
-		if( !modified_header )
-		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
-			modified_header = TRUE;
-		}
-		
-		printf( "\nrpdesk2 has changed." );
-		if( b->object.rpdesk2 )
-			printf( " HOOK faulted? chain faulted? locked? owner destroyed?\n" );
-		else
-			printf( " HOOK recovered?\n" );
-		
-		PRINT_HEX_NAME( "Old", a->object.rpdesk2 );
-		PRINT_HEX_NAME( "New", b->object.rpdesk2 );
-	}
+	if( is_gui_diff( a, b, THREAD_ORIGIN ) )
+		fields |= DIFF_ORIGIN;
 	
+	if( is_gui_diff( a, b, THREAD_TARGET ) )
+		fields |= DIFF_TARGET;
 	
-	if( modified_header )
-		print_hook_notice_end();
+	/* if the HANDLEENTRY and HOOK are the same as in the previous snapshot then only the associated 
+	gui threads can differ. see init_desktop_hook_store()
+	*/
+	if( b->unchanged || is_same_HOOK( a, b ) )
+		return fields;
 	
-	return !!modified_header;
+	return ( fields | get_diff_HOOK_fields( a, b ) );
 }
 
 
 
-/* print_diff_desktop_hook_items()
-Print the HOOKs that have been added/removed/modified from a single desktop between snapshots.
+/* diff_desktop_hook_items()
+Add diff events for the HOOKs that have been added/removed/modified from a single desktop.
 
+Ignored HOOKs don't have events.
+
+'store' is the diff event store
 'a' is a desktop and its HOOKs captured in the previous snapshot
 'b' is the same desktop and its HOOKs captured in the current snapshot
 */
-void print_diff_desktop_hook_items( 
+void diff_desktop_hook_items( 
+	struct diff_event_list *const store,   // in
 	const struct desktop_hook_item *const a,   // in
 	const struct desktop_hook_item *const b   // in
 )
@@ -806,6 +972,7 @@ void print_diff_desktop_hook_items(
 	WCHAR *deskname = NULL;
 	unsigned a_hi = 0, b_hi = 0;
 	
+	FAIL_IF( !store );
 	FAIL_IF( !a );
 	FAIL_IF( !b );
 	
@@ -816,32 +983,29 @@ void print_diff_desktop_hook_items(
 	FAIL_IF( a->hook_max != b->hook_max );
 	FAIL_IF( a->hook_count > a->hook_max );
 	FAIL_IF( b->hook_count > b->hook_max );
+	FAIL_IF( a->hook_count && !a->key );
+	FAIL_IF( b->hook_count && !b->key );
 	
 	
 	deskname = b->desktop->pwszDesktopName;
 	
+	/* merge join the sorted hook arrays. only the hook keys are read to find the matching hooks. */
 	a_hi = 0, b_hi = 0;
 	while( ( a_hi < a->hook_count ) && ( b_hi < b->hook_count ) )
 	{
-		int ret = compare_hook( &a->hook[ a_hi ], &b->hook[ b_hi ] );
+		int ret = compare_hook_key( &a->key[ a_hi ], &b->key[ b_hi ] );
 		
 		if( ret < 0 ) // hook removed
 		{
 			if( !a->hook[ a_hi ].ignore )
-			{
-				print_hook_notice_begin( &a->hook[ a_hi ], deskname, HOOK_REMOVED );
-				print_hook_notice_end();
-			}
+				add_diff_event( store, HOOK_REMOVED, 0, &a->hook[ a_hi ], NULL, deskname );
 			
 			++a_hi;
 		}
 		else if( ret > 0 ) // hook added
 		{
 			if( !b->hook[ b_hi ].ignore )
-			{
-				print_hook_notice_begin( &b->hook[ b_hi ], deskname, HOOK_ADDED );
-				print_hook_notice_end();
-			}
+				add_diff_event( store, HOOK_ADDED, 0, NULL, &b->hook[ b_hi ], deskname );
 			
 			++b_hi;
 		}
@@ -852,7 +1016,16 @@ void print_diff_desktop_hook_items(
 			information has changed (like the hook is hung, etc).
 			*/
 			if( !a->hook[ a_hi ].ignore || !b->hook[ b_hi ].ignore )
-				print_diff_hook( &a->hook[ a_hi ], &b->hook[ b_hi ], deskname );
+			{
+				unsigned fields = get_diff_hook_fields( &a->hook[ a_hi ], &b->hook[ b_hi ] );
+				
+				if( fields )
+				{
+					add_diff_event( store, HOOK_MODIFIED, fields, 
+						&a->hook[ a_hi ], &b->hook[ b_hi ], deskname 
+					);
+				}
+			}
 			
 			++a_hi;
 			++b_hi;
@@ -862,10 +1035,7 @@ void print_diff_desktop_hook_items(
 	while( a_hi < a->hook_count ) // hooks removed
 	{
 		if( !a->hook[ a_hi ].ignore )
-		{
-			print_hook_notice_begin( &a->hook[ a_hi ], deskname, HOOK_REMOVED );
-			print_hook_notice_end();
-		}
+			add_diff_event( store, HOOK_REMOVED, 0, &a->hook[ a_hi ], NULL, deskname );
 		
 		++a_hi;
 	}
@@ -873,10 +1043,7 @@ void print_diff_desktop_hook_items(
 	while( b_hi < b->hook_count ) // hooks added
 	{
 		if( !b->hook[ b_hi ].ignore )
-		{
-			print_hook_notice_begin( &b->hook[ b_hi ], deskname, HOOK_ADDED );
-			print_hook_notice_end();
-		}
+			add_diff_event( store, HOOK_ADDED, 0, NULL, &b->hook[ b_hi ], deskname );
 		
 		++b_hi;
 	}
@@ -886,13 +1053,19 @@ void print_diff_desktop_hook_items(
 
 
 
-/* print_diff_desktop_hook_lists()
-Print the HOOKs that have been added/removed/modified from all desktops between snapshots.
+/* diff_desktop_hook_lists()
+Get the diff events for the HOOKs that have been added/removed/modified from all desktops.
 
+The diff event store is emptied first, so it holds only the events between these two snapshots.
+
+'store' is the diff event store
 'list_a' is the previous snapshot's desktop hook list
 'list_b' is the current snapshot's desktop hook list
+
+returns the number of events
 */
-void print_diff_desktop_hook_lists( 
+unsigned diff_desktop_hook_lists( 
+	struct diff_event_list *const store,   // in
 	const struct desktop_hook_list *const list_a,   // in
 	const struct desktop_hook_list *const list_b   // in
 )
@@ -900,12 +1073,15 @@ void print_diff_desktop_hook_lists(
 	struct desktop_hook_item *a = NULL;
 	struct desktop_hook_item *b = NULL;
 	
+	FAIL_IF( !store );
 	FAIL_IF( !list_a );
 	FAIL_IF( !list_b );
 	
 	
+	store->event_count = 0;
+	
 	for( a = list_a->head, b = list_b->head; ( a && b ); a = a->next, b = b->next )
-		print_diff_desktop_hook_items( a, b );
+		diff_desktop_hook_items( store, a, b );
 	
 	if( a || b )
 	{
@@ -913,42 +1089,299 @@ void print_diff_desktop_hook_lists(
 		exit( 1 );
 	}
 	
-	return;
+	return store->event_count;
 }
 
 
 
-/* print_initial_desktop_hook_item()
-Print the HOOKs that have been found on a single desktop in an initial snapshot.
+/* diff_initial_desktop_hook_list()
+Get the diff events for the HOOKs that have been found on all desktops in an initial snapshot.
 
-'item' is a desktop and its HOOKs captured in the snapshot
+The diff event store is emptied first, so it holds only the events for this snapshot.
+Ignored HOOKs don't have events.
 
-returns the number of HOOKs printed
+'store' is the diff event store
+'list' is the initial snapshot's desktop hook list
+
+returns the number of events
 */
-unsigned print_initial_desktop_hook_item( 
-	const struct desktop_hook_item *const item   // in
+unsigned diff_initial_desktop_hook_list( 
+	struct diff_event_list *const store,   // in
+	const struct desktop_hook_list *const list   // in
 )
 {
-	unsigned i = 0;
-	unsigned printed = 0;
+	struct desktop_hook_item *item = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !list );
 	
-	FAIL_IF( !item );
-	FAIL_IF( !item->desktop );
-	FAIL_IF( !item->hook_max );
-	FAIL_IF( item->hook_count > item->hook_max );
 	
+	store->event_count = 0;
 	
-	for( i = 0; i < item->hook_count; ++i )
+	/* for each desktop in a snapshot add the HOOKs found */
+	for( item = list->head; item; item = item->next )
 	{
-		if( !item->hook[ i ].ignore )
+		unsigned i = 0;
+		
+		
+		FAIL_IF( !item->desktop );
+		FAIL_IF( !item->hook_max );
+		FAIL_IF( item->hook_count > item->hook_max );
+		
+		for( i = 0; i < item->hook_count; ++i )
 		{
-			print_hook_notice_begin( &item->hook[ i ], item->desktop->pwszDesktopName, HOOK_FOUND );
-			print_hook_notice_end();
-			++printed;
+			if( !item->hook[ i ].ignore )
+			{
+				add_diff_event( store, HOOK_FOUND, 0, NULL, &item->hook[ i ], 
+					item->desktop->pwszDesktopName 
+				);
+			}
 		}
 	}
 	
-	return printed;
+	return store->event_count;
+}
+
+
+
+/* print_diff_event()
+Print a diff event as a HOOK notice.
+
+This is the text renderer of the diff events. A modified HOOK's notice has a section for each field 
+that changed, in the order the fields are in the HANDLEENTRY and HOOK.
+
+'event' is the diff event
+*/
+void print_diff_event( 
+	const struct diff_event *const event   // in
+)
+{
+	const struct hook *a = NULL;
+	const struct hook *b = NULL;
+	
+	FAIL_IF( !event );
+	
+	
+	if( event->type != HOOK_MODIFIED )
+	{
+		print_hook_notice_begin( ( event->b ? event->b : event->a ), event->deskname, event->type );
+		print_hook_notice_end();
+		return;
+	}
+	
+	a = event->a;
+	b = event->b;
+	
+	print_hook_notice_begin( b, event->deskname, HOOK_MODIFIED );
+	
+	if( event->fields & DIFF_ENTRY_FLAGS )
+	{
+		BYTE temp = 0;
+		
+		
+		output_printf( "\nThe associated HANDLEENTRY's flags have changed.\n" );
+		
+		temp = (BYTE)( a->entry.bFlags & b->entry.bFlags );
+		if( temp )
+		{
+			output_printf( "Flags same: " );
+			print_HANDLEENTRY_flags( temp );
+			output_printf( "\n" );
+		}
+		
+		temp = (BYTE)( a->entry.bFlags & ~b->entry.bFlags );
+		if( temp )
+		{
+			output_printf( "Flags removed: " );
+			print_HANDLEENTRY_flags( temp );
+			output_printf( "\n" );
+		}
+		
+		temp = (BYTE)( b->entry.bFlags & ~a->entry.bFlags );
+		if( temp )
+		{
+			output_printf( "Flags added: " );
+			print_HANDLEENTRY_flags( temp );
+			output_printf( "\n" );
+		}
+	}
+	
+	if( event->fields & DIFF_OWNER )
+		print_diff_gui( a, b, THREAD_OWNER );
+	
+	if( event->fields & DIFF_HANDLE )
+	{
+		output_printf( "\nThe HOOK's handle has changed.\n" );
+		OUTPUT_HEX_NAME( "Old", a->object.head.h );
+		OUTPUT_HEX_NAME( "New", b->object.head.h );
+	}
+	
+	if( event->fields & DIFF_LOCK_COUNT )
+	{
+		output_printf( "\nThe HOOK's lock count has changed.\n" );
+		output_printf( "Old: %u\n", a->object.head.cLockObj );
+		output_printf( "New: %u\n", b->object.head.cLockObj );
+	}
+	
+	if( event->fields & DIFF_ORIGIN )
+		print_diff_gui( a, b, THREAD_ORIGIN );
+	
+	if( event->fields & DIFF_RPDESK1 )
+	{
+		output_printf( "\nrpdesk1 has changed. The desktop that the HOOK is on has changed?\n" );
+		OUTPUT_HEX_NAME( "Old", a->object.rpdesk1 );
+		OUTPUT_HEX_NAME( "New", b->object.rpdesk1 );
+	}
+	
+	if( event->fields & DIFF_SELF )
+	{
+		output_printf( "\nThe HOOK's kernel address has changed.\n" );
+		OUTPUT_HEX_NAME( "Old", a->object.pSelf );
+		OUTPUT_HEX_NAME( "New", b->object.pSelf );
+	}
+	
+	if( event->fields & DIFF_NEXT )
+	{
+		output_printf( "\nThe HOOK's chain has been modified.\n" );
+		OUTPUT_HEX_NAME( "Old", a->object.phkNext );
+		OUTPUT_HEX_NAME( "New", b->object.phkNext );
+	}
+	
+	if( event->fields & DIFF_ID )
+	{
+		output_printf( "\nThe HOOK's id has changed.\n" );
+		
+		output_printf( "Old: " );
+		print_HOOK_id( a->object.iHook );
+		output_printf( "\n" );
+		
+		output_printf( "New: " );
+		print_HOOK_id( b->object.iHook );
+		output_printf( "\n" );
+	}
+	
+	if( event->fields & DIFF_OFFPFN )
+	{
+		output_printf( "\nThe HOOK's function offset has changed.\n" );
+		OUTPUT_HEX_NAME( "Old", a->object.offPfn );
+		OUTPUT_HEX_NAME( "New", b->object.offPfn );
+	}
+	
+	if( event->fields & DIFF_FLAGS )
+	{
+		BYTE temp = 0;
+		
+		
+		output_printf( "\nThe HOOK's flags have changed.\n" );
+		
+		temp = (BYTE)( a->object.flags & b->object.flags );
+		if( temp )
+		{
+			output_printf( "Flags same: " );
+			print_HOOK_flags( temp );
+			output_printf( "\n" );
+		}
+		
+		temp = (BYTE)( a->object.flags & ~b->object.flags );
+		if( temp )
+		{
+			output_printf( "Flags removed: " );
+			print_HOOK_flags( temp );
+			output_printf( "\n" );
+		}
+		
+		temp = (BYTE)( b->object.flags & ~a->object.flags );
+		if( temp )
+		{
+			output_printf( "Flags added: " );
+			print_HOOK_flags( temp );
+			output_printf( "\n" );
+		}
+	}
+	
+	if( event->fields & DIFF_IHMOD )
+	{
+		output_printf( "\nThe HOOK's function module atom index has changed.\n" );
+		output_printf( "Old: %d\n", a->object.ihmod );
+		output_printf( "New: %d\n", b->object.ihmod );
+	}
+	
+	if( event->fields & DIFF_TARGET )
+		print_diff_gui( a, b, THREAD_TARGET );
+	
+	if( event->fields & DIFF_RPDESK2 )
+	{
+		output_printf( "\nrpdesk2 has changed." );
+		if( b->object.rpdesk2 )
+			output_printf( " HOOK faulted? chain faulted? locked? owner destroyed?\n" );
+		else
+			output_printf( " HOOK recovered?\n" );
+		
+		OUTPUT_HEX_NAME( "Old", a->object.rpdesk2 );
+		OUTPUT_HEX_NAME( "New", b->object.rpdesk2 );
+	}
+	
+	print_hook_notice_end();
+	
+	return;
+}
+
+
+
+/* print_diff_events()
+Print each diff event in a diff event store as a HOOK notice.
+
+'store' is the diff event store
+
+returns the number of HOOK notices printed
+*/
+unsigned print_diff_events( 
+	const struct diff_event_list *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->event_count > store->event_max );
+	
+	
+	for( i = 0; i < store->event_count; ++i )
+		print_diff_event( &store->event[ i ] );
+	
+	return store->event_count;
+}
+
+
+
+/* print_diff_desktop_hook_lists()
+Print the HOOKs that have been added/removed/modified from all desktops between snapshots.
+
+The diff events are put in the diff event store and then printed. The diff and the printing are 
+timed as the diff and output phases of the current poll.
+
+'store' is the diff event store
+'list_a' is the previous snapshot's desktop hook list
+'list_b' is the current snapshot's desktop hook list
+
+returns the number of HOOK notices printed
+*/
+unsigned print_diff_desktop_hook_lists( 
+	struct diff_event_list *const store,   // in
+	const struct desktop_hook_list *const list_a,   // in
+	const struct desktop_hook_list *const list_b   // in
+)
+{
+	__int64 ticks = get_timing_ticks( G->timing );
+	unsigned count = 0;
+	
+	
+	diff_desktop_hook_lists( store, list_a, list_b );
+	ticks = add_timing( G->timing, TIMING_DIFF, ticks );
+	
+	count = print_diff_events( store );
+	add_timing( G->timing, TIMING_OUTPUT, ticks );
+	
+	return count;
 }
 
 
@@ -956,22 +1389,92 @@ unsigned print_initial_desktop_hook_item(
 /* print_initial_desktop_hook_list()
 Print the HOOKs that have been found on all desktops in an initial snapshot.
 
+The diff events are put in the diff event store and then printed. The diff and the printing are 
+timed as the diff and output phases of the current poll.
+
+'store' is the diff event store
 'list' is the initial snapshot's desktop hook list
 
-returns the number of HOOKs printed
+returns the number of HOOK notices printed
 */
 unsigned print_initial_desktop_hook_list( 
+	struct diff_event_list *const store,   // in
 	const struct desktop_hook_list *const list   // in
 )
 {
-	unsigned printed = 0;
-	struct desktop_hook_item *item = NULL;
+	__int64 ticks = get_timing_ticks( G->timing );
+	unsigned count = 0;
 	
-	FAIL_IF( !list );
 	
-	/* for each desktop in a snapshot print the HOOKs found */
-	for( item = list->head; item; item = item->next )
-		printed += print_initial_desktop_hook_item( item );
+	diff_initial_desktop_hook_list( store, list );
+	ticks = add_timing( G->timing, TIMING_DIFF, ticks );
+	
+	count = print_diff_events( store );
+	add_timing( G->timing, TIMING_OUTPUT, ticks );
+	
+	return count;
+}
+
+
+
+/* print_diff_event_store()
+Print a diff event store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_diff_event_store( 
+	const struct diff_event_list *const store   // in
+)
+{
+	const char *const objname = "Diff Event Store";
+	unsigned i = 0;
+	
+	
+	if( !store )
+		return;
 	
-	return printed;
+	PRINT_DBLSEP_BEGIN( objname );
+	
+	printf( "store->event_max: %u\n", store->event_max );
+	printf( "store->event_count: %u\n", store->event_count );
+	
+	for( i = 0; i < store->event_count; ++i )
+	{
+		const struct diff_event *const event = &store->event[ i ];
+		const struct hook *const hook = ( event->b ? event->b : event->a );
+		
+		
+		printf( "event[ %u ]: type %d, fields ", i, event->type );
+		PRINT_HEX_BARE( event->fields );
+		printf( ", HOOK " );
+		PRINT_HEX_BARE( hook->object.head.h );
+		printf( ", desktop '%ls'\n", event->deskname );
+	}
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_diff_event_store()
+Free a diff event store and all its descendants.
+
+this function then sets the diff event store pointer to NULL and returns
+if( !in || !*in ) then this function returns.
+*/
+void free_diff_event_store( 
+	struct diff_event_list **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	free( (*in)->event );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
 }
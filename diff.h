@@ -68,9 +68,102 @@ enum threadtype
 
 
 
+/** The fields of a HOOK that are compared between snapshots.
+A diff event for a modified HOOK has a bitmask of the fields that changed.
+*/
+/* HANDLEENTRY.bFlags */
+#define DIFF_ENTRY_FLAGS   1u
+
+/* HANDLEENTRY.pOwner. the associated gui owner thread info is significantly different. */
+#define DIFF_OWNER   ( 1u << 1 )
+
+/* HOOK.head.h */
+#define DIFF_HANDLE   ( 1u << 2 )
+
+/* HOOK.head.cLockObj. never set if the user requested to ignore lock counts. */
+#define DIFF_LOCK_COUNT   ( 1u << 3 )
+
+/* HOOK.pti. the associated gui origin thread info is significantly different. */
+#define DIFF_ORIGIN   ( 1u << 4 )
+
+/* HOOK.rpdesk1 */
+#define DIFF_RPDESK1   ( 1u << 5 )
+
+/* HOOK.pSelf */
+#define DIFF_SELF   ( 1u << 6 )
+
+/* HOOK.phkNext */
+#define DIFF_NEXT   ( 1u << 7 )
+
+/* HOOK.iHook */
+#define DIFF_ID   ( 1u << 8 )
+
+/* HOOK.offPfn */
+#define DIFF_OFFPFN   ( 1u << 9 )
+
+/* HOOK.flags */
+#define DIFF_FLAGS   ( 1u << 10 )
+
+/* HOOK.ihmod */
+#define DIFF_IHMOD   ( 1u << 11 )
+
+/* HOOK.ptiHooked. the associated gui target thread info is significantly different. */
+#define DIFF_TARGET   ( 1u << 12 )
+
+/* HOOK.rpdesk2 */
+#define DIFF_RPDESK2   ( 1u << 13 )
+
+
+
+/** A diff event.
+A HOOK that was found in an initial snapshot, or added/removed/modified between two snapshots.
+The hook info pointed to is in the snapshots that were compared and is valid as long as they are.
+*/
+struct diff_event
+{
+	/* the diff type */
+	enum difftype type;
+	
+	/* if the HOOK was modified this is a DIFF_* bitmask of the fields that changed, otherwise 0 */
+	unsigned fields;
+	
+	/* the hook info in the previous snapshot. NULL if the HOOK was found or added. */
+	const struct hook *a;
+	
+	/* the hook info in the current snapshot. NULL if the HOOK was removed. */
+	const struct hook *b;
+	
+	/* the name of the desktop the HOOK is on */
+	const WCHAR *deskname;
+};
+
+
+
+/** The diff event store.
+This store holds the diff events from a comparison of two snapshots. It's emptied and reused for 
+each comparison, and its array of events grows as needed and is never shrunk.
+*/
+struct diff_event_list
+{
+	/* an array of diff events in the order they were found */
+	struct diff_event *event;   // calloc(), free()
+	
+	/* the number of elements allocated in the array */
+	unsigned event_max;
+	
+	/* the number of events in the array */
+	unsigned event_count;
+};
+
+
+
 /** 
 these functions are documented in the comment block above their definitions in diff.c
 */
+void set_hook_notice_time( 
+	const __int64 utc   // in
+);
+
 void print_brief_thread_info(
 	const struct hook *const hook,   // in
 	const enum threadtype threadtype   // in
@@ -84,30 +177,78 @@ void print_hook_notice_begin(
 
 void print_hook_notice_end( void );
 
-int print_diff_hook( 
-	const struct hook *const a,   // in
-	const struct hook *const b,   // in
+void create_diff_event_store( 
+	struct diff_event_list **const out   // out deref
+);
+
+void add_diff_event( 
+	struct diff_event_list *const store,   // in
+	const enum difftype type,   // in
+	const unsigned fields,   // in
+	const struct hook *const a,   // in, optional
+	const struct hook *const b,   // in, optional
 	const WCHAR *const deskname   // in
 );
 
-void print_diff_desktop_hook_items( 
+int is_same_HOOK( 
+	const struct hook *const a,   // in
+	const struct hook *const b   // in
+);
+
+unsigned get_diff_HOOK_fields( 
+	const struct hook *const a,   // in
+	const struct hook *const b   // in
+);
+
+unsigned get_diff_hook_fields( 
+	const struct hook *const a,   // in
+	const struct hook *const b   // in
+);
+
+void diff_desktop_hook_items( 
+	struct diff_event_list *const store,   // in
 	const struct desktop_hook_item *const a,   // in
 	const struct desktop_hook_item *const b   // in
 );
 
-void print_diff_desktop_hook_lists( 
+unsigned diff_desktop_hook_lists( 
+	struct diff_event_list *const store,   // in
 	const struct desktop_hook_list *const list_a,   // in
 	const struct desktop_hook_list *const list_b   // in
 );
 
-unsigned print_initial_desktop_hook_item( 
-	const struct desktop_hook_item *const item   // in
+unsigned diff_initial_desktop_hook_list( 
+	struct diff_event_list *const store,   // in
+	const struct desktop_hook_list *const list   // in
+);
+
+void print_diff_event( 
+	const struct diff_event *const event   // in
+);
+
+unsigned print_diff_events( 
+	const struct diff_event_list *const store   // in
+);
+
+unsigned print_diff_desktop_hook_lists( 
+	struct diff_event_list *const store,   // in
+	const struct desktop_hook_list *const list_a,   // in
+	const struct desktop_hook_list *const list_b   // in
 );
 
 unsigned print_initial_desktop_hook_list( 
+	struct diff_event_list *const store,   // in
 	const struct desktop_hook_list *const list   // in
 );
 
+void print_diff_event_store( 
+	const struct diff_event_list *const store   // in
+);
+
+void free_diff_event_store( 
+	struct diff_event_list **const in   // in deref
+);
+
 
 #ifdef __cplusplus
 }
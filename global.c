@@ -26,6 +26,11 @@ There are several global stores (these are referred to as descendants of 'G'):
 'G->prog' is the global program store. It holds basic program and system info.
 'G->config' is the global configuration store. It holds the user's configuration.
 'G->desktops' is the global desktop store. It holds the list of attached to desktops.
+'G->output' is the global output store. It holds the buffer that HOOK notices are written to.
+'G->cache' is the global cache store. It holds the thread info that persists across snapshots.
+'G->pool' is the global pool store. It holds the worker threads that find GUI threads.
+'G->timing' is the global timing store. It holds the time taken by each phase of each poll.
+'G->capture' is the global capture store. It holds the thread that queries the system process info.
 
 Each of the global stores and their functions are defined in their own units, eg prog.h/prog.c
 
@@ -84,6 +89,21 @@ void create_global_store( void )
 	/* desktop store (linked list of desktops' heap and thread info) */
 	create_desktop_store( &G->desktops );
 	
+	/* output store (the sink that HOOK notices are written to) */
+	create_output_store( &G->output );
+	
+	/* cache store (information about the system that persists across snapshots) */
+	create_cache_store( &G->cache );
+	
+	/* pool store (worker threads) */
+	create_pool_store( &G->pool );
+	
+	/* timing store (the time taken by each phase of each poll) */
+	create_timing_store( &G->timing );
+	
+	/* capture store (the thread that queries the system process info ahead of the snapshots) */
+	create_capture_store( &G->capture );
+	
 	
 	return;
 }
@@ -103,8 +123,18 @@ void print_global_store( void )
 	printf( "\n" );
 	print_global_config_store();
 	printf( "\n" );
+	print_global_output_store();
+	printf( "\n" );
 	print_global_desktop_store();
 	printf( "\n" );
+	print_global_cache_store();
+	printf( "\n" );
+	print_global_pool_store();
+	printf( "\n" );
+	print_global_timing_store();
+	printf( "\n" );
+	print_global_capture_store();
+	printf( "\n" );
 	
 	return;
 }
@@ -122,6 +152,16 @@ void free_global_store( void )
 	if( !G )
 		return;
 	
+	free_capture_store( &G->capture );
+	
+	free_timing_store( &G->timing );
+	
+	free_pool_store( &G->pool );
+	
+	free_cache_store( &G->cache );
+	
+	free_output_store( &G->output );
+	
 	free_desktop_store( &G->desktops );
 	
 	free_config_store( &G->config );
@@ -32,6 +32,21 @@ along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
 /* desktop store (linked list of desktops' heap and thread info) */
 #include "desktop.h"
 
+/* output store (the sink that HOOK notices are written to) */
+#include "output.h"
+
+/* cache store (information about the system that persists across snapshots) */
+#include "cache.h"
+
+/* pool store (worker threads) */
+#include "pool.h"
+
+/* timing store (the time taken by each phase of each poll) */
+#include "timing.h"
+
+/* capture store (the thread that queries the system process info ahead of the snapshots) */
+#include "capture.h"
+
 
 
 #ifdef __cplusplus
@@ -52,6 +67,21 @@ struct global
 	
 	/* linked list of attached to desktops and their heap info. requires config init. */
 	struct desktop_list *desktops;   // create_desktop_store(), free_desktop_store()
+	
+	/* the sink that HOOK notices are written to. requires config init. */
+	struct output *output;   // create_output_store(), free_output_store()
+	
+	/* the thread info that persists across snapshots. requires config init. */
+	struct cache *cache;   // create_cache_store(), free_cache_store()
+	
+	/* the worker threads that find GUI threads. requires config init. */
+	struct pool *pool;   // create_pool_store(), free_pool_store()
+	
+	/* the time taken by each phase of each poll. requires config init. */
+	struct timing *timing;   // create_timing_store(), free_timing_store()
+	
+	/* the thread that queries the system process info ahead of the snapshots. requires config init. */
+	struct capture *capture;   // create_capture_store(), free_capture_store()
 };
 
 
@@ -0,0 +1,296 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for scanning a table of user handle entries (HANDLEENTRY).
+Each function is documented in the comment block above its definition.
+
+The table of user handle entries in the shared info section (aheList) has tens of thousands of 
+entries, and only a handful of them are for HOOK objects. These functions find the entries of a 
+given type so that only those entries have to be copied and examined.
+
+-
+scan_handle_table_scalar()
+
+Scan a table of HANDLEENTRY one entry at a time for entries of a type.
+-
+
+-
+get_sse2_scan_masks()
+
+Get the byte masks that select the bType bytes in each 16 byte chunk of a HANDLEENTRY table.
+-
+
+-
+scan_handle_table_sse2()
+
+Scan a table of HANDLEENTRY 16 bytes at a time using SSE2 for entries of a type.
+-
+
+-
+is_sse2_scan_available()
+
+Check whether scan_handle_table_sse2() can be used on this processor.
+-
+
+-
+scan_handle_table()
+
+Scan a table of HANDLEENTRY for entries of a type using the fastest scan available.
+-
+
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "util.h"
+
+#include "handle_table.h"
+
+/* SSE2 intrinsics are available to x86 and x64 compilers even if the compiler isn't generating SSE2 
+code by default. Whether the processor supports SSE2 is checked at runtime.
+*/
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __SSE2__ )
+#define HANDLE_TABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+
+/* The number of 16 byte chunks before the position of the bType member repeats in the same place.
+sizeof( HANDLEENTRY ) is 12 on x86 and 24 on x64, which is 3 chunks (48 bytes) either way.
+*/
+#define SSE2_SCAN_PERIOD_MAX   16
+
+
+
+/* scan_handle_table_scalar()
+Scan a table of HANDLEENTRY one entry at a time for entries of a type.
+
+'index' receives the index of each entry in 'table' whose bType is 'type'.
+'index_max' is the number of elements in 'index'.
+'table' is an array of 'count' HANDLEENTRY.
+
+The table may be changing while it is scanned. An entry found by this function has to be copied 
+and its type checked again before it is used.
+
+returns the number of indexes written to 'index'. the scan stops if 'index' is full.
+*/
+unsigned scan_handle_table_scalar( 
+	unsigned *const index,   // out
+	const unsigned index_max,   // in
+	const HANDLEENTRY *const table,   // in
+	const unsigned count,   // in
+	const BYTE type   // in
+)
+{
+	unsigned i = 0;
+	unsigned found = 0;
+	
+	FAIL_IF( !index );
+	FAIL_IF( !table );
+	
+	
+	for( i = 0; ( i < count ) && ( found < index_max ); ++i )
+	{
+		if( table[ i ].bType == type )
+			index[ found++ ] = i;
+	}
+	
+	return found;
+}
+
+
+
+#ifdef HANDLE_TABLE_SSE2
+/* get_sse2_scan_masks()
+Get the byte masks that select the bType bytes in each 16 byte chunk of a HANDLEENTRY table.
+
+For every chunk of 16 bytes in the table the bytes that are the bType member of an entry are in the 
+same position as they are in every 'period' chunks. 'mask[ n ]' receives a movemask value with a 
+bit set for each bType byte in chunk n of the period.
+
+returns the period: the number of elements written to 'mask'
+*/
+static unsigned get_sse2_scan_masks( 
+	int mask[ SSE2_SCAN_PERIOD_MAX ]   // out
+)
+{
+	unsigned chunk = 0, bit = 0, period = 0, a = 0, b = 0;
+	const unsigned stride = sizeof( HANDLEENTRY );
+	const unsigned offset = offsetof( HANDLEENTRY, bType );
+	
+	
+	/* period = stride / gcd( stride, 16 ) */
+	for( a = stride, b = 16; b; )
+	{
+		unsigned t = a % b;
+		a = b;
+		b = t;
+	}
+	period = stride / a;
+	
+	FAIL_IF( period > SSE2_SCAN_PERIOD_MAX );
+	
+	for( chunk = 0; chunk < period; ++chunk )
+	{
+		mask[ chunk ] = 0;
+		
+		for( bit = 0; bit < 16; ++bit )
+		{
+			if( !( ( ( chunk * 16 ) + bit + stride - offset ) % stride ) )
+				mask[ chunk ] |= 1 << bit;
+		}
+	}
+	
+	return period;
+}
+#endif
+
+
+
+/* scan_handle_table_sse2()
+Scan a table of HANDLEENTRY 16 bytes at a time using SSE2 for entries of a type.
+
+This has the same behavior as scan_handle_table_scalar(). The table is compared 16 bytes at a time 
+against the type, and the result is masked so only the bType bytes are considered. Most chunks 
+don't have a match so there's usually just a load, compare and test for every 16 bytes. The entries 
+in the remainder of the table that doesn't fill a chunk are scanned one at a time.
+
+Only whole chunks inside the table are read.
+
+Call is_sse2_scan_available() first to make sure this function can be used. If this program was 
+compiled without SSE2 support this function calls scan_handle_table_scalar().
+
+returns the number of indexes written to 'index'. the scan stops if 'index' is full.
+*/
+unsigned scan_handle_table_sse2( 
+	unsigned *const index,   // out
+	const unsigned index_max,   // in
+	const HANDLEENTRY *const table,   // in
+	const unsigned count,   // in
+	const BYTE type   // in
+)
+{
+#ifdef HANDLE_TABLE_SSE2
+	unsigned i = 0, chunk = 0, phase = 0, period = 0, chunk_count = 0;
+	unsigned found = 0;
+	int mask[ SSE2_SCAN_PERIOD_MAX ];
+	__m128i match;
+	const BYTE *const bytes = (const BYTE *)table;
+	const unsigned stride = sizeof( HANDLEENTRY );
+	const unsigned offset = offsetof( HANDLEENTRY, bType );
+	
+	FAIL_IF( !index );
+	FAIL_IF( !table );
+	
+	
+	period = get_sse2_scan_masks( mask );
+	match = _mm_set1_epi8( (char)type );
+	
+	/* the number of whole chunks in the table */
+	chunk_count = (unsigned)( ( (size_t)count * stride ) / 16 );
+	
+	for( chunk = 0; chunk < chunk_count; ++chunk )
+	{
+		const __m128i data = _mm_loadu_si128( (const __m128i *)&bytes[ chunk * 16 ] );
+		unsigned bits = _mm_movemask_epi8( _mm_cmpeq_epi8( data, match ) ) & mask[ phase ];
+		unsigned bit = 0;
+		
+		
+		if( ++phase == period )
+			phase = 0;
+		
+		for( bit = 0; bits; ++bit, bits >>= 1 )
+		{
+			if( !( bits & 1 ) )
+				continue;
+			
+			if( found >= index_max )
+				return found;
+			
+			index[ found++ ] = ( ( chunk * 16 ) + bit - offset ) / stride;
+		}
+	}
+	
+	/* the first entry whose bType is past the last whole chunk */
+	i = ( ( chunk_count * 16 ) > offset ) 
+		? ( ( ( chunk_count * 16 ) - offset + stride - 1 ) / stride ) 
+		: 0;
+	
+	for( ; ( i < count ) && ( found < index_max ); ++i )
+	{
+		if( table[ i ].bType == type )
+			index[ found++ ] = i;
+	}
+	
+	return found;
+#else
+	return scan_handle_table_scalar( index, index_max, table, count, type );
+#endif
+}
+
+
+
+/* is_sse2_scan_available()
+Check whether scan_handle_table_sse2() can be used on this processor.
+
+returns nonzero if this program was compiled with SSE2 support and the processor supports SSE2
+*/
+int is_sse2_scan_available( void )
+{
+#ifdef HANDLE_TABLE_SSE2
+	/* SSE2 is always available on x64 */
+	if( IsProcessorFeaturePresent( PF_XMMI64_INSTRUCTIONS_AVAILABLE ) )
+		return TRUE;
+#endif
+	
+	return FALSE;
+}
+
+
+
+/* scan_handle_table()
+Scan a table of HANDLEENTRY for entries of a type using the fastest scan available.
+
+The scan function is chosen the first time this function is called. It has the same behavior as 
+scan_handle_table_scalar().
+
+returns the number of indexes written to 'index'. the scan stops if 'index' is full.
+*/
+unsigned scan_handle_table( 
+	unsigned *const index,   // out
+	const unsigned index_max,   // in
+	const HANDLEENTRY *const table,   // in
+	const unsigned count,   // in
+	const BYTE type   // in
+)
+{
+	static unsigned (*scan)( 
+		unsigned *const, const unsigned, const HANDLEENTRY *const, const unsigned, const BYTE 
+	);
+	
+	
+	if( !scan )
+		scan = ( is_sse2_scan_available() ? scan_handle_table_sse2 : scan_handle_table_scalar );
+	
+	return scan( index, index_max, table, count, type );
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _HANDLE_TABLE_H
+#define _HANDLE_TABLE_H
+
+#include <windows.h>
+
+/* HANDLEENTRY */
+#include "reactos.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** 
+these functions are documented in the comment block above their definitions in handle_table.c
+*/
+unsigned scan_handle_table_scalar( 
+	unsigned *const index,   // out
+	const unsigned index_max,   // in
+	const HANDLEENTRY *const table,   // in
+	const unsigned count,   // in
+	const BYTE type   // in
+);
+
+unsigned scan_handle_table_sse2( 
+	unsigned *const index,   // out
+	const unsigned index_max,   // in
+	const HANDLEENTRY *const table,   // in
+	const unsigned count,   // in
+	const BYTE type   // in
+);
+
+int is_sse2_scan_available( void );
+
+unsigned scan_handle_table( 
+	unsigned *const index,   // out
+	const unsigned index_max,   // in
+	const HANDLEENTRY *const table,   // in
+	const unsigned count,   // in
+	const BYTE type   // in
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HANDLE_TABLE_H
@@ -55,6 +55,12 @@ Create and initialize the global stores, print the license and version and then
 
 #include "diff.h"
 
+#include "snapshot_file.h"
+
+#include "replay.h"
+
+#include "schedule.h"
+
 #include "test.h"
 
 /* the global stores */
@@ -123,7 +129,9 @@ HOOK information at that point in time. This function calls init_snapshot_store(
 snapshot and then matches the HOOKs to their threads. This function then prints the results.
 
 If monitoring/polling is enabled then snapshots are taken continuously with each current snapshot 
-compared to the previous one for differences. The results are printed for each difference.
+compared to the previous one for differences. The results are printed for each difference. The 
+snapshots are taken on a fixed-rate schedule, so the time taken by each one is subtracted from the 
+wait for the next.
 
 returns nonzero on success (a single snapshot was taken and its results printed to stdout).
 if polling is enabled this function will loop continuously and never return.
@@ -135,7 +143,12 @@ int gethooks()
 	struct snapshot *previous = NULL;
 	struct snapshot *current = NULL;
 	struct snapshot *temp = NULL;
+	struct diff_event_list *events = NULL;
+	struct schedule *schedule = NULL;
 	int ret = 0;
+	unsigned changes = 0;
+	unsigned __int64 check_count = 0;
+	unsigned __int64 skip_count = 0;
 	
 	FAIL_IF( !G );   // The global store must exist.
 	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
@@ -149,8 +162,11 @@ int gethooks()
 	/* allocate the memory needed to take a snapshot */
 	create_snapshot_store( &current );
 	
+	/* allocate the diff event store that is reused for each comparison of snapshots */
+	create_diff_event_store( &events );
+	
 	/* take a snapshot */
-	ret = init_snapshot_store( current );
+	ret = init_snapshot_store( current, NULL );
 	
 	if( G->config->verbose >= 8 )
 		print_snapshot_store( current );
@@ -161,8 +177,15 @@ int gethooks()
 		exit( 1 );
 	}
 	
+	/* if the user specified a snapshot file then append the snapshot to it */
+	if( G->config->snapshot_file && !write_snapshot_file( current, G->config->snapshot_file ) )
+	{
+		MSG_FATAL( "write_snapshot_file() failed." );
+		exit( 1 );
+	}
+	
 	/* print the HOOKs found in the snapshot */
-	print_initial_desktop_hook_list( current->desktop_hooks );
+	print_initial_desktop_hook_list( events, current->desktop_hooks );
 	printf( "\n" );
 	
 	/* for each desktop in the snapshot */
@@ -189,21 +212,116 @@ int gethooks()
 		}
 	}
 	
+	/* print the size of the spi buffer and the arena memory that was needed for the snapshot */
+	if( G->config->verbose >= 2 )
+	{
+		printf( "\n" );
+		print_spi_buffer_stats( current );
+		print_arena_stats( current->arena, "Snapshot arena" );
+		print_cache_stats( G->cache );
+	}
+	
+	/* write the output of the initial snapshot, which is the first poll */
+	end_global_timing_poll();
+	
 	/* if polling is disabled then the user did not request monitor mode so we're done */
 	if( G->config->polling < POLLING_MIN )
 		goto cleanup;
 	
-	printf( "\nMonitor mode enabled. Checking for changes every %d seconds...\n", 
-		G->config->polling 
-	);
-	fflush( stdout );
+	if( G->config->adaptive_max_ms )
+	{
+		printf( "\nMonitor mode enabled. Checking for changes every %u to %u milliseconds...\n", 
+			G->config->adaptive_min_ms, 
+			G->config->adaptive_max_ms 
+		);
+	}
+	else if( G->config->polling_ms % 1000 )
+	{
+		printf( "\nMonitor mode enabled. Checking for changes every %u milliseconds...\n", 
+			G->config->polling_ms 
+		);
+	}
+	else
+	{
+		printf( "\nMonitor mode enabled. Checking for changes every %d seconds...\n", 
+			G->config->polling 
+		);
+	}
+	output_flush();
 	
 	/* allocate the memory needed to take another snapshot */
 	create_snapshot_store( &previous );
 	
+	/* the first poll's deadline is an interval from now */
+	create_schedule_store( &schedule );
+	
+	if( !init_schedule_store( schedule, G->config->polling_ms, 
+		G->config->adaptive_min_ms, G->config->adaptive_max_ms ) 
+	)
+	{
+		MSG_FATAL( "init_schedule_store() failed." );
+		exit( 1 );
+	}
+	
 	for( ;; )
 	{
-		Sleep( G->config->polling * 1000 );
+		unsigned missed = 0;
+		
+		
+		/* if the capture is pipelined then start it shortly before the deadline, so that the thread 
+		info it lists is about as recent as the hooks that are read when the snapshot is taken.
+		*/
+		if( G->capture->init_time )
+		{
+			wait_schedule_lead( schedule, CAPTURE_LEAD_MS );
+			start_capture( G->capture );
+		}
+		
+		/* wait until the deadline of the next poll. if the last poll took longer than the interval 
+		then the deadline has passed and the next snapshot is taken now.
+		*/
+		missed = wait_schedule( schedule );
+		
+		if( missed && ( G->config->verbose >= 1 ) )
+		{
+			printf( "\nThe last poll overran the schedule by %.3f ms. %u deadlines missed.\n", 
+				( (double)schedule->last_overrun * 1000.0 / (double)schedule->frequency ), 
+				missed 
+			);
+		}
+		
+		++check_count;
+		
+		/* if no HOOK has changed since the last snapshot then another snapshot would be the same. 
+		skip it and wait for the next poll. the fingerprint is timed as a scan of the handle table.
+		*/
+		if( G->config->flags & CFG_SKIP_UNCHANGED )
+		{
+			__int64 ticks = get_timing_ticks( G->timing );
+			
+			
+			ret = is_hook_fingerprint_unchanged( current->desktop_hooks );
+			add_timing( G->timing, TIMING_SCAN, ticks );
+			
+			if( ret )
+			{
+				++skip_count;
+				
+				adapt_schedule( schedule, 0 );
+				
+				if( G->config->verbose >= 2 )
+				{
+					printf( "Skipped %I64u of %I64u checks (%.1f%%), the hooks were unchanged.\n", 
+						skip_count, 
+						check_count, 
+						( (double)skip_count * 100.0 / (double)check_count ) 
+					);
+				}
+				
+				end_global_timing_poll();
+				continue;
+			}
+		}
 		
 		/* swap pointers to previous and current snapshot stores.
 		this is better than continually freeing and creating the stores.
@@ -214,8 +332,8 @@ int gethooks()
 		previous = current;
 		current = temp;
 		
-		/* take a snapshot */
-		ret = init_snapshot_store( current );
+		/* take a snapshot. HOOKs that haven't changed since the previous snapshot are marked unchanged */
+		ret = init_snapshot_store( current, previous );
 		
 		if( G->config->verbose >= 8 )
 			print_snapshot_store( current );
@@ -226,15 +344,59 @@ int gethooks()
 			exit( 1 );
 		}
 		
+		if( G->config->snapshot_file && !write_snapshot_file( current, G->config->snapshot_file ) )
+		{
+			MSG_FATAL( "write_snapshot_file() failed." );
+			exit( 1 );
+		}
+		
 		/* Print the HOOKs that have been added/removed/modified since the last snapshot */
-		print_diff_desktop_hook_lists( previous->desktop_hooks, current->desktop_hooks );
+		changes = print_diff_desktop_hook_lists( events, previous->desktop_hooks, current->desktop_hooks );
+		
+		/* if polling is adaptive then poll sooner after changes and later when there are none */
+		adapt_schedule( schedule, changes );
+		
+		/* print how many threads' info was reused from the last snapshot, and how many polls were 
+		on schedule
+		*/
+		if( G->config->verbose >= 2 )
+		{
+			print_cache_stats( G->cache );
+			print_schedule_stats( schedule );
+			printf( "\n" );
+			
+			if( G->capture->init_time )
+			{
+				print_capture_stats( G->capture );
+				printf( "\n" );
+			}
+			
+			if( G->config->flags & CFG_SKIP_UNCHANGED )
+			{
+				printf( "Skipped %I64u of %I64u checks (%.1f%%).\n", 
+					skip_count, 
+					check_count, 
+					( (double)skip_count * 100.0 / (double)check_count ) 
+				);
+			}
+		}
+		
+		/* write the output of this poll before waiting for the next */
+		end_global_timing_poll();
 	}
 	
 	
 cleanup:
+	/* if the user specified a timing summary file then write the summary */
+	if( G->timing->init_time && !write_timing_summary( G->timing ) )
+		MSG_ERROR( "write_timing_summary() failed." );
+	
 	/* free the stores and all their descendants */
 	free_snapshot_store( &previous );
 	free_snapshot_store( &current );
+	free_spare_snapshot_arena();
+	free_diff_event_store( &events );
+	free_schedule_store( &schedule );
 	
 	if( G->config->verbose >= 5 )
 		PRINT_HASHSEP_END( objname );
@@ -250,6 +412,8 @@ cleanup:
 #endif
 static void pause( void )
 {
+	/* the output is buffered and must be written before the pause */
+	output_flush();
 	system( "pause" );
 	return;
 }
@@ -333,13 +497,66 @@ int main( int argc, char **argv )
 	/* G->config has been initialized */
 	
 	
-	/* Initialize the global desktop store 'G->desktops', a descendant of the global store.
-	The global desktop store holds a linked list of attached to desktops and their heaps.
-	'G->config' must be initialized before initializing the global desktop store.
+	/* Initialize the global output store 'G->output', a descendant of the global store.
+	The global output store holds the buffer that HOOK notices are written to.
+	'G->config' must be initialized before initializing the global output store.
+	*/
+	init_global_output_store();
+	
+	/* G->output has been initialized */
+	
+	
+	/* Initialize the global timing store 'G->timing', a descendant of the global store.
+	The global timing store holds the time taken by each phase of each poll, if the user asked.
+	'G->config' must be initialized before initializing the global timing store.
 	*/
-	init_global_desktop_store();
+	init_global_timing_store();
 	
-	/* G->desktops has been initialized */
+	/* G->timing has been initialized, unless the phases aren't timed */
+	
+	
+	/* If the user specified a snapshot file or directory to replay then no desktops are attached to 
+	and no snapshots of the system are taken, so the stores that read the system aren't initialized.
+	The stores that replay() depends on have been initialized above.
+	*/
+	if( !G->config->replay_path )
+	{
+		/* Initialize the global desktop store 'G->desktops', a descendant of the global store.
+		The global desktop store holds a linked list of attached to desktops and their heaps.
+		'G->config' must be initialized before initializing the global desktop store.
+		*/
+		init_global_desktop_store();
+		
+		/* G->desktops has been initialized */
+		
+		
+		/* Initialize the global cache store 'G->cache', a descendant of the global store.
+		The global cache store holds the thread info and process handles that persist across snapshots.
+		'G->config' must be initialized before initializing the global cache store.
+		*/
+		init_global_cache_store();
+		
+		/* G->cache has been initialized */
+		
+		
+		/* Initialize the global pool store 'G->pool', a descendant of the global store.
+		The global pool store holds the worker threads that find GUI threads, if there are any.
+		'G->config' must be initialized before initializing the global pool store.
+		*/
+		init_global_pool_store();
+		
+		/* G->pool has been initialized, unless there are no worker threads */
+		
+		
+		/* Initialize the global capture store 'G->capture', a descendant of the global store.
+		The global capture store holds the thread that queries the system process info ahead of the 
+		snapshots in monitor mode, if the user asked.
+		'G->config' must be initialized before initializing the global capture store.
+		*/
+		init_global_capture_store();
+		
+		/* G->capture has been initialized, unless the capture is not pipelined */
+	}
 	
 	
 	/* The global store is initialized */
@@ -348,9 +565,14 @@ int main( int argc, char **argv )
 		print_global_store();
 	
 	
-	/* If the testlist is initialized the user requested testmode to run tests.
+	/* If the user specified a snapshot file or directory then run replay() to replay it.
+	Else if the testlist is initialized the user requested testmode to run tests.
 	Else run gethooks() to take snapshots and print differences.
-	testmode() and gethooks() return nonzero on success, but main should return zero on success.
+	replay(), testmode() and gethooks() return nonzero on success, but main should return zero on 
+	success.
 	*/
+	if( G->config->replay_path )
+		return !replay();
+	
 	return ( ( G->config->testlist->init_time ) ? !testmode() : !gethooks() );
 }
@@ -0,0 +1,426 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for an output store, the sink that the HOOK notices are written to.
+Each function is documented in the comment block above its definition.
+
+For now there is only one output store that is written to and it's a global store (G->output).
+The output store is described in output.h.
+
+-
+create_output_store()
+
+Create an output store and its descendants or die.
+-
+
+-
+init_output_store()
+
+Initialize an output store's backend and buffer.
+-
+
+-
+init_global_output_store()
+
+Initialize the global output store according to the user's configuration.
+-
+
+-
+output_printf()
+
+Print formatted output to the global output store.
+-
+
+-
+output_flush()
+
+Flush the global output store.
+-
+
+-
+print_output_store()
+
+Print an output store.
+-
+
+-
+print_global_output_store()
+
+Print the global output store.
+-
+
+-
+free_output_store()
+
+Flush and free an output store.
+-
+
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <limits.h>
+
+#include "util.h"
+
+#include "output.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* create_output_store()
+Create an output store and its descendants or die.
+*/
+void create_output_store( 
+	struct output **const out   // out deref
+)
+{
+	struct output *store = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate an output store */
+	store = must_calloc( 1, sizeof( *store ) );
+	
+	
+	*out = store;
+	return;
+}
+
+
+
+/* init_output_store()
+Initialize an output store's backend and buffer.
+
+'store' is the output store
+'type' is the backend
+'filename' is the name of the file to write to if the backend is OUTPUT_FILE
+'buffer_size' is the size of the buffer in bytes. if zero then OUTPUT_BUFFER_SIZE is used.
+
+If the backend is a file then stdout is reopened as the file so that everything that would have been 
+printed to the console, including error messages, is written to the file in order. Either way stdout 
+is then fully buffered.
+
+stdout has already been written to when this is called. Microsoft's CRT flushes a stream and frees 
+its old buffer in setvbuf(), so stdout is flushed first and its buffer can still be changed.
+
+returns nonzero on success
+*/
+int init_output_store( 
+	struct output *const store,   // in, out
+	const enum output_type type,   // in
+	const WCHAR *const filename,   // in, optional
+	const size_t buffer_size   // in, optional
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	FAIL_IF( !type );
+	FAIL_IF( ( type == OUTPUT_FILE ) && !filename );
+	FAIL_IF( buffer_size > INT_MAX );
+	
+	
+	store->type = type;
+	store->buffer_size = ( buffer_size ? buffer_size : OUTPUT_BUFFER_SIZE );
+	
+	if( type == OUTPUT_CONSOLE )
+	{
+		store->stream = stdout;
+		
+		fflush( stdout );
+		
+		/* the buffer is allocated by setvbuf() and is freed with the stream */
+		if( setvbuf( store->stream, NULL, _IOFBF, store->buffer_size ) )
+		{
+			MSG_ERROR( "setvbuf() failed." );
+			return FALSE;
+		}
+	}
+	else if( type == OUTPUT_FILE )
+	{
+		store->stream = stdout;
+		store->pwszFileName = must_wcsdup( filename );
+		
+		/* whatever has been printed to the console must be written before stdout is reopened */
+		fflush( stdout );
+		
+		if( !_wfreopen( store->pwszFileName, L"w", stdout ) )
+		{
+			MSG_ERROR( "_wfreopen() failed." );
+			printf( "file: %ls\n", store->pwszFileName );
+			return FALSE;
+		}
+		
+		/* the stream was just reopened so its buffer can still be set. the buffer is allocated by 
+		setvbuf() and is freed with the stream, so it outlives the output store.
+		*/
+		if( setvbuf( store->stream, NULL, _IOFBF, store->buffer_size ) )
+		{
+			MSG_ERROR( "setvbuf() failed." );
+			return FALSE;
+		}
+	}
+	else if( type == OUTPUT_MEMORY )
+		store->buffer = must_calloc( store->buffer_size, 1 );
+	else
+	{
+		MSG_ERROR( "Unknown output type." );
+		printf( "type: %d\n", type );
+		return FALSE;
+	}
+	
+	/* this store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* init_global_output_store()
+Initialize the global output store according to the user's configuration.
+
+If the user specified the 'o' option then the output is written to a file, otherwise the console.
+
+This function must only be called from the main thread.
+'G->output' depends on the global program (G->prog) and configuration (G->config) stores.
+*/
+void init_global_output_store( void )
+{
+	FAIL_IF( !G );   // The global store must exist.
+	
+	FAIL_IF( G->output->init_time );   // Fail if this store has already been initialized.
+	
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( !init_output_store( G->output, 
+		( G->config->output_file ? OUTPUT_FILE : OUTPUT_CONSOLE ), 
+		G->config->output_file, 
+		0 ) 
+	)
+	{
+		MSG_FATAL( "init_output_store() failed." );
+		exit( 1 );
+	}
+	
+	return;
+}
+
+
+
+/* output_printf()
+Print formatted output to the global output store.
+
+This is printf() for anything that's part of a HOOK notice. If the global output store hasn't been 
+initialized then this is the same as printf().
+
+If the backend is memory and there isn't enough room left in the buffer then the buffer is discarded 
+as if it had been flushed. If the output doesn't fit in an empty buffer it's truncated.
+
+returns the number of characters written, or a negative value on error.
+*/
+int output_printf( 
+	const char *const format,   // in
+	...
+)
+{
+	struct output *const store = ( G ? G->output : NULL );
+	va_list args;
+	int ret = 0;
+	
+	FAIL_IF( !format );
+	
+	
+	if( !store || !store->init_time )
+	{
+		va_start( args, format );
+		ret = vprintf( format, args );
+		va_end( args );
+		
+		return ret;
+	}
+	
+	if( store->type != OUTPUT_MEMORY )
+	{
+		va_start( args, format );
+		ret = vfprintf( store->stream, format, args );
+		va_end( args );
+	}
+	else
+	{
+		for( ;; )
+		{
+			const size_t remaining = store->buffer_size - store->buffer_used;
+			
+			
+			va_start( args, format );
+			ret = _vsnprintf( store->buffer + store->buffer_used, remaining, format, args );
+			va_end( args );
+			
+			/* the output and its null terminator fit */
+			if( ( ret >= 0 ) && ( (size_t)ret < remaining ) )
+			{
+				store->buffer_used += ret;
+				break;
+			}
+			
+			/* the output doesn't fit in an empty buffer so it's truncated */
+			if( !store->buffer_used )
+			{
+				ret = (int)( remaining - 1 );
+				store->buffer[ ret ] = '\0';
+				store->buffer_used = 0;
+				++store->flush_count;
+				break;
+			}
+			
+			/* discard the buffer and try again */
+			store->buffer_used = 0;
+			++store->flush_count;
+		}
+	}
+	
+	if( ret > 0 )
+		store->bytes_written += ret;
+	
+	return ret;
+}
+
+
+
+/* output_flush()
+Flush the global output store.
+
+This is called at each flush point, which is after each snapshot has been printed, and before the 
+program waits for anything. If the global output store hasn't been initialized then stdout is 
+flushed.
+*/
+void output_flush( void )
+{
+	struct output *const store = ( G ? G->output : NULL );
+	
+	
+	if( !store || !store->init_time )
+	{
+		fflush( stdout );
+		return;
+	}
+	
+	if( store->type == OUTPUT_MEMORY )
+		store->buffer_used = 0;
+	else
+		fflush( store->stream );
+	
+	++store->flush_count;
+	
+	return;
+}
+
+
+
+/* print_output_store()
+Print an output store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_output_store( 
+	const struct output *const store   // in
+)
+{
+	const char *const objname = "Output Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->type: " );
+	if( store->type == OUTPUT_CONSOLE )
+		printf( "OUTPUT_CONSOLE" );
+	else if( store->type == OUTPUT_FILE )
+		printf( "OUTPUT_FILE" );
+	else if( store->type == OUTPUT_MEMORY )
+		printf( "OUTPUT_MEMORY" );
+	else
+		printf( "<unknown> (%d)", store->type );
+	printf( "\n" );
+	
+	printf( "store->pwszFileName: %ls\n", 
+		( store->pwszFileName ? store->pwszFileName : L"<NULL>" ) 
+	);
+	printf( "store->buffer_size: %Iu\n", store->buffer_size );
+	printf( "store->buffer_used: %Iu\n", store->buffer_used );
+	printf( "store->bytes_written: %I64u\n", store->bytes_written );
+	printf( "store->flush_count: %I64u\n", store->flush_count );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* print_global_output_store()
+Print the global output store.
+*/
+void print_global_output_store( void )
+{
+	print_output_store( G->output );
+	return;
+}
+
+
+
+/* free_output_store()
+Flush and free an output store.
+
+If the backend is a stream then the stream is flushed. The stream stays open since it's stdout.
+
+this function then sets the output store pointer to NULL and returns
+if( !in || !*in ) then this function returns.
+*/
+void free_output_store( 
+	struct output **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->stream )
+		fflush( (*in)->stream );
+	
+	free( (*in)->buffer );
+	free( (*in)->pwszFileName );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,180 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <windows.h>
+
+#include <stdio.h>
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The output store type.
+The different backends that the output can be written to.
+*/
+enum output_type
+{
+	OUTPUT_INVALID_TYPE,   // 0 is an invalid type
+	OUTPUT_CONSOLE,   // stdout, fully buffered. this is the default.
+	OUTPUT_FILE,   // stdout reopened as a file, fully buffered. user specified the 'o' option.
+	OUTPUT_MEMORY   // a memory buffer that is discarded when full or flushed. for benchmarks.
+};
+
+
+
+/** The output store.
+The output store is a sink that the HOOK notices and the other diff output are written to.
+
+Printing a HOOK notice is dozens of small writes. The stream is flushed only at each flush point, 
+which is after each snapshot is printed, instead of after every notice.
+
+The console and file backends are stdout, so that what is written by printf() directly, like error 
+messages, is still in order with what's written to the sink. Both fully buffer stdout with a large 
+buffer. The file backend reopens stdout as the file first. MSG_LOCATION() flushes stdout before and 
+after an error or warning, so it isn't held behind the notices until the next flush point.
+*/
+struct output
+{
+	/* the backend */
+	enum output_type type;
+	
+	/* the stream the output is written to. NULL if the backend is memory. */
+	FILE *stream;   // console: stdout. file: _wfopen(), fclose()
+	
+	/* the name of the output file. NULL unless the backend is a file. */
+	WCHAR *pwszFileName;   // _wcsdup(), free()
+	
+	/* the buffer the output is written to, if the backend is memory. NULL otherwise. */
+	char *buffer;   // calloc(), free()
+	
+	/* the size of the buffer in bytes. if the backend is the console or a file this is the size of 
+	the stream's buffer, which is allocated by setvbuf().
+	*/
+	size_t buffer_size;
+	
+	/* the number of bytes used in the buffer. only the memory backend keeps track of this. */
+	size_t buffer_used;
+	
+	/* the number of bytes that have been written to the sink */
+	unsigned __int64 bytes_written;
+	
+	/* the number of times the sink has been flushed */
+	unsigned __int64 flush_count;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/* the default size of the output buffer in bytes */
+#define OUTPUT_BUFFER_SIZE   ( 1024 * 1024 )
+
+
+
+/** Print an address in hex to the output store. 
+These work the same as PRINT_HEX_BARE() and PRINT_HEX_NAME() in util.h.
+*/
+#define OUTPUT_HEX_BARE(addr)   \
+	do \
+	{ \
+		size_t bytes = sizeof( addr ); \
+		 \
+		if( bytes == sizeof(BYTE) ) \
+			output_printf( "0x%0*I64X", (int)( sizeof( BYTE ) * 2 ), (UINT64)(*(BYTE *)&addr ) ); \
+		else if( bytes == sizeof(WORD) ) \
+			output_printf( "0x%0*I64X", (int)( sizeof( WORD ) * 2 ), (UINT64)(*(WORD *)&addr ) ); \
+		else if( bytes == sizeof(DWORD) ) \
+			output_printf( "0x%0*I64X", (int)( sizeof( DWORD ) * 2 ), (UINT64)(*(DWORD *)&addr ) ); \
+		else if( bytes == sizeof(UINT64) ) \
+			output_printf( "0x%0*I64X", (int)( sizeof( UINT64 ) * 2 ), (UINT64)(*(UINT64 *)&addr ) ); \
+		else \
+			output_printf( "<unimplemented>" ); \
+		 \
+__pragma(warning(push)) \
+__pragma(warning(disable:4127)) \
+	} while( 0 ) \
+__pragma(warning(pop))
+
+#define OUTPUT_HEX_NAME(name,addr)   \
+	do \
+	{ \
+		const char *str = NULL; \
+		str = ( name ); \
+		output_printf( "%s%s", ( str ? str : "" ), ( ( str && str[ 0 ] ) ? ": " : "" ) ); \
+		OUTPUT_HEX_BARE( ( addr ) ); \
+		output_printf( "\n" ); \
+		 \
+__pragma(warning(push)) \
+__pragma(warning(disable:4127)) \
+	} while( 0 ) \
+__pragma(warning(pop))
+
+#define OUTPUT_HEX(addr)   OUTPUT_HEX_NAME( #addr, ( addr ) )
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in output.c
+*/
+void create_output_store( 
+	struct output **const out   // out deref
+);
+
+int init_output_store( 
+	struct output *const store,   // in, out
+	const enum output_type type,   // in
+	const WCHAR *const filename,   // in, optional
+	const size_t buffer_size   // in, optional
+);
+
+void init_global_output_store( void );
+
+int output_printf( 
+	const char *const format,   // in
+	...
+);
+
+void output_flush( void );
+
+void print_output_store( 
+	const struct output *const store   // in
+);
+
+void print_global_output_store( void );
+
+void free_output_store( 
+	struct output **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _OUTPUT_H
@@ -0,0 +1,455 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a pool store, a pool of worker threads.
+Each function is documented in the comment block above its definition.
+
+For now there is only one pool store and it's a global store (G->pool). It's only initialized if the 
+user specified more than one worker thread.
+The pool store is described in pool.h.
+
+-
+create_pool_store()
+
+Create a pool store and its descendants or die.
+-
+
+-
+init_pool_store()
+
+Initialize a pool store by creating its worker threads.
+-
+
+-
+init_global_pool_store()
+
+Initialize the global pool store according to the user's configuration.
+-
+
+-
+pool_worker_thread()
+
+The thread function of each worker in a pool.
+-
+
+-
+partition_pool_ranges()
+
+Partition a count of work items into contiguous ranges, one for each worker.
+-
+
+-
+run_pool()
+
+Run a function on the pool's workers, each with its own range of work items, and wait for them.
+-
+
+-
+print_pool_store()
+
+Print a pool store.
+-
+
+-
+print_global_pool_store()
+
+Print the global pool store.
+-
+
+-
+free_pool_store()
+
+Stop a pool store's worker threads and free the store.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "pool.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+static DWORD WINAPI pool_worker_thread( 
+	LPVOID lpParameter   // in
+);
+
+
+
+/* create_pool_store()
+Create a pool store and its descendants or die.
+*/
+void create_pool_store( 
+	struct pool **const out   // out deref
+)
+{
+	struct pool *store = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a pool store */
+	store = must_calloc( 1, sizeof( *store ) );
+	
+	
+	*out = store;
+	return;
+}
+
+
+
+/* init_pool_store()
+Initialize a pool store by creating its worker threads.
+
+'worker_count' is the number of worker threads, from 1 to POOL_MAX_WORKERS.
+
+If a worker thread can't be created then the workers that were created are left for 
+free_pool_store() to stop, and the pool must not be run.
+
+returns nonzero on success
+*/
+int init_pool_store( 
+	struct pool *const store,   // in, out
+	const unsigned worker_count   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	FAIL_IF( !worker_count || ( worker_count > POOL_MAX_WORKERS ) );
+	
+	
+	store->worker = must_calloc( worker_count, sizeof( *store->worker ) );
+	store->worker_max = worker_count;
+	
+	for( i = 0; i < worker_count; ++i )
+	{
+		struct pool_worker *const worker = &store->worker[ i ];
+		
+		
+		worker->pool = store;
+		
+		/* both events are auto-reset and initially nonsignaled */
+		worker->start = CreateEvent( NULL, FALSE, FALSE, NULL );
+		worker->done = CreateEvent( NULL, FALSE, FALSE, NULL );
+		
+		if( !worker->start || !worker->done )
+		{
+			MSG_ERROR_GLE( "CreateEvent() failed." );
+			return FALSE;
+		}
+		
+		worker->thread = CreateThread( NULL, 0, pool_worker_thread, worker, 0, NULL );
+		
+		if( !worker->thread )
+		{
+			MSG_ERROR_GLE( "CreateThread() failed." );
+			return FALSE;
+		}
+		
+		/* the number of workers that can be run */
+		store->worker_count = i + 1;
+	}
+	
+	/* this store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* init_global_pool_store()
+Initialize the global pool store according to the user's configuration.
+
+The pool is only initialized if the user specified more than one worker thread with the 'j' option. 
+Otherwise the GUI threads are found on the main thread and the pool isn't used.
+
+This function must only be called from the main thread.
+'G->pool' depends on the global program (G->prog) and configuration (G->config) stores.
+*/
+void init_global_pool_store( void )
+{
+	FAIL_IF( !G );   // The global store must exist.
+	
+	FAIL_IF( G->pool->init_time );   // Fail if this store has already been initialized.
+	
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( G->config->worker_threads <= 1 )
+		return;
+	
+	if( !init_pool_store( G->pool, G->config->worker_threads ) )
+	{
+		MSG_FATAL( "init_pool_store() failed." );
+		exit( 1 );
+	}
+	
+	return;
+}
+
+
+
+/* pool_worker_thread()
+The thread function of each worker in a pool.
+
+The worker waits to be started, does its range of work items and then signals that it's done. It 
+exits when it's started and the pool's quit flag is set.
+
+returns zero
+*/
+static DWORD WINAPI pool_worker_thread( 
+	LPVOID lpParameter   // in
+)
+{
+	struct pool_worker *const worker = (struct pool_worker *)lpParameter;
+	
+	
+	for( ;; )
+	{
+		WaitForSingleObject( worker->start, INFINITE );
+		
+		if( worker->pool->quit )
+			break;
+		
+		worker->pool->callback( worker->pool->param, worker->range.begin, worker->range.end );
+		
+		SetEvent( worker->done );
+	}
+	
+	return 0;
+}
+
+
+
+/* partition_pool_ranges()
+Partition a count of work items into contiguous ranges, one for each worker.
+
+'key' is optional. If it's specified then it points to the key of the first work item, and each 
+key is an unsigned __int64 'key_stride' bytes after the last. A range never ends between two work 
+items with the same key, so that consecutive work items with the same key, for example the threads 
+of a process, are always done by the same worker.
+'count' is the number of work items.
+'parts' is the maximum number of ranges.
+'range' receives the ranges. It must have room for 'parts' ranges.
+
+The work items are divided as evenly as possible, and then each range is extended to the end of its 
+last key. Every work item is in exactly one range, and the ranges are in order.
+
+returns the number of ranges
+*/
+unsigned partition_pool_ranges( 
+	const void *const key,   // in, optional
+	const size_t key_stride,   // in, optional
+	const unsigned count,   // in
+	const unsigned parts,   // in
+	struct pool_range *const range   // out
+)
+{
+	unsigned i = 0, begin = 0;
+	
+	FAIL_IF( key && !key_stride );
+	FAIL_IF( !parts );
+	FAIL_IF( !range );
+	
+	
+#define PARTITION_KEY(index)   \
+	( *(const unsigned __int64 *)( (const char *)key + ( (size_t)( index ) * key_stride ) ) )
+	
+	for( i = 0; ( i < parts ) && ( begin < count ); ++i )
+	{
+		const unsigned remaining = count - begin;
+		const unsigned parts_remaining = parts - i;
+		unsigned end = begin + ( ( remaining + parts_remaining - 1 ) / parts_remaining );
+		
+		
+		while( key && ( end < count ) && ( PARTITION_KEY( end ) == PARTITION_KEY( end - 1 ) ) )
+			++end;
+		
+		range[ i ].begin = begin;
+		range[ i ].end = end;
+		begin = end;
+	}
+	
+#undef PARTITION_KEY
+	
+	return i;
+}
+
+
+
+/* run_pool()
+Run a function on the pool's workers, each with its own range of work items, and wait for them.
+
+'callback' is called once on a worker thread for each range that isn't empty.
+'param' is passed to each call of 'callback'.
+'range' is the array of ranges. The first range is done by the first worker, and so on.
+'range_count' is the number of ranges. It can't be more than the number of workers.
+
+This function returns after every worker has done its range.
+This function must only be called from the main thread.
+*/
+void run_pool( 
+	struct pool *const store,   // in, out
+	pool_callback callback,   // in
+	void *param,   // in, out, optional
+	const struct pool_range *const range,   // in
+	const unsigned range_count   // in
+)
+{
+	unsigned i = 0, started = 0;
+	HANDLE done[ POOL_MAX_WORKERS ];
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The pool store must be initialized.
+	FAIL_IF( !callback );
+	FAIL_IF( !range );
+	FAIL_IF( range_count > store->worker_count );
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	store->callback = callback;
+	store->param = param;
+	
+	for( i = 0; i < range_count; ++i )
+	{
+		if( range[ i ].begin >= range[ i ].end )
+			continue;
+		
+		store->worker[ i ].range = range[ i ];
+		done[ started++ ] = store->worker[ i ].done;
+		
+		SetEvent( store->worker[ i ].start );
+	}
+	
+	if( started && 
+		( WaitForMultipleObjects( started, done, TRUE, INFINITE ) == WAIT_FAILED ) 
+	)
+	{
+		MSG_FATAL_GLE( "WaitForMultipleObjects() failed." );
+		exit( 1 );
+	}
+	
+	++store->run_count;
+	return;
+}
+
+
+
+/* print_pool_store()
+Print a pool store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_pool_store( 
+	const struct pool *const store   // in
+)
+{
+	const char *const objname = "Pool Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->worker_max: %u\n", store->worker_max );
+	printf( "store->worker_count: %u\n", store->worker_count );
+	printf( "store->quit: %ld\n", store->quit );
+	printf( "store->run_count: %I64u\n", store->run_count );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* print_global_pool_store()
+Print the global pool store.
+*/
+void print_global_pool_store( void )
+{
+	print_pool_store( G->pool );
+	return;
+}
+
+
+
+/* free_pool_store()
+Stop a pool store's worker threads and free the store.
+
+Each worker is started with the quit flag set, and then waited on until it exits.
+
+this function then sets the pool store pointer to NULL and returns
+if( !in || !*in ) then this function returns.
+*/
+void free_pool_store( 
+	struct pool **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	InterlockedExchange( &(*in)->quit, 1 );
+	
+	/* a worker whose thread couldn't be created may still have its events */
+	for( i = 0; i < (*in)->worker_max; ++i )
+	{
+		struct pool_worker *const worker = &(*in)->worker[ i ];
+		
+		
+		if( worker->thread )
+		{
+			SetEvent( worker->start );
+			WaitForSingleObject( worker->thread, INFINITE );
+			CloseHandle( worker->thread );
+		}
+		
+		if( worker->start )
+			CloseHandle( worker->start );
+		
+		if( worker->done )
+			CloseHandle( worker->done );
+	}
+	
+	free( (*in)->worker );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,168 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <windows.h>
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Forward declaration for the pool store.
+*/
+struct pool;
+
+
+
+/** A range of work items, from 'begin' up to but not including 'end'.
+*/
+struct pool_range
+{
+	unsigned begin;
+	unsigned end;
+};
+
+
+
+/** The function that is called on a worker thread to do a range of work items.
+'param' is the parameter that was passed to run_pool().
+The function must only write to the work items in its own range.
+*/
+typedef void ( __cdecl *pool_callback )( 
+	void *param,   // in, out, optional
+	const unsigned begin,   // in
+	const unsigned end   // in
+);
+
+
+
+/** A worker thread in a pool.
+*/
+struct pool_worker
+{
+	/* the pool this worker belongs to */
+	struct pool *pool;
+	
+	/* the worker thread */
+	HANDLE thread;   // CreateThread(), CloseHandle()
+	
+	/* signaled by the main thread when the worker has a range to do */
+	HANDLE start;   // CreateEvent(), CloseHandle()
+	
+	/* signaled by the worker when it has done its range */
+	HANDLE done;   // CreateEvent(), CloseHandle()
+	
+	/* the range of work items the worker does on its next start */
+	struct pool_range range;
+};
+
+
+
+/** The pool store.
+The pool store is a pool of worker threads that each do a range of work items in parallel.
+
+The worker threads are created once and wait to be started by run_pool(). The caller decides which 
+range of work items each worker does, usually with partition_pool_ranges().
+*/
+struct pool
+{
+	/* the array of workers */
+	struct pool_worker *worker;   // calloc(), free()
+	
+	/* the number of workers in the array */
+	unsigned worker_max;
+	
+	/* the number of workers whose threads have been created */
+	unsigned worker_count;
+	
+	/* the function and parameter of the current run */
+	pool_callback callback;
+	void *param;
+	
+	/* nonzero when the workers must exit */
+	volatile LONG quit;
+	
+	/* the number of times the pool has been run */
+	unsigned __int64 run_count;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/* the maximum number of workers in a pool. run_pool() waits on every worker's event at once. */
+#define POOL_MAX_WORKERS   MAXIMUM_WAIT_OBJECTS
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in pool.c
+*/
+void create_pool_store( 
+	struct pool **const out   // out deref
+);
+
+int init_pool_store( 
+	struct pool *const store,   // in, out
+	const unsigned worker_count   // in
+);
+
+void init_global_pool_store( void );
+
+unsigned partition_pool_ranges( 
+	const void *const key,   // in, optional
+	const size_t key_stride,   // in, optional
+	const unsigned count,   // in
+	const unsigned parts,   // in
+	struct pool_range *const range   // out
+);
+
+void run_pool( 
+	struct pool *const store,   // in, out
+	pool_callback callback,   // in
+	void *param,   // in, out, optional
+	const struct pool_range *const range,   // in
+	const unsigned range_count   // in
+);
+
+void print_pool_store( 
+	const struct pool *const store   // in
+);
+
+void print_global_pool_store( void );
+
+void free_pool_store( 
+	struct pool **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _POOL_H
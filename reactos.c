@@ -96,6 +96,8 @@ Get the HOOK id from its name.
 
 #include "reactos.h"
 
+#include "output.h"
+
 
 
 /* w_handlenames[]
@@ -162,25 +164,25 @@ void print_HANDLEENTRY_flags(
 		return;
 	
 	if( bFlags & HANDLEF_DESTROY )
-		printf( "HANDLEF_DESTROY " );
+		output_printf( "HANDLEF_DESTROY " );
 	
 	if( bFlags & HANDLEF_INDESTROY )
-		printf( "HANDLEF_INDESTROY " );
+		output_printf( "HANDLEF_INDESTROY " );
 	
 	if( bFlags & HANDLEF_INWAITFORDEATH )
-		printf( "HANDLEF_INWAITFORDEATH " );
+		output_printf( "HANDLEF_INWAITFORDEATH " );
 	
 	if( bFlags & HANDLEF_FINALDESTROY )
-		printf( "HANDLEF_FINALDESTROY " );
+		output_printf( "HANDLEF_FINALDESTROY " );
 	
 	if( bFlags & HANDLEF_MARKED_OK )
-		printf( "HANDLEF_MARKED_OK " );
+		output_printf( "HANDLEF_MARKED_OK " );
 	
 	if( bFlags & HANDLEF_GRANTED )
-		printf( "HANDLEF_GRANTED " );
+		output_printf( "HANDLEF_GRANTED " );
 	
 	if( bFlags & ~(unsigned)HANDLEF_VALID )
-		printf( "<0x%02X> ", (unsigned)( bFlags & ~(unsigned)HANDLEF_VALID ) );
+		output_printf( "<0x%02X> ", (unsigned)( bFlags & ~(unsigned)HANDLEF_VALID ) );
 	
 	return;
 }
@@ -266,9 +268,9 @@ void print_HOOK_id(
 	const unsigned index = (unsigned)( iHook + 1 ); /* the array index is the same as id + 1 */
 
 	if( index < w_hooknames_count )
-		printf( "%ls ", w_hooknames[ index ] );
+		output_printf( "%ls ", w_hooknames[ index ] );
 	else
-		printf( "<%d> ", iHook );
+		output_printf( "<%d> ", iHook );
 	
 	return;
 }
@@ -288,31 +290,31 @@ void print_HOOK_flags(
 		return;
 	
 	if( flags & HF_GLOBAL )
-		printf( "HF_GLOBAL " );
+		output_printf( "HF_GLOBAL " );
 	
 	if( flags & HF_ANSI )
-		printf( "HF_ANSI " );
+		output_printf( "HF_ANSI " );
 	
 	if( flags & HF_NEEDHC_SKIP )
-		printf( "HF_NEEDHC_SKIP " );
+		output_printf( "HF_NEEDHC_SKIP " );
 	
 	if( flags & HF_HUNG )
-		printf( "HF_HUNG " );
+		output_printf( "HF_HUNG " );
 	
 	if( flags & HF_HOOKFAULTED )
-		printf( "HF_HOOKFAULTED " );
+		output_printf( "HF_HOOKFAULTED " );
 	
 	if( flags & HF_NOPLAYBACKDELAY )
-		printf( "HF_NOPLAYBACKDELAY " );
+		output_printf( "HF_NOPLAYBACKDELAY " );
 	
 	if( flags & HF_WX86KNOWINDOWLL )
-		printf( "HF_WX86KNOWINDOWLL " );
+		output_printf( "HF_WX86KNOWINDOWLL " );
 	
 	if( flags & HF_DESTROYED )
-		printf( "HF_DESTROYED " );
+		output_printf( "HF_DESTROYED " );
 	
 	if( flags & ~(DWORD)HF_VALID )
-		printf( "<0x%08lX> ", (DWORD)( flags & ~(DWORD)HF_VALID ) );
+		output_printf( "<0x%08lX> ", (DWORD)( flags & ~(DWORD)HF_VALID ) );
 	
 	return;
 }
@@ -340,16 +342,16 @@ void print_HOOK_anomalies(
 		)
 	)
 	{
-		printf( "ERROR: The HOOK @ " );
-		PRINT_HEX_BARE( object->pSelf );
-		printf( " is supposed to be global-only but is missing the HF_GLOBAL flag!\n" );
+		output_printf( "ERROR: The HOOK @ " );
+		OUTPUT_HEX_BARE( object->pSelf );
+		output_printf( " is supposed to be global-only but is missing the HF_GLOBAL flag!\n" );
 	}
 	
 	if( ( object->flags & HF_GLOBAL ) && object->ptiHooked )
 	{
-		printf( "ERROR: The global HOOK @ " );
-		PRINT_HEX_BARE( object->pSelf );
-		printf( " has a target address even though global HOOKs aren't supposed to have them.\n" );
+		output_printf( "ERROR: The global HOOK @ " );
+		OUTPUT_HEX_BARE( object->pSelf );
+		output_printf( " has a target address even though global HOOKs aren't supposed to have them.\n" );
 	}
 	
 	return;
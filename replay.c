@@ -0,0 +1,583 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for replaying snapshots from binary snapshot files.
+Each function is documented in the comment block above its definition.
+
+Replay is monitor mode without the system: the snapshots written by the 'w' option are loaded and 
+printed and compared by the same functions that print and compare live snapshots, as fast as they 
+can be loaded. No desktop is attached to and no process is read, so G->desktops, G->cache, G->pool 
+and G->capture are not initialized and the desktops the snapshots refer to are held in a desktop 
+store of their own that is made up of only their names.
+
+-
+compare_filename()
+
+Compare two file names without regard to case.
+-
+
+-
+get_replay_filenames()
+
+Get the names of the snapshot files to replay.
+-
+
+-
+get_replay_desktop()
+
+Get the desktop item for a desktop name from the replay desktop store, adding it if it's not there.
+-
+
+-
+is_replay_desktop_wanted()
+
+Check the user-specified desktop list to determine if a desktop's hooks should be replayed.
+-
+
+-
+prepare_replay_snapshot()
+
+Prepare a loaded snapshot to be printed and compared according to the user's configuration.
+-
+
+-
+is_same_desktop_layout()
+
+Check whether two snapshots' desktop hook lists can be compared.
+-
+
+-
+replay()
+
+Replay the snapshots in a snapshot file or a directory of snapshot files.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "snapshot_file.h"
+
+#include "diff.h"
+
+#include "output.h"
+
+#include "replay.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+static int compare_filename( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static unsigned get_replay_filenames( 
+	WCHAR ***const out,   // out deref
+	const WCHAR *const path   // in
+);
+
+static struct desktop_item *get_replay_desktop( 
+	struct desktop_list *const desktops,   // in
+	const WCHAR *const name   // in
+);
+
+static int is_replay_desktop_wanted( 
+	const WCHAR *const name   // in
+);
+
+static void prepare_replay_snapshot( 
+	struct snapshot *const snapshot,   // in, out
+	struct desktop_list *const desktops   // in
+);
+
+static int is_same_desktop_layout( 
+	const struct desktop_hook_list *const a,   // in
+	const struct desktop_hook_list *const b   // in
+);
+
+
+
+/* compare_filename()
+Compare two file names without regard to case.
+
+qsort() callback to sort an array of pointers to file names.
+
+returns the result of _wcsicmp()
+*/
+static int compare_filename( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const WCHAR *const a = *(const WCHAR *const *)p1;
+	const WCHAR *const b = *(const WCHAR *const *)p2;
+	
+	
+	return _wcsicmp( a, b );
+}
+
+
+
+/* get_replay_filenames()
+Get the names of the snapshot files to replay.
+
+'out' receives an array of file names, each allocated by must_calloc(). The caller must free each 
+name and then the array.
+'path' is the name of a snapshot file or a directory of snapshot files. if it's a directory then 
+the array has the name of each file in the directory, not including subdirectories, sorted by name.
+
+returns the number of file names in the array. if zero then no array is allocated.
+*/
+static unsigned get_replay_filenames( 
+	WCHAR ***const out,   // out deref
+	const WCHAR *const path   // in
+)
+{
+	DWORD attributes = 0;
+	HANDLE hFind = INVALID_HANDLE_VALUE;
+	WIN32_FIND_DATAW fd;
+	WCHAR *pattern = NULL;
+	WCHAR **name = NULL;
+	unsigned name_count = 0, name_max = 0;
+	size_t path_len = 0;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	FAIL_IF( !path );
+	
+	
+	attributes = GetFileAttributesW( path );
+	if( attributes == INVALID_FILE_ATTRIBUTES )
+	{
+		MSG_ERROR_GLE( "GetFileAttributesW() failed." );
+		printf( "path: %ls\n", path );
+		return 0;
+	}
+	
+	/* a single file */
+	if( !( attributes & FILE_ATTRIBUTE_DIRECTORY ) )
+	{
+		name = must_calloc( 1, sizeof( *name ) );
+		name[ 0 ] = must_wcsdup( path );
+		
+		*out = name;
+		return 1;
+	}
+	
+	/* a directory. find all the files in it. */
+	path_len = wcslen( path );
+	
+	/* path + '\' + '*' + '\0' */
+	pattern = must_calloc( path_len + 3, sizeof( *pattern ) );
+	wcscpy( pattern, path );
+	if( path_len && ( path[ path_len - 1 ] != L'\\' ) && ( path[ path_len - 1 ] != L'/' ) )
+		pattern[ path_len++ ] = L'\\';
+	pattern[ path_len ] = L'*';
+	
+	ZeroMemory( &fd, sizeof( fd ) );
+	
+	hFind = FindFirstFileW( pattern, &fd );
+	if( hFind == INVALID_HANDLE_VALUE )
+	{
+		if( GetLastError() != ERROR_FILE_NOT_FOUND )
+		{
+			MSG_ERROR_GLE( "FindFirstFileW() failed." );
+			printf( "pattern: %ls\n", pattern );
+		}
+		
+		free( pattern );
+		return 0;
+	}
+	
+	do
+	{
+		if( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+			continue;
+		
+		/* grow the array of names */
+		if( name_count == name_max )
+		{
+			WCHAR **temp = NULL;
+			
+			
+			name_max = ( name_max ? ( name_max * 2 ) : 16 );
+			temp = must_calloc( name_max, sizeof( *temp ) );
+			
+			if( name_count )
+				memcpy( temp, name, ( name_count * sizeof( *name ) ) );
+			
+			free( name );
+			name = temp;
+		}
+		
+		/* the directory path up to and including the separator, then the file name */
+		name[ name_count ] = 
+			must_calloc( path_len + wcslen( fd.cFileName ) + 1, sizeof( *name[ name_count ] ) );
+		
+		wcsncpy( name[ name_count ], pattern, path_len );
+		wcscpy( name[ name_count ] + path_len, fd.cFileName );
+		
+		++name_count;
+	} while( FindNextFileW( hFind, &fd ) );
+	
+	if( GetLastError() != ERROR_NO_MORE_FILES )
+	{
+		MSG_WARNING_GLE( "FindNextFileW() failed." );
+		printf( "Not all files in the directory will be replayed.\n" );
+	}
+	
+	FindClose( hFind );
+	free( pattern );
+	
+	if( name_count )
+		qsort( name, name_count, sizeof( *name ), compare_filename );
+	
+	*out = name;
+	return name_count;
+}
+
+
+
+/* get_replay_desktop()
+Get the desktop item for a desktop name from the replay desktop store, adding it if it's not there.
+
+The desktop items in the replay desktop store have only a name. Each desktop hook item of each 
+replayed snapshot is pointed to the item with its desktop's name, so that snapshots loaded from 
+different images and files have the same desktop items and can be compared.
+
+returns the desktop item
+*/
+static struct desktop_item *get_replay_desktop( 
+	struct desktop_list *const desktops,   // in
+	const WCHAR *const name   // in
+)
+{
+	struct desktop_item *item = NULL;
+	
+	FAIL_IF( !desktops );
+	FAIL_IF( !name );
+	
+	
+	for( item = desktops->head; item; item = item->next )
+	{
+		if( !wcscmp( item->pwszDesktopName, name ) )
+			return item;
+	}
+	
+	item = must_calloc( 1, sizeof( *item ) );
+	item->pwszDesktopName = must_wcsdup( name );
+	
+	if( !desktops->head )
+		desktops->head = item;
+	else
+		desktops->tail->next = item;
+	
+	desktops->tail = item;
+	
+	return item;
+}
+
+
+
+/* is_replay_desktop_wanted()
+Check the user-specified desktop list to determine if a desktop's hooks should be replayed.
+
+When taking snapshots the desktops that are not in the user's desktop list are never attached to so 
+there are no hooks from them. A snapshot file has the hooks from whatever desktops were attached to 
+when it was written so the desktop list is applied when it is replayed.
+
+If the user specified the 'd' option without any names then live snapshots are only of the current 
+desktop. There is no current desktop in a snapshot file so in that case every desktop is wanted.
+
+returns nonzero if the desktop's hooks should be replayed
+*/
+static int is_replay_desktop_wanted( 
+	const WCHAR *const name   // in
+)
+{
+	const struct list_item *item = NULL;
+	
+	FAIL_IF( !name );
+	
+	
+	if( !G->config->desklist->init_time || !G->config->desklist->head )
+		return TRUE;
+	
+	for( item = G->config->desklist->head; item; item = item->next )
+	{
+		if( item->name && !wcscmp( item->name, name ) )
+			return TRUE;
+	}
+	
+	return FALSE;
+}
+
+
+
+/* prepare_replay_snapshot()
+Prepare a loaded snapshot to be printed and compared according to the user's configuration.
+
+Each desktop hook item is pointed to the replay desktop store's item with its desktop's name.
+
+Whether a hook is ignored was decided by the configuration of the program that wrote the snapshot. 
+It's decided again here according to this program's configuration, and every hook on a desktop 
+that is not wanted is ignored.
+
+'snapshot' is a snapshot loaded by init_snapshot_file_store(). The view it's in is copy on write.
+'desktops' is the replay desktop store
+*/
+static void prepare_replay_snapshot( 
+	struct snapshot *const snapshot,   // in, out
+	struct desktop_list *const desktops   // in
+)
+{
+	struct desktop_hook_item *item = NULL;
+	
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->desktop_hooks );
+	FAIL_IF( !desktops );
+	
+	
+	for( item = snapshot->desktop_hooks->head; item; item = item->next )
+	{
+		unsigned i = 0;
+		int wanted = 0;
+		
+		
+		item->desktop = get_replay_desktop( desktops, item->desktop->pwszDesktopName );
+		
+		wanted = is_replay_desktop_wanted( item->desktop->pwszDesktopName );
+		
+		for( i = 0; i < item->hook_count; ++i )
+			item->hook[ i ].ignore = ( !wanted || !is_hook_wanted( &item->hook[ i ] ) );
+	}
+	
+	return;
+}
+
+
+
+/* is_same_desktop_layout()
+Check whether two snapshots' desktop hook lists can be compared.
+
+diff_desktop_hook_lists() compares the desktop hook items of two lists in order and requires 
+that each pair has the same desktop. That is always true in monitor mode but snapshot files may 
+have been written by different runs with different desktops.
+
+returns nonzero if the lists have the same desktops in the same order
+*/
+static int is_same_desktop_layout( 
+	const struct desktop_hook_list *const a,   // in
+	const struct desktop_hook_list *const b   // in
+)
+{
+	const struct desktop_hook_item *x = NULL;
+	const struct desktop_hook_item *y = NULL;
+	
+	FAIL_IF( !a );
+	FAIL_IF( !b );
+	
+	
+	for( x = a->head, y = b->head; ( x && y ); x = x->next, y = y->next )
+	{
+		if( ( x->desktop != y->desktop ) || ( x->hook_max != y->hook_max ) )
+			return FALSE;
+	}
+	
+	return ( !x && !y );
+}
+
+
+
+/* replay()
+Replay the snapshots in a snapshot file or a directory of snapshot files.
+
+The snapshot files are those written by the 'w' option. Each file is loaded and each snapshot in it 
+is printed and compared exactly as gethooks() does in monitor mode: the first snapshot's HOOKs are 
+printed as found and each snapshot after that is compared to the one before it. There's no delay 
+between snapshots.
+
+A file that fails to load is skipped. If a snapshot can't be compared to the one before it, because 
+it has different desktops, then it's printed as if it were the first snapshot.
+
+The time printed in each HOOK notice is the time the snapshot was taken.
+
+returns nonzero on success (at least one snapshot was replayed).
+*/
+int replay( void )
+{
+	const char *const objname = "Replay";
+	WCHAR **filename = NULL;
+	unsigned filename_count = 0;
+	struct desktop_list *desktops = NULL;
+	struct diff_event_list *events = NULL;
+	struct snapshot_file *previous_file = NULL;
+	struct snapshot_file *current_file = NULL;
+	const struct snapshot *previous = NULL;
+	unsigned i = 0;
+	unsigned file_count = 0, skipped_count = 0, snapshot_count = 0, restart_count = 0;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	FAIL_IF( !G->output->init_time );   // The output store must be initialized.
+	FAIL_IF( !G->config->replay_path );
+	
+	/* the stores that read the system must not be initialized in replay mode */
+	FAIL_IF( G->desktops->init_time );
+	FAIL_IF( G->cache->init_time );
+	FAIL_IF( G->pool->init_time );
+	FAIL_IF( G->capture->init_time );
+	
+	
+	if( G->config->verbose >= 5 )
+		PRINT_HASHSEP_BEGIN( objname );
+	
+	filename_count = get_replay_filenames( &filename, G->config->replay_path );
+	if( !filename_count )
+	{
+		MSG_ERROR( "No snapshot files were found." );
+		printf( "path: %ls\n", G->config->replay_path );
+		return FALSE;
+	}
+	
+	create_desktop_store( &desktops );
+	create_diff_event_store( &events );
+	
+	for( i = 0; i < filename_count; ++i )
+	{
+		unsigned j = 0;
+		
+		
+		create_snapshot_file_store( &current_file );
+		
+		if( !init_snapshot_file_store( current_file, filename[ i ], NULL ) )
+		{
+			MSG_ERROR( "init_snapshot_file_store() failed. The file will be skipped." );
+			printf( "file: %ls\n", filename[ i ] );
+			
+			free_snapshot_file_store( &current_file );
+			++skipped_count;
+			continue;
+		}
+		
+		++file_count;
+		
+		if( G->config->verbose >= 1 )
+			printf( "\nReplaying %u snapshots from '%ls'.\n", 
+				current_file->snapshot_count, 
+				current_file->pwszFileName 
+			);
+		
+		for( j = 0; j < current_file->snapshot_count; ++j )
+		{
+			struct snapshot *current = current_file->snapshot[ j ];
+			
+			
+			prepare_replay_snapshot( current, desktops );
+			
+			set_hook_notice_time( current->init_time );
+			
+			if( previous && is_same_desktop_layout( previous->desktop_hooks, current->desktop_hooks ) )
+			{
+				/* Print the HOOKs that have been added/removed/modified since the last snapshot */
+				print_diff_desktop_hook_lists( events, 
+					previous->desktop_hooks, 
+					current->desktop_hooks 
+				);
+			}
+			else
+			{
+				if( previous )
+				{
+					printf( "\nThe desktops in the snapshot are different from the previous snapshot.\n" );
+					printf( "The snapshot can't be compared and its HOOKs will be printed as found.\n" );
+					++restart_count;
+				}
+				
+				/* print the HOOKs found in the snapshot */
+				print_initial_desktop_hook_list( events, current->desktop_hooks );
+			}
+			
+			previous = current;
+			++snapshot_count;
+			
+			/* each snapshot replayed is a poll. only the diff and output phases are timed. */
+			end_timing_poll( G->timing );
+			
+			if( G->config->verbose >= 3 )
+				print_timing_poll( G->timing );
+		}
+		
+		/* the last snapshot of the previous file has been compared to the first snapshot of this 
+		file so the previous file is no longer needed. if this file is empty then keep the previous 
+		file since its last snapshot is still the previous snapshot.
+		*/
+		if( current_file->snapshot_count )
+		{
+			free_snapshot_file_store( &previous_file );
+			previous_file = current_file;
+			current_file = NULL;
+		}
+		else
+			free_snapshot_file_store( &current_file );
+		
+		output_flush();
+	}
+	
+	set_hook_notice_time( 0 );
+	
+	printf( "\nReplayed %u snapshots from %u files.", snapshot_count, file_count );
+	if( skipped_count )
+		printf( " Skipped %u files.", skipped_count );
+	if( restart_count )
+		printf( " %u snapshots could not be compared.", restart_count );
+	printf( "\n" );
+	
+	if( G->timing->init_time )
+	{
+		if( G->config->verbose >= 3 )
+			print_timing_stats( G->timing );
+		
+		if( !write_timing_summary( G->timing ) )
+			MSG_ERROR( "write_timing_summary() failed." );
+	}
+	
+	/* free the stores and all their descendants */
+	free_snapshot_file_store( &previous_file );
+	free_diff_event_store( &events );
+	free_desktop_store( &desktops );
+	
+	for( i = 0; i < filename_count; ++i )
+		free( filename[ i ] );
+	
+	free( filename );
+	
+	if( G->config->verbose >= 5 )
+		PRINT_HASHSEP_END( objname );
+	
+	return ( snapshot_count ? TRUE : FALSE );
+}
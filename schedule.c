@@ -0,0 +1,516 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a schedule store, which times the polls in monitor mode.
+Each function is documented in the comment block above its definition.
+
+-
+create_schedule_store()
+
+Create a schedule store and its descendants or die.
+-
+
+-
+get_schedule_ticks()
+
+Get the current ticks of the performance counter.
+-
+
+-
+init_schedule_store()
+
+Initialize a schedule store.
+-
+
+-
+wait_schedule_lead()
+
+Wait until a lead time before the deadline of the next poll.
+-
+
+-
+wait_schedule()
+
+Wait until the deadline of the next poll.
+-
+
+-
+set_schedule_interval()
+
+Set the interval between polls.
+-
+
+-
+adapt_schedule()
+
+Adapt the interval between polls to the number of changes found by the last poll.
+-
+
+-
+print_schedule_stats()
+
+Print the number of polls and overruns, the longest overrun, and the adaptive interval. No newline.
+-
+
+-
+print_schedule_store()
+
+Print a schedule store.
+-
+
+-
+free_schedule_store()
+
+Free a schedule store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "schedule.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+static __int64 get_schedule_ticks( void );
+
+
+
+/* create_schedule_store()
+Create a schedule store and its descendants or die.
+
+winmm is loaded for timeBeginPeriod() and timeEndPeriod(). If it can't be loaded then the store is 
+still created, and init_schedule_store() warns if the system timer period is needed.
+*/
+void create_schedule_store( 
+	struct schedule **const out   // out deref
+)
+{
+	struct schedule *store = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a schedule store */
+	store = must_calloc( 1, sizeof( *store ) );
+	
+	store->winmm = LoadLibraryA( "winmm" );
+	if( store->winmm )
+	{
+		*(FARPROC *)&store->timeBeginPeriod = GetProcAddress( store->winmm, "timeBeginPeriod" );
+		*(FARPROC *)&store->timeEndPeriod = GetProcAddress( store->winmm, "timeEndPeriod" );
+	}
+	
+	*out = store;
+	return;
+}
+
+
+
+/* get_schedule_ticks()
+Get the current ticks of the performance counter.
+
+returns the ticks
+*/
+static __int64 get_schedule_ticks( void )
+{
+	LARGE_INTEGER count;
+	
+	
+	QueryPerformanceCounter( &count );
+	return count.QuadPart;
+}
+
+
+
+/* init_schedule_store()
+Initialize a schedule store.
+
+The deadline of the first poll is 'interval_ms' milliseconds from when this function is called.
+
+'interval_ms' is the interval between polls, in milliseconds. If it's 0 then wait_schedule() only 
+yields the rest of the main thread's time slice.
+'min_ms' and 'max_ms' are the minimum and maximum interval if the schedule is adaptive. If 'max_ms' 
+is 0 then the schedule isn't adaptive and the interval doesn't change.
+
+returns nonzero on success
+*/
+int init_schedule_store( 
+	struct schedule *const store,   // in, out
+	const unsigned interval_ms,   // in
+	const unsigned min_ms,   // in
+	const unsigned max_ms   // in
+)
+{
+	LARGE_INTEGER frequency;
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	FAIL_IF( max_ms && ( ( min_ms > max_ms ) || ( interval_ms < min_ms ) || ( interval_ms > max_ms ) ) );
+	
+	
+	if( !QueryPerformanceFrequency( &frequency ) || ( frequency.QuadPart <= 0 ) )
+	{
+		MSG_ERROR_GLE( "QueryPerformanceFrequency() failed." );
+		return FALSE;
+	}
+	
+	store->frequency = frequency.QuadPart;
+	store->interval_ms = interval_ms;
+	store->interval = ( (__int64)interval_ms * store->frequency ) / 1000;
+	store->min_ms = max_ms ? min_ms : interval_ms;
+	store->max_ms = max_ms ? max_ms : interval_ms;
+	
+	/* a finer system timer uses more power, so it's only requested when it's needed. an adaptive 
+	schedule needs it if its shortest interval does.
+	*/
+	if( store->min_ms && ( store->min_ms < 1000 ) )
+	{
+		/* TIMERR_NOERROR is 0 */
+		if( store->timeBeginPeriod && store->timeEndPeriod && !store->timeBeginPeriod( 1 ) )
+			store->timer_period = 1;
+		else if( G->config->verbose >= 1 )
+			MSG_WARNING( "The system timer period couldn't be set. Polls may be late." );
+	}
+	
+	store->deadline = get_schedule_ticks();
+	store->last_adapt = store->deadline;
+	
+	/* this store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* wait_schedule_lead()
+Wait until a lead time before the deadline of the next poll.
+
+This is for work that must be started shortly before the next poll, like a capture. The schedule 
+isn't changed, and wait_schedule() must still be called to wait the rest of the time until the 
+deadline. If that time has already passed, or the schedule has no interval, this returns at once.
+
+'lead_ms' is how many milliseconds before the deadline to wait until. if it's more than half the 
+interval then half the interval is used.
+*/
+void wait_schedule_lead( 
+	const struct schedule *const store,   // in
+	const unsigned lead_ms   // in
+)
+{
+	__int64 now = 0, until = 0, lead = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The schedule store must be initialized.
+	
+	
+	if( !store->interval )
+		return;
+	
+	lead = ( (__int64)lead_ms * store->frequency ) / 1000;
+	
+	if( lead > ( store->interval / 2 ) )
+		lead = store->interval / 2;
+	
+	until = store->deadline + store->interval - lead;
+	now = get_schedule_ticks();
+	
+	/* the milliseconds are rounded up so this doesn't spin, the same as wait_schedule() */
+	while( now < until )
+	{
+		const __int64 remaining = until - now;
+		
+		
+		Sleep( (DWORD)( ( ( remaining * 1000 ) + store->frequency - 1 ) / store->frequency ) );
+		now = get_schedule_ticks();
+	}
+	
+	return;
+}
+
+
+
+/* wait_schedule()
+Wait until the deadline of the next poll.
+
+The deadline of the next poll is the deadline of the last poll plus the interval. If it has already 
+passed then the last poll overran it. In that case this function doesn't wait, and the schedule 
+starts again from now.
+
+returns the number of deadlines that were missed, or 0 if the next poll is on time
+*/
+unsigned wait_schedule( 
+	struct schedule *const store   // in, out
+)
+{
+	__int64 now = 0;
+	unsigned missed = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The schedule store must be initialized.
+	
+	
+	++store->wait_count;
+	
+	if( !store->interval )
+	{
+		Sleep( 0 );
+		store->deadline = get_schedule_ticks();
+		return 0;
+	}
+	
+	store->deadline += store->interval;
+	now = get_schedule_ticks();
+	
+	if( now >= store->deadline )
+	{
+		const __int64 overrun = now - store->deadline;
+		
+		
+		missed = (unsigned)( overrun / store->interval ) + 1;
+		
+		++store->overrun_count;
+		store->missed_count += missed;
+		store->last_overrun = overrun;
+		
+		if( overrun > store->max_overrun )
+			store->max_overrun = overrun;
+		
+		store->deadline = now;
+		return missed;
+	}
+	
+	/* Sleep() can return before the time has passed, so sleep until the deadline is reached. the 
+	milliseconds are rounded up so this doesn't spin.
+	*/
+	while( now < store->deadline )
+	{
+		const __int64 remaining = store->deadline - now;
+		
+		
+		Sleep( (DWORD)( ( ( remaining * 1000 ) + store->frequency - 1 ) / store->frequency ) );
+		now = get_schedule_ticks();
+	}
+	
+	return 0;
+}
+
+
+
+/* set_schedule_interval()
+Set the interval between polls.
+
+The deadline of the next poll is the deadline of the last poll plus the new interval, so a shorter 
+interval brings the next poll forward. If that deadline has already passed then the next call to 
+wait_schedule() counts it as an overrun.
+
+'interval_ms' is the interval between polls, in milliseconds
+*/
+void set_schedule_interval( 
+	struct schedule *const store,   // in, out
+	const unsigned interval_ms   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The schedule store must be initialized.
+	
+	
+	store->interval_ms = interval_ms;
+	store->interval = ( (__int64)interval_ms * store->frequency ) / 1000;
+	
+	return;
+}
+
+
+
+/* adapt_schedule()
+Adapt the interval between polls to the number of changes found by the last poll.
+
+If the schedule is adaptive then the interval is shortened to the minimum when the last poll found 
+changes, since more are likely to follow. Otherwise the interval is doubled, up to the maximum, so 
+that an idle system is polled less and less often.
+
+The rate of changes is updated whether or not the schedule is adaptive.
+
+'change_count' is the number of changes found by the last poll
+*/
+void adapt_schedule( 
+	struct schedule *const store,   // in, out
+	const unsigned change_count   // in
+)
+{
+	__int64 now = 0;
+	unsigned interval_ms = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The schedule store must be initialized.
+	
+	
+	now = get_schedule_ticks();
+	
+	if( now > store->last_adapt )
+	{
+		const double rate = 
+			( (double)change_count * (double)store->frequency ) / (double)( now - store->last_adapt );
+		
+		
+		/* each new rate is weighted by a quarter */
+		store->change_rate += ( rate - store->change_rate ) * 0.25;
+	}
+	
+	store->last_adapt = now;
+	store->change_count += change_count;
+	
+	if( store->min_ms == store->max_ms )
+		return;
+	
+	if( change_count )
+	{
+		interval_ms = store->min_ms;
+		
+		if( store->interval_ms != store->min_ms )
+			++store->tighten_count;
+	}
+	else if( store->interval_ms > ( store->max_ms / 2 ) )
+		interval_ms = store->max_ms;
+	else
+		interval_ms = store->interval_ms * 2;
+	
+	if( interval_ms != store->interval_ms )
+		set_schedule_interval( store, interval_ms );
+	
+	return;
+}
+
+
+
+/* print_schedule_stats()
+Print the number of polls and overruns, the longest overrun, and the adaptive interval. No newline.
+
+if 'store' is NULL or not initialized this function returns without having printed anything.
+*/
+void print_schedule_stats( 
+	const struct schedule *const store   // in
+)
+{
+	if( !store || !store->init_time )
+		return;
+	
+	printf( "Schedule: every %u ms. %I64u polls, %I64u overruns, %I64u deadlines missed. "
+		"Longest overrun %.3f ms.", 
+		store->interval_ms, 
+		store->wait_count, 
+		store->overrun_count, 
+		store->missed_count, 
+		( (double)store->max_overrun * 1000.0 / (double)store->frequency ) 
+	);
+	
+	if( store->min_ms != store->max_ms )
+	{
+		printf( " Adaptive %u-%u ms, tightened %I64u times.", 
+			store->min_ms, 
+			store->max_ms, 
+			store->tighten_count 
+		);
+	}
+	
+	printf( " %.3f changes/sec.", store->change_rate );
+	
+	return;
+}
+
+
+
+/* print_schedule_store()
+Print a schedule store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_schedule_store( 
+	const struct schedule *const store   // in
+)
+{
+	const char *const objname = "Schedule Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->frequency: %I64d\n", store->frequency );
+	printf( "store->interval_ms: %u\n", store->interval_ms );
+	printf( "store->interval: %I64d\n", store->interval );
+	printf( "store->min_ms: %u\n", store->min_ms );
+	printf( "store->max_ms: %u\n", store->max_ms );
+	printf( "store->deadline: %I64d\n", store->deadline );
+	printf( "store->wait_count: %I64u\n", store->wait_count );
+	printf( "store->overrun_count: %I64u\n", store->overrun_count );
+	printf( "store->missed_count: %I64u\n", store->missed_count );
+	printf( "store->last_overrun: %I64d\n", store->last_overrun );
+	printf( "store->max_overrun: %I64d\n", store->max_overrun );
+	printf( "store->tighten_count: %I64u\n", store->tighten_count );
+	printf( "store->change_count: %I64u\n", store->change_count );
+	printf( "store->change_rate: %f\n", store->change_rate );
+	printf( "store->last_adapt: %I64d\n", store->last_adapt );
+	printf( "store->timer_period: %u\n", store->timer_period );
+	printf( "store->winmm: 0x%p\n", store->winmm );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_schedule_store()
+Free a schedule store and all its descendants.
+
+If a system timer period was requested then it's ended, and winmm is freed.
+
+this function then sets the schedule store pointer to NULL and returns
+if( !in || !*in ) then this function returns.
+*/
+void free_schedule_store( 
+	struct schedule **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->timer_period )
+		(*in)->timeEndPeriod( (*in)->timer_period );
+	
+	if( (*in)->winmm )
+		FreeLibrary( (*in)->winmm );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
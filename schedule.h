@@ -0,0 +1,166 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SCHEDULE_H
+#define _SCHEDULE_H
+
+#include <windows.h>
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The schedule store.
+The schedule store times the polls in monitor mode. The polls are on a fixed-rate schedule: each 
+poll's deadline is the previous deadline plus the interval, so the time taken to take, diff and 
+print a snapshot is subtracted from the wait and the polls don't drift.
+
+If a poll takes longer than the interval then its next deadline has already passed. That's an 
+overrun. The next poll is taken immediately and the schedule starts again from then, so that missed 
+polls aren't taken in a burst to catch up.
+
+If the schedule is adaptive then the interval changes with the polls' results: it's shortened to 
+the minimum when a poll finds changes and doubled for each poll that doesn't, up to the maximum.
+*/
+struct schedule
+{
+	/* the frequency of the performance counter, in ticks per second */
+	__int64 frequency;
+	
+	/* the interval between the deadlines of the polls, in milliseconds */
+	unsigned interval_ms;
+	
+	/* the interval between the deadlines of the polls, in ticks of the performance counter */
+	__int64 interval;
+	
+	/* the minimum and maximum interval in milliseconds if the schedule is adaptive, otherwise both 
+	are the same as the interval.
+	*/
+	unsigned min_ms;
+	unsigned max_ms;
+	
+	/* the ticks of the performance counter at the deadline of the next poll */
+	__int64 deadline;
+	
+	/* the number of times wait_schedule() has been called */
+	unsigned __int64 wait_count;
+	
+	/* the number of polls that finished after their next deadline */
+	unsigned __int64 overrun_count;
+	
+	/* the number of deadlines that were missed because of an overrun. one overrun can miss more 
+	than one deadline if it took more than twice the interval.
+	*/
+	unsigned __int64 missed_count;
+	
+	/* the ticks of the last overrun and the longest overrun, past the deadline */
+	__int64 last_overrun;
+	__int64 max_overrun;
+	
+	/* the number of times adapt_schedule() shortened the interval because a poll had changes */
+	unsigned __int64 tighten_count;
+	
+	/* the total number of changes passed to adapt_schedule() */
+	unsigned __int64 change_count;
+	
+	/* the rate of changes, in changes per second. this is an exponentially weighted moving average 
+	of the rate at each call to adapt_schedule(), so it follows recent polls.
+	*/
+	double change_rate;
+	
+	/* the ticks of the performance counter when adapt_schedule() was last called */
+	__int64 last_adapt;
+	
+	/* the period of the system timer that was requested with timeBeginPeriod(), in milliseconds, 
+	or 0 if it wasn't requested. Sleep() has the resolution of the system timer, which by default is 
+	about 15 milliseconds, so for intervals of less than a second a 1 millisecond period is requested.
+	*/
+	UINT timer_period;   // timeBeginPeriod(), timeEndPeriod()
+	
+	/* winmm and its timeBeginPeriod() and timeEndPeriod(). winmm is loaded once when this store is 
+	created instead of being linked, since it's only used for sub-second polling. the function 
+	pointers are NULL if it couldn't be loaded.
+	*/
+	HMODULE winmm;   // LoadLibraryA(), FreeLibrary()
+	UINT ( WINAPI *timeBeginPeriod )( UINT );
+	UINT ( WINAPI *timeEndPeriod )( UINT );
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in schedule.c
+*/
+void create_schedule_store( 
+	struct schedule **const out   // out deref
+);
+
+int init_schedule_store( 
+	struct schedule *const store,   // in, out
+	const unsigned interval_ms,   // in
+	const unsigned min_ms,   // in
+	const unsigned max_ms   // in
+);
+
+void wait_schedule_lead( 
+	const struct schedule *const store,   // in
+	const unsigned lead_ms   // in
+);
+
+unsigned wait_schedule( 
+	struct schedule *const store   // in, out
+);
+
+void set_schedule_interval( 
+	struct schedule *const store,   // in, out
+	const unsigned interval_ms   // in
+);
+
+void adapt_schedule( 
+	struct schedule *const store,   // in, out
+	const unsigned change_count   // in
+);
+
+void print_schedule_stats( 
+	const struct schedule *const store   // in
+);
+
+void print_schedule_store( 
+	const struct schedule *const store   // in
+);
+
+void free_schedule_store( 
+	struct schedule **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SCHEDULE_H
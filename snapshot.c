@@ -55,15 +55,75 @@ If the passed in thread info is for a GUI thread add it to the passed in snapsho
 -
 
 -
-compare_gui()
+read_Win32ThreadInfo()
 
-Compare two gui structs according to the kernel address of the associated Win32ThreadInfo struct.
+Read a thread's TEB address and the Win32ThreadInfo address in its TEB.
+-
+
+-
+may_have_teb()
+
+Check whether a thread may have a TEB, without reading it.
+-
+
+-
+grow_work_array()
+
+Grow a snapshot store's work array.
+-
+
+-
+callback_add_gui_work()
+
+Add the passed in process' thread infos to the passed in snapshot's work array.
+-
+
+-
+callback_read_gui_work()
+
+Read the TEB and Win32ThreadInfo of each thread in a range of a snapshot's work array.
+-
+
+-
+read_gui_work()
+
+Read the threads in a snapshot's work array on the worker threads and then add the GUI threads.
+-
+
+-
+hash_Win32ThreadInfo()
+
+Hash a Win32ThreadInfo address to its home slot in a snapshot store's gui index.
+-
+
+-
+reset_gui_array()
+
+Soft reset a snapshot store's gui array and gui index so they can be reused.
+-
+
+-
+add_gui()
+
+Add a GUI thread to a snapshot store's gui array and gui index.
 -
 
 -
 find_Win32ThreadInfo()
 
-Search a snapshot store's array of gui threads for a Win32ThreadInfo address.
+Search a snapshot store's gui index for a Win32ThreadInfo address.
+-
+
+-
+resize_spi_buffer()
+
+Reallocate a snapshot store's spi buffer to a new size.
+-
+
+-
+get_spi_used_bytes()
+
+Get the number of bytes used in a snapshot store's spi buffer.
 -
 
 -
@@ -90,6 +150,12 @@ print_gui_array()
 Print a snapshot store's array of gui structs.
 -
 
+-
+print_spi_buffer_stats()
+
+Print the allocated, used and peak sizes of a snapshot store's spi buffer, and its index counts.
+-
+
 -
 print_spi_array_brief()
 
@@ -108,9 +174,16 @@ free_snapshot_store()
 Free a snapshot store and all its descendants.
 -
 
+-
+free_spare_snapshot_arena()
+
+Free the arena kept from the last snapshot store that was freed.
+-
+
 */
 
 #include <stdio.h>
+#include <stddef.h>
 
 #include "util.h"
 
@@ -122,11 +195,43 @@ Free a snapshot store and all its descendants.
 
 #include "snapshot.h"
 
+#include "output.h"
+
+#include "cache.h"
+
+#include "pool.h"
+
+#include "arena.h"
+
 /* the global stores */
 #include "global.h"
 
 
 
+/* the smallest size in bytes of an spi buffer, unless the maximum number of threads is smaller.
+this is the same minimum traverse_threads() uses for the size estimate when it isn't passed a buffer.
+*/
+#define SPI_MIN_BYTES   1048576
+
+/* the number of consecutive snapshots that must use less than a quarter of the spi buffer before 
+it is halved.
+*/
+#define SPI_SHRINK_AFTER   16
+
+/* the minimum number of bytes in each block of a snapshot store's arena. each hook array is larger 
+than this so it gets a block of its own.
+*/
+#define SNAPSHOT_ARENA_BLOCK_BYTES   1048576
+
+
+
+/* the arena of the last snapshot store that was freed. it's reset and kept so that the next snapshot 
+store that's created can reuse its memory instead of allocating it again.
+*/
+static struct arena *spare_arena;   // create_arena_store(), free_spare_snapshot_arena()
+
+
+
 static int callback_add_gui( 
 	void *cb_param,   // in, out
 	SYSTEM_PROCESS_INFORMATION *const spi,   // in
@@ -135,9 +240,50 @@ static int callback_add_gui(
 	const DWORD flags   // in, optional
 );
 
-static int compare_gui( 
-	const void *const p1,   // in
-	const void *const p2   // in
+static int read_Win32ThreadInfo( 
+	HANDLE process,   // in
+	const SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const DWORD flags,   // in, optional
+	void **const pvTeb,   // out
+	void **const pvWin32ThreadInfo   // out
+);
+
+static int may_have_teb( 
+	const SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const DWORD flags   // in, optional
+);
+
+static void grow_work_array( 
+	struct snapshot *const store   // in, out
+);
+
+static int callback_add_gui_work( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG count,   // in
+	const DWORD flags   // in, optional
+);
+
+static void __cdecl callback_read_gui_work( 
+	void *param,   // in, out
+	const unsigned begin,   // in
+	const unsigned end   // in
+);
+
+static int read_gui_work( 
+	struct snapshot *const store,   // in, out
+	const DWORD flags   // in, optional
+);
+
+static unsigned hash_Win32ThreadInfo( 
+	const struct snapshot *const store,   // in
+	const void *const pvWin32ThreadInfo   // in
+);
+
+static void resize_spi_buffer( 
+	struct snapshot *const store,   // in, out
+	size_t bytes   // in
 );
 
 
@@ -146,19 +292,36 @@ static int compare_gui(
 Create a snapshot store and its descendants or die.
 
 The snapshot store holds hooks, gui thread info and system thread info recorded consecutively.
+
+The store is allocated from its own arena, along with the memory of its descendants that isn't 
+resized. If a snapshot store was freed before then its arena is reused.
 */
 void create_snapshot_store( 
 	struct snapshot **const out   // out deref
 )
 {
 	struct snapshot *snapshot = NULL;
+	struct arena *arena = NULL;
 	
 	FAIL_IF( !out );
 	FAIL_IF( *out );
 	
 	
+	/* reuse the arena of the last snapshot store that was freed, or create one */
+	if( spare_arena )
+	{
+		arena = spare_arena;
+		spare_arena = NULL;
+	}
+	else
+	{
+		create_arena_store( &arena );
+		init_arena_store( arena, SNAPSHOT_ARENA_BLOCK_BYTES );
+	}
+	
 	/* allocate a snapshot store */
-	snapshot = must_calloc( 1, sizeof( *snapshot ) );
+	snapshot = arena_calloc( arena, 1, sizeof( *snapshot ) );
+	snapshot->arena = arena;
 	
 	
 	/* the allocated/maximum number of elements in the array pointed to by gui.
@@ -168,35 +331,57 @@ void create_snapshot_store(
 	
 	/* allocate an array of gui structs */
 	snapshot->gui = 
-		must_calloc( snapshot->gui_max, sizeof( *snapshot->gui ) );
+		arena_calloc( snapshot->arena, snapshot->gui_max, sizeof( *snapshot->gui ) );
 	
+	/* the gui index has the smallest power of 2 number of slots that is at least twice the number 
+	of elements in the gui array. a load factor of at most 50% keeps linear probing short.
+	*/
+	for( snapshot->gui_index_bits = 1; snapshot->gui_index_bits < 31; ++snapshot->gui_index_bits )
+	{
+		if( ( ( 1u << snapshot->gui_index_bits ) / 2 ) >= snapshot->gui_max )
+			break;
+	}
+	
+	snapshot->gui_index_max = 1u << snapshot->gui_index_bits;
+	FAIL_IF( snapshot->gui_index_max <= snapshot->gui_max );
 	
-	/* the allocated size of the buffer in bytes.
+	/* allocate the gui index */
+	snapshot->gui_index = 
+		arena_calloc( snapshot->arena, snapshot->gui_index_max, sizeof( *snapshot->gui_index ) );
+	
+	
+	/* the maximum size of the buffer in bytes.
 	
 	when traverse_threads() is called how much memory is needed depends on how many threads in the 
 	system, the thread process ratio and whether extended process information was requested.
-	because this information is constantly changing depending on the state of the system, and to 
-	avoid too many allocations and frees, i'm using one big buffer that can be continually refilled.
+	because this information is constantly changing depending on the state of the system the 
+	buffer is sized adaptively by init_snapshot_store(), but it never grows past this limit.
 	
-	the size is calculated based on the worst-case scenario of one thread per process.
+	the limit is calculated based on the worst-case scenario of one thread per process.
 	eg 20k max threads is about a 6.5MB buffer
 	*/
-	snapshot->spi_max_bytes = 
+	snapshot->spi_limit_bytes = 
 	( 
 		snapshot->gui_max 
 		* ( sizeof( SYSTEM_PROCESS_INFORMATION ) 
 			+ sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) 
 		)
+		+ TRAVERSE_RESERVED_BCOUNT
 	);
 	
 	/* allocate the buffer
 	the buffer is read and written by traverse_threads().
 	the buffer contains the SYSTEM_PROCESS_INFORMATION array for the snapshot.
+	
+	the initial size is the same as what traverse_threads() would allocate for itself: double 
+	the size estimate from NtQuerySystemInformation(). the buffer is always extended.
 	*/
-	snapshot->spi = must_calloc( snapshot->spi_max_bytes, 1 );
+	resize_spi_buffer( snapshot, 
+		get_spi_bcount_estimate( TRAVERSE_FLAG_EXTENDED, NULL ) * 2 + TRAVERSE_RESERVED_BCOUNT 
+	);
 	
 	
-	create_desktop_hook_store( &snapshot->desktop_hooks );
+	create_desktop_hook_store( &snapshot->desktop_hooks, snapshot->arena );
 	
 	
 	*out = snapshot;
@@ -283,9 +468,24 @@ struct callback_info
 	struct snapshot *store;   // in, out
 	
 	/* Temporary process handle opened in a prior call to the callback function.
-	If traverse_threads() did not terminate successfully this handle must be closed.
+	If traverse_threads() did not terminate successfully this handle must be closed, unless it's 
+	owned by the process cache.
 	*/
 	HANDLE process;   // in, out, actual, optional
+	
+	/* nonzero if 'process' is owned by the process cache and must not be closed */
+	BOOL is_process_cached;   // in, out, actual
+	
+	/* the timing ticks when NtQuerySystemInformation() was called. when the callback is first 
+	called the query has returned, and this is set to the ticks when the TEBs began to be read.
+	*/
+	__int64 ticks;   // in, out
+	
+	/* if the spi buffer is a capture that's recycled then the system utc time in FILETIME format 
+	when the capture thread queried it, and the ticks that its query took. otherwise zero.
+	*/
+	__int64 capture_time;   // in
+	__int64 capture_ticks;   // in
 };
 
 /* callback_add_gui()
@@ -313,6 +513,15 @@ static int callback_add_gui(
 	// address of Win32ThreadInfo
 	void *pvWin32ThreadInfo = NULL;
 	
+	// the thread's entry in the thread cache, if it was found there
+	const struct thread_cache_entry *cached = NULL;
+	
+	// nonzero if the thread's TEB and Win32ThreadInfo can be cached
+	int is_cacheable = FALSE;
+	
+	// the GUI thread info to add to the gui array
+	struct gui gui;
+	
 	// the return code of this function
 	int return_code = TRAVERSE_CALLBACK_ABORT;
 	
@@ -332,14 +541,29 @@ static int callback_add_gui(
 	*/
 	if( !ci->store->init_time_spi )
 	{
-		/* ci->store->spi array was just initialized. record init time. */
-		GetSystemTimeAsFileTime( (FILETIME *)&ci->store->init_time_spi );
+		if( ci->capture_time )
+		{
+			/* the spi array was queried by the capture thread. record when and how long it took. 
+			the time spent recycling it on this thread is timed as a phase of its own.
+			*/
+			ci->store->init_time_spi = ci->capture_time;
+			
+			add_timing_ticks( G->timing, TIMING_QUERY, ci->capture_ticks );
+			ci->ticks = add_timing( G->timing, TIMING_RECYCLE, ci->ticks );
+		}
+		else
+		{
+			/* ci->store->spi array was just initialized. record init time. */
+			GetSystemTimeAsFileTime( (FILETIME *)&ci->store->init_time_spi );
+			
+			ci->ticks = add_timing( G->timing, TIMING_QUERY, ci->ticks );
+		}
 	}
 	
 	
 	
 	/** 
-	Open the process if it isn't open already
+	Check the process and thread ids
 	*/
 	dbg_printf( "PID: %Iu, ImageName: %ls\n", spi->UniqueProcessId, spi->ImageName.Buffer );
 	
@@ -352,31 +576,112 @@ static int callback_add_gui(
 		goto cleanup;
 	}
 	
-	if( process_is_new )
+	if( process_is_new && ci->process ) // there is a process handle already open
 	{
-		if( ci->process ) // there is a process handle already open
-		{
-			/* the last opened process' handle should have already been closed.
-			this shouldn't happen. abort 
-			*/
-			dbg_printf( "There is a process handle already open. Aborting!\n" );
-			return_code = TRAVERSE_CALLBACK_ABORT;
-			goto cleanup;
-		}
+		/* the last opened process' handle should have already been closed.
+		this shouldn't happen. abort 
+		*/
+		dbg_printf( "There is a process handle already open. Aborting!\n" );
+		return_code = TRAVERSE_CALLBACK_ABORT;
+		goto cleanup;
+	}
+	
+	/* mark the process as seen in this snapshot so that its cached handle isn't closed, and skip 
+	traversing its threads if it's in another session.
+	*/
+	if( process_is_new 
+		&& skip_process( G->cache, 
+			(unsigned __int64)(size_t)spi->UniqueProcessId, 
+			spi->CreateTime.QuadPart, 
+			(unsigned)spi->SessionId, 
+			(unsigned)spi->NumberOfThreads ) 
+	)
+	{
+		dbg_printf( "Skipping process. It's in another session.\n" );
 		
-		SetLastError( 0 ); // error code is evaluated on success
-		ci->process = OpenProcess( PROCESS_VM_READ, FALSE, (DWORD)spi->UniqueProcessId );
+		return_code = TRAVERSE_CALLBACK_SKIP;
+		goto cleanup;
+	}
+	
+	dbg_printf( "TID: %Iu\n", sti->ClientId.UniqueThread );
+	
+	/* if there's no thread id then continue to the next thread */
+	if( !sti->ClientId.UniqueThread )
+	{
+		dbg_printf( "Ignoring thread with id 0.\n" );
+		
+		return_code = TRAVERSE_CALLBACK_CONTINUE;
+		goto cleanup;
+	}
+	
+	
+	
+	/** 
+	Check the thread cache for the thread's TEB and Win32ThreadInfo
+	*/
+	cached = find_thread_cache_entry( G->cache, 
+		(unsigned __int64)(size_t)spi->UniqueProcessId, 
+		(unsigned __int64)(size_t)sti->ClientId.UniqueThread, 
+		sti->CreateTime.QuadPart 
+	);
+	
+	if( cached )
+	{
+		dbg_printf( "Thread found in the thread cache.\n" );
+		
+		pvTeb = (void *)cached->pvTeb;
+		pvWin32ThreadInfo = (void *)cached->pvWin32ThreadInfo;
+		
+		/* a thread cached as not a GUI thread isn't read again until its entry expires */
+		if( pvTeb && !pvWin32ThreadInfo )
+			++ci->store->unread_count;
+		
+		goto found;
+	}
+	
+	
+	
+	/** 
+	Open the process if it isn't open already.
+	The process is opened on the first of its threads that isn't in the thread cache. If the process 
+	is in the process cache then its cached handle is used instead.
+	*/
+	if( !ci->process )
+	{
+		ci->process = open_cached_process( G->cache, 
+			(unsigned __int64)(size_t)spi->UniqueProcessId, 
+			spi->CreateTime.QuadPart, 
+			&ci->is_process_cached 
+		);
 		
-		dbg_printf( "OpenProcess() %s. pid: %u, GLE: %u, Handle: 0x%p.\n",
+		dbg_printf( "open_cached_process() %s. pid: %u, GLE: %u, Handle: 0x%p, cached: %s.\n",
 			( ci->process ? "success" : "error" ), 
 			(DWORD)spi->UniqueProcessId, 
 			GetLastError(), 
-			ci->process 
+			ci->process, 
+			( ci->is_process_cached ? "yes" : "no" ) 
 		);
 		
 		/* if the process couldn't be opened then skip traversing its threads */
 		if( !ci->process )
 		{
+			const SYSTEM_THREAD_INFORMATION *current = sti;
+			ULONG i = 0;
+			
+			
+			/* none of this thread and the threads remaining in the process are read */
+			for( i = 0; i <= remaining; ++i )
+			{
+				if( current->ClientId.UniqueThread && may_have_teb( current, flags ) )
+					++ci->store->unread_count;
+				
+				current = (const SYSTEM_THREAD_INFORMATION *)( (size_t)current + 
+					( ( flags & TRAVERSE_FLAG_EXTENDED ) ? 
+						sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) : 
+						sizeof( SYSTEM_THREAD_INFORMATION ) ) 
+				);
+			}
+			
 			return_code = TRAVERSE_CALLBACK_SKIP;
 			goto cleanup;
 		}
@@ -385,19 +690,142 @@ static int callback_add_gui(
 	
 	
 	/** 
-	Get the thread's environment block (TEB)
+	Get the thread's TEB and the Win32ThreadInfo in it
 	*/
-	dbg_printf( "TID: %Iu\n", sti->ClientId.UniqueThread );
+	is_cacheable = read_Win32ThreadInfo( ci->process, sti, flags, &pvTeb, &pvWin32ThreadInfo );
 	
-	/* if there's no thread id then continue to the next thread */
-	if( !sti->ClientId.UniqueThread )
+	/* cache the thread unless its TEB couldn't be read, which is tried again next snapshot */
+	if( !is_cacheable )
+		++ci->store->unread_count;
+	else
+	{
+		add_thread_cache_entry( G->cache, 
+			(unsigned __int64)(size_t)spi->UniqueProcessId, 
+			(unsigned __int64)(size_t)sti->ClientId.UniqueThread, 
+			sti->CreateTime.QuadPart, 
+			pvTeb, 
+			pvWin32ThreadInfo 
+		);
+	}
+	
+	
+found:
+	/* if there's no TEB associated with the thread then continue to the next thread. */
+	if( !pvTeb )
 	{
-		dbg_printf( "Ignoring thread with id 0.\n" );
-		
 		return_code = TRAVERSE_CALLBACK_CONTINUE;
 		goto cleanup;
 	}
 	
+	dbg_printf( "Win32ThreadInfo: 0x%p\n", pvWin32ThreadInfo );
+	
+	/* if there's no Win32ThreadInfo then this thread is not a GUI thread.
+	continue to the next thread
+	*/
+	if( !pvWin32ThreadInfo )
+	{
+		return_code = TRAVERSE_CALLBACK_CONTINUE;
+		goto cleanup;
+	}
+	
+	/** add the GUI thread's info to the array of gui thread infos.
+	add_gui() also adds the thread to the gui index and checks whether its Win32ThreadInfo is unique.
+	*/
+	gui.pvWin32ThreadInfo = pvWin32ThreadInfo;
+	gui.unique_w32thread = TRUE;
+	gui.pvTeb = pvTeb;
+	gui.spi = spi;
+	gui.sti = sti;
+	
+	/* if the number of gui threads found is more than can be held in the array 
+	then abort. this is a high number like 10,000 - 100,000 so this shouldn't happen.
+	*/
+	if( !add_gui( ci->store, &gui ) ) // all array elements filled
+	{
+		MSG_ERROR( "Too many GUI objects!\n" );
+		printf( "ci->store->gui_count: %u\n", ci->store->gui_count );
+		printf( "ci->store->gui_max: %u\n", ci->store->gui_max );
+		
+		return_code = TRAVERSE_CALLBACK_ABORT;
+		goto cleanup;
+	}
+	
+	return_code = TRAVERSE_CALLBACK_CONTINUE;
+	
+cleanup:
+	
+	/* if there's a handle to a process and either there's no more remaining 
+	threads in the process to be traversed or the callback isn't continuing to 
+	traverse the process' threads then close the process handle. 
+	a handle owned by the process cache is left open for the next snapshot.
+	*/
+	if( ci && ci->process && ci->is_process_cached 
+		&& ( !remaining || ( return_code != TRAVERSE_CALLBACK_CONTINUE ) ) 
+	) 
+	{
+		ci->process = NULL;
+		ci->is_process_cached = FALSE;
+	}
+	else if( ci && ci->process && ( !remaining || ( return_code != TRAVERSE_CALLBACK_CONTINUE ) ) ) 
+	{
+		BOOL ret = 0;
+		
+		
+		SetLastError( 0 ); // error code is evaluated on success
+		ret = CloseHandle( ci->process ); // it's ok if the handle is already closed/invalid
+		
+		dbg_printf( "CloseHandle() %s. GLE: %u, Handle: 0x%p\n",
+			( ret ? "success" : "error" ), 
+			GetLastError(), 
+			ci->process
+		);
+		
+		ci->process = NULL;
+	}
+	
+	return return_code;
+}
+
+
+
+/* read_Win32ThreadInfo()
+Read a thread's TEB address and the Win32ThreadInfo address in its TEB.
+
+'process' is a handle to the thread's process with PROCESS_VM_READ access.
+'sti' is the thread's thread info.
+'flags' is the flags parameter that was passed to traverse_threads().
+'*pvTeb' receives the TEB address, or NULL if the thread doesn't have a TEB.
+'*pvWin32ThreadInfo' receives the Win32ThreadInfo address, or NULL if the thread isn't a GUI thread 
+or its TEB couldn't be read.
+
+This function only reads from the global stores and can be called from a worker thread.
+
+returns nonzero if the result can be cached, which is if the thread doesn't have a TEB or its TEB 
+was read.
+*/
+static int read_Win32ThreadInfo( 
+	HANDLE process,   // in
+	const SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const DWORD flags,   // in, optional
+	void **const pvTeb,   // out
+	void **const pvWin32ThreadInfo   // out
+)
+{
+	BOOL ret = 0;
+	
+	FAIL_IF( !process );
+	FAIL_IF( !sti );
+	FAIL_IF( !pvTeb );
+	FAIL_IF( !pvWin32ThreadInfo );
+	
+	
+	*pvTeb = NULL;
+	*pvWin32ThreadInfo = NULL;
+	
+	
+	/** 
+	Get the thread's environment block (TEB)
+	*/
 	/* check to see if we already have this thread's TEB address.
 	if TRAVERSE_FLAG_EXTENDED was passed in then traverse_threads()
 	called NtQuerySystemInformation() with SystemExtendedProcessInformation.
@@ -406,200 +834,720 @@ static int callback_add_gui(
 	if( ( flags & TRAVERSE_FLAG_EXTENDED ) && ( G->prog->dwOSMajorVersion >= 6 ) )
 	{
 		dbg_printf( "Getting TEB address from SYSTEM_EXTENDED_THREAD_INFORMATION\n" );
-		pvTeb = ( (SYSTEM_EXTENDED_THREAD_INFORMATION *)sti )->TebAddress;
+		*pvTeb = ( (SYSTEM_EXTENDED_THREAD_INFORMATION *)sti )->TebAddress;
 	}
 	else
 	{
 		dbg_printf( "Getting TEB address from get_teb()\n" );
-		pvTeb = get_teb( (DWORD)sti->ClientId.UniqueThread, flags );
+		*pvTeb = get_teb( (DWORD)sti->ClientId.UniqueThread, flags );
+	}
+	
+	dbg_printf( "TEB: 0x%p\n", *pvTeb );
+	
+	/* if there's no TEB associated with the thread then there's no Win32ThreadInfo either */
+	if( !*pvTeb )
+		return TRUE;
+	
+	
+	/** 
+	Get Win32ThreadInfo from the TEB
+	*/
+/* offsetof W32ThreadInfo: 0x40 TEB32, 0x78 TEB64 */
+#ifdef _M_IX86
+#define OFFSET_OF_W32THREADINFO 0x040
+#else
+#define OFFSET_OF_W32THREADINFO 0x078
+#endif
+
+	SetLastError( 0 ); // error code is evaluated on success
+	ret = ReadProcessMemory( 
+		process, 
+		(char *)*pvTeb + OFFSET_OF_W32THREADINFO,
+		pvWin32ThreadInfo, 
+		sizeof( *pvWin32ThreadInfo ), 
+		NULL 
+	);
+	
+	dbg_printf( "ReadProcessMemory() %s. GLE: %u, Handle: 0x%p.\n",
+		( ret ? "success" : "error" ), 
+		GetLastError(), 
+		process 
+	);
+	
+	if( !ret )
+		*pvWin32ThreadInfo = NULL;
+	
+	return ret;
+}
+
+
+
+/* may_have_teb()
+Check whether a thread may have a TEB, without reading it.
+
+If TRAVERSE_FLAG_EXTENDED was passed in and this is Vista+ then the thread info has the TEB address, 
+the same as read_Win32ThreadInfo() gets it. A thread without a TEB (eg a system thread) isn't a GUI 
+thread. Otherwise the TEB address isn't known without the thread's process.
+
+'sti' is the thread's thread info.
+'flags' is the flags parameter that was passed to traverse_threads().
+
+This function only reads from the global stores and can be called from a worker thread.
+
+returns nonzero if the thread has a TEB or might have one
+*/
+static int may_have_teb( 
+	const SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const DWORD flags   // in, optional
+)
+{
+	FAIL_IF( !sti );
+	
+	
+	if( ( flags & TRAVERSE_FLAG_EXTENDED ) && ( G->prog->dwOSMajorVersion >= 6 ) )
+		return !!( (const SYSTEM_EXTENDED_THREAD_INFORMATION *)sti )->TebAddress;
+	
+	return TRUE;
+}
+
+
+
+/* grow_work_array()
+Grow a snapshot store's work array.
+
+The work array starts with as many elements as the gui array and is doubled each time it's grown. 
+The elements that have been written to are kept.
+*/
+static void grow_work_array( 
+	struct snapshot *const store   // in, out
+)
+{
+	struct gui_work *work = NULL;
+	unsigned work_max = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	work_max = ( store->work_max ? ( store->work_max * 2 ) : store->gui_max );
+	FAIL_IF( work_max <= store->work_max );
+	
+	work = must_calloc( work_max, sizeof( *work ) );
+	
+	if( store->work_count )
+		memcpy( work, store->work, store->work_count * sizeof( *work ) );
+	
+	free( store->work );
+	store->work = work;
+	store->work_max = work_max;
+	
+	return;
+}
+
+
+
+/* callback_add_gui_work()
+Add the passed in process' thread infos to the passed in snapshot's work array.
+
+traverse_threads_batch() callback: this function is called for every SYSTEM_PROCESS_INFORMATION with 
+its array of 'count' SYSTEM_THREAD_INFORMATION.
+
+This is used instead of callback_add_gui() when there are worker threads. Each thread is looked up 
+in the thread cache here on the main thread. The threads that aren't found are read later by the 
+workers in read_gui_work(). The process is checked once for all of its threads, and the work array 
+is grown once for all of them instead of being checked for each thread.
+
+The behavior of a traverse_threads_batch() callback is documented in traverse_threads.txt.
+*/
+static int callback_add_gui_work( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG count,   // in
+	const DWORD flags   // in, optional
+)
+{
+	struct callback_info *const ci = (struct callback_info *)cb_param; 
+	struct gui_work *work = NULL;
+	const struct thread_cache_entry *cached = NULL;
+	SYSTEM_THREAD_INFORMATION *current = sti;
+	unsigned __int64 pid = 0;
+	ULONG i = 0;
+	
+	/* the size of each element of the thread info array. EXTENDED is always passed in, but the 
+	array is walked by whichever size traverse_threads_batch() was asked for.
+	*/
+	const size_t sti_bcount = ( ( flags & TRAVERSE_FLAG_EXTENDED ) ? 
+		sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) : sizeof( SYSTEM_THREAD_INFORMATION ) );
+	
+	FAIL_IF( !sti );
+	FAIL_IF( !ci );
+	FAIL_IF( !ci->store );
+	
+	
+	/* the first time this callback is called is the earliest time that the spi init can be recorded */
+	if( !ci->store->init_time_spi )
+	{
+		if( ci->capture_time )
+		{
+			/* the spi array was queried by the capture thread. record when and how long it took. */
+			ci->store->init_time_spi = ci->capture_time;
+			
+			add_timing_ticks( G->timing, TIMING_QUERY, ci->capture_ticks );
+			ci->ticks = add_timing( G->timing, TIMING_RECYCLE, ci->ticks );
+		}
+		else
+		{
+			GetSystemTimeAsFileTime( (FILETIME *)&ci->store->init_time_spi );
+			ci->ticks = add_timing( G->timing, TIMING_QUERY, ci->ticks );
+		}
+	}
+	
+	/* if there's no process id then skip traversing its threads */
+	if( !spi->UniqueProcessId )
+	{
+		dbg_printf( "Ignoring process with id 0.\n" );
+		return TRAVERSE_CALLBACK_CONTINUE;
+	}
+	
+	pid = (unsigned __int64)(size_t)spi->UniqueProcessId;
+	
+	/* mark the process as seen in this snapshot so that its cached handle isn't closed, and skip 
+	its threads if it's in another session.
+	*/
+	if( skip_process( G->cache, 
+		pid, 
+		spi->CreateTime.QuadPart, 
+		(unsigned)spi->SessionId, 
+		(unsigned)spi->NumberOfThreads ) 
+	)
+	{
+		dbg_printf( "Skipping process. It's in another session.\n" );
+		return TRAVERSE_CALLBACK_CONTINUE;
+	}
+	
+	/* make room for all of the process' threads at once */
+	while( ( ci->store->work_max - ci->store->work_count ) < count )
+		grow_work_array( ci->store );
+	
+	for( i = 0; i < count; 
+		++i, current = (SYSTEM_THREAD_INFORMATION *)( (size_t)current + sti_bcount ) 
+	)
+	{
+		/* if there's no thread id then continue to the next thread */
+		if( !current->ClientId.UniqueThread )
+		{
+			dbg_printf( "Ignoring thread with id 0.\n" );
+			continue;
+		}
+		
+		work = &ci->store->work[ ci->store->work_count++ ];
+		ZeroMemory( work, sizeof( *work ) );
+		
+		work->pid = pid;
+		work->spi = spi;
+		work->sti = current;
+		
+		cached = find_thread_cache_entry( G->cache, 
+			pid, 
+			(unsigned __int64)(size_t)current->ClientId.UniqueThread, 
+			current->CreateTime.QuadPart 
+		);
+		
+		if( cached )
+		{
+			work->pvTeb = cached->pvTeb;
+			work->pvWin32ThreadInfo = cached->pvWin32ThreadInfo;
+			work->cached = TRUE;
+		}
+	}
+	
+	return TRAVERSE_CALLBACK_CONTINUE;
+}
+
+
+
+/* stuff to be passed to callback_read_gui_work().
+this struct members' annotations are similar to those of function parameters
+*/
+struct work_info
+{
+	/* The store which holds the work array to read. */
+	struct snapshot *store;   // in, out
+	
+	/* The flags parameter that was passed to traverse_threads(). */
+	DWORD flags;   // in, optional
+};
+
+/* callback_read_gui_work()
+Read the TEB and Win32ThreadInfo of each thread in a range of a snapshot's work array.
+
+run_pool() callback: this function is called on a worker thread for each range of the work array.
+
+Threads that were found in the thread cache are skipped, as are threads whose process couldn't be 
+opened. The processes were opened by read_gui_work() before the workers were run. Only the work 
+array elements in the range are written to.
+*/
+static void __cdecl callback_read_gui_work( 
+	void *param,   // in, out
+	const unsigned begin,   // in
+	const unsigned end   // in
+)
+{
+	const struct work_info *const wi = (const struct work_info *)param;
+	const DWORD flags = wi->flags;
+	unsigned i = 0;
+	
+	
+	for( i = begin; i < end; ++i )
+	{
+		struct gui_work *const work = &wi->store->work[ i ];
+		void *pvTeb = NULL;
+		void *pvWin32ThreadInfo = NULL;
+		
+		
+		/* if the thread was cached or its process couldn't be opened then skip it */
+		if( work->cached || !work->process )
+			continue;
+		
+		work->cacheable = 
+			read_Win32ThreadInfo( work->process, work->sti, flags, &pvTeb, &pvWin32ThreadInfo );
+		work->pvTeb = pvTeb;
+		work->pvWin32ThreadInfo = pvWin32ThreadInfo;
+	}
+	
+	return;
+}
+
+
+
+/* read_gui_work()
+Read the threads in a snapshot's work array on the worker threads and then add the GUI threads to 
+the snapshot's gui array.
+
+Each process with a thread that isn't in the thread cache is opened here first, since the process 
+cache can only be used from the main thread. The work array is then partitioned by process id into 
+one range for each worker, so each process is read by only one worker. After all the workers are 
+done the threads that were read are added to the thread cache, and the GUI threads are added to the 
+gui array in the same order they would have been by callback_add_gui().
+
+This function must only be called from the main thread.
+
+returns nonzero on success.
+returns zero if the gui array is full.
+*/
+static int read_gui_work( 
+	struct snapshot *const store,   // in, out
+	const DWORD flags   // in, optional
+)
+{
+	unsigned i = 0, range_count = 0;
+	struct pool_range range[ POOL_MAX_WORKERS ];
+	struct work_info wi;
+	HANDLE process = NULL, closed = NULL;
+	unsigned __int64 pid = 0;
+	BOOL is_opened = FALSE, is_process_cached = FALSE;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !G->pool->init_time );   // The pool store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	/* the threads of a process are consecutive. open each process only once. */
+	for( i = 0; i < store->work_count; ++i )
+	{
+		struct gui_work *const work = &store->work[ i ];
+		
+		
+		if( work->cached )
+			continue;
+		
+		if( !is_opened || ( work->pid != pid ) )
+		{
+			pid = work->pid;
+			is_opened = TRUE;
+			
+			process = open_cached_process( G->cache, 
+				pid, 
+				work->spi->CreateTime.QuadPart, 
+				&is_process_cached 
+			);
+			
+			dbg_printf( "open_cached_process() %s. pid: %u, GLE: %u, Handle: 0x%p, cached: %s.\n",
+				( process ? "success" : "error" ), 
+				(DWORD)pid, 
+				GetLastError(), 
+				process, 
+				( is_process_cached ? "yes" : "no" ) 
+			);
+		}
+		
+		work->process = process;
+		work->is_process_cached = is_process_cached;
+	}
+	
+	if( store->work_count )
+	{
+		range_count = partition_pool_ranges( &store->work[ 0 ].pid, 
+			sizeof( store->work[ 0 ] ), 
+			store->work_count, 
+			G->pool->worker_count, 
+			range 
+		);
 	}
 	
-	dbg_printf( "TEB: 0x%p\n", pvTeb );
+	ZeroMemory( &wi, sizeof( wi ) );
+	wi.store = store;
+	wi.flags = flags;
+	
+	run_pool( G->pool, callback_read_gui_work, &wi, range, range_count );
+	
+	/* close the process handles that aren't owned by the process cache. every handle was opened 
+	before any was closed, so no two processes share a handle value.
+	*/
+	for( i = 0; i < store->work_count; ++i )
+	{
+		struct gui_work *const work = &store->work[ i ];
+		
+		
+		if( work->process && !work->is_process_cached && ( work->process != closed ) )
+		{
+			CloseHandle( work->process );
+			closed = work->process;
+		}
+		
+		work->process = NULL;
+	}
+	
+	for( i = 0; i < store->work_count; ++i )
+	{
+		const struct gui_work *const work = &store->work[ i ];
+		struct gui gui;
+		
+		
+		/* count the threads that may be GUI threads but weren't read, the same as callback_add_gui() 
+		does: cached as not GUI threads, or not read because their process couldn't be opened or 
+		their TEB couldn't be read.
+		*/
+		if( !work->pvWin32ThreadInfo 
+			&& ( work->cached ? !!work->pvTeb : ( !work->cacheable && may_have_teb( work->sti, flags ) ) ) 
+		)
+			++store->unread_count;
+		
+		if( work->cacheable )
+		{
+			add_thread_cache_entry( G->cache, 
+				work->pid, 
+				(unsigned __int64)(size_t)work->sti->ClientId.UniqueThread, 
+				work->sti->CreateTime.QuadPart, 
+				work->pvTeb, 
+				work->pvWin32ThreadInfo 
+			);
+		}
+		
+		/* if there's no Win32ThreadInfo then this thread is not a GUI thread */
+		if( !work->pvTeb || !work->pvWin32ThreadInfo )
+			continue;
+		
+		ZeroMemory( &gui, sizeof( gui ) );
+		gui.pvWin32ThreadInfo = work->pvWin32ThreadInfo;
+		gui.unique_w32thread = TRUE;
+		gui.pvTeb = work->pvTeb;
+		gui.spi = work->spi;
+		gui.sti = work->sti;
+		
+		if( !add_gui( store, &gui ) ) // all array elements filled
+		{
+			MSG_ERROR( "Too many GUI objects!\n" );
+			printf( "store->gui_count: %u\n", store->gui_count );
+			printf( "store->gui_max: %u\n", store->gui_max );
+			return FALSE;
+		}
+	}
+	
+	return TRUE;
+}
+
+
+
+/* hash_Win32ThreadInfo()
+Hash a Win32ThreadInfo address to its home slot in a snapshot store's gui index.
+
+THREADINFO is allocated from kernel pool so the low bits of its address are always zero and the 
+high bits rarely differ. The address is folded and then Fibonacci hashed, which takes the top 
+'gui_index_bits' bits of the product.
+
+returns the index of the home slot in the gui index
+*/
+static unsigned hash_Win32ThreadInfo( 
+	const struct snapshot *const store,   // in
+	const void *const pvWin32ThreadInfo   // in
+)
+{
+	unsigned __int64 x = (uintptr_t)pvWin32ThreadInfo;
+	DWORD folded = (DWORD)( ( x >> 4 ) ^ ( x >> 32 ) );
+	
+	
+	return (unsigned)( ( folded * 2654435761u ) >> ( 32 - store->gui_index_bits ) );
+}
+
+
+
+/* reset_gui_array()
+Soft reset a snapshot store's gui array and gui index so they can be reused.
+
+The gui array memory is not cleared, only its count. The gui index is cleared.
+*/
+void reset_gui_array( 
+	struct snapshot *const store   // in, out
+)
+{
+	FAIL_IF( !store );
+	
+	
+	if( store->gui_count )
+		ZeroMemory( store->gui_index, store->gui_index_max * sizeof( *store->gui_index ) );
+	
+	store->gui_count = 0;
+	
+	return;
+}
+
+
+
+/* add_gui()
+Add a GUI thread to a snapshot store's gui array and gui index.
+
+'gui' is copied to the end of the gui array and its position is added to the gui index.
+
+The index is searched for the Win32ThreadInfo address while looking for a free slot. If the address 
+is already in the index then both the existing gui and the new gui are marked as not unique, and 
+the new gui is added to the array but not to the index. find_Win32ThreadInfo() does not return a 
+gui whose Win32ThreadInfo is not unique.
+
+returns nonzero on success.
+returns zero if the gui array is full.
+*/
+int add_gui( 
+	struct snapshot *const store,   // in, out
+	const struct gui *const gui   // in
+)
+{
+	unsigned i = 0;
+	struct gui *added = NULL;
+	const unsigned mask = store->gui_index_max - 1;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !gui );
+	FAIL_IF( !gui->pvWin32ThreadInfo );
+	FAIL_IF( store->gui_count > store->gui_max );
 	
-	/* if there's no TEB associated with the thread then continue to the next thread. */
-	if( !pvTeb )
-	{
-		return_code = TRAVERSE_CALLBACK_CONTINUE;
-		goto cleanup;
-	}
 	
+	if( store->gui_count >= store->gui_max ) // all array elements filled
+		return FALSE;
 	
-	/** 
-	Get Win32ThreadInfo from the TEB
-	*/
+	added = &store->gui[ store->gui_count ];
+	*added = *gui;
+	added->unique_w32thread = TRUE;
+	
+	for( i = hash_Win32ThreadInfo( store, gui->pvWin32ThreadInfo ); ; i = ( i + 1 ) & mask )
 	{
-		BOOL ret = 0;
+		struct gui *existing = NULL;
 		
-/* offsetof W32ThreadInfo: 0x40 TEB32, 0x78 TEB64 */
-#ifdef _M_IX86
-#define OFFSET_OF_W32THREADINFO 0x040
-#else
-#define OFFSET_OF_W32THREADINFO 0x078
-#endif
-
-		SetLastError( 0 ); // error code is evaluated on success
-		ret = ReadProcessMemory( 
-			ci->process, 
-			(char *)pvTeb + OFFSET_OF_W32THREADINFO,
-			&pvWin32ThreadInfo, 
-			sizeof( pvWin32ThreadInfo ), 
-			NULL 
-		);
 		
-		dbg_printf( "ReadProcessMemory() %s. GLE: %u, Handle: 0x%p.\n",
-			( ret ? "success" : "error" ), 
-			GetLastError(), 
-			ci->process 
-		);
+		if( !store->gui_index[ i ] ) // empty slot
+		{
+			store->gui_index[ i ] = store->gui_count + 1;
+			break;
+		}
 		
-		if( !ret )
-			pvWin32ThreadInfo = 0;
-	}
-	
-	dbg_printf( "Win32ThreadInfo: 0x%p\n", pvWin32ThreadInfo );
-	
-	/* if there's no Win32ThreadInfo then this thread is not a GUI thread.
-	continue to the next thread
-	*/
-	if( !pvWin32ThreadInfo )
-	{
-		return_code = TRAVERSE_CALLBACK_CONTINUE;
-		goto cleanup;
-	}
-	
-	/* if the number of gui threads found is more than can be held in the array 
-	then abort. this is a high number like 10,000 - 100,000 so this shouldn't happen.
-	*/
-	if( ci->store->gui_count >= ci->store->gui_max ) // all array elements filled
-	{
-		MSG_ERROR( "Too many GUI objects!\n" );
-		printf( "ci->store->gui_count: %u\n", ci->store->gui_count );
-		printf( "ci->store->gui_max: %u\n", ci->store->gui_max );
+		existing = &store->gui[ store->gui_index[ i ] - 1 ];
 		
-		if( ci->store->gui_count > ci->store->gui_max )
+		if( existing->pvWin32ThreadInfo == gui->pvWin32ThreadInfo ) // duplicate
 		{
-			printf( "Setting gui_count to gui_max.\n" );
-			ci->store->gui_count = ci->store->gui_max;
+			existing->unique_w32thread = FALSE;
+			added->unique_w32thread = FALSE;
+			break;
 		}
-		
-		return_code = TRAVERSE_CALLBACK_ABORT;
-		goto cleanup;
 	}
 	
+	// increment the number of gui threads found
+	store->gui_count++;
 	
+	return TRUE;
+}
+
+
+
+/* find_Win32ThreadInfo()
+Search a snapshot store's gui index for a Win32ThreadInfo address.
+
+returns the gui struct that contains the matching pvWin32ThreadInfo.
+returns NULL if there is no match or the matching Win32ThreadInfo is not unique.
+*/
+struct gui *find_Win32ThreadInfo( 
+	const struct snapshot *const store,   // in
+	const void *const pvWin32ThreadInfo   // in
+)
+{
+	unsigned i = 0;
+	const unsigned mask = store->gui_index_max - 1;
 	
-	/** add the GUI thread's info to the array of gui thread infos.
-	*/
-	ci->store->gui[ ci->store->gui_count ].pvWin32ThreadInfo = pvWin32ThreadInfo;
-	// assume that the Win32ThreadInfo is unique. the gui array is scanned for dupes after traversal.
-	ci->store->gui[ ci->store->gui_count ].unique_w32thread = TRUE;
-	ci->store->gui[ ci->store->gui_count ].pvTeb = pvTeb;
-	ci->store->gui[ ci->store->gui_count ].spi = spi;
-	ci->store->gui[ ci->store->gui_count ].sti = sti;
-	
-	// increment the number of gui threads found
-	ci->store->gui_count++;
+	FAIL_IF( store->gui_count > store->gui_max );
 	
-	return_code = TRAVERSE_CALLBACK_CONTINUE;
 	
-cleanup:
+	if( !store->gui_count || !pvWin32ThreadInfo )
+		return NULL;
 	
-	/* if there's a handle to a process and either there's no more remaining 
-	threads in the process to be traversed or the callback isn't continuing to 
-	traverse the process' threads then close the process handle
-	*/
-	if( ci && ci->process && ( !remaining || ( return_code != TRAVERSE_CALLBACK_CONTINUE ) ) ) 
+	for( i = hash_Win32ThreadInfo( store, pvWin32ThreadInfo ); ; i = ( i + 1 ) & mask )
 	{
-		BOOL ret = 0;
+		struct gui *found = NULL;
 		
 		
-		SetLastError( 0 ); // error code is evaluated on success
-		ret = CloseHandle( ci->process ); // it's ok if the handle is already closed/invalid
+		if( !store->gui_index[ i ] ) // empty slot
+			return NULL;
 		
-		dbg_printf( "CloseHandle() %s. GLE: %u, Handle: 0x%p\n",
-			( ret ? "success" : "error" ), 
-			GetLastError(), 
-			ci->process
-		);
+		found = &store->gui[ store->gui_index[ i ] - 1 ];
 		
-		ci->process = NULL;
+		if( found->pvWin32ThreadInfo == pvWin32ThreadInfo )
+		{
+			// Don't return the GUI thread if its Win32ThreadInfo is not unique
+			return ( found->unique_w32thread ? found : NULL );
+		}
 	}
-	
-	return return_code;
 }
 
 
 
-/* compare_gui()
-Compare two gui structs according to the kernel address of the associated Win32ThreadInfo struct.
+/* resize_spi_buffer()
+Reallocate a snapshot store's spi buffer to a new size.
 
-qsort() callback: this function is called when sorting the gui array according to Win32ThreadInfo
-bsearch() callback: this function is called when searching the gui array for a Win32ThreadInfo
+'bytes' is the requested size in bytes. it is clamped to at least SPI_MIN_BYTES and at most the 
+store's spi_limit_bytes.
 
-returns -1 if 'p1' Win32ThreadInfo < 'p2' Win32ThreadInfo
-returns 1 if 'p1' Win32ThreadInfo > 'p2' Win32ThreadInfo
-returns 0 if 'p1' Win32ThreadInfo == 'p2' Win32ThreadInfo
+The contents of the buffer are not kept, and the spi array is no longer initialized. The buffer 
+must not be resized while the gui array points into it, and traverse_threads() must be called on the 
+buffer before it can be used with TRAVERSE_FLAG_RECYCLE since the sanity struct at the end of the 
+buffer records the buffer's size.
 */
-static int compare_gui( 
-	const void *const p1,   // in
-	const void *const p2   // in
+static void resize_spi_buffer( 
+	struct snapshot *const store,   // in, out
+	size_t bytes   // in
 )
 {
-	const struct gui *const a = p1;
-	const struct gui *const b = p2;
+	FAIL_IF( !store );
+	FAIL_IF( !store->spi_limit_bytes );
 	
 	
-	if( a->pvWin32ThreadInfo < b->pvWin32ThreadInfo )
-		return -1;
-	else if( a->pvWin32ThreadInfo > b->pvWin32ThreadInfo )
-		return 1;
-	else
-		return 0;
+	if( bytes < SPI_MIN_BYTES )
+		bytes = SPI_MIN_BYTES;
+	
+	if( bytes > store->spi_limit_bytes )
+		bytes = store->spi_limit_bytes;
+	
+	if( store->spi && ( bytes == store->spi_max_bytes ) )
+		return;
+	
+	free( store->spi );
+	store->spi = must_calloc( bytes, 1 );
+	store->spi_max_bytes = bytes;
+	store->init_time_spi = 0;
+	
+	if( store->spi_peak_bytes < store->spi_max_bytes )
+		store->spi_peak_bytes = store->spi_max_bytes;
+	
+	store->spi_low_count = 0;
+	return;
 }
 
 
 
-/* find_Win32ThreadInfo()
-Search a snapshot store's array of gui threads for a Win32ThreadInfo address.
+/* get_spi_used_bytes()
+Get the number of bytes used in a snapshot store's spi buffer.
+
+The used bytes are from the start of the buffer to the end of the last thread info or image name, 
+whichever is further. traverse_threads() writes its own information at the end of the buffer, 
+which isn't counted. If that includes a process index then the process infos are read from the 
+index instead of by walking the array.
 
-returns the gui struct that contains the matching pvWin32ThreadInfo
+'process_count' receives the number of SYSTEM_PROCESS_INFORMATION structs in the buffer.
+
+returns the number of bytes used
 */
-struct gui *find_Win32ThreadInfo( 
+size_t get_spi_used_bytes( 
 	const struct snapshot *const store,   // in
-	const void *const pvWin32ThreadInfo   // in
+	unsigned *const process_count   // out
 )
 {
-	struct gui findme;
-	struct gui *found = NULL;
+	const BYTE *const base = (const BYTE *)store->spi;
+	const size_t sti_size = ( store->spi_extended 
+		? sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) 
+		: sizeof( SYSTEM_THREAD_INFORMATION ) 
+	);
+	size_t offset = 0, used = 0;
+	const struct traverse_index_entry *index = NULL;
+	ULONG index_count = 0;
 	
-	FAIL_IF( store->gui_count > store->gui_max );
+	FAIL_IF( !store );
+	FAIL_IF( !process_count );
 	
 	
-	if( !store->gui_count )
-		return NULL;
+	*process_count = 0;
 	
-	ZeroMemory( &findme, sizeof( findme ) );
+	if( !store->spi || !store->init_time_spi )
+		return 0;
 	
-	/* only the pvWin32ThreadInfo member is compared */
-	findme.pvWin32ThreadInfo = pvWin32ThreadInfo;
+	index = get_traverse_index( store->spi, store->spi_max_bytes, &index_count, NULL );
 	
-	found = 
-		bsearch( 
-			&findme, 
-			store->gui, 
-			store->gui_count, 
-			sizeof( *store->gui ), 
-			compare_gui 
-		);
-
-	if( found )
+	for( ;; )
 	{
-		// Don't return the GUI thread if its Win32ThreadInfo is not unique
-		if( !found->unique_w32thread )
-			found = NULL;
+		const SYSTEM_PROCESS_INFORMATION *spi = NULL;
+		size_t end = 0;
+		
+		
+		if( index )
+		{
+			if( *process_count >= index_count )
+				break;
+			
+			offset = index[ *process_count ].offset;
+		}
+		
+		if( ( store->spi_max_bytes < offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) )
+			|| ( offset > ( store->spi_max_bytes - offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) ) )
+		)
+			break;
+		
+		spi = (const SYSTEM_PROCESS_INFORMATION *)( base + offset );
+		++*process_count;
+		
+		end = offset + offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) 
+			+ ( spi->NumberOfThreads * sti_size );
+		
+		if( end > used )
+			used = end;
+		
+		if( ( (const BYTE *)spi->ImageName.Buffer >= base ) 
+			&& ( (const BYTE *)spi->ImageName.Buffer < ( base + store->spi_max_bytes ) )
+		)
+		{
+			end = (size_t)( (const BYTE *)spi->ImageName.Buffer - base ) 
+				+ spi->ImageName.MaximumLength;
+			
+			if( end > used )
+				used = end;
+		}
+		
+		if( index )
+			continue;
+		
+		if( !spi->NextEntryOffset )
+			break;
+		
+		offset += spi->NextEntryOffset;
 	}
-
-	return found;
+	
+	return ( ( used < store->spi_max_bytes ) ? used : store->spi_max_bytes );
 }
 
 
@@ -619,17 +1567,33 @@ All of that information makes a snapshot of the state of the system.
 Unlike other stores the snapshot stores are reused/reinitialized rather than freeing and 
 recreating the stores, to avoid delay when taking continuous snapshots.
 
+'previous' is the snapshot store taken before this one, and is optional. Any HOOK that hasn't 
+changed since the previous snapshot is marked unchanged so the diff can skip comparing its fields. 
+See init_desktop_hook_store().
+
+If a new or changed hook's thread can't be any thread in the system process info then the system 
+process info and the gui threads are queried once more, and the hooks are read again. A pipelined 
+capture isn't used for the second read. See is_hook_thread_missing().
+
+The store's spi buffer is sized adaptively. If the buffer is too small for the system process info 
+it is doubled, up to the limit set by the maximum number of threads, and the info is requested 
+again. If the buffer has been mostly unused for SPI_SHRINK_AFTER consecutive snapshots it is halved 
+before the info is requested.
+
 This function must only be called from the main thread.
 
 returns nonzero on success
 */
 int init_snapshot_store( 
-	struct snapshot *const store   // in
+	struct snapshot *const store,   // in
+	const struct snapshot *const previous   // in, optional
 )
 {
-	unsigned i = 0;
 	__int64 first_fail_time = 0;
+	__int64 ticks = 0;
 	int ret = 0;
+	int taken = FALSE, recycle = FALSE, reread = FALSE;
+	__int64 capture_time = 0, capture_ticks = 0;
 	LONG nt_status = 0;
 	DWORD flags = 0;
 	struct callback_info ci;
@@ -637,18 +1601,30 @@ int init_snapshot_store(
 	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
 	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
 	FAIL_IF( !G->desktops->init_time );   // The desktop store must be initialized.
+	FAIL_IF( !G->cache->init_time );   // The cache store must be initialized.
 	
 	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
 	
 	FAIL_IF( !store );   // a snapshot store must always be passed in
 	
 	
+	/* each snapshot is a new generation in the thread cache */
+	begin_cache_generation( G->cache );
+	
+	/* if the query is retried the time of every attempt counts toward the query */
+	ticks = get_timing_ticks( G->timing );
+	
 retry:
 	flags = 0;
 	nt_status = 0;
 	
-	/* snapshot stores are reused. do a soft reset to reuse gui array */
-	store->gui_count = 0;
+	/* if this is a retry then the threads already looked up in the cache aren't counted again */
+	rewind_cache_stats( G->cache );
+	
+	/* snapshot stores are reused. do a soft reset to reuse gui array and work array */
+	reset_gui_array( store );
+	store->work_count = 0;
+	store->unread_count = 0;
 	/* the spi array doesn't have a count. traverse_threads() overwrites the spi regardless */
 	/* store->desktop_hooks is soft reset by init_desktop_hook_store() */
 	
@@ -663,8 +1639,57 @@ retry:
 		goto gethooks;
 	
 	
+	/* if the spi buffer has been mostly unused for a while then halve it, but keep it at least 
+	double the bytes used by the last snapshot. this must be done before the gui array is written 
+	since the gui array points into the spi buffer.
+	*/
+	if( store->spi_low_count >= SPI_SHRINK_AFTER )
+	{
+		size_t bytes = store->spi_max_bytes / 2;
+		
+		if( bytes < ( store->spi_used_bytes * 2 + TRAVERSE_RESERVED_BCOUNT ) )
+			bytes = store->spi_used_bytes * 2 + TRAVERSE_RESERVED_BCOUNT;
+		
+		store->spi_low_count = 0;
+		
+		if( bytes < store->spi_max_bytes )
+		{
+			resize_spi_buffer( store, bytes );
+			++store->spi_shrink_count;
+			
+			if( G->config->verbose >= 2 )
+				printf( "The spi buffer was shrunk to %Iu bytes.\n", store->spi_max_bytes );
+		}
+	}
+	
+	/* if the capture is pipelined then exchange the spi buffer for the one the capture thread filled 
+	just before the deadline of this poll. that's done once for each snapshot, not on a retry.
+	*/
+	if( G->capture->init_time && !taken )
+	{
+		taken = TRUE;
+		recycle = take_capture( G->capture, &store->spi, &store->spi_max_bytes, 
+			&capture_time, 
+			&capture_ticks 
+		);
+		
+		/* the buffer may not be the size this store last had */
+		store->init_time_spi = 0;
+		
+		if( store->spi_peak_bytes < store->spi_max_bytes )
+			store->spi_peak_bytes = store->spi_max_bytes;
+	}
+	
 	ZeroMemory( &ci, sizeof( ci ) );
 	ci.store = store;
+	ci.ticks = ticks;
+	
+	/* the snapshot's spi time and query time are the capture's, not the recycle's */
+	if( recycle )
+	{
+		ci.capture_time = capture_time;
+		ci.capture_ticks = capture_ticks;
+	}
 	
 	/* callback_add_gui() gets TEBs faster with EXTENDED */
 	store->spi_extended = TRUE;
@@ -674,18 +1699,68 @@ retry:
 	if( G->config->verbose >= 9 )
 		flags |= TRAVERSE_FLAG_DEBUG;
 	
+	/* index the process infos so that later passes over the spi array don't have to walk it */
+	flags |= TRAVERSE_FLAG_INDEX;
+	
+	/* the capture thread already queried the spi. traverse the buffer it filled. */
+	if( recycle )
+		flags |= TRAVERSE_FLAG_RECYCLE;
+	
 	/* call traverse_threads() to write the array of spi and gui.
 	traverse_threads() calls callback_add_gui() which writes to the store's array of gui and sets 
-	the spi init time.
+	the spi init time. if there are worker threads then traverse_threads_batch() is called instead, 
+	and it calls callback_add_gui_work() once for each process. that writes to the store's work 
+	array, and the gui array is written after by read_gui_work().
 	*/
-	ret = traverse_threads( 
-		callback_add_gui, /* callback */
-		&ci, /* pointer to callback data */
-		ci.store->spi, /* buffer that will receive the array of spi */
-		ci.store->spi_max_bytes, /* buffer's byte count */
-		flags, /* flags */
-		&nt_status /* pointer to receive status */
-	);
+	if( G->pool->init_time )
+	{
+		ret = traverse_threads_batch( 
+			callback_add_gui_work, /* callback */
+			&ci, /* pointer to callback data */
+			ci.store->spi, /* buffer that will receive the array of spi */
+			ci.store->spi_max_bytes, /* buffer's byte count */
+			flags, /* flags */
+			&nt_status /* pointer to receive status */
+		);
+	}
+	else
+	{
+		ret = traverse_threads( 
+			callback_add_gui, /* callback */
+			&ci, /* pointer to callback data */
+			ci.store->spi, /* buffer that will receive the array of spi */
+			ci.store->spi_max_bytes, /* buffer's byte count */
+			flags, /* flags */
+			&nt_status /* pointer to receive status */
+		);
+	}
+	
+	/* if the buffer is too small then double it and try again */
+	if( ( ret == TRAVERSE_ERROR_BUFFER_TOO_SMALL ) 
+		&& ( store->spi_max_bytes < store->spi_limit_bytes ) 
+	)
+	{
+		resize_spi_buffer( store, store->spi_max_bytes * 2 );
+		++store->spi_grow_count;
+		
+		if( G->config->verbose >= 2 )
+			printf( "The spi buffer was grown to %Iu bytes.\n", store->spi_max_bytes );
+		
+		goto retry;
+	}
+	
+	/* if the captured buffer couldn't be traversed then query the spi on this thread instead */
+	if( recycle && ( ret != TRAVERSE_SUCCESS ) )
+	{
+		if( G->config->verbose >= 1 )
+		{
+			MSG_WARNING( "The captured spi couldn't be recycled. Querying again..." );
+			printf( "traverse_threads() returned: %s\n", traverse_threads_retcode_to_cstr( ret ) );
+		}
+		
+		recycle = FALSE;
+		goto retry;
+	}
 	
 	if( ret != TRAVERSE_SUCCESS )
 	{
@@ -723,7 +1798,7 @@ retry:
 				 fflush( stdout );
 			}
 
-			if( G->config->polling != 0 )
+			if( ( G->config->polling != 0 ) || G->config->polling_ms )
 				Sleep( 1 ); // so as not to suck up cpu
 
 			goto retry;
@@ -772,53 +1847,68 @@ retry:
 		return FALSE;
 	}
 	
-	/* sort the gui array according to Win32ThreadInfo.
-	this array must be sorted so that bsearch() can be called to later search for a Win32ThreadInfo
-	*/
-	qsort( 
-		store->gui,
-		store->gui_count,
-		sizeof( *store->gui ),
-		compare_gui
-	);
+	/* if there are worker threads then read the threads in the work array and write the gui array */
+	if( G->pool->init_time && !read_gui_work( store, flags ) )
+	{
+		MSG_ERROR( "read_gui_work() failed." );
+		store->init_time_spi = 0;
+		return FALSE;
+	}
 	
-	/* search for invalid or duplicate Win32ThreadInfo */
-	for( i = 1; i < store->gui_count; ++i )
+	/* every thread and process that hasn't exited was seen in this generation. evict the rest. */
+	evict_exited_threads( G->cache );
+	evict_exited_processes( G->cache );
+	
+	/* track how much of the spi buffer is used. if less than a quarter then it may be shrunk */
 	{
-		struct gui *const a = &store->gui[ i - 1 ];
-		struct gui *const b = &store->gui[ i ];
-		
-		
-		if( a->pvWin32ThreadInfo == b->pvWin32ThreadInfo )
-		{
-			a->unique_w32thread = FALSE;
-			b->unique_w32thread = FALSE;
-		}
+		unsigned process_count = 0;
 		
-		if( !a->pvWin32ThreadInfo )
-		{
-			MSG_ERROR( "Invalid pvWin32ThreadInfo." );
-			print_gui( a );
-			return FALSE;
-		}
+		store->spi_used_bytes = get_spi_used_bytes( store, &process_count );
 		
-		if( !b->pvWin32ThreadInfo )
-		{
-			MSG_ERROR( "Invalid pvWin32ThreadInfo." );
-			print_gui( b );
-			return FALSE;
-		}
+		if( ( store->spi_max_bytes > SPI_MIN_BYTES ) 
+			&& ( ( store->spi_used_bytes * 4 ) < store->spi_max_bytes ) 
+		)
+			++store->spi_low_count;
+		else
+			store->spi_low_count = 0;
 	}
 	
+	add_timing( G->timing, TIMING_TEB, ci.ticks );
+	
+	/* the gui index was written and any duplicate Win32ThreadInfo marked by callback_add_gui() */
+	
 	/* the gui array has been initialized */
 	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time_gui );
 	
 	
 gethooks:
 	/* init the desktop hook store */
-	if( !init_desktop_hook_store( store ) )
+	if( !init_desktop_hook_store( store, ( previous ? previous->desktop_hooks : NULL ) ) )
 		return FALSE;
 	
+	/* if a new or changed hook's thread isn't any thread in the spi array then it was created after 
+	the thread info was queried. read the threads again, at most once for each snapshot. if the 
+	thread may be one that wasn't read, because its process couldn't be opened or it's cached as not 
+	a GUI thread, then reading again wouldn't find it and isn't done.
+	*/
+	if( !reread 
+		&& !( G->config->flags & CFG_COMPLETELY_PASSIVE ) 
+		&& is_hook_thread_missing( store->desktop_hooks, store->unread_count ) 
+	)
+	{
+		if( G->config->verbose >= 2 )
+			printf( "A hook's thread isn't in the thread info. Reading the threads again.\n" );
+		
+		/* the time of the second read counts toward the query again */
+		ticks = get_timing_ticks( G->timing );
+		
+		/* the captured thread info may be older than the hooks. query it again. */
+		recycle = FALSE;
+		
+		reread = TRUE;
+		goto retry;
+	}
+	
 	/* the snapshot store has been initialized */
 	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
 	return TRUE;
@@ -837,40 +1927,40 @@ void print_gui_brief(
 {
 	if( !gui )
 	{
-		printf( "<unknown>" );
+		output_printf( "<unknown>" );
 		return;
 	}
 	
 	if( gui->spi && gui->spi->ImageName.Buffer )
 	{
-		printf( "%.*ls", 
+		output_printf( "%.*ls", 
 			(int)( gui->spi->ImageName.Length / sizeof( WCHAR ) ), 
 			gui->spi->ImageName.Buffer 
 		);
 	}
 	else
-		printf( "<unknown>" );
+		output_printf( "<unknown>" );
 	
-	printf( " (" );
+	output_printf( " (" );
 	
-	printf( "PID " );
+	output_printf( "PID " );
 	if( gui->spi )
-		printf( "%Iu", gui->spi->UniqueProcessId );
+		output_printf( "%Iu", gui->spi->UniqueProcessId );
 	else
-		printf( "<unknown>" );
+		output_printf( "<unknown>" );
 	
-	printf( ", " );
+	output_printf( ", " );
 	
-	printf( "TID " );
+	output_printf( "TID " );
 	if( gui->sti )
-		printf( "%Iu", gui->sti->ClientId.UniqueThread );
+		output_printf( "%Iu", gui->sti->ClientId.UniqueThread );
 	else
-		printf( "<unknown>" );
+		output_printf( "<unknown>" );
 	
-	printf( " @ " );
-	PRINT_HEX_BARE( gui->pvWin32ThreadInfo );
+	output_printf( " @ " );
+	OUTPUT_HEX_BARE( gui->pvWin32ThreadInfo );
 	
-	printf( ")" );
+	output_printf( ")" );
 	
 	return;
 }
@@ -996,6 +2086,46 @@ void print_gui_array(
 
 
 
+/* print_spi_buffer_stats()
+Print the allocated, used and peak sizes of a snapshot store's spi buffer, and the number of 
+processes and threads in its index.
+
+The allocated size is the steady-state size of the buffer, which changes only when the buffer is 
+grown or shrunk by init_snapshot_store().
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_spi_buffer_stats(
+	const struct snapshot *const store   // in
+)
+{
+	ULONG process_count = 0, thread_count = 0;
+	
+	
+	if( !store )
+		return;
+	
+	printf( "spi buffer: %Iu bytes allocated, %Iu bytes used, %Iu bytes peak, %Iu bytes limit.\n", 
+		store->spi_max_bytes, 
+		store->spi_used_bytes, 
+		store->spi_peak_bytes, 
+		store->spi_limit_bytes 
+	);
+	printf( "spi buffer: grown %u times, shrunk %u times.\n", 
+		store->spi_grow_count, 
+		store->spi_shrink_count 
+	);
+	
+	if( store->init_time_spi 
+		&& get_traverse_index( store->spi, store->spi_max_bytes, &process_count, &thread_count ) 
+	)
+		printf( "spi index: %lu processes, %lu threads.\n", process_count, thread_count );
+	
+	return;
+}
+
+
+
 /* print_spi_array_brief()
 Print some brief information from a snapshot store's spi array.
 
@@ -1067,6 +2197,10 @@ void print_snapshot_store(
 	PRINT_DBLSEP_BEGIN( objname );
 	print_init_time( "store->init_time", store->init_time );
 	
+	print_spi_buffer_stats( store );
+	
+	print_arena_stats( store->arena, "Snapshot arena" );
+	
 	print_spi_array_brief( store );
 	
 	print_gui_array( store );
@@ -1083,6 +2217,9 @@ void print_snapshot_store(
 /* free_snapshot_store()
 Free a snapshot store and all its descendants.
 
+The store's arena is reset and kept for the next snapshot store that's created, unless an arena is 
+already being kept, in which case it's freed.
+
 this function then sets the snapshot store pointer to NULL and returns
 
 'in' is a pointer to a pointer to the snapshot store, which contains the snapshot information.
@@ -1092,17 +2229,46 @@ void free_snapshot_store(
 	struct snapshot **const in   // in deref
 )
 {
+	struct arena *arena = NULL;
+	
+	
 	if( !in || !*in )
 		return;
 	
 	free_desktop_hook_store( &(*in)->desktop_hooks );
 	
-	free( (*in)->gui );
+	free( (*in)->work );
 	
 	free( (*in)->spi );
 	
-	free( (*in) );
+	/* the store itself was allocated from the arena */
+	arena = (*in)->arena;
 	*in = NULL;
 	
+	if( !spare_arena )
+	{
+		reset_arena_store( arena );
+		spare_arena = arena;
+	}
+	else
+	{
+		free_arena_store( &arena );
+	}
+	
+	return;
+}
+
+
+
+/* free_spare_snapshot_arena()
+Free the arena kept from the last snapshot store that was freed.
+
+This is called when no more snapshot stores will be created. If another one is created after then 
+it gets a new arena.
+*/
+void free_spare_snapshot_arena( void )
+{
+	free_arena_store( &spare_arena );
+	
 	return;
 }
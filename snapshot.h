@@ -32,6 +32,9 @@ SYSTEM_PROCESS_INFORMATION
 /* desktop hook store (linked list of desktop and hook information) */
 #include "desktop_hook.h"
 
+/* arena store (memory allocated in order and released all at once) */
+#include "arena.h"
+
 
 
 #ifdef __cplusplus
@@ -90,6 +93,42 @@ struct gui
 
 
 
+/** A thread that may be a GUI thread, to be read by a worker thread.
+When there are worker threads each thread in the system is first added to the snapshot store's work 
+array on the main thread, and then the threads whose info wasn't cached are read by the workers.
+*/
+struct gui_work
+{
+	/* the thread's process id. the work array is partitioned by this key. */
+	unsigned __int64 pid;
+	
+	/* the thread's process info and thread info in the parent snapshot store's spi buffer */
+	SYSTEM_PROCESS_INFORMATION *spi;
+	SYSTEM_THREAD_INFORMATION *sti;
+	
+	/* the address of the thread's TEB and Win32ThreadInfo, as found in the thread cache or read 
+	by a worker
+	*/
+	const void *pvTeb;
+	const void *pvWin32ThreadInfo;
+	
+	/* nonzero if the thread was found in the thread cache */
+	BOOL cached;
+	
+	/* nonzero if the thread was read by a worker and can be added to the thread cache */
+	BOOL cacheable;
+	
+	/* a handle to the thread's process, opened on the main thread before the workers are run. 
+	NULL if the thread was found in the thread cache or its process couldn't be opened.
+	*/
+	HANDLE process;
+	
+	/* nonzero if 'process' is owned by the process cache, else it's closed after the workers are done */
+	BOOL is_process_cached;
+};
+
+
+
 /** The snapshot store. 
 The snapshot store holds system process info (spi), gui thread info (gui) and desktop hook info 
 (desktop_hooks).
@@ -114,6 +153,22 @@ struct snapshot
 	/* the allocated size of the buffer in bytes */
 	size_t spi_max_bytes;
 	
+	/* the size in bytes the buffer is never grown past, based on the maximum number of threads */
+	size_t spi_limit_bytes;
+	
+	/* the largest size in bytes the buffer has been allocated */
+	size_t spi_peak_bytes;
+	
+	/* the number of bytes in the buffer used by the last snapshot */
+	size_t spi_used_bytes;
+	
+	/* the number of consecutive snapshots that used less than a quarter of the buffer */
+	unsigned spi_low_count;
+	
+	/* the number of times the buffer has been grown or shrunk */
+	unsigned spi_grow_count;
+	unsigned spi_shrink_count;
+	
 	/* this member is nonzero if the caller called traverse_threads() to output to 'spi' 
 	using the flag TRAVERSE_FLAG_EXTENDED. That means the system's process info was 
 	queried using SystemExtendedProcessInformation instead of SystemProcessInformation, 
@@ -128,7 +183,7 @@ struct snapshot
 	the spi array must be initialized before this array is initialized.
 	*/
 	/* the gui array */
-	struct gui *gui;   // calloc(), free()
+	struct gui *gui;   // arena_calloc()
 	
 	/* the allocated/maximum number of elements in the gui array.
 	this is also the maximum number of threads that can be handled in this snapshot.
@@ -140,6 +195,40 @@ struct snapshot
 	*/
 	unsigned gui_count;
 	
+	/* how many threads in the spi array may be GUI threads but weren't read in this snapshot, 
+	because their process couldn't be opened, their TEB couldn't be read or they're cached as not 
+	GUI threads. a hook's thread that isn't in the gui array may be one of these.
+	*/
+	unsigned unread_count;
+	
+	/* an open addressing hash index of the gui array, keyed by pvWin32ThreadInfo.
+	each slot holds the index of a gui array element plus one, or zero if the slot is empty.
+	the index is written by add_gui() and searched by find_Win32ThreadInfo().
+	*/
+	unsigned *gui_index;   // arena_calloc()
+	
+	/* the number of slots in the gui index. this is a power of 2 and always more than gui_max, 
+	so there is always at least one empty slot to terminate a search.
+	*/
+	unsigned gui_index_max;
+	
+	/* log2 of gui_index_max */
+	unsigned gui_index_bits;
+	
+	
+	
+	/** an array of threads to be read by worker threads.
+	this is only used if there are worker threads.
+	*/
+	/* the work array */
+	struct gui_work *work;   // calloc(), free()
+	
+	/* the allocated number of elements in the work array. it's grown as needed. */
+	unsigned work_max;
+	
+	/* the number of elements written to in the work array */
+	unsigned work_count;
+	
 	
 	
 	/* desktop hook store. a linked list of desktops and their hooks */
@@ -147,6 +236,14 @@ struct snapshot
 	
 	
 	
+	/* the arena that owns this store and the memory of its descendants that isn't resized: the gui 
+	array, the gui index, and the desktop hook items and their arrays. the spi buffer and the work 
+	array are resized so they're allocated from the heap.
+	*/
+	struct arena *arena;   // create_arena_store(), free_arena_store()
+	
+	
+	
 	/* the system utc time in FILETIME format immediately after spi has been initialized.
 	this is nonzero when the spi array has been initialized.
 	*/
@@ -187,13 +284,28 @@ int match_gui_thread_id(
 	const unsigned __int64 tid   // in
 );
 
+void reset_gui_array( 
+	struct snapshot *const store   // in, out
+);
+
+int add_gui( 
+	struct snapshot *const store,   // in, out
+	const struct gui *const gui   // in
+);
+
 struct gui *find_Win32ThreadInfo( 
 	const struct snapshot *const store,   // in
 	const void *const pvWin32ThreadInfo   // in
 );
 
+size_t get_spi_used_bytes( 
+	const struct snapshot *const store,   // in
+	unsigned *const process_count   // out
+);
+
 int init_snapshot_store( 
-	struct snapshot *const store   // in
+	struct snapshot *const store,   // in
+	const struct snapshot *const previous   // in, optional
 );
 
 void print_gui_brief( 
@@ -208,6 +320,10 @@ void print_gui_array(
 	const struct snapshot *const store   // in
 );
 
+void print_spi_buffer_stats(
+	const struct snapshot *const store   // in
+);
+
 void print_spi_array_brief(
 	const struct snapshot *const store   // in
 );
@@ -220,6 +336,8 @@ void free_snapshot_store(
 	struct snapshot **const in   // in deref
 );
 
+void free_spare_snapshot_arena( void );
+
 
 #ifdef __cplusplus
 }
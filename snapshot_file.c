@@ -0,0 +1,1434 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for writing snapshots to a binary snapshot file and for a snapshot file 
+store (a snapshot file mapped into memory and the snapshots in it).
+Each function is documented in the comment block above its definition.
+
+The snapshot file format is described in snapshot_file.h.
+
+A snapshot loaded from a file is the same snapshot store that was written, and the print and diff 
+functions can be called on it. Unlike other snapshot stores it is in a view of the file and must not 
+be freed or reinitialized. Its gui index is not written so find_Win32ThreadInfo() can't be used, 
+and its spi buffer can't be traversed by traverse_threads() which requires its own information in 
+the buffer.
+
+-
+align_image_size()
+
+Round a size up to the alignment of a snapshot image.
+-
+
+-
+add_image_section()
+
+Add a section to the layout of a snapshot image.
+-
+
+-
+get_image_section()
+
+Get a pointer to the start of a section in a snapshot image.
+-
+
+-
+set_image_pointer()
+
+Set a pointer in a snapshot image to an offset in the image and add a relocation for it.
+-
+
+-
+compare_reloc()
+
+Compare two relocations according to their offset.
+-
+
+-
+write_snapshot_file()
+
+Write a snapshot store to the end of a snapshot file.
+-
+
+-
+create_snapshot_file_store()
+
+Create a snapshot file store and its descendants or die.
+-
+
+-
+is_in_image_section()
+
+Check that a block of memory is in a section of a snapshot image.
+-
+
+-
+is_spi_in_image()
+
+Check that a SYSTEM_PROCESS_INFORMATION struct and its image name are in a snapshot image.
+-
+
+-
+load_snapshot_image()
+
+Validate and relocate a snapshot image in memory.
+-
+
+-
+init_snapshot_file_store()
+
+Initialize a snapshot file store by mapping a snapshot file into memory and loading its snapshots.
+-
+
+-
+print_snapshot_file_store()
+
+Print a snapshot file store.
+-
+
+-
+free_snapshot_file_store()
+
+Free a snapshot file store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "util.h"
+
+#include "snapshot_file.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/** A snapshot image that is being written.
+*/
+struct image
+{
+	/* the image */
+	BYTE *base;   // calloc(), free()
+	
+	/* the header at the start of the image */
+	struct snapshot_file_header *header;
+	
+	/* the number of relocations that have been written */
+	unsigned reloc_count;
+	
+	/* the number of relocations that there is space for */
+	unsigned reloc_max;
+};
+
+
+
+static size_t align_image_size( 
+	const size_t size   // in
+);
+
+static void add_image_section( 
+	struct snapshot_file_header *const header,   // in, out
+	const enum snapshot_file_section_type type,   // in
+	const size_t elem_size,   // in
+	const size_t count,   // in
+	unsigned __int64 *const size   // in, out
+);
+
+static void *get_image_section( 
+	const void *const base,   // in
+	const enum snapshot_file_section_type type   // in
+);
+
+static void set_image_pointer( 
+	struct image *const image,   // in, out
+	void *const field,   // out
+	const size_t offset,   // in
+	const enum snapshot_file_section_type type   // in
+);
+
+static int compare_reloc( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static int is_in_image_section( 
+	const void *const base,   // in
+	const void *const p,   // in
+	const size_t size,   // in
+	const enum snapshot_file_section_type type   // in
+);
+
+static int is_spi_in_image( 
+	const void *const base,   // in
+	const SYSTEM_PROCESS_INFORMATION *const spi   // in
+);
+
+
+
+/* align_image_size()
+Round a size up to the alignment of a snapshot image.
+
+returns the aligned size
+*/
+static size_t align_image_size( 
+	const size_t size   // in
+)
+{
+	return ( ( size + ( SNAPSHOT_FILE_ALIGNMENT - 1 ) ) & ~(size_t)( SNAPSHOT_FILE_ALIGNMENT - 1 ) );
+}
+
+
+
+/* add_image_section()
+Add a section to the layout of a snapshot image.
+
+'size' is the size of the image so far. The section is placed at the end of the image and 'size' 
+receives the new size of the image.
+*/
+static void add_image_section( 
+	struct snapshot_file_header *const header,   // in, out
+	const enum snapshot_file_section_type type,   // in
+	const size_t elem_size,   // in
+	const size_t count,   // in
+	unsigned __int64 *const size   // in, out
+)
+{
+	struct snapshot_file_section *section = NULL;
+	
+	FAIL_IF( !header );
+	FAIL_IF( ( type <= SECTION_INVALID_TYPE ) || ( type >= SECTION_COUNT ) );
+	FAIL_IF( !size );
+	FAIL_IF( *size % SNAPSHOT_FILE_ALIGNMENT );
+	
+	
+	section = &header->section[ type ];
+	
+	section->type = (DWORD)type;
+	section->elem_size = (DWORD)elem_size;
+	section->offset = (DWORD)*size;
+	section->count = (DWORD)count;
+	
+	*size += align_image_size( elem_size * count );
+	return;
+}
+
+
+
+/* get_image_section()
+Get a pointer to the start of a section in a snapshot image.
+
+returns a pointer to the start of the section
+*/
+static void *get_image_section( 
+	const void *const base,   // in
+	const enum snapshot_file_section_type type   // in
+)
+{
+	const struct snapshot_file_header *const header = base;
+	
+	
+	return (void *)( (BYTE *)base + header->section[ type ].offset );
+}
+
+
+
+/* set_image_pointer()
+Set a pointer in a snapshot image to an offset in the image and add a relocation for it.
+
+'field' is the pointer in the image.
+'offset' is the offset in the image that the pointer will point to once it has been relocated.
+'type' is the type of the section that 'offset' is in.
+*/
+static void set_image_pointer( 
+	struct image *const image,   // in, out
+	void *const field,   // out
+	const size_t offset,   // in
+	const enum snapshot_file_section_type type   // in
+)
+{
+	struct snapshot_file_reloc *reloc = NULL;
+	
+	FAIL_IF( !image );
+	FAIL_IF( !field );
+	FAIL_IF( image->reloc_count >= image->reloc_max );
+	
+	
+	*(uintptr_t *)field = (uintptr_t)offset;
+	
+	reloc = get_image_section( image->base, SECTION_RELOC );
+	reloc[ image->reloc_count ].offset = (DWORD)( (BYTE *)field - image->base );
+	reloc[ image->reloc_count ].section = (DWORD)type;
+	image->reloc_count++;
+	
+	return;
+}
+
+
+
+/* compare_reloc()
+Compare two relocations according to their offset.
+
+qsort() callback: this function is called to sort the relocations in a snapshot image
+
+returns -1 if p1's offset is less than p2's offset
+returns 1 if p1's offset is greater than p2's offset
+returns 0 if p1's offset is the same as p2's offset
+*/
+static int compare_reloc( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct snapshot_file_reloc *const a = p1;
+	const struct snapshot_file_reloc *const b = p2;
+	
+	
+	if( a->offset < b->offset )
+		return -1;
+	else if( a->offset > b->offset )
+		return 1;
+	else
+		return 0;
+}
+
+
+
+/* write_snapshot_file()
+Write a snapshot store to the end of a snapshot file.
+
+The snapshot store is copied to a snapshot image which is appended to the file. If the file does 
+not exist it is created.
+
+returns nonzero on success
+*/
+int write_snapshot_file( 
+	const struct snapshot *const store,   // in
+	const WCHAR *const filename   // in
+)
+{
+	const struct desktop_hook_item *current = NULL;
+	struct snapshot_file_header layout;
+	struct image image;
+	struct snapshot *snapshot = NULL;
+	struct desktop_hook_list *list = NULL;
+	struct desktop_hook_item *item = NULL;
+	struct desktop_item *desktop = NULL;
+	struct hook *hook = NULL;
+	struct hook_key *key = NULL;
+	struct gui *gui = NULL;
+	BYTE *spi = NULL;
+	WCHAR *name = NULL;
+	unsigned item_count = 0, hook_count = 0, name_count = 0, process_count = 0;
+	unsigned i = 0, j = 0, k = 0, h = 0, n = 0;
+	size_t spi_bytes = 0;
+	unsigned __int64 size = 0;
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	LARGE_INTEGER file_size;
+	DWORD written = 0;
+	int ret = FALSE;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !filename );
+	
+	FAIL_IF( !store->init_time );   // The snapshot store must be initialized.
+	FAIL_IF( !store->desktop_hooks->init_time );   // The desktop hook store must be initialized.
+	
+	
+	/* count the elements in each section */
+	for( current = store->desktop_hooks->head; current; current = current->next )
+	{
+		++item_count;
+		hook_count += current->hook_count;
+		name_count += (unsigned)wcslen( current->desktop->pwszDesktopName ) + 1;
+	}
+	
+	spi_bytes = get_spi_used_bytes( store, &process_count );
+	
+	/* lay out the image */
+	ZeroMemory( &layout, sizeof( layout ) );
+	ZeroMemory( &image, sizeof( image ) );
+	
+	/* snapshot: spi, gui, desktop_hooks
+	desktop hook list: head, tail
+	desktop hook item: desktop, hook, key, next
+	desktop: name
+	hook: owner, origin, target
+	gui: spi, sti
+	spi: image name
+	*/
+	image.reloc_max = 
+		3 + 2 + ( item_count * 5 ) + ( hook_count * 3 ) + ( store->gui_count * 2 ) + process_count;
+	
+	size = align_image_size( sizeof( layout ) );
+	add_image_section( &layout, SECTION_SNAPSHOT, sizeof( *snapshot ), 1, &size );
+	add_image_section( &layout, SECTION_DESKTOP_HOOK_LIST, sizeof( *list ), 1, &size );
+	add_image_section( &layout, SECTION_DESKTOP_HOOK_ITEM, sizeof( *item ), item_count, &size );
+	add_image_section( &layout, SECTION_DESKTOP, sizeof( *desktop ), item_count, &size );
+	add_image_section( &layout, SECTION_HOOK, sizeof( *hook ), hook_count, &size );
+	add_image_section( &layout, SECTION_HOOK_KEY, sizeof( *key ), hook_count, &size );
+	add_image_section( &layout, SECTION_GUI, sizeof( *gui ), store->gui_count, &size );
+	add_image_section( &layout, SECTION_SPI, sizeof( *spi ), spi_bytes, &size );
+	add_image_section( &layout, SECTION_NAME, sizeof( *name ), name_count, &size );
+	add_image_section( 
+		&layout, SECTION_RELOC, sizeof( struct snapshot_file_reloc ), image.reloc_max, &size 
+	);
+	
+	if( size > 0x7FFFFFFF )
+	{
+		MSG_ERROR( "The snapshot is too large to write." );
+		printf( "size: %I64u\n", size );
+		return FALSE;
+	}
+	
+	memcpy( layout.magic, SNAPSHOT_FILE_MAGIC, SNAPSHOT_FILE_MAGIC_LEN );
+	layout.version = SNAPSHOT_FILE_VERSION;
+	layout.header_size = sizeof( layout );
+	layout.image_size = (DWORD)size;
+	layout.pointer_size = sizeof( void * );
+	layout.section_count = SECTION_COUNT;
+	layout.init_time = store->init_time;
+	
+	image.base = must_calloc( 1, (size_t)size );
+	image.header = (struct snapshot_file_header *)image.base;
+	*image.header = layout;
+	
+	snapshot = get_image_section( image.base, SECTION_SNAPSHOT );
+	list = get_image_section( image.base, SECTION_DESKTOP_HOOK_LIST );
+	item = get_image_section( image.base, SECTION_DESKTOP_HOOK_ITEM );
+	desktop = get_image_section( image.base, SECTION_DESKTOP );
+	hook = get_image_section( image.base, SECTION_HOOK );
+	key = get_image_section( image.base, SECTION_HOOK_KEY );
+	gui = get_image_section( image.base, SECTION_GUI );
+	spi = get_image_section( image.base, SECTION_SPI );
+	name = get_image_section( image.base, SECTION_NAME );
+	
+	
+	/* the snapshot store. the gui index, the work array and the arena aren't written */
+	*snapshot = *store;
+	
+	if( spi_bytes )
+		set_image_pointer( &image, &snapshot->spi, layout.section[ SECTION_SPI ].offset, SECTION_SPI );
+	else
+		snapshot->spi = NULL;
+	
+	snapshot->spi_max_bytes = spi_bytes;
+	
+	if( store->gui_count )
+		set_image_pointer( &image, &snapshot->gui, layout.section[ SECTION_GUI ].offset, SECTION_GUI );
+	else
+		snapshot->gui = NULL;
+	
+	snapshot->gui_max = store->gui_count;
+	snapshot->gui_index = NULL;
+	snapshot->gui_index_max = 0;
+	snapshot->gui_index_bits = 0;
+	snapshot->work = NULL;
+	snapshot->work_max = 0;
+	snapshot->work_count = 0;
+	snapshot->arena = NULL;
+	
+	set_image_pointer( 
+		&image, 
+		&snapshot->desktop_hooks, 
+		layout.section[ SECTION_DESKTOP_HOOK_LIST ].offset, 
+		SECTION_DESKTOP_HOOK_LIST 
+	);
+	
+	
+	/* the desktop hook store. the arrays that are only used to initialize it aren't written */
+	*list = *store->desktop_hooks;
+	list->head = NULL;
+	list->tail = NULL;
+	list->item_by_range = NULL;
+	list->candidate = NULL;
+	list->candidate_max = 0;
+	list->record = NULL;
+	list->sort = NULL;
+	list->sort_spare = NULL;
+	list->sort_max = 0;
+	list->generation = 0;
+	list->arena = NULL;
+	
+	if( item_count )
+	{
+		set_image_pointer( 
+			&image, 
+			&list->head, 
+			layout.section[ SECTION_DESKTOP_HOOK_ITEM ].offset, 
+			SECTION_DESKTOP_HOOK_ITEM 
+		);
+		
+		set_image_pointer( 
+			&image, 
+			&list->tail, 
+			layout.section[ SECTION_DESKTOP_HOOK_ITEM ].offset + ( ( item_count - 1 ) * sizeof( *item ) ), 
+			SECTION_DESKTOP_HOOK_ITEM 
+		);
+	}
+	
+	
+	/* the desktop hook items, their desktops and their hooks */
+	for( current = store->desktop_hooks->head, k = 0; current; current = current->next, ++k )
+	{
+		item[ k ] = *current;
+		
+		set_image_pointer( 
+			&image, 
+			&item[ k ].desktop, 
+			layout.section[ SECTION_DESKTOP ].offset + ( k * sizeof( *desktop ) ), 
+			SECTION_DESKTOP 
+		);
+		
+		if( current->hook_count )
+		{
+			set_image_pointer( 
+				&image, 
+				&item[ k ].hook, 
+				layout.section[ SECTION_HOOK ].offset + ( h * sizeof( *hook ) ), 
+				SECTION_HOOK 
+			);
+			
+			set_image_pointer( 
+				&image, 
+				&item[ k ].key, 
+				layout.section[ SECTION_HOOK_KEY ].offset + ( h * sizeof( *key ) ), 
+				SECTION_HOOK_KEY 
+			);
+		}
+		else
+		{
+			item[ k ].hook = NULL;
+			item[ k ].key = NULL;
+		}
+		
+		if( current->next )
+		{
+			set_image_pointer( 
+				&image, 
+				&item[ k ].next, 
+				layout.section[ SECTION_DESKTOP_HOOK_ITEM ].offset + ( ( k + 1 ) * sizeof( *item ) ), 
+				SECTION_DESKTOP_HOOK_ITEM 
+			);
+		}
+		else
+			item[ k ].next = NULL;
+		
+		/* only the desktop's name is written. the rest is specific to this process */
+		wcscpy( &name[ n ], current->desktop->pwszDesktopName );
+		
+		set_image_pointer( 
+			&image, 
+			&desktop[ k ].pwszDesktopName, 
+			layout.section[ SECTION_NAME ].offset + ( n * sizeof( *name ) ), 
+			SECTION_NAME 
+		);
+		
+		n += (unsigned)wcslen( current->desktop->pwszDesktopName ) + 1;
+		
+		/* the hooks. their threads are in the gui array */
+		for( i = 0; i < current->hook_count; ++i, ++h )
+		{
+			const struct gui *thread[ 3 ];
+			const struct gui **field[ 3 ];
+			
+			
+			hook[ h ] = current->hook[ i ];
+			key[ h ] = current->key[ i ];
+			
+			/* whether a hook is unchanged depends on the snapshot taken before it */
+			hook[ h ].unchanged = FALSE;
+			
+			thread[ 0 ] = current->hook[ i ].owner;
+			thread[ 1 ] = current->hook[ i ].origin;
+			thread[ 2 ] = current->hook[ i ].target;
+			
+			field[ 0 ] = &hook[ h ].owner;
+			field[ 1 ] = &hook[ h ].origin;
+			field[ 2 ] = &hook[ h ].target;
+			
+			for( j = 0; j < 3; ++j )
+			{
+				if( thread[ j ] 
+					&& ( thread[ j ] >= store->gui ) 
+					&& ( thread[ j ] < ( store->gui + store->gui_count ) )
+				)
+				{
+					set_image_pointer( 
+						&image, 
+						(void *)field[ j ], 
+						layout.section[ SECTION_GUI ].offset 
+							+ ( (size_t)( thread[ j ] - store->gui ) * sizeof( *gui ) ), 
+						SECTION_GUI 
+					);
+				}
+				else
+					*field[ j ] = NULL;
+			}
+		}
+	}
+	
+	
+	/* the gui array. the spi and sti are in the spi buffer */
+	for( i = 0; i < store->gui_count; ++i )
+	{
+		const BYTE *const base = (const BYTE *)store->spi;
+		
+		
+		gui[ i ] = store->gui[ i ];
+		
+		if( spi_bytes
+			&& ( (const BYTE *)store->gui[ i ].spi >= base ) 
+			&& ( (const BYTE *)store->gui[ i ].spi < ( base + spi_bytes ) )
+		)
+		{
+			set_image_pointer( 
+				&image, 
+				&gui[ i ].spi, 
+				layout.section[ SECTION_SPI ].offset + ( (const BYTE *)store->gui[ i ].spi - base ), 
+				SECTION_SPI 
+			);
+		}
+		else
+			gui[ i ].spi = NULL;
+		
+		if( spi_bytes
+			&& ( (const BYTE *)store->gui[ i ].sti >= base ) 
+			&& ( (const BYTE *)store->gui[ i ].sti < ( base + spi_bytes ) )
+		)
+		{
+			set_image_pointer( 
+				&image, 
+				&gui[ i ].sti, 
+				layout.section[ SECTION_SPI ].offset + ( (const BYTE *)store->gui[ i ].sti - base ), 
+				SECTION_SPI 
+			);
+		}
+		else
+			gui[ i ].sti = NULL;
+	}
+	
+	
+	/* the spi buffer. the image names are in the buffer */
+	if( spi_bytes )
+	{
+		size_t offset = 0;
+		
+		
+		memcpy( spi, store->spi, spi_bytes );
+		
+		for( i = 0; i < process_count; ++i )
+		{
+			SYSTEM_PROCESS_INFORMATION *p = (SYSTEM_PROCESS_INFORMATION *)( spi + offset );
+			const BYTE *const buffer = (const BYTE *)p->ImageName.Buffer;
+			
+			
+			if( ( buffer >= (const BYTE *)store->spi ) 
+				&& ( buffer < ( (const BYTE *)store->spi + spi_bytes ) )
+			)
+			{
+				set_image_pointer( 
+					&image, 
+					&p->ImageName.Buffer, 
+					layout.section[ SECTION_SPI ].offset + ( buffer - (const BYTE *)store->spi ), 
+					SECTION_SPI 
+				);
+			}
+			else
+				p->ImageName.Buffer = NULL;
+			
+			offset += p->NextEntryOffset;
+		}
+	}
+	
+	
+	/* the relocations are sorted so that they can be validated in one pass */
+	image.header->section[ SECTION_RELOC ].count = image.reloc_count;
+	
+	qsort( 
+		get_image_section( image.base, SECTION_RELOC ), 
+		image.reloc_count, 
+		sizeof( struct snapshot_file_reloc ), 
+		compare_reloc 
+	);
+	
+	
+	/* append the image to the file */
+	hFile = CreateFileW( 
+		filename, 
+		FILE_APPEND_DATA, 
+		FILE_SHARE_READ, 
+		NULL, 
+		OPEN_ALWAYS, 
+		FILE_ATTRIBUTE_NORMAL, 
+		NULL 
+	);
+	if( hFile == INVALID_HANDLE_VALUE )
+	{
+		MSG_ERROR_GLE( "CreateFileW() failed." );
+		printf( "filename: %ls\n", filename );
+		goto cleanup;
+	}
+	
+	/* each image in the file must start on an aligned offset */
+	if( !GetFileSizeEx( hFile, &file_size ) )
+	{
+		MSG_ERROR_GLE( "GetFileSizeEx() failed." );
+		printf( "filename: %ls\n", filename );
+		goto cleanup;
+	}
+	
+	if( file_size.QuadPart % SNAPSHOT_FILE_ALIGNMENT )
+	{
+		MSG_ERROR( "The file is not a snapshot file or its last snapshot is incomplete." );
+		printf( "filename: %ls\n", filename );
+		goto cleanup;
+	}
+	
+	if( !WriteFile( hFile, image.base, (DWORD)size, &written, NULL ) || ( written != size ) )
+	{
+		MSG_ERROR_GLE( "WriteFile() failed." );
+		printf( "filename: %ls\n", filename );
+		printf( "written: %lu of %I64u bytes\n", written, size );
+		goto cleanup;
+	}
+	
+	ret = TRUE;
+	
+cleanup:
+	if( hFile != INVALID_HANDLE_VALUE )
+		CloseHandle( hFile );
+	
+	free( image.base );
+	
+	return ret;
+}
+
+
+
+/* create_snapshot_file_store()
+Create a snapshot file store and its descendants or die.
+*/
+void create_snapshot_file_store( 
+	struct snapshot_file **const out   // out deref
+)
+{
+	struct snapshot_file *file = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a snapshot file store */
+	file = must_calloc( 1, sizeof( *file ) );
+	
+	file->hFile = INVALID_HANDLE_VALUE;
+	
+	
+	*out = file;
+	return;
+}
+
+
+
+/* is_in_image_section()
+Check that a block of memory is in a section of a snapshot image.
+
+'p' is the start of the block and 'size' is its size in bytes. The block must be in the section and 
+if the section is an array of structs it must start on one of the structs.
+
+returns nonzero if the block is in the section
+*/
+static int is_in_image_section( 
+	const void *const base,   // in
+	const void *const p,   // in
+	const size_t size,   // in
+	const enum snapshot_file_section_type type   // in
+)
+{
+	const struct snapshot_file_header *const header = base;
+	const struct snapshot_file_section *const section = &header->section[ type ];
+	const BYTE *const begin = (const BYTE *)base + section->offset;
+	const size_t bytes = (size_t)section->elem_size * section->count;
+	
+	
+	if( !p 
+		|| ( (const BYTE *)p < begin ) 
+		|| ( size > bytes )
+		|| ( (size_t)( (const BYTE *)p - begin ) > ( bytes - size ) )
+	)
+		return FALSE;
+	
+	if( ( section->elem_size > sizeof( WCHAR ) ) 
+		&& ( (size_t)( (const BYTE *)p - begin ) % section->elem_size )
+	)
+		return FALSE;
+	
+	return TRUE;
+}
+
+
+
+/* is_spi_in_image()
+Check that a SYSTEM_PROCESS_INFORMATION struct and its image name are in a snapshot image.
+
+The struct must be aligned the same as it is in a buffer written by NtQuerySystemInformation().
+The threads that follow the struct aren't checked.
+
+returns nonzero if the struct and its image name are in the image
+*/
+static int is_spi_in_image( 
+	const void *const base,   // in
+	const SYSTEM_PROCESS_INFORMATION *const spi   // in
+)
+{
+	if( ( (uintptr_t)spi % sizeof( void * ) )
+		|| !is_in_image_section( base, spi, offsetof( SYSTEM_PROCESS_INFORMATION, Threads ), SECTION_SPI ) 
+	)
+		return FALSE;
+	
+	if( spi->ImageName.Buffer
+		&& !is_in_image_section( base, spi->ImageName.Buffer, spi->ImageName.Length, SECTION_SPI ) 
+	)
+		return FALSE;
+	
+	return TRUE;
+}
+
+
+
+/* load_snapshot_image()
+Validate and relocate a snapshot image in memory.
+
+'image' is the start of the image and 'size' is the number of bytes available from there, which 
+may be more than the image size. The image is modified in place: each pointer in it is relocated.
+
+'desktops' is optional. If it's passed in then each desktop in the snapshot that has the same name 
+as a desktop in 'desktops' is replaced by it, so that snapshots loaded from different images can be 
+compared. Otherwise the desktops in the image are used.
+
+'out' receives a pointer to the snapshot store in the image.
+
+returns nonzero on success
+*/
+int load_snapshot_image( 
+	struct snapshot **const out,   // out deref
+	void *const image,   // in, out
+	const size_t size,   // in
+	const struct desktop_list *const desktops   // in, optional
+)
+{
+	const struct snapshot_file_header *const header = image;
+	const struct snapshot_file_section *section = NULL;
+	const struct snapshot_file_reloc *reloc = NULL;
+	struct snapshot *snapshot = NULL;
+	struct desktop_hook_item *item = NULL;
+	const char *reason = NULL;
+	size_t sti_size = 0;
+	unsigned i = 0, j = 0;
+	
+	/* the sizeof each element in each section type */
+	const size_t elem_size[ SECTION_COUNT ] = 
+	{
+		0,   // SECTION_INVALID_TYPE
+		sizeof( struct snapshot ),   // SECTION_SNAPSHOT
+		sizeof( struct desktop_hook_list ),   // SECTION_DESKTOP_HOOK_LIST
+		sizeof( struct desktop_hook_item ),   // SECTION_DESKTOP_HOOK_ITEM
+		sizeof( struct desktop_item ),   // SECTION_DESKTOP
+		sizeof( struct hook ),   // SECTION_HOOK
+		sizeof( struct hook_key ),   // SECTION_HOOK_KEY
+		sizeof( struct gui ),   // SECTION_GUI
+		sizeof( BYTE ),   // SECTION_SPI
+		sizeof( WCHAR ),   // SECTION_NAME
+		sizeof( struct snapshot_file_reloc )   // SECTION_RELOC
+	};
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	FAIL_IF( !image );
+	
+	
+	/* the header */
+	if( ( size < sizeof( *header ) )
+		|| memcmp( header->magic, SNAPSHOT_FILE_MAGIC, SNAPSHOT_FILE_MAGIC_LEN )
+	)
+	{
+		reason = "The snapshot image has no header.";
+		goto invalid;
+	}
+	
+	if( header->version != SNAPSHOT_FILE_VERSION )
+	{
+		reason = "The snapshot image version is not supported.";
+		goto invalid;
+	}
+	
+	if( ( header->header_size != sizeof( *header ) )
+		|| ( header->pointer_size != sizeof( void * ) )
+		|| ( header->section_count != SECTION_COUNT )
+	)
+	{
+		reason = "The snapshot image was written by a different build of this program.";
+		goto invalid;
+	}
+	
+	if( ( header->image_size < sizeof( *header ) )
+		|| ( header->image_size > size )
+		|| ( header->image_size % SNAPSHOT_FILE_ALIGNMENT )
+	)
+	{
+		reason = "The snapshot image size is invalid.";
+		goto invalid;
+	}
+	
+	
+	/* the sections */
+	for( i = SECTION_INVALID_TYPE + 1; i < SECTION_COUNT; ++i )
+	{
+		section = &header->section[ i ];
+		
+		if( section->type != i )
+		{
+			reason = "A section type is invalid.";
+			goto invalid;
+		}
+		
+		if( section->elem_size != elem_size[ i ] )
+		{
+			reason = "A section was written by a different build of this program.";
+			goto invalid;
+		}
+		
+		if( ( section->offset < sizeof( *header ) )
+			|| ( section->offset % SNAPSHOT_FILE_ALIGNMENT )
+			|| ( ( (unsigned __int64)section->offset 
+					+ ( (unsigned __int64)section->elem_size * section->count ) 
+				) > header->image_size 
+			)
+		)
+		{
+			reason = "A section is outside the snapshot image.";
+			goto invalid;
+		}
+	}
+	
+	if( ( header->section[ SECTION_SNAPSHOT ].count != 1 )
+		|| ( header->section[ SECTION_DESKTOP_HOOK_LIST ].count != 1 )
+		|| ( header->section[ SECTION_DESKTOP ].count 
+			!= header->section[ SECTION_DESKTOP_HOOK_ITEM ].count 
+		)
+	)
+	{
+		reason = "A section count is invalid.";
+		goto invalid;
+	}
+	
+	
+	/* the relocations. each is checked before it's applied. they must be in order of offset so that 
+	no pointer is relocated twice.
+	*/
+	section = &header->section[ SECTION_RELOC ];
+	reloc = get_image_section( image, SECTION_RELOC );
+	
+	for( i = 0; i < section->count; ++i )
+	{
+		const struct snapshot_file_section *target = NULL;
+		uintptr_t *field = NULL;
+		
+		
+		if( ( reloc[ i ].offset < sizeof( *header ) )
+			|| ( reloc[ i ].offset % sizeof( void * ) )
+			|| ( reloc[ i ].offset > ( header->image_size - sizeof( void * ) ) )
+			|| ( i && ( reloc[ i ].offset <= reloc[ i - 1 ].offset ) )
+			|| ( ( reloc[ i ].offset + sizeof( void * ) > section->offset )
+				&& ( reloc[ i ].offset < ( section->offset + ( section->count * section->elem_size ) ) )
+			)
+		)
+		{
+			reason = "A relocation offset is invalid.";
+			goto invalid;
+		}
+		
+		if( ( reloc[ i ].section <= SECTION_INVALID_TYPE ) 
+			|| ( reloc[ i ].section >= SECTION_RELOC ) 
+		)
+		{
+			reason = "A relocation section is invalid.";
+			goto invalid;
+		}
+		
+		target = &header->section[ reloc[ i ].section ];
+		field = (uintptr_t *)( (BYTE *)image + reloc[ i ].offset );
+		
+		if( ( *field < target->offset )
+			|| ( ( *field - target->offset ) >= ( (uintptr_t)target->count * target->elem_size ) )
+			|| ( ( *field - target->offset ) % target->elem_size )
+		)
+		{
+			reason = "A relocated pointer is outside of its section.";
+			goto invalid;
+		}
+		
+		*field += (uintptr_t)image;
+	}
+	
+	
+	/* the snapshot store. the pointers that weren't relocated still hold offsets, so each pointer 
+	that is used is checked to be in the right section.
+	*/
+	snapshot = get_image_section( image, SECTION_SNAPSHOT );
+	
+	if( !snapshot->init_time 
+		|| ( snapshot->desktop_hooks != get_image_section( image, SECTION_DESKTOP_HOOK_LIST ) )
+		|| !snapshot->desktop_hooks->init_time
+	)
+	{
+		reason = "The snapshot store is invalid.";
+		goto invalid;
+	}
+	
+	if( ( snapshot->spi_max_bytes != header->section[ SECTION_SPI ].count )
+		|| ( snapshot->spi 
+			!= ( snapshot->spi_max_bytes ? get_image_section( image, SECTION_SPI ) : NULL ) 
+		)
+		|| ( snapshot->gui_count != header->section[ SECTION_GUI ].count )
+		|| ( snapshot->gui_max != snapshot->gui_count )
+		|| ( snapshot->gui 
+			!= ( snapshot->gui_count ? get_image_section( image, SECTION_GUI ) : NULL ) 
+		)
+		|| snapshot->gui_index 
+		|| snapshot->work 
+		|| snapshot->arena 
+	)
+	{
+		reason = "The snapshot store's arrays are invalid.";
+		goto invalid;
+	}
+	
+	
+	/* the spi buffer */
+	sti_size = ( snapshot->spi_extended 
+		? sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) 
+		: sizeof( SYSTEM_THREAD_INFORMATION ) 
+	);
+	
+	if( snapshot->spi )
+	{
+		const SYSTEM_PROCESS_INFORMATION *spi = snapshot->spi;
+		
+		
+		for( ;; )
+		{
+			/* the number of bytes from this spi to the end of the spi buffer */
+			const size_t remaining = snapshot->spi_max_bytes 
+				- (size_t)( (const BYTE *)spi - (const BYTE *)snapshot->spi );
+			
+			
+			if( !is_spi_in_image( image, spi ) 
+				|| ( spi->NumberOfThreads > ( remaining / sti_size ) )
+				|| !is_in_image_section( 
+					image, 
+					spi->Threads, 
+					( (size_t)spi->NumberOfThreads * sti_size ), 
+					SECTION_SPI 
+				)
+				|| ( spi->NextEntryOffset >= remaining )
+			)
+			{
+				reason = "The spi buffer is invalid.";
+				goto invalid;
+			}
+			
+			if( !spi->NextEntryOffset )
+				break;
+			
+			spi = (const SYSTEM_PROCESS_INFORMATION *)( (const BYTE *)spi + spi->NextEntryOffset );
+		}
+	}
+	
+	
+	/* the gui array */
+	for( i = 0; i < snapshot->gui_count; ++i )
+	{
+		const struct gui *const gui = &snapshot->gui[ i ];
+		
+		
+		if( ( gui->spi && !is_spi_in_image( image, gui->spi ) )
+			|| ( gui->sti 
+				&& ( ( (uintptr_t)gui->sti % sizeof( void * ) )
+					|| !is_in_image_section( image, gui->sti, sti_size, SECTION_SPI ) 
+				)
+			)
+		)
+		{
+			reason = "The gui array is invalid.";
+			goto invalid;
+		}
+	}
+	
+	
+	/* the desktop hook store */
+	if( snapshot->desktop_hooks->item_by_range
+		|| snapshot->desktop_hooks->candidate
+		|| snapshot->desktop_hooks->record
+		|| snapshot->desktop_hooks->sort
+		|| snapshot->desktop_hooks->sort_spare
+		|| snapshot->desktop_hooks->arena
+		|| ( snapshot->desktop_hooks->head 
+			&& !is_in_image_section( 
+				image, 
+				snapshot->desktop_hooks->head, 
+				sizeof( *item ), 
+				SECTION_DESKTOP_HOOK_ITEM 
+			)
+		)
+		|| ( snapshot->desktop_hooks->tail 
+			&& !is_in_image_section( 
+				image, 
+				snapshot->desktop_hooks->tail, 
+				sizeof( *item ), 
+				SECTION_DESKTOP_HOOK_ITEM 
+			)
+		)
+	)
+	{
+		reason = "The desktop hook store is invalid.";
+		goto invalid;
+	}
+	
+	for( item = snapshot->desktop_hooks->head, i = 0; item; item = item->next, ++i )
+	{
+		const WCHAR *name = NULL;
+		
+		
+		if( ( i >= header->section[ SECTION_DESKTOP_HOOK_ITEM ].count )
+			|| ( item->next 
+				&& !is_in_image_section( image, item->next, sizeof( *item ), SECTION_DESKTOP_HOOK_ITEM ) 
+			)
+			|| !is_in_image_section( image, item->desktop, sizeof( *item->desktop ), SECTION_DESKTOP )
+			|| ( item->hook_count > item->hook_max )
+			|| ( item->hook_count > header->section[ SECTION_HOOK ].count )
+			|| ( item->hook_count 
+				&& !is_in_image_section( 
+					image, 
+					item->hook, 
+					( item->hook_count * sizeof( *item->hook ) ), 
+					SECTION_HOOK 
+				)
+			)
+			|| ( item->hook_count 
+				&& !is_in_image_section( 
+					image, 
+					item->key, 
+					( item->hook_count * sizeof( *item->key ) ), 
+					SECTION_HOOK_KEY 
+				)
+			)
+		)
+		{
+			reason = "A desktop hook item is invalid.";
+			goto invalid;
+		}
+		
+		/* the desktop name must be null terminated in the name section */
+		for( name = item->desktop->pwszDesktopName; 
+			is_in_image_section( image, name, sizeof( *name ), SECTION_NAME ) && *name; 
+			++name 
+		)
+			;
+		
+		if( !is_in_image_section( image, name, sizeof( *name ), SECTION_NAME ) )
+		{
+			reason = "A desktop name is invalid.";
+			goto invalid;
+		}
+		
+		for( j = 0; j < item->hook_count; ++j )
+		{
+			const struct hook *const hook = &item->hook[ j ];
+			
+			
+			if( ( hook->owner 
+					&& !is_in_image_section( image, hook->owner, sizeof( *hook->owner ), SECTION_GUI ) 
+				)
+				|| ( hook->origin 
+					&& !is_in_image_section( image, hook->origin, sizeof( *hook->origin ), SECTION_GUI ) 
+				)
+				|| ( hook->target 
+					&& !is_in_image_section( image, hook->target, sizeof( *hook->target ), SECTION_GUI ) 
+				)
+			)
+			{
+				reason = "A hook is invalid.";
+				goto invalid;
+			}
+		}
+		
+		/* the hook keys are rebuilt from the hooks so they can't disagree */
+		build_hook_keys( item );
+	}
+	
+	
+	/* the snapshot is valid. use the passed in desktops where the names match */
+	if( desktops )
+	{
+		for( item = snapshot->desktop_hooks->head; item; item = item->next )
+		{
+			struct desktop_item *desktop = NULL;
+			
+			
+			for( desktop = desktops->head; desktop; desktop = desktop->next )
+			{
+				if( !wcscmp( desktop->pwszDesktopName, item->desktop->pwszDesktopName ) )
+				{
+					item->desktop = desktop;
+					break;
+				}
+			}
+		}
+	}
+	
+	*out = snapshot;
+	return TRUE;
+	
+invalid:
+	MSG_ERROR( "The snapshot image is invalid." );
+	printf( "%s\n", reason );
+	return FALSE;
+}
+
+
+
+/* init_snapshot_file_store()
+Initialize a snapshot file store by mapping a snapshot file into memory and loading its snapshots.
+
+The file is mapped copy on write and each snapshot image in it is relocated in place by 
+load_snapshot_image(). 'desktops' is optional and is passed to load_snapshot_image().
+
+returns nonzero on success
+*/
+int init_snapshot_file_store( 
+	struct snapshot_file *const store,   // in, out
+	const WCHAR *const filename,   // in
+	const struct desktop_list *const desktops   // in, optional
+)
+{
+	LARGE_INTEGER file_size;
+	size_t offset = 0;
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !filename );
+	
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	FAIL_IF( store->base );
+	
+	
+	store->pwszFileName = must_wcsdup( filename );
+	
+	store->hFile = CreateFileW( 
+		filename, 
+		GENERIC_READ, 
+		( FILE_SHARE_READ | FILE_SHARE_WRITE ), 
+		NULL, 
+		OPEN_EXISTING, 
+		FILE_ATTRIBUTE_NORMAL, 
+		NULL 
+	);
+	if( store->hFile == INVALID_HANDLE_VALUE )
+	{
+		MSG_ERROR_GLE( "CreateFileW() failed." );
+		printf( "filename: %ls\n", filename );
+		return FALSE;
+	}
+	
+	if( !GetFileSizeEx( store->hFile, &file_size ) )
+	{
+		MSG_ERROR_GLE( "GetFileSizeEx() failed." );
+		printf( "filename: %ls\n", filename );
+		return FALSE;
+	}
+	
+	if( !file_size.QuadPart || ( (unsigned __int64)file_size.QuadPart > (size_t)-1 ) )
+	{
+		MSG_ERROR( "The snapshot file is empty or too large to map." );
+		printf( "filename: %ls\n", filename );
+		printf( "size: %I64d\n", file_size.QuadPart );
+		return FALSE;
+	}
+	
+	store->size = (size_t)file_size.QuadPart;
+	
+	store->hMapping = CreateFileMappingW( store->hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+	if( !store->hMapping )
+	{
+		MSG_ERROR_GLE( "CreateFileMappingW() failed." );
+		printf( "filename: %ls\n", filename );
+		return FALSE;
+	}
+	
+	store->base = MapViewOfFile( store->hMapping, FILE_MAP_COPY, 0, 0, 0 );
+	if( !store->base )
+	{
+		MSG_ERROR_GLE( "MapViewOfFile() failed." );
+		printf( "filename: %ls\n", filename );
+		return FALSE;
+	}
+	
+	
+	/* count the snapshot images. each header is fully validated when its image is loaded */
+	for( offset = 0; offset < store->size; ++store->snapshot_count )
+	{
+		const struct snapshot_file_header *const header = 
+			(const struct snapshot_file_header *)( (BYTE *)store->base + offset );
+		
+		
+		if( ( ( store->size - offset ) < sizeof( *header ) )
+			|| ( header->image_size < sizeof( *header ) )
+			|| ( header->image_size % SNAPSHOT_FILE_ALIGNMENT )
+			|| ( header->image_size > ( store->size - offset ) )
+		)
+		{
+			MSG_ERROR( "The snapshot file is not a snapshot file or its last snapshot is incomplete." );
+			printf( "filename: %ls\n", filename );
+			printf( "offset: %Iu\n", offset );
+			return FALSE;
+		}
+		
+		offset += header->image_size;
+	}
+	
+	store->snapshot = must_calloc( store->snapshot_count, sizeof( *store->snapshot ) );
+	
+	for( offset = 0, i = 0; i < store->snapshot_count; ++i )
+	{
+		const struct snapshot_file_header *const header = 
+			(const struct snapshot_file_header *)( (BYTE *)store->base + offset );
+		
+		
+		if( !load_snapshot_image( 
+			&store->snapshot[ i ], 
+			(BYTE *)store->base + offset, 
+			( store->size - offset ), 
+			desktops 
+		) )
+		{
+			MSG_ERROR( "load_snapshot_image() failed." );
+			printf( "filename: %ls\n", filename );
+			printf( "snapshot: %u, offset: %Iu\n", i, offset );
+			return FALSE;
+		}
+		
+		offset += header->image_size;
+	}
+	
+	
+	/* the snapshot file store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* print_snapshot_file_store()
+Print a snapshot file store.
+
+The snapshots are printed briefly. Call print_snapshot_store() to print a snapshot.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_snapshot_file_store( 
+	const struct snapshot_file *const store   // in
+)
+{
+	const char *const objname = "Snapshot File Store";
+	unsigned i = 0;
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->pwszFileName: %ls\n", 
+		( store->pwszFileName ? store->pwszFileName : L"<NULL>" ) 
+	);
+	
+	PRINT_HEX( store->hFile );
+	PRINT_HEX( store->hMapping );
+	PRINT_HEX( store->base );
+	printf( "store->size: %Iu\n", store->size );
+	printf( "store->snapshot_count: %u\n", store->snapshot_count );
+	
+	for( i = 0; store->snapshot && ( i < store->snapshot_count ); ++i )
+	{
+		printf( "\nstore->snapshot[ %u ]: ", i );
+		PRINT_HEX_BARE( store->snapshot[ i ] );
+		printf( "\n" );
+		
+		if( store->snapshot[ i ] )
+			print_init_time( "init_time", store->snapshot[ i ]->init_time );
+	}
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_snapshot_file_store()
+Free a snapshot file store and all its descendants.
+
+The snapshots that were loaded from the file are in the view of the file and are freed with it.
+
+this function then sets the snapshot file store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the snapshot file store.
+if( !in || !*in ) then this function returns.
+*/
+void free_snapshot_file_store( 
+	struct snapshot_file **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	free( (*in)->snapshot );
+	
+	if( (*in)->base )
+		UnmapViewOfFile( (*in)->base );
+	
+	if( (*in)->hMapping )
+		CloseHandle( (*in)->hMapping );
+	
+	if( (*in)->hFile != INVALID_HANDLE_VALUE )
+		CloseHandle( (*in)->hFile );
+	
+	free( (*in)->pwszFileName );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,216 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SNAPSHOT_FILE_H
+#define _SNAPSHOT_FILE_H
+
+#include <windows.h>
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+/* desktop store (linked list of desktops' heap and thread info) */
+#include "desktop.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The binary snapshot file format.
+A snapshot file is one or more snapshot images written one after the other. Each image is the 
+snapshot store and its descendants laid out in sections, with every pointer replaced by the offset 
+of what it points to from the start of the image. A relocation table lists the offset of every 
+pointer in the image, so once an image is mapped into memory the pointers are fixed up by adding 
+the address of the image to each of them and the snapshot can be used as is.
+
+The structs in the image are this program's structs, so an image can only be loaded by a build of 
+this program with the same version of the format and the same struct sizes. The header records both.
+*/
+#define SNAPSHOT_FILE_MAGIC   "GHSNAP\r\n"
+#define SNAPSHOT_FILE_MAGIC_LEN   8
+#define SNAPSHOT_FILE_VERSION   2
+
+/* the image and each section in it starts on a multiple of this many bytes */
+#define SNAPSHOT_FILE_ALIGNMENT   16
+
+
+/** The types of sections in a snapshot image.
+The section type is also the section's index in the header's section array.
+*/
+enum snapshot_file_section_type
+{
+	SECTION_INVALID_TYPE,   // 0 is an invalid type
+	SECTION_SNAPSHOT,   // struct snapshot. count is always 1.
+	SECTION_DESKTOP_HOOK_LIST,   // struct desktop_hook_list. count is always 1.
+	SECTION_DESKTOP_HOOK_ITEM,   // struct desktop_hook_item array
+	SECTION_DESKTOP,   // struct desktop_item array, one for each desktop hook item
+	SECTION_HOOK,   // struct hook array, all desktops' hook arrays one after the other
+	SECTION_HOOK_KEY,   // struct hook_key array, all desktops' hook key arrays one after the other
+	SECTION_GUI,   // struct gui array
+	SECTION_SPI,   // the used bytes of the spi buffer
+	SECTION_NAME,   // WCHAR array of the desktop names, each null terminated
+	SECTION_RELOC,   // struct snapshot_file_reloc array
+	SECTION_COUNT
+};
+
+
+/** A section in a snapshot image.
+*/
+struct snapshot_file_section
+{
+	/* the section type. this is the same as the section's index in the header's section array */
+	DWORD type;
+	
+	/* the size of each element in the section, in bytes */
+	DWORD elem_size;
+	
+	/* the offset of the section from the start of the image, in bytes */
+	DWORD offset;
+	
+	/* the number of elements in the section */
+	DWORD count;
+};
+
+
+/** A relocation in a snapshot image.
+*/
+struct snapshot_file_reloc
+{
+	/* the offset of a pointer from the start of the image, in bytes */
+	DWORD offset;
+	
+	/* the type of the section that the pointer points into */
+	DWORD section;
+};
+
+
+/** The header at the start of each snapshot image.
+*/
+struct snapshot_file_header
+{
+	/* SNAPSHOT_FILE_MAGIC, not null terminated */
+	char magic[ SNAPSHOT_FILE_MAGIC_LEN ];
+	
+	/* SNAPSHOT_FILE_VERSION */
+	DWORD version;
+	
+	/* the sizeof the header */
+	DWORD header_size;
+	
+	/* the size of the image in bytes, including the header. the next image follows this one. */
+	DWORD image_size;
+	
+	/* the sizeof a pointer in the program that wrote the image */
+	DWORD pointer_size;
+	
+	/* SECTION_COUNT */
+	DWORD section_count;
+	
+	DWORD reserved;
+	
+	/* a copy of the snapshot's init_time */
+	__int64 init_time;
+	
+	/* the sections, indexed by section type */
+	struct snapshot_file_section section[ SECTION_COUNT ];
+};
+
+
+
+/** The snapshot file store.
+The snapshot file store holds a snapshot file mapped into memory and the snapshots in it.
+*/
+struct snapshot_file
+{
+	/* the name of the snapshot file */
+	WCHAR *pwszFileName;   // _wcsdup(), free()
+	
+	/* a handle to the snapshot file */
+	HANDLE hFile;   // CreateFileW(), CloseHandle()
+	
+	/* a handle to the file mapping of the snapshot file */
+	HANDLE hMapping;   // CreateFileMappingW(), CloseHandle()
+	
+	/* a copy on write view of the whole snapshot file.
+	the pointers in each snapshot image are relocated in place so the view is copy on write.
+	*/
+	void *base;   // MapViewOfFile(), UnmapViewOfFile()
+	
+	/* the size of the view in bytes */
+	size_t size;
+	
+	/* an array of pointers to the snapshots in the view, in the order they were written.
+	these snapshot stores and their descendants must not be freed or reinitialized.
+	*/
+	struct snapshot **snapshot;   // calloc(), free()
+	
+	/* the number of snapshots in the array */
+	unsigned snapshot_count;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in snapshot_file.c
+*/
+int write_snapshot_file( 
+	const struct snapshot *const store,   // in
+	const WCHAR *const filename   // in
+);
+
+void create_snapshot_file_store( 
+	struct snapshot_file **const out   // out deref
+);
+
+int load_snapshot_image( 
+	struct snapshot **const out,   // out deref
+	void *const image,   // in, out
+	const size_t size,   // in
+	const struct desktop_list *const desktops   // in, optional
+);
+
+int init_snapshot_file_store( 
+	struct snapshot_file *const store,   // in, out
+	const WCHAR *const filename,   // in
+	const struct desktop_list *const desktops   // in, optional
+);
+
+void print_snapshot_file_store( 
+	const struct snapshot_file *const store   // in
+);
+
+void free_snapshot_file_store( 
+	struct snapshot_file **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SNAPSHOT_FILE_H
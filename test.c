@@ -75,6 +75,149 @@ dump_teb_wrapper()
 Wrapper that calls debug function dump_teb() to dump a TEB to a file.
 -
 
+-
+get_benchmark_time()
+
+Get the current value of the performance counter, in seconds.
+-
+
+-
+get_benchmark_random()
+
+Get the next number from a simple pseudorandom sequence for synthetic benchmark data.
+-
+
+-
+compare_gui()
+
+Compare two gui structs according to the kernel address of the associated Win32ThreadInfo struct.
+-
+
+-
+benchmark_gui_lookup()
+
+Benchmark Win32ThreadInfo lookups in the gui index against a sorted gui array and bsearch().
+-
+
+-
+benchmark_desktop_range()
+
+Benchmark finding the desktop of a HOOK in the desktop range array against walking the desktop list.
+-
+
+-
+benchmark_handle_scan()
+
+Benchmark the scalar and SSE2 scans of a HANDLEENTRY table for HOOK entries.
+-
+
+-
+benchmark_snapshot_file()
+
+Benchmark writing a snapshot to a snapshot file and loading it, and compare the loaded snapshot.
+-
+
+-
+benchmark_output()
+
+Benchmark printing HOOK notices to the output store.
+-
+
+-
+benchmark_hook_compare()
+
+Benchmark comparing HOOKs field by field against the masked word compare fast path.
+-
+
+-
+resolve_synthetic_work()
+
+Resolve a range of synthetic work items. A stand-in for reading threads' Win32ThreadInfo.
+-
+
+-
+benchmark_pool()
+
+Benchmark resolving synthetic work items on the worker pool against the main thread, and check them.
+-
+
+-
+benchmark_arena()
+
+Benchmark allocating the memory of a snapshot store from its arena against the heap, and check the 
+arena.
+-
+
+-
+diff_hook_items_by_hook()
+
+Add diff events for two desktop hook items by comparing their hook arrays instead of their hook keys.
+-
+
+-
+benchmark_hook_diff()
+
+Benchmark diffing desktops by their hook keys against diffing them by their hook arrays, and check 
+that the events are the same.
+-
+
+-
+benchmark_hook_sort()
+
+Benchmark sorting a desktop's hook array with sort_hook_array() against qsort() with compare_hook(), 
+and check that the order is the same.
+-
+
+-
+callback_count_thread()
+
+Count a thread and whether it's waiting. The per-thread callback benchmarked by benchmark_traverse().
+-
+
+-
+callback_count_threads()
+
+Count a process' threads and how many are waiting. The batch callback benchmarked by 
+benchmark_traverse().
+-
+
+-
+benchmark_traverse()
+
+Benchmark traversing the thread info with a callback for each thread against a callback for each 
+process, and check that the counts are the same.
+-
+
+-
+build_synthetic_spi()
+
+Build a synthetic array of SYSTEM_PROCESS_INFORMATION structs.
+-
+
+-
+synthetic_query()
+
+Write the synthetic array of SYSTEM_PROCESS_INFORMATION structs in synthetic_spi to a buffer.
+-
+
+-
+callback_check_synthetic()
+
+Count a process' threads and check that the process and its threads are in the array.
+-
+
+-
+fuzz_traverse()
+
+Fuzz traverse_threads() with synthetic and corrupted arrays of SYSTEM_PROCESS_INFORMATION structs.
+-
+
+-
+benchmark_parse()
+
+Benchmark how fast traverse_threads() parses a synthetic array of SYSTEM_PROCESS_INFORMATION structs.
+-
+
 -
 function[], function__count
 
@@ -109,6 +252,16 @@ Run user-specified tests.
 
 #include "diff.h"
 
+#include "handle_table.h"
+
+#include "snapshot_file.h"
+
+#include "output.h"
+
+#include "pool.h"
+
+#include "arena.h"
+
 /* traverse_threads() */
 #include "nt_independent_sysprocinfo_structs.h"
 #include "traverse_threads.h"
@@ -139,6 +292,63 @@ static int find_most_preceding_kernel_HOOK(
 	const unsigned __int64 addr   // in
 );
 
+static double get_benchmark_time( void );
+
+static unsigned get_benchmark_random( 
+	unsigned __int64 *const state   // in, out
+);
+
+static void __cdecl resolve_synthetic_work( 
+	void *param,   // in, out
+	const unsigned begin,   // in
+	const unsigned end   // in
+);
+
+static int compare_gui( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static int callback_count_thread( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG remaining,   // in
+	const DWORD flags   // in, optional
+);
+
+static int callback_count_threads( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG count,   // in
+	const DWORD flags   // in, optional
+);
+
+static ULONG build_synthetic_spi( 
+	void *buffer,   // out
+	const size_t bcount,   // in
+	const unsigned *const thread_count,   // in
+	const unsigned process_count,   // in
+	const DWORD flags,   // in
+	ULONG *const offset   // out, optional
+);
+
+static LONG __stdcall synthetic_query( 
+	int infotype,   // in
+	void *buffer,   // out
+	ULONG buffer_bcount,   // in
+	ULONG *retlen   // out
+);
+
+static int callback_check_synthetic( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+	const ULONG count,   // in
+	const DWORD flags   // in, optional
+);
+
 static void print_function_usage( 
 	unsigned i   // in
 );
@@ -213,6 +423,7 @@ unsigned __int64 print_kernel_HOOK(
 )
 {
 	unsigned i = 0;
+	int range = 0;
 	struct hook hook;
 	struct snapshot *snapshot = NULL;
 	struct desktop_item *desktop = NULL;
@@ -221,13 +432,15 @@ unsigned __int64 print_kernel_HOOK(
 	ZeroMemory( &hook, sizeof( hook ) );
 	
 	/* Check to see if the HOOK is located on a desktop we're attached to */
-	for( desktop = G->desktops->head; desktop; desktop = desktop->next )
-	{
-		if( ( (uintptr_t)addr < ( (uintptr_t)desktop->pDeskInfo->pvDesktopLimit - sizeof( HOOK ) ) )
-			&& ( (uintptr_t)addr >= (uintptr_t)desktop->pDeskInfo->pvDesktopBase )
-		) /* The HOOK is on an accessible desktop */
-			break;
-	}
+	range = find_desktop_range( 
+		G->desktops->range, 
+		G->desktops->range_count, 
+		(uintptr_t)addr, 
+		sizeof( HOOK ) 
+	);
+	
+	if( range >= 0 ) /* The HOOK is on an accessible desktop */
+		desktop = G->desktops->range[ range ].desktop;
 	
 	
 	if( !desktop )
@@ -254,7 +467,7 @@ unsigned __int64 print_kernel_HOOK(
 	}
 	
 	create_snapshot_store( &snapshot );
-	if( init_snapshot_store( snapshot ) )
+	if( init_snapshot_store( snapshot, NULL ) )
 	{
 		struct desktop_hook_item *dh = NULL;
 		
@@ -331,7 +544,7 @@ static int find_kernel_HOOK(
 		goto cleanup;
 	
 	create_snapshot_store( &snapshot );
-	if( !init_snapshot_store( snapshot ) )
+	if( !init_snapshot_store( snapshot, NULL ) )
 	{
 		MSG_ERROR( "Could not initialize the snapshot store." );
 		goto cleanup;
@@ -394,7 +607,7 @@ static int find_most_preceding_kernel_HOOK(
 		goto cleanup;
 	
 	create_snapshot_store( &snapshot );
-	if( !init_snapshot_store( snapshot ) )
+	if( !init_snapshot_store( snapshot, NULL ) )
 	{
 		MSG_ERROR( "Could not initialize the snapshot store." );
 		goto cleanup;
@@ -594,35 +807,48 @@ struct callback_info
 /* callback_get_pid_from_tid()
 Find which process is associated with a thread id.
 
-traverse_threads() callback: this function is called for every SYSTEM_THREAD_INFORMATION.
+traverse_threads_batch() callback: this function is called for every SYSTEM_PROCESS_INFORMATION with 
+its array of 'count' SYSTEM_THREAD_INFORMATION.
 
-The behavior of a traverse_threads() callback is documented in traverse_threads.txt.
+The behavior of a traverse_threads_batch() callback is documented in traverse_threads.txt.
 */
 static int callback_get_pid_from_tid( 
 	void *cb_param,   // in, out, optional
 	SYSTEM_PROCESS_INFORMATION *const spi,   // in
 	SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
-	const ULONG remaining,   // in
+	const ULONG count,   // in
 	const DWORD flags   // in, optional
 )
 {
 	// callback data
 	struct callback_info *const ci = (struct callback_info *)cb_param; 
 	
+	// the size of each element of the thread info array
+	const size_t sti_bcount = ( ( flags & TRAVERSE_FLAG_EXTENDED ) ? 
+		sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) : sizeof( SYSTEM_THREAD_INFORMATION ) );
+	
+	ULONG i = 0;
+	
 	FAIL_IF( !ci );
 	FAIL_IF( !ci->tid );
 	FAIL_IF( ci->pid );
 	
 	
-	if( (DWORD)sti->ClientId.UniqueThread == (DWORD)ci->tid ) // thread id found
+	for( i = 0; i < count; ++i )
 	{
-		ci->pid = (DWORD)spi->UniqueProcessId;
+		const SYSTEM_THREAD_INFORMATION *const current = 
+			(SYSTEM_THREAD_INFORMATION *)( (size_t)sti + ( i * sti_bcount ) );
 		
-		/* found it, no need to continue */
-		return TRAVERSE_CALLBACK_ABORT;
+		if( (DWORD)current->ClientId.UniqueThread == (DWORD)ci->tid ) // thread id found
+		{
+			ci->pid = (DWORD)spi->UniqueProcessId;
+			
+			/* found it, no need to continue */
+			return TRAVERSE_CALLBACK_ABORT;
+		}
 	}
 	
-	return TRAVERSE_CALLBACK_CONTINUE; /* continue normally to the next thread */
+	return TRAVERSE_CALLBACK_CONTINUE; /* continue normally to the next process */
 }
 
 
@@ -649,7 +875,7 @@ unsigned __int64 dump_teb_wrapper(
 	if( G->config->verbose >= 9 )
 		flags |= TRAVERSE_FLAG_DEBUG;
 	
-	ret = traverse_threads( 
+	ret = traverse_threads_batch( 
 		callback_get_pid_from_tid, /* your callback */
 		&ci, /* your callback data */
 		NULL, /* your buffer. unused in this example  */
@@ -674,132 +900,2681 @@ unsigned __int64 dump_teb_wrapper(
 
 
 
-const struct
-{
-	unsigned __int64 (*pfn)(unsigned __int64);
-	const WCHAR *name; // function name as it should be specified by the user
-	const WCHAR *description; // function description
-	const WCHAR *param_name; // parameter name
-	const BOOL param_required; // whether a parameter is required or not
-	const WCHAR *extra_info; // extra info 
-	const WCHAR *example_name; // an example of the command line parameters
-	const WCHAR *example_description; // a description of the example
-} function[] =
+/* get_benchmark_time()
+Get the current value of the performance counter, in seconds.
+
+returns the performance counter in seconds, or 0 if there is no performance counter
+*/
+static double get_benchmark_time( void )
 {
-	{
-		print_handle_count,   // pfn
-		L"user",   // name
-		/* description */
-		L"Print counts of USER free, invalid, valid, menu, hook, and generic handles.",
-		L"seconds",   // param_name
-		FALSE,   // param_required
-		L"Specify the number of seconds to enable polling.",   // extra_info
-		L"3",   // example_name
-		L"Print the count every 3 seconds."   // example_description
-	},
-	{
-		print_kernel_HOOK,   // pfn
-		L"hook",   // name
-		/* description */
-		L"Print a HOOK. Pass in a pointer to the kernel address of a HOOK.",
-		L"address",   // param_name
-		TRUE,   // param_required
-		NULL,   // extra_info
-		L"0xFE893E68 -v 6",   // example_name
-		L"Print HOOK at 0xFE893E68."   // example_description
-	},
-	{
-		print_kernel_HOOK_chain,   // pfn
-		L"chain",   // name
-		/* description */
-		L"Print a HOOK chain. Pass in a pointer to the kernel address of a HOOK.",
-		L"address",   // param_name
-		TRUE,   // param_required
-		NULL,   // extra_info
-		L"0xFE893E68",   // example_name
-		L"Print HOOK at 0xFE893E68 and any HOOKs after it in the chain.",   // example_description
-	},
-	{
-		print_kernel_HOOK_desktop_chains,   // pfn
-		L"deskhooks",   // name
-		/* description */
-		L"Print the HOOK chains in DESKTOPINFO.aphkStart[] for each attached to desktop.",
-		NULL,   // param_name
-		FALSE,   // param_required
-		L"Use the user-specified hook include/exclude list for filtering.",   // extra_info
-		L"-d -i WH_KEYBOARD_LL -v 1",   // example_name
-		L"Print the WH_KEYBOARD_LL chain on the current desktop.",   // example_description
-	},
-	{
-		dump_teb_wrapper,   // pfn
-		L"teb",   // name
-		/* description */
-		L"Dump to a file the thread environment block of a thread in another process.",
-		L"TID",   // param_name
-		TRUE,   // param_required
-		NULL,   // extra_info
-		L"148",   // example_name
-		L"Dump the TEB of thread id 148 to a file.",   // example_description
-	}
-};
-const unsigned function_count = sizeof( function ) / sizeof( function[ 0 ] );
+	LARGE_INTEGER count, frequency;
+	
+	
+	if( !QueryPerformanceFrequency( &frequency ) || !frequency.QuadPart 
+		|| !QueryPerformanceCounter( &count )
+	)
+		return 0;
+	
+	return (double)count.QuadPart / (double)frequency.QuadPart;
+}
 
 
 
-/* print_function_usage()
-Print an individual testmode function's usage.
+/* get_benchmark_random()
+Get the next number from a simple pseudorandom sequence for synthetic benchmark data.
 
-'i' is the index of the function in array
+This is xorshift64. The sequence is the same for the same initial state so that benchmark results 
+are repeatable. '*state' must be initialized to nonzero.
+
+returns the next pseudorandom number
 */
-static void print_function_usage( 
-	unsigned i   // in
+static unsigned get_benchmark_random( 
+	unsigned __int64 *const state   // in, out
 )
 {
-	FAIL_IF( i >= function_count );
-	FAIL_IF( !function[ i ].name );
-	
-	printf( "----------------------------------------------------------------------------[b]\n" );
-	
-	if( function[ i ].description )
-		printf( "%ls\n", function[ i ].description );
+	FAIL_IF( !state );
+	FAIL_IF( !*state );
 	
-	printf( "%s -z %ls", G->prog->pszBasename, function[ i ].name );
-	if( function[ i ].param_name )
-	{
-		BOOL req = !!function[ i ].param_required;
-		printf( " " );
-		printf( "%c%ls%c", ( req ? '<' : '[' ), function[ i ].param_name, ( req ? '>' : ']' ) );
-	}
-	printf( "\n" );
 	
-	if( function[ i ].extra_info )
-	{
-		printf( "\n" );
-		printf( "%ls\n", function[ i ].extra_info );
-	}
-	
-	if( function[ i ].example_name )
-	{
-		printf( "\n" );
-		if( function[ i ].example_description )
-			printf( "Example: %ls\n", function[ i ].example_description );
-		
-		printf( "%s -z %ls %ls\n", 
-			G->prog->pszBasename, function[ i ].name, function[ i ].example_name 
-		);
-	}
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
 	
-	printf( "----------------------------------------------------------------------------[e]\n" );
-	printf( "\n" );
-	return;
+	return (unsigned)( *state >> 32 );
 }
 
 
 
-/* print_testmode_usage()
-Print the testmode functions and their usage.
+/* compare_gui()
+Compare two gui structs according to the kernel address of the associated Win32ThreadInfo struct.
+
+qsort() and bsearch() callback for benchmark_gui_lookup(). This is how gui threads were searched 
+for before the gui index.
+
+returns -1 if 'p1' Win32ThreadInfo < 'p2' Win32ThreadInfo
+returns 1 if 'p1' Win32ThreadInfo > 'p2' Win32ThreadInfo
+returns 0 if 'p1' Win32ThreadInfo == 'p2' Win32ThreadInfo
 */
-void print_testmode_usage( void )
+static int compare_gui( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct gui *const a = p1;
+	const struct gui *const b = p2;
+	
+	
+	if( a->pvWin32ThreadInfo < b->pvWin32ThreadInfo )
+		return -1;
+	else if( a->pvWin32ThreadInfo > b->pvWin32ThreadInfo )
+		return 1;
+	else
+		return 0;
+}
+
+
+
+/* benchmark_gui_lookup()
+Benchmark Win32ThreadInfo lookups in the gui index against a sorted gui array and bsearch().
+
+A synthetic gui array of 'count' threads is built both ways: sorted with qsort() and scanned for 
+duplicates, and added to a snapshot store's gui index with add_gui(). Then the same set of 
+Win32ThreadInfo addresses, half of them in the array, is looked up both ways.
+
+'count' is the number of synthetic GUI threads. default 10000, it can't be more than max threads.
+
+returns nonzero if both ways found the same GUI threads
+*/
+unsigned __int64 benchmark_gui_lookup( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, n = 0;
+	unsigned found_bsearch = 0, found_index = 0;
+	unsigned __int64 state = 0x2545F491;
+	double begin = 0, build_bsearch = 0, build_index = 0, lookup_bsearch = 0, lookup_index = 0;
+	const unsigned lookups = 1000000;
+	const uintptr_t base = (uintptr_t)0 - 0x10000000;
+	struct gui *sorted = NULL;
+	const void **key = NULL;
+	struct snapshot *snapshot = NULL;
+	
+	
+	create_snapshot_store( &snapshot );
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		count = 10000;
+	
+	if( !count || ( count > snapshot->gui_max ) )
+	{
+		printf( "The number of GUI threads must be from 1 to %u (max threads).\n", snapshot->gui_max );
+		free_snapshot_store( &snapshot );
+		return FALSE;
+	}
+	
+	n = (unsigned)count;
+	sorted = must_calloc( n, sizeof( *sorted ) );
+	key = must_calloc( lookups, sizeof( *key ) );
+	
+	/* THREADINFO is allocated from kernel pool: high addresses, 16 byte aligned. 
+	the range is narrow enough that there are some duplicates.
+	*/
+	for( i = 0; i < n; ++i )
+	{
+		sorted[ i ].pvWin32ThreadInfo = 
+			(void *)( base + ( get_benchmark_random( &state ) % 0x800000 ) * 16 );
+		sorted[ i ].unique_w32thread = TRUE;
+	}
+	
+	/* half of the lookups are for addresses in the array */
+	for( i = 0; i < lookups; ++i )
+	{
+		if( i & 1 )
+			key[ i ] = sorted[ get_benchmark_random( &state ) % n ].pvWin32ThreadInfo;
+		else
+			key[ i ] = (void *)( base + ( get_benchmark_random( &state ) % 0x800000 ) * 16 );
+	}
+	
+	
+	/* build the index */
+	begin = get_benchmark_time();
+	reset_gui_array( snapshot );
+	for( i = 0; i < n; ++i )
+		add_gui( snapshot, &sorted[ i ] );
+	build_index = get_benchmark_time() - begin;
+	
+	/* build the sorted array */
+	begin = get_benchmark_time();
+	qsort( sorted, n, sizeof( *sorted ), compare_gui );
+	for( i = 1; i < n; ++i )
+	{
+		if( sorted[ i - 1 ].pvWin32ThreadInfo == sorted[ i ].pvWin32ThreadInfo )
+		{
+			sorted[ i - 1 ].unique_w32thread = FALSE;
+			sorted[ i ].unique_w32thread = FALSE;
+		}
+	}
+	build_bsearch = get_benchmark_time() - begin;
+	
+	
+	/* search the index */
+	begin = get_benchmark_time();
+	for( i = 0; i < lookups; ++i )
+	{
+		if( find_Win32ThreadInfo( snapshot, key[ i ] ) )
+			++found_index;
+	}
+	lookup_index = get_benchmark_time() - begin;
+	
+	/* search the sorted array */
+	begin = get_benchmark_time();
+	for( i = 0; i < lookups; ++i )
+	{
+		struct gui findme;
+		struct gui *found = NULL;
+		
+		
+		findme.pvWin32ThreadInfo = key[ i ];
+		
+		found = bsearch( &findme, sorted, n, sizeof( *sorted ), compare_gui );
+		if( found && found->unique_w32thread )
+			++found_bsearch;
+	}
+	lookup_bsearch = get_benchmark_time() - begin;
+	
+	
+	printf( "Synthetic GUI threads: %u. Lookups: %u.\n", n, lookups );
+	printf( "qsort() and bsearch(): build %.3f ms, %.1f ns per lookup, %u found.\n", 
+		build_bsearch * 1000, lookup_bsearch * 1000000000 / lookups, found_bsearch 
+	);
+	printf( "gui index:             build %.3f ms, %.1f ns per lookup, %u found.\n", 
+		build_index * 1000, lookup_index * 1000000000 / lookups, found_index 
+	);
+	
+	if( found_bsearch != found_index )
+		MSG_ERROR( "The gui index and bsearch() found a different number of GUI threads." );
+	
+	free( key );
+	free( sorted );
+	free_snapshot_store( &snapshot );
+	return ( found_bsearch == found_index );
+}
+
+
+
+/* benchmark_desktop_range()
+Benchmark finding the desktop of a HOOK in the desktop range array against walking the desktop list.
+
+A synthetic desktop list of 'count' desktops, each with a 3MB heap, and a synthetic table of 65536 
+HANDLEENTRY are created. For every entry the desktop that holds its pHead is found both by walking 
+the list the way the desktop hook store used to, and by find_desktop_range().
+
+'count' is the number of synthetic desktops. default 16.
+
+returns nonzero if both ways found the same desktops
+*/
+unsigned __int64 benchmark_desktop_range( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, j = 0, n = 0;
+	unsigned found_list = 0, found_range = 0;
+	uintptr_t checksum_list = 0, checksum_range = 0;
+	unsigned __int64 state = 0x2545F491;
+	double begin = 0, elapsed_list = 0, elapsed_range = 0;
+	const unsigned entry_count = 65536, passes = 16;
+	const uintptr_t base = (uintptr_t)0 - 0x40000000, heap_size = 0x300000, stride = 0x400000;
+	HANDLEENTRY *entry = NULL;
+	DESKTOPINFO *info = NULL;
+	struct desktop_list *list = NULL;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		count = 16;
+	
+	if( !count || ( count > 0x100 ) )
+	{
+		printf( "The number of desktops must be from 1 to 256.\n" );
+		return FALSE;
+	}
+	
+	n = (unsigned)count;
+	info = must_calloc( n, sizeof( *info ) );
+	entry = must_calloc( entry_count, sizeof( *entry ) );
+	
+	/* the desktops are added to the list in a random order, each has a heap in its own slot */
+	create_desktop_store( &list );
+	for( i = 0; i < n; ++i )
+	{
+		struct desktop_item *d = must_calloc( 1, sizeof( *d ) );
+		
+		
+		info[ i ].pvDesktopBase = (PVOID)( base + ( i * stride ) );
+		info[ i ].pvDesktopLimit = (PVOID)( base + ( i * stride ) + heap_size );
+		d->pDeskInfo = &info[ i ];
+		
+		if( !list->head || ( get_benchmark_random( &state ) & 1 ) )
+		{
+			d->next = list->head;
+			list->head = d;
+			if( !list->tail )
+				list->tail = d;
+		}
+		else
+		{
+			list->tail->next = d;
+			list->tail = d;
+		}
+	}
+	
+	build_desktop_range_array( list );
+	
+	/* most of the synthetic HOOKs are on one of the desktops, the rest are between them */
+	for( i = 0; i < entry_count; ++i )
+	{
+		entry[ i ].bType = TYPE_HOOK;
+		entry[ i ].pHead = 
+			(PHEAD)( base + ( get_benchmark_random( &state ) % ( n * ( stride / 16 ) ) ) * 16 );
+	}
+	
+	
+	/* walk the desktop list */
+	begin = get_benchmark_time();
+	for( j = 0; j < passes; ++j )
+	{
+		for( i = 0; i < entry_count; ++i )
+		{
+			struct desktop_item *d = NULL;
+			
+			
+			for( d = list->head; d; d = d->next )
+			{
+				if( ( (uintptr_t)entry[ i ].pHead 
+						< ( (uintptr_t)d->pDeskInfo->pvDesktopLimit - sizeof( HOOK ) ) 
+					)
+					&& ( (uintptr_t)entry[ i ].pHead >= (uintptr_t)d->pDeskInfo->pvDesktopBase )
+				)
+					break;
+			}
+			
+			if( d )
+			{
+				++found_list;
+				checksum_list += (uintptr_t)d;
+			}
+		}
+	}
+	elapsed_list = get_benchmark_time() - begin;
+	
+	/* search the range array */
+	begin = get_benchmark_time();
+	for( j = 0; j < passes; ++j )
+	{
+		for( i = 0; i < entry_count; ++i )
+		{
+			int range = 
+				find_desktop_range( 
+					list->range, 
+					list->range_count, 
+					(uintptr_t)entry[ i ].pHead, 
+					sizeof( HOOK ) 
+				);
+			
+			if( range >= 0 )
+			{
+				++found_range;
+				checksum_range += (uintptr_t)list->range[ range ].desktop;
+			}
+		}
+	}
+	elapsed_range = get_benchmark_time() - begin;
+	
+	
+	printf( "Synthetic desktops: %u. HANDLEENTRY lookups: %u.\n", n, entry_count * passes );
+	printf( "desktop list walk:  %.1f ns per lookup, %u found.\n", 
+		elapsed_list * 1000000000 / ( entry_count * passes ), found_list 
+	);
+	printf( "desktop range array: %.1f ns per lookup, %u found.\n", 
+		elapsed_range * 1000000000 / ( entry_count * passes ), found_range 
+	);
+	
+	if( ( found_list != found_range ) || ( checksum_list != checksum_range ) )
+		MSG_ERROR( "The range array and the list walk found different desktops." );
+	
+	free_desktop_store( &list );
+	free( entry );
+	free( info );
+	return ( ( found_list == found_range ) && ( checksum_list == checksum_range ) );
+}
+
+
+
+/* benchmark_handle_scan()
+Benchmark the scalar and SSE2 scans of a HANDLEENTRY table for HOOK entries.
+
+A synthetic table of 'count' HANDLEENTRY is created with random types, about 1% of them TYPE_HOOK. 
+The table is scanned repeatedly by scan_handle_table_scalar() and scan_handle_table_sse2() and the 
+throughput of each is reported in entries per second. The indexes found by both are compared.
+
+'count' is the number of synthetic entries. default 65536.
+
+returns nonzero if both scans found the same entries
+*/
+unsigned __int64 benchmark_handle_scan( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, j = 0, n = 0;
+	unsigned found_scalar = 0, found_sse2 = 0;
+	unsigned __int64 state = 0x2545F491;
+	double begin = 0, elapsed_scalar = 0, elapsed_sse2 = 0;
+	const unsigned passes = 1000;
+	int same = TRUE;
+	HANDLEENTRY *table = NULL;
+	unsigned *index_scalar = NULL, *index_sse2 = NULL;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		count = 65536;
+	
+	if( !count || ( count > 0x1000000 ) )
+	{
+		printf( "The number of entries must be from 1 to 16777216.\n" );
+		return FALSE;
+	}
+	
+	n = (unsigned)count;
+	table = must_calloc( n, sizeof( *table ) );
+	index_scalar = must_calloc( n, sizeof( *index_scalar ) );
+	index_sse2 = must_calloc( n, sizeof( *index_sse2 ) );
+	
+	for( i = 0; i < n; ++i )
+	{
+		unsigned r = get_benchmark_random( &state );
+		
+		
+		/* TYPE_FREE through TYPE_SETWINDOWPOS, or TYPE_HOOK one time in a hundred */
+		table[ i ].bType = (BYTE)( ( ( r % 100 ) == 0 ) ? TYPE_HOOK : ( ( r >> 8 ) % TYPE_HOOK ) );
+		
+		/* other members may have the same value as TYPE_HOOK and must not be matched */
+		table[ i ].bFlags = TYPE_HOOK;
+		table[ i ].wUniq = (WORD)r;
+		table[ i ].pHead = (PHEAD)(uintptr_t)( r * 0x01010101u );
+		table[ i ].pOwner = (PVOID)(uintptr_t)( TYPE_HOOK * 0x01010101u );
+	}
+	
+	printf( "SSE2 scan is %savailable on this processor.\n", ( is_sse2_scan_available() ? "" : "not " ) );
+	
+	begin = get_benchmark_time();
+	for( j = 0; j < passes; ++j )
+		found_scalar = scan_handle_table_scalar( index_scalar, n, table, n, TYPE_HOOK );
+	elapsed_scalar = get_benchmark_time() - begin;
+	
+	if( is_sse2_scan_available() )
+	{
+		begin = get_benchmark_time();
+		for( j = 0; j < passes; ++j )
+			found_sse2 = scan_handle_table_sse2( index_sse2, n, table, n, TYPE_HOOK );
+		elapsed_sse2 = get_benchmark_time() - begin;
+		
+		same = ( found_scalar == found_sse2 );
+		for( i = 0; same && ( i < found_scalar ); ++i )
+			same = ( index_scalar[ i ] == index_sse2[ i ] );
+	}
+	
+	printf( "Synthetic HANDLEENTRY: %u. Passes: %u.\n", n, passes );
+	printf( "scalar scan: %.0f entries/sec, %u found.\n", 
+		( elapsed_scalar ? ( (double)n * passes / elapsed_scalar ) : 0 ), found_scalar 
+	);
+	
+	if( is_sse2_scan_available() )
+	{
+		printf( "SSE2 scan:   %.0f entries/sec, %u found.\n", 
+			( elapsed_sse2 ? ( (double)n * passes / elapsed_sse2 ) : 0 ), found_sse2 
+		);
+	}
+	
+	if( !same )
+		MSG_ERROR( "The scalar and SSE2 scans found different entries." );
+	
+	free( index_sse2 );
+	free( index_scalar );
+	free( table );
+	return same;
+}
+
+
+
+/* benchmark_snapshot_file()
+Benchmark writing a snapshot to a snapshot file and loading it, and compare the loaded snapshot.
+
+A snapshot is taken and written 'count' times to a temporary snapshot file. The file is then loaded 
+by a snapshot file store and the rate of each is reported in snapshots per second. Each loaded 
+snapshot's hooks are compared to the hooks in the snapshot that was taken. The file is deleted.
+
+'count' is the number of times to write the snapshot. default 100.
+
+returns nonzero if every loaded snapshot has the same hooks as the snapshot that was taken
+*/
+unsigned __int64 benchmark_snapshot_file( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, j = 0, n = 0;
+	double begin = 0, elapsed_write = 0, elapsed_load = 0;
+	int same = FALSE;
+	WCHAR path[ MAX_PATH + 1 ] = { 0 };
+	WCHAR filename[ MAX_PATH + 1 ] = { 0 };
+	struct snapshot *snapshot = NULL;
+	struct snapshot_file *file = NULL;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		count = 100;
+	
+	if( !count || ( count > 100000 ) )
+	{
+		printf( "The number of snapshots must be from 1 to 100000.\n" );
+		return FALSE;
+	}
+	
+	n = (unsigned)count;
+	
+	if( !GetTempPathW( MAX_PATH, path ) || !GetTempFileNameW( path, L"ghs", 0, filename ) )
+	{
+		MSG_ERROR_GLE( "Failed to get a temporary file name." );
+		return FALSE;
+	}
+	
+	create_snapshot_store( &snapshot );
+	if( !init_snapshot_store( snapshot, NULL ) )
+	{
+		MSG_ERROR( "init_snapshot_store() failed." );
+		goto cleanup;
+	}
+	
+	begin = get_benchmark_time();
+	for( i = 0; i < n; ++i )
+	{
+		if( !write_snapshot_file( snapshot, filename ) )
+		{
+			MSG_ERROR( "write_snapshot_file() failed." );
+			goto cleanup;
+		}
+	}
+	elapsed_write = get_benchmark_time() - begin;
+	
+	begin = get_benchmark_time();
+	create_snapshot_file_store( &file );
+	if( !init_snapshot_file_store( file, filename, G->desktops ) )
+	{
+		MSG_ERROR( "init_snapshot_file_store() failed." );
+		goto cleanup;
+	}
+	elapsed_load = get_benchmark_time() - begin;
+	
+	if( G->config->verbose >= 5 )
+		print_snapshot_file_store( file );
+	
+	same = ( file->snapshot_count == n );
+	
+	for( i = 0; same && ( i < file->snapshot_count ); ++i )
+	{
+		const struct desktop_hook_item *a = NULL, *b = NULL;
+		
+		
+		for( a = snapshot->desktop_hooks->head, b = file->snapshot[ i ]->desktop_hooks->head; 
+			same && a && b; 
+			a = a->next, b = b->next 
+		)
+		{
+			same = ( ( a->desktop == b->desktop ) && ( a->hook_count == b->hook_count ) );
+			
+			for( j = 0; same && ( j < a->hook_count ); ++j )
+			{
+				same = ( !compare_hook( &a->hook[ j ], &b->hook[ j ] )
+					&& !memcmp( &a->hook[ j ].object, &b->hook[ j ].object, sizeof( HOOK ) )
+					&& ( !a->hook[ j ].owner == !b->hook[ j ].owner )
+					&& ( !a->hook[ j ].owner 
+						|| ( a->hook[ j ].owner->pvWin32ThreadInfo 
+							== b->hook[ j ].owner->pvWin32ThreadInfo 
+						)
+					)
+				);
+			}
+		}
+		
+		if( a || b )
+			same = FALSE;
+	}
+	
+	printf( "Snapshots: %u. File size: %Iu bytes.\n", n, file->size );
+	printf( "write: %.0f snapshots/sec.\n", ( elapsed_write ? ( n / elapsed_write ) : 0 ) );
+	printf( "load:  %.0f snapshots/sec.\n", ( elapsed_load ? ( n / elapsed_load ) : 0 ) );
+	
+	if( !same )
+		MSG_ERROR( "A loaded snapshot is not the same as the snapshot that was written." );
+	
+cleanup:
+	free_snapshot_file_store( &file );
+	free_snapshot_store( &snapshot );
+	DeleteFileW( filename );
+	return same;
+}
+
+
+
+/* benchmark_output()
+Benchmark printing HOOK notices to the output store.
+
+A snapshot is taken and the diff events for its HOOKs are made once. The events are then printed as 
+HOOK notices 'count' times to an output store with a memory backend, which is flushed after each 
+time as it would be after each snapshot. The rate is reported in notices per second. This is the 
+cost of formatting the notices, without the console.
+
+'count' is the number of times to print the snapshot's HOOKs. default 100.
+
+returns nonzero on success
+*/
+unsigned __int64 benchmark_output( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, n = 0, notices = 0;
+	double begin = 0, elapsed = 0;
+	int ret = FALSE;
+	struct snapshot *snapshot = NULL;
+	struct output *memory = NULL;
+	struct output *console = NULL;
+	struct diff_event_list *events = NULL;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		count = 100;
+	
+	if( !count || ( count > 100000 ) )
+	{
+		printf( "The number of times must be from 1 to 100000.\n" );
+		return FALSE;
+	}
+	
+	n = (unsigned)count;
+	
+	create_snapshot_store( &snapshot );
+	if( !init_snapshot_store( snapshot, NULL ) )
+	{
+		MSG_ERROR( "init_snapshot_store() failed." );
+		goto cleanup;
+	}
+	
+	create_output_store( &memory );
+	if( !init_output_store( memory, OUTPUT_MEMORY, NULL, 0 ) )
+	{
+		MSG_ERROR( "init_output_store() failed." );
+		goto cleanup;
+	}
+	
+	/* the HOOKs found in the snapshot. only the printing of their notices is benchmarked. */
+	create_diff_event_store( &events );
+	diff_initial_desktop_hook_list( events, snapshot->desktop_hooks );
+	
+	/* write the notices to the memory store instead of the global output store */
+	output_flush();
+	console = G->output;
+	G->output = memory;
+	
+	begin = get_benchmark_time();
+	for( i = 0; i < n; ++i )
+	{
+		notices += print_diff_events( events );
+		output_flush();
+	}
+	elapsed = get_benchmark_time() - begin;
+	
+	G->output = console;
+	
+	printf( "Notices: %u. Output: %I64u bytes.\n", notices, memory->bytes_written );
+	printf( "output: %.0f notices/sec, %.1f MB/sec.\n", 
+		( elapsed ? ( notices / elapsed ) : 0 ), 
+		( elapsed ? ( memory->bytes_written / elapsed / ( 1024 * 1024 ) ) : 0 ) 
+	);
+	
+	if( !notices )
+		printf( "There are no HOOKs to print. Check the hook and program include/exclude options.\n" );
+	
+	ret = TRUE;
+	
+cleanup:
+	free_diff_event_store( &events );
+	free_output_store( &memory );
+	free_snapshot_store( &snapshot );
+	return ret;
+}
+
+
+
+/* benchmark_hook_compare()
+Benchmark comparing HOOKs field by field against the masked word compare fast path.
+
+Two arrays of 'count' synthetic hook structs are compared element by element, first by calling 
+get_diff_HOOK_fields() for each pair and then by calling is_same_HOOK() first and only calling 
+get_diff_HOOK_fields() for the pairs that are not the same, which is what get_diff_hook_fields() 
+does. This is done with 0%, 1% and 50% of the pairs changed. A changed pair has a random field 
+changed, one of which is the lock count. Use the 'c' option to ignore lock counts.
+
+'count' is the number of synthetic hook structs in each array. default 10000.
+
+returns nonzero if both ways of comparing found the same differences
+*/
+unsigned __int64 benchmark_hook_compare( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, j = 0, k = 0, n = 0;
+	unsigned __int64 state = 0x2545F491;
+	const unsigned passes = 100;
+	const unsigned rate[] = { 0, 1, 50 };
+	int same = TRUE;
+	struct hook *a = NULL, *b = NULL;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		count = 10000;
+	
+	if( !count || ( count > 1000000 ) )
+	{
+		printf( "The number of hooks must be from 1 to 1000000.\n" );
+		return FALSE;
+	}
+	
+	n = (unsigned)count;
+	a = must_calloc( n, sizeof( *a ) );
+	b = must_calloc( n, sizeof( *b ) );
+	
+	printf( "Synthetic hooks: %u. Passes: %u. Lock counts are %s.\n", 
+		n, passes, ( ( G->config->flags & CFG_IGNORE_LOCK_COUNTS ) ? "ignored" : "compared" ) 
+	);
+	
+	for( k = 0; k < ( sizeof( rate ) / sizeof( rate[ 0 ] ) ); ++k )
+	{
+		unsigned changed_field = 0, changed_fast = 0;
+		double begin = 0, elapsed_field = 0, elapsed_fast = 0;
+		
+		
+		for( i = 0; i < n; ++i )
+		{
+			unsigned r = get_benchmark_random( &state );
+			
+			
+			a[ i ].entry.pHead = (PHEAD)(uintptr_t)( ( i + 1 ) * 0x40 );
+			a[ i ].entry.bType = TYPE_HOOK;
+			a[ i ].entry.bFlags = (BYTE)( r & HANDLEF_VALID );
+			a[ i ].object.head.h = (HANDLE)(uintptr_t)( ( r & 0xFFFF0000 ) | i );
+			a[ i ].object.head.cLockObj = ( r >> 8 ) & 0xF;
+			a[ i ].object.pSelf = a[ i ].entry.pHead;
+			a[ i ].object.phkNext = (struct _HOOK *)(uintptr_t)( ( r % n ) * 0x40 );
+			a[ i ].object.iHook = (INT)( r % 16 ) - 1;
+			a[ i ].object.offPfn = (UINT_PTR)( r * 0x10 );
+			a[ i ].object.flags = ( r >> 4 ) & HF_VALID;
+			a[ i ].object.ihmod = (INT)( r % 8 ) - 1;
+			
+			b[ i ] = a[ i ];
+			
+			r = get_benchmark_random( &state );
+			
+			if( ( r % 100 ) < rate[ k ] )
+			{
+				switch( ( r >> 8 ) % 4 )
+				{
+					case 0:
+						++b[ i ].object.head.cLockObj;
+						break;
+					case 1:
+						b[ i ].object.flags ^= HF_HUNG;
+						break;
+					case 2:
+						b[ i ].object.phkNext = NULL;
+						break;
+					default:
+						b[ i ].entry.bFlags ^= HANDLEF_DESTROY;
+						break;
+				}
+			}
+		}
+		
+		begin = get_benchmark_time();
+		for( j = 0; j < passes; ++j )
+		{
+			changed_field = 0;
+			
+			for( i = 0; i < n; ++i )
+			{
+				if( get_diff_HOOK_fields( &a[ i ], &b[ i ] ) )
+					++changed_field;
+			}
+		}
+		elapsed_field = get_benchmark_time() - begin;
+		
+		begin = get_benchmark_time();
+		for( j = 0; j < passes; ++j )
+		{
+			changed_fast = 0;
+			
+			for( i = 0; i < n; ++i )
+			{
+				if( !is_same_HOOK( &a[ i ], &b[ i ] ) && get_diff_HOOK_fields( &a[ i ], &b[ i ] ) )
+					++changed_fast;
+			}
+		}
+		elapsed_fast = get_benchmark_time() - begin;
+		
+		printf( "%2u%% changed: field by field %.0f hooks/sec, masked compare %.0f hooks/sec, "
+			"%u different.\n", 
+			rate[ k ], 
+			( elapsed_field ? ( (double)n * passes / elapsed_field ) : 0 ), 
+			( elapsed_fast ? ( (double)n * passes / elapsed_fast ) : 0 ), 
+			changed_fast 
+		);
+		
+		if( changed_field != changed_fast )
+			same = FALSE;
+	}
+	
+	if( !same )
+		MSG_ERROR( "The field by field and masked compares found different changes." );
+	
+	free( b );
+	free( a );
+	return same;
+}
+
+
+
+/* a synthetic work item for benchmark_pool() */
+struct synthetic_work
+{
+	/* the key the work items are partitioned by, like a process id. this must be the first member. */
+	unsigned __int64 pid;
+	
+	/* the result of resolving the work item, like a Win32ThreadInfo address */
+	unsigned __int64 value;
+	
+	/* the number of times the work item was resolved */
+	unsigned resolve_count;
+};
+
+/* resolve_synthetic_work()
+Resolve a range of synthetic work items. A stand-in for reading threads' Win32ThreadInfo.
+
+run_pool() callback: this function is called on a worker thread for each range of work items.
+'param' points to the first synthetic_work item.
+
+Each work item's value is a function of its key and its index, computed slowly enough to stand in 
+for a ReadProcessMemory() call.
+*/
+static void __cdecl resolve_synthetic_work( 
+	void *param,   // in, out
+	const unsigned begin,   // in
+	const unsigned end   // in
+)
+{
+	struct synthetic_work *const work = (struct synthetic_work *)param;
+	unsigned i = 0, j = 0;
+	
+	
+	for( i = begin; i < end; ++i )
+	{
+		unsigned __int64 state = work[ i ].pid ^ ( (unsigned __int64)i << 32 );
+		
+		
+		for( j = 0; j < 256; ++j )
+			get_benchmark_random( &state );
+		
+		work[ i ].value = state;
+		++work[ i ].resolve_count;
+	}
+	
+	return;
+}
+
+
+
+/* benchmark_pool()
+Benchmark resolving synthetic work items on the worker pool against the main thread, and check them.
+
+'count' is the number of synthetic work items. The work items are grouped by key into groups of 1 
+to 64, like the threads of a process.
+
+The work items are resolved on the main thread and then on the worker pool, and this function checks 
+that the ranges from partition_pool_ranges() cover every work item once, in order and without 
+splitting a group, and that each work item was resolved once with the same value as on the main 
+thread.
+
+If the global pool store isn't initialized, because the 'j' option wasn't specified, a pool of 4 
+worker threads is used.
+
+returns nonzero if the checks passed
+*/
+unsigned __int64 benchmark_pool( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, n = 0, range_count = 0, next = 0;
+	unsigned __int64 state = 0x2545F491;
+	unsigned __int64 pid = 0;
+	int same = TRUE;
+	double begin = 0, elapsed_serial = 0, elapsed_pool = 0;
+	struct synthetic_work *work = NULL;
+	unsigned __int64 *serial = NULL;
+	struct pool *local = NULL;
+	struct pool *pool = NULL;
+	struct pool_range range[ POOL_MAX_WORKERS ];
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		count = 100000;
+	
+	if( !count || ( count > 10000000 ) )
+	{
+		printf( "The number of work items must be from 1 to 10000000.\n" );
+		return FALSE;
+	}
+	
+	if( G->pool->init_time )
+		pool = G->pool;
+	else
+	{
+		create_pool_store( &local );
+		
+		if( !init_pool_store( local, 4 ) )
+		{
+			MSG_ERROR( "init_pool_store() failed." );
+			free_pool_store( &local );
+			return FALSE;
+		}
+		
+		pool = local;
+	}
+	
+	n = (unsigned)count;
+	work = must_calloc( n, sizeof( *work ) );
+	serial = must_calloc( n, sizeof( *serial ) );
+	
+	/* group the work items by key */
+	for( i = 0; i < n; ++i )
+	{
+		if( i == next )
+		{
+			pid += 4;
+			next = i + 1 + ( get_benchmark_random( &state ) % 64 );
+		}
+		
+		work[ i ].pid = pid;
+	}
+	
+	printf( "Synthetic work items: %u. Worker threads: %u.\n", n, pool->worker_count );
+	
+	begin = get_benchmark_time();
+	resolve_synthetic_work( work, 0, n );
+	elapsed_serial = get_benchmark_time() - begin;
+	
+	for( i = 0; i < n; ++i )
+	{
+		serial[ i ] = work[ i ].value;
+		work[ i ].value = 0;
+		work[ i ].resolve_count = 0;
+	}
+	
+	begin = get_benchmark_time();
+	range_count = 
+		partition_pool_ranges( &work[ 0 ].pid, sizeof( work[ 0 ] ), n, pool->worker_count, range );
+	run_pool( pool, resolve_synthetic_work, work, range, range_count );
+	elapsed_pool = get_benchmark_time() - begin;
+	
+	printf( "Main thread %.0f items/sec, worker pool %.0f items/sec in %u ranges.\n", 
+		( elapsed_serial ? ( (double)n / elapsed_serial ) : 0 ), 
+		( elapsed_pool ? ( (double)n / elapsed_pool ) : 0 ), 
+		range_count 
+	);
+	
+	/* the ranges must be in order and cover every work item once */
+	for( i = 0; i < range_count; ++i )
+	{
+		if( ( range[ i ].begin != ( i ? range[ i - 1 ].end : 0 ) ) 
+			|| ( range[ i ].begin >= range[ i ].end ) 
+		)
+		{
+			MSG_ERROR( "The ranges are not contiguous." );
+			printf( "range %u: %u to %u\n", i, range[ i ].begin, range[ i ].end );
+			same = FALSE;
+		}
+		
+		/* a group must not be split between ranges */
+		if( i && ( work[ range[ i ].begin ].pid == work[ range[ i ].begin - 1 ].pid ) )
+		{
+			MSG_ERROR( "A group was split between ranges." );
+			printf( "range %u: %u to %u\n", i, range[ i ].begin, range[ i ].end );
+			same = FALSE;
+		}
+	}
+	
+	if( !range_count || ( range[ range_count - 1 ].end != n ) )
+	{
+		MSG_ERROR( "The ranges don't cover every work item." );
+		same = FALSE;
+	}
+	
+	for( i = 0; i < n; ++i )
+	{
+		if( ( work[ i ].resolve_count != 1 ) || ( work[ i ].value != serial[ i ] ) )
+		{
+			MSG_ERROR( "A work item was not resolved once with the same value as the main thread." );
+			printf( "work item %u: resolve count %u\n", i, work[ i ].resolve_count );
+			same = FALSE;
+			break;
+		}
+	}
+	
+	free( serial );
+	free( work );
+	free_pool_store( &local );
+	return same;
+}
+
+
+
+/* benchmark_arena()
+Benchmark allocating the memory of a snapshot store from its arena against the heap, and check the 
+arena.
+
+'count' is the number of times the memory is allocated and released.
+
+Each time the snapshot store, the gui array, the gui index and a hook array for each desktop are 
+allocated, the same as by create_snapshot_store() and the first init_snapshot_store(). They're 
+allocated from the heap and freed, and then allocated from an arena and the arena is reset. After 
+that create_snapshot_store() and free_snapshot_store() are called 'count' times, which reuse the 
+arena of the last snapshot store that was freed.
+
+This function checks that the arena's allocations are aligned and don't overlap, and that memory 
+from arena_calloc() is zeroed after the arena is reset.
+
+returns nonzero if the checks passed
+*/
+unsigned __int64 benchmark_arena( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, j = 0, k = 0, n = 0, desktop_count = 0, index_max = 0, hook_max = 0;
+	int same = TRUE;
+	double begin = 0, elapsed_heap = 0, elapsed_arena = 0, elapsed_store = 0;
+	const struct desktop_item *desktop = NULL;
+	struct arena *arena = NULL;
+	struct snapshot *snapshot = NULL;
+	struct gui *gui = NULL;
+	unsigned *index = NULL;
+	struct hook **hook = NULL;
+	
+	/* the allocations of one pass from the arena, for the overlap check */
+	const void **p = NULL;
+	size_t *bytes = NULL;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		count = 100;
+	
+	if( !count || ( count > 100000 ) )
+	{
+		printf( "The number of passes must be from 1 to 100000.\n" );
+		return FALSE;
+	}
+	
+	n = (unsigned)count;
+	
+	for( desktop = G->desktops->head; desktop; desktop = desktop->next )
+		++desktop_count;
+	
+	if( !desktop_count )
+		desktop_count = 1;
+	
+	/* the same sizes as create_snapshot_store() and add_desktop_hook_item() */
+	for( index_max = 2; ( index_max / 2 ) < G->config->max_threads; index_max *= 2 )
+		;
+	
+	hook_max = 65535;
+	
+	hook = must_calloc( desktop_count, sizeof( *hook ) );
+	p = must_calloc( desktop_count + 3, sizeof( *p ) );
+	bytes = must_calloc( desktop_count + 3, sizeof( *bytes ) );
+	
+	printf( "Passes: %u. Threads: %u. Desktops: %u.\n", n, G->config->max_threads, desktop_count );
+	
+	
+	begin = get_benchmark_time();
+	
+	for( i = 0; i < n; ++i )
+	{
+		snapshot = must_calloc( 1, sizeof( *snapshot ) );
+		gui = must_calloc( G->config->max_threads, sizeof( *gui ) );
+		index = must_calloc( index_max, sizeof( *index ) );
+		
+		for( j = 0; j < desktop_count; ++j )
+		{
+			hook[ j ] = must_calloc( hook_max, sizeof( *hook[ j ] ) );
+			hook[ j ][ 0 ].entry_index = j;
+		}
+		
+		gui[ 0 ].unique_w32thread = TRUE;
+		index[ 0 ] = 1;
+		
+		for( j = 0; j < desktop_count; ++j )
+			free( hook[ j ] );
+		
+		free( index );
+		free( gui );
+		free( snapshot );
+	}
+	
+	elapsed_heap = get_benchmark_time() - begin;
+	
+	
+	create_arena_store( &arena );
+	init_arena_store( arena, 1048576 );
+	
+	begin = get_benchmark_time();
+	
+	for( i = 0; i < n; ++i )
+	{
+		snapshot = arena_calloc( arena, 1, sizeof( *snapshot ) );
+		gui = arena_calloc( arena, G->config->max_threads, sizeof( *gui ) );
+		index = arena_calloc( arena, index_max, sizeof( *index ) );
+		
+		for( j = 0; j < desktop_count; ++j )
+		{
+			hook[ j ] = arena_alloc( arena, hook_max, sizeof( *hook[ j ] ) );
+			hook[ j ][ 0 ].entry_index = j;
+		}
+		
+		gui[ 0 ].unique_w32thread = TRUE;
+		index[ 0 ] = 1;
+		
+		/* keep the last pass' allocations for the checks */
+		if( i == ( n - 1 ) )
+			break;
+		
+		reset_arena_store( arena );
+	}
+	
+	elapsed_arena = get_benchmark_time() - begin;
+	
+	
+	/* the allocations must be aligned and must not overlap */
+	p[ 0 ] = snapshot;
+	bytes[ 0 ] = sizeof( *snapshot );
+	p[ 1 ] = gui;
+	bytes[ 1 ] = G->config->max_threads * sizeof( *gui );
+	p[ 2 ] = index;
+	bytes[ 2 ] = index_max * sizeof( *index );
+	
+	for( j = 0; j < desktop_count; ++j )
+	{
+		p[ j + 3 ] = hook[ j ];
+		bytes[ j + 3 ] = hook_max * sizeof( *hook[ j ] );
+	}
+	
+	for( j = 0; j < ( desktop_count + 3 ); ++j )
+	{
+		if( (uintptr_t)p[ j ] % ARENA_ALIGNMENT )
+		{
+			MSG_ERROR( "An arena allocation is not aligned." );
+			printf( "allocation %u: 0x%p\n", j, p[ j ] );
+			same = FALSE;
+		}
+		
+		for( k = j + 1; k < ( desktop_count + 3 ); ++k )
+		{
+			if( ( (const char *)p[ j ] < ( (const char *)p[ k ] + bytes[ k ] ) ) 
+				&& ( (const char *)p[ k ] < ( (const char *)p[ j ] + bytes[ j ] ) ) 
+			)
+			{
+				MSG_ERROR( "Arena allocations overlap." );
+				printf( "allocation %u: 0x%p, allocation %u: 0x%p\n", j, p[ j ], k, p[ k ] );
+				same = FALSE;
+			}
+		}
+	}
+	
+	/* dirty the gui array and then allocate it again after a reset. it must be zeroed. */
+	memset( gui, 0xFF, G->config->max_threads * sizeof( *gui ) );
+	reset_arena_store( arena );
+	
+	arena_calloc( arena, 1, sizeof( *snapshot ) );
+	gui = arena_calloc( arena, G->config->max_threads, sizeof( *gui ) );
+	
+	for( i = 0; i < ( G->config->max_threads * sizeof( *gui ) ); ++i )
+	{
+		if( ( (const BYTE *)gui )[ i ] )
+		{
+			MSG_ERROR( "Memory from arena_calloc() was not zeroed after the arena was reset." );
+			printf( "byte %u: 0x%02X\n", i, ( (const BYTE *)gui )[ i ] );
+			same = FALSE;
+			break;
+		}
+	}
+	
+	print_arena_stats( arena, "Benchmark arena" );
+	free_arena_store( &arena );
+	
+	
+	begin = get_benchmark_time();
+	
+	for( i = 0; i < n; ++i )
+	{
+		create_snapshot_store( &snapshot );
+		free_snapshot_store( &snapshot );
+	}
+	
+	elapsed_store = get_benchmark_time() - begin;
+	
+	printf( "Heap %.0f passes/sec, arena %.0f passes/sec. "
+		"create_snapshot_store() and free_snapshot_store() %.0f passes/sec.\n", 
+		( elapsed_heap ? ( (double)n / elapsed_heap ) : 0 ), 
+		( elapsed_arena ? ( (double)n / elapsed_arena ) : 0 ), 
+		( elapsed_store ? ( (double)n / elapsed_store ) : 0 ) 
+	);
+	
+	free( bytes );
+	free( p );
+	free( hook );
+	return same;
+}
+
+
+
+/* diff_hook_items_by_hook()
+Add diff events for two desktop hook items by comparing their hook arrays instead of their hook keys.
+
+This is diff_desktop_hook_items() as it was before the hook key arrays, when the merge join read 
+each hook struct to compare it. It's the baseline for benchmark_hook_diff().
+*/
+static void diff_hook_items_by_hook( 
+	struct diff_event_list *const store,   // in
+	const struct desktop_hook_item *const a,   // in
+	const struct desktop_hook_item *const b   // in
+)
+{
+	const WCHAR *const deskname = b->desktop->pwszDesktopName;
+	unsigned a_hi = 0, b_hi = 0;
+	
+	
+	while( ( a_hi < a->hook_count ) && ( b_hi < b->hook_count ) )
+	{
+		int ret = compare_hook( &a->hook[ a_hi ], &b->hook[ b_hi ] );
+		
+		if( ret < 0 ) // hook removed
+		{
+			if( !a->hook[ a_hi ].ignore )
+				add_diff_event( store, HOOK_REMOVED, 0, &a->hook[ a_hi ], NULL, deskname );
+			
+			++a_hi;
+		}
+		else if( ret > 0 ) // hook added
+		{
+			if( !b->hook[ b_hi ].ignore )
+				add_diff_event( store, HOOK_ADDED, 0, NULL, &b->hook[ b_hi ], deskname );
+			
+			++b_hi;
+		}
+		else
+		{
+			if( !a->hook[ a_hi ].ignore || !b->hook[ b_hi ].ignore )
+			{
+				unsigned fields = get_diff_hook_fields( &a->hook[ a_hi ], &b->hook[ b_hi ] );
+				
+				if( fields )
+				{
+					add_diff_event( store, HOOK_MODIFIED, fields, 
+						&a->hook[ a_hi ], &b->hook[ b_hi ], deskname 
+					);
+				}
+			}
+			
+			++a_hi;
+			++b_hi;
+		}
+	}
+	
+	for( ; a_hi < a->hook_count; ++a_hi ) // hooks removed
+	{
+		if( !a->hook[ a_hi ].ignore )
+			add_diff_event( store, HOOK_REMOVED, 0, &a->hook[ a_hi ], NULL, deskname );
+	}
+	
+	for( ; b_hi < b->hook_count; ++b_hi ) // hooks added
+	{
+		if( !b->hook[ b_hi ].ignore )
+			add_diff_event( store, HOOK_ADDED, 0, NULL, &b->hook[ b_hi ], deskname );
+	}
+	
+	return;
+}
+
+
+
+/* benchmark_hook_diff()
+Benchmark diffing desktops by their hook keys against diffing them by their hook arrays, and check 
+that the events are the same.
+
+'count' is the number of synthetic hooks on the desktop. If it's not specified then desktops with 
+10000 and 100000 hooks are benchmarked.
+
+Each desktop is captured twice. In the second capture about 1 in 100 hooks were removed, 1 in 100 
+were added and 1 in 100 were modified. The two captures are diffed by diff_desktop_hook_items(), 
+which reads only the hook keys until it finds a match, and by diff_hook_items_by_hook(), which reads 
+the hook structs.
+
+returns nonzero if the events were the same
+*/
+unsigned __int64 benchmark_hook_diff( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, j = 0, k = 0, n = 0, pass = 0;
+	unsigned __int64 state = 0x2545F491;
+	const unsigned passes = 20;
+	unsigned size[ 2 ];
+	unsigned size_count = 0;
+	int same = TRUE;
+	WCHAR deskname[] = L"Synthetic";
+	struct desktop_item desktop;
+	struct desktop_hook_item a, b;
+	struct diff_event_list *by_key = NULL, *by_hook = NULL;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+	{
+		size[ 0 ] = 10000;
+		size[ 1 ] = 100000;
+		size_count = 2;
+	}
+	else if( !count || ( count > 1000000 ) )
+	{
+		printf( "The number of hooks must be from 1 to 1000000.\n" );
+		return FALSE;
+	}
+	else
+	{
+		size[ 0 ] = (unsigned)count;
+		size_count = 1;
+	}
+	
+	ZeroMemory( &desktop, sizeof( desktop ) );
+	desktop.pwszDesktopName = deskname;
+	
+	create_diff_event_store( &by_key );
+	create_diff_event_store( &by_hook );
+	
+	printf( "Passes: %u. sizeof( struct hook ): %u. sizeof( struct hook_key ): %u.\n", 
+		passes, (unsigned)sizeof( struct hook ), (unsigned)sizeof( struct hook_key ) 
+	);
+	
+	for( k = 0; k < size_count; ++k )
+	{
+		double begin = 0, elapsed_key = 0, elapsed_hook = 0;
+		
+		
+		n = size[ k ];
+		
+		ZeroMemory( &a, sizeof( a ) );
+		ZeroMemory( &b, sizeof( b ) );
+		
+		a.desktop = b.desktop = &desktop;
+		a.hook_max = b.hook_max = n * 2;
+		a.hook = must_calloc( a.hook_max, sizeof( *a.hook ) );
+		b.hook = must_calloc( b.hook_max, sizeof( *b.hook ) );
+		a.key = must_calloc( a.hook_max, sizeof( *a.key ) );
+		b.key = must_calloc( b.hook_max, sizeof( *b.key ) );
+		
+		/* the hooks are in heap order, the same as they're sorted by init_desktop_hook_store() */
+		for( i = 0; i < n; ++i )
+		{
+			struct hook *const hook = &a.hook[ a.hook_count++ ];
+			unsigned r = get_benchmark_random( &state );
+			
+			
+			hook->entry_index = r % 65536;
+			hook->entry.pHead = (PHEAD)(uintptr_t)( ( i + 1 ) * 0x80 );
+			hook->entry.bType = TYPE_HOOK;
+			hook->object.head.h = (HANDLE)(uintptr_t)( ( r & 0xFFFF0000 ) | hook->entry_index );
+			hook->object.pSelf = hook->entry.pHead;
+			hook->object.iHook = (INT)( r % 16 ) - 1;
+			hook->object.offPfn = (UINT_PTR)( r * 0x10 );
+			
+			r = get_benchmark_random( &state );
+			
+			if( ( r % 100 ) == 0 ) // removed
+				continue;
+			
+			b.hook[ b.hook_count ] = *hook;
+			b.hook[ b.hook_count ].unchanged = TRUE;
+			
+			if( ( r % 100 ) == 1 ) // modified
+			{
+				b.hook[ b.hook_count ].object.flags ^= HF_HUNG;
+				b.hook[ b.hook_count ].unchanged = FALSE;
+			}
+			
+			++b.hook_count;
+			
+			if( ( r % 100 ) == 2 ) // added
+			{
+				b.hook[ b.hook_count ] = *hook;
+				b.hook[ b.hook_count ].entry.pHead = (PHEAD)( (uintptr_t)hook->entry.pHead + 0x40 );
+				b.hook[ b.hook_count ].object.pSelf = b.hook[ b.hook_count ].entry.pHead;
+				++b.hook_count;
+			}
+		}
+		
+		build_hook_keys( &a );
+		build_hook_keys( &b );
+		
+		begin = get_benchmark_time();
+		for( pass = 0; pass < passes; ++pass )
+		{
+			by_key->event_count = 0;
+			diff_desktop_hook_items( by_key, &a, &b );
+		}
+		elapsed_key = get_benchmark_time() - begin;
+		
+		begin = get_benchmark_time();
+		for( pass = 0; pass < passes; ++pass )
+		{
+			by_hook->event_count = 0;
+			diff_hook_items_by_hook( by_hook, &a, &b );
+		}
+		elapsed_hook = get_benchmark_time() - begin;
+		
+		printf( "%u hooks: by key %.0f hooks/sec, by hook %.0f hooks/sec, %u events.\n", 
+			n, 
+			( elapsed_key ? ( (double)n * passes / elapsed_key ) : 0 ), 
+			( elapsed_hook ? ( (double)n * passes / elapsed_hook ) : 0 ), 
+			by_key->event_count 
+		);
+		
+		if( by_key->event_count != by_hook->event_count )
+			same = FALSE;
+		
+		for( j = 0; same && ( j < by_key->event_count ); ++j )
+		{
+			same = ( ( by_key->event[ j ].type == by_hook->event[ j ].type )
+				&& ( by_key->event[ j ].fields == by_hook->event[ j ].fields )
+				&& ( by_key->event[ j ].a == by_hook->event[ j ].a )
+				&& ( by_key->event[ j ].b == by_hook->event[ j ].b )
+			);
+		}
+		
+		free( b.key );
+		free( a.key );
+		free( b.hook );
+		free( a.hook );
+	}
+	
+	if( !same )
+		MSG_ERROR( "The diffs by key and by hook found different events." );
+	
+	free_diff_event_store( &by_hook );
+	free_diff_event_store( &by_key );
+	return same;
+}
+
+
+
+/* benchmark_hook_sort()
+Benchmark sorting a desktop's hook array with sort_hook_array() against qsort() with compare_hook(), 
+and check that the order is the same.
+
+'count' is the number of synthetic hooks on the desktop. If it's not specified then desktops with 
+10000 and 100000 hooks are benchmarked.
+
+The pHeads of the synthetic hooks are spread through a desktop heap and the hooks are shuffled, like 
+the HANDLEENTRYs of HOOKs are found in the handle table. About 1 in 50 hooks have the same pHead as 
+another hook but a different HANDLEENTRY index, and about 1 in 100 have the same pHead and index but 
+a different handle, some of which are sign extended, so that every part of the key is sorted. Each 
+size is sorted from shuffled and then from already sorted.
+
+returns nonzero if the order was the same
+*/
+unsigned __int64 benchmark_hook_sort( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, k = 0, n = 0, pass = 0, order = 0;
+	unsigned __int64 state = 0x7A3C15E9;
+	const unsigned passes = 20;
+	unsigned size[ 2 ];
+	unsigned size_count = 0;
+	int same = TRUE;
+	struct hook *unsorted = NULL;
+	struct desktop_hook_item radix, by_qsort;
+	struct desktop_hook_list *store = NULL;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+	{
+		size[ 0 ] = 10000;
+		size[ 1 ] = 100000;
+		size_count = 2;
+	}
+	else if( !count || ( count > 1000000 ) )
+	{
+		printf( "The number of hooks must be from 1 to 1000000.\n" );
+		return FALSE;
+	}
+	else
+	{
+		size[ 0 ] = (unsigned)count;
+		size_count = 1;
+	}
+	
+	/* the store is only used for its sort arrays */
+	create_desktop_hook_store( &store, NULL );
+	
+	printf( "Passes: %u. sizeof( struct hook ): %u. sizeof( struct hook_sort ): %u.\n", 
+		passes, (unsigned)sizeof( struct hook ), (unsigned)sizeof( struct hook_sort ) 
+	);
+	
+	for( k = 0; k < size_count; ++k )
+	{
+		n = size[ k ];
+		
+		ZeroMemory( &radix, sizeof( radix ) );
+		ZeroMemory( &by_qsort, sizeof( by_qsort ) );
+		
+		unsorted = must_calloc( n, sizeof( *unsorted ) );
+		radix.hook_max = by_qsort.hook_max = n;
+		radix.hook = must_calloc( radix.hook_max, sizeof( *radix.hook ) );
+		by_qsort.hook = must_calloc( by_qsort.hook_max, sizeof( *by_qsort.hook ) );
+		radix.key = must_calloc( radix.hook_max, sizeof( *radix.key ) );
+		by_qsort.key = must_calloc( by_qsort.hook_max, sizeof( *by_qsort.key ) );
+		radix.hook_count = by_qsort.hook_count = n;
+		
+		for( i = 0; i < n; ++i )
+		{
+			struct hook *const hook = &unsorted[ i ];
+			unsigned r = get_benchmark_random( &state );
+			
+			
+			hook->entry_index = r % 65536;
+			hook->entry.pHead = (PHEAD)(uintptr_t)( 0x80000000u + ( ( i + 1 ) * 0x80 ) );
+			hook->entry.bType = TYPE_HOOK;
+			hook->object.head.h = (HANDLE)(uintptr_t)( ( r & 0x7FFF0000 ) | hook->entry_index );
+			
+			r = get_benchmark_random( &state );
+			
+			if( i && ( ( r % 50 ) == 0 ) ) // same pHead, different index
+			{
+				hook->entry.pHead = unsorted[ i - 1 ].entry.pHead;
+				hook->entry_index = ( unsorted[ i - 1 ].entry_index + 1 + ( r % 7 ) ) % 65536;
+			}
+			else if( i && ( ( r % 100 ) == 1 ) ) // same pHead and index, different handle
+			{
+				hook->entry.pHead = unsorted[ i - 1 ].entry.pHead;
+				hook->entry_index = unsorted[ i - 1 ].entry_index;
+				hook->object.head.h = (HANDLE)(intptr_t)(INT)( 0x80000000u | ( r & 0x7FFF0000 ) | i );
+			}
+			
+			hook->object.pSelf = hook->entry.pHead;
+		}
+		
+		/* shuffle */
+		for( i = n; i > 1; --i )
+		{
+			const unsigned j = get_benchmark_random( &state ) % i;
+			struct hook temp = unsorted[ i - 1 ];
+			
+			unsorted[ i - 1 ] = unsorted[ j ];
+			unsorted[ j ] = temp;
+		}
+		
+		for( order = 0; order < 2; ++order )
+		{
+			double begin = 0, elapsed_radix = 0, elapsed_qsort = 0;
+			
+			
+			begin = get_benchmark_time();
+			for( pass = 0; pass < passes; ++pass )
+			{
+				memcpy( radix.hook, unsorted, n * sizeof( *unsorted ) );
+				sort_hook_array( store, &radix );
+			}
+			elapsed_radix = get_benchmark_time() - begin;
+			
+			begin = get_benchmark_time();
+			for( pass = 0; pass < passes; ++pass )
+			{
+				memcpy( by_qsort.hook, unsorted, n * sizeof( *unsorted ) );
+				qsort( by_qsort.hook, by_qsort.hook_count, sizeof( *by_qsort.hook ), compare_hook );
+				build_hook_keys( &by_qsort );
+			}
+			elapsed_qsort = get_benchmark_time() - begin;
+			
+			printf( "%u hooks, %s: radix sort %.0f hooks/sec, qsort %.0f hooks/sec.\n", 
+				n, 
+				( order ? "already sorted" : "shuffled" ), 
+				( elapsed_radix ? ( (double)n * passes / elapsed_radix ) : 0 ), 
+				( elapsed_qsort ? ( (double)n * passes / elapsed_qsort ) : 0 ) 
+			);
+			
+			for( i = 0; same && ( i < n ); ++i )
+			{
+				same = ( ( radix.hook[ i ].entry.pHead == by_qsort.hook[ i ].entry.pHead )
+					&& ( radix.hook[ i ].entry_index == by_qsort.hook[ i ].entry_index )
+					&& ( radix.hook[ i ].object.head.h == by_qsort.hook[ i ].object.head.h )
+					&& !compare_hook_key( &radix.key[ i ], &by_qsort.key[ i ] )
+				);
+			}
+			
+			/* sort from the sorted order the second time */
+			memcpy( unsorted, by_qsort.hook, n * sizeof( *unsorted ) );
+		}
+		
+		free( by_qsort.key );
+		free( radix.key );
+		free( by_qsort.hook );
+		free( radix.hook );
+		free( unsorted );
+	}
+	
+	if( !same )
+		MSG_ERROR( "The radix sort and qsort() ordered the hooks differently." );
+	
+	free_desktop_hook_store( &store );
+	return same;
+}
+
+
+
+/* stuff to be passed to callback_count_thread() and callback_count_threads().
+this struct members' annotations are similar to those of function parameters
+*/
+struct count_info
+{
+	/* the number of threads */
+	unsigned __int64 threads;   // in, out
+	
+	/* the number of threads that are waiting */
+	unsigned __int64 waiting;   // in, out
+	
+	/* the sum of the thread ids */
+	unsigned __int64 tid_sum;   // in, out
+};
+
+/* the ThreadState of a waiting thread. this is 'Waiting' in enum KTHREAD_STATE */
+#define THREAD_STATE_WAITING   5
+
+/* callback_count_thread()
+Count a thread and whether it's waiting. The per-thread callback benchmarked by benchmark_traverse().
+
+traverse_threads() callback: this function is called for every SYSTEM_THREAD_INFORMATION.
+
+The behavior of a traverse_threads() callback is documented in traverse_threads.txt.
+*/
+static int callback_count_thread( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG remaining,   // in
+	const DWORD flags   // in, optional
+)
+{
+	struct count_info *const info = (struct count_info *)cb_param;
+	
+	
+	++info->threads;
+	
+	if( sti->ThreadState == THREAD_STATE_WAITING )
+		++info->waiting;
+	
+	info->tid_sum += (size_t)sti->ClientId.UniqueThread;
+	
+	return TRAVERSE_CALLBACK_CONTINUE;
+}
+
+
+
+/* callback_count_threads()
+Count a process' threads and how many are waiting. The batch callback benchmarked by 
+benchmark_traverse().
+
+traverse_threads_batch() callback: this function is called for every SYSTEM_PROCESS_INFORMATION with 
+its array of 'count' SYSTEM_THREAD_INFORMATION.
+
+The behavior of a traverse_threads_batch() callback is documented in traverse_threads.txt.
+*/
+static int callback_count_threads( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG count,   // in
+	const DWORD flags   // in, optional
+)
+{
+	struct count_info *const info = (struct count_info *)cb_param;
+	const size_t sti_bcount = ( ( flags & TRAVERSE_FLAG_EXTENDED ) ? 
+		sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) : sizeof( SYSTEM_THREAD_INFORMATION ) );
+	const char *current = (const char *)sti;
+	unsigned __int64 waiting = 0, tid_sum = 0;
+	ULONG i = 0;
+	
+	
+	/* accumulate in locals so the loop doesn't write through the pointer for every thread */
+	for( i = 0; i < count; ++i, current += sti_bcount )
+	{
+		const SYSTEM_THREAD_INFORMATION *const thread = (const SYSTEM_THREAD_INFORMATION *)current;
+		
+		waiting += ( thread->ThreadState == THREAD_STATE_WAITING );
+		tid_sum += (size_t)thread->ClientId.UniqueThread;
+	}
+	
+	info->threads += count;
+	info->waiting += waiting;
+	info->tid_sum += tid_sum;
+	
+	return TRAVERSE_CALLBACK_CONTINUE;
+}
+
+
+
+/* benchmark_traverse()
+Benchmark traversing the thread info with a callback for each thread against a callback for each 
+process, and check that the counts are the same.
+
+The thread info is queried once into a buffer, and then each pass recycles the buffer so that only 
+the traversal is timed. Each pass is timed with traverse_threads() and callback_count_thread(), 
+and with traverse_threads_batch() and callback_count_threads().
+
+'count' is the number of passes. default 1000, it can't be more than 1000000.
+
+returns nonzero if the counts are the same
+*/
+unsigned __int64 benchmark_traverse( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned pass = 0, passes = 0, order = 0;
+	int ret = TRAVERSE_ERROR_GENERAL;
+	int same = TRUE;
+	LONG status = 0;
+	size_t bcount = 0;
+	void *buffer = NULL;
+	const DWORD flags = ( TRAVERSE_FLAG_EXTENDED | TRAVERSE_FLAG_RECYCLE );
+	struct count_info by_thread, by_process;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		passes = 1000;
+	else if( !count || ( count > 1000000 ) )
+	{
+		printf( "The number of passes must be from 1 to 1000000.\n" );
+		return FALSE;
+	}
+	else
+		passes = (unsigned)count;
+	
+	/* the same size as the spi buffer of a snapshot store */
+	bcount = get_spi_bcount_estimate( TRAVERSE_FLAG_EXTENDED, NULL ) * 2 + TRAVERSE_RESERVED_BCOUNT;
+	
+	for( ;; )
+	{
+		buffer = must_calloc( bcount, 1 );
+		
+		ret = traverse_threads( NULL, NULL, buffer, bcount, TRAVERSE_FLAG_EXTENDED, &status );
+		if( ret != TRAVERSE_ERROR_BUFFER_TOO_SMALL )
+			break;
+		
+		free( buffer );
+		bcount *= 2;
+	}
+	
+	if( ret != TRAVERSE_SUCCESS )
+	{
+		MSG_ERROR( "traverse_threads() failed to query the thread info." );
+		printf( "traverse_threads() returned: %s\n", traverse_threads_retcode_to_cstr( ret ) );
+		free( buffer );
+		return FALSE;
+	}
+	
+	printf( "Passes: %u.\n", passes );
+	
+	/* time both ways twice, alternating which goes first */
+	for( order = 0; ( order < 2 ) && ( ret == TRAVERSE_SUCCESS ); ++order )
+	{
+		double elapsed_thread = 0, elapsed_process = 0;
+		unsigned k = 0;
+		
+		
+		ZeroMemory( &by_thread, sizeof( by_thread ) );
+		ZeroMemory( &by_process, sizeof( by_process ) );
+		
+		for( k = 0; ( k < 2 ) && ( ret == TRAVERSE_SUCCESS ); ++k )
+		{
+			const int batch = ( k != order );
+			const double begin = get_benchmark_time();
+			
+			
+			for( pass = 0; ( pass < passes ) && ( ret == TRAVERSE_SUCCESS ); ++pass )
+			{
+				if( batch )
+				{
+					ret = traverse_threads_batch( 
+						callback_count_threads, &by_process, buffer, bcount, flags, NULL 
+					);
+				}
+				else
+				{
+					ret = traverse_threads( 
+						callback_count_thread, &by_thread, buffer, bcount, flags, NULL 
+					);
+				}
+			}
+			
+			if( batch )
+				elapsed_process = get_benchmark_time() - begin;
+			else
+				elapsed_thread = get_benchmark_time() - begin;
+		}
+		
+		if( ret != TRAVERSE_SUCCESS )
+			break;
+		
+		printf( "%I64u threads, %I64u waiting: per thread %.0f threads/sec, "
+			"per process %.0f threads/sec.\n", 
+			( by_process.threads / passes ), 
+			( by_process.waiting / passes ), 
+			( elapsed_thread ? ( (double)by_thread.threads / elapsed_thread ) : 0 ), 
+			( elapsed_process ? ( (double)by_process.threads / elapsed_process ) : 0 ) 
+		);
+		
+		same = same 
+			&& ( by_thread.threads == by_process.threads )
+			&& ( by_thread.waiting == by_process.waiting )
+			&& ( by_thread.tid_sum == by_process.tid_sum );
+	}
+	
+	if( ret != TRAVERSE_SUCCESS )
+	{
+		MSG_ERROR( "traverse_threads() failed to recycle the thread info." );
+		printf( "traverse_threads() returned: %s\n", traverse_threads_retcode_to_cstr( ret ) );
+		same = FALSE;
+	}
+	else if( !same )
+		MSG_ERROR( "The per thread and per process callbacks counted the threads differently." );
+	
+	free( buffer );
+	return same;
+}
+
+
+
+/* the synthetic system process information that synthetic_query() writes to the query's buffer.
+this struct members' annotations are similar to those of function parameters
+*/
+static struct
+{
+	/* the synthetic array of SYSTEM_PROCESS_INFORMATION structs */
+	const void *spi;   // in
+	
+	/* the size in bytes of the array */
+	ULONG bcount;   // in
+	
+	/* the offset of each process info in the array, and the number of process infos */
+	const ULONG *offset;   // in
+	unsigned process_count;   // in
+} synthetic_spi;
+
+/* stuff to be passed to callback_check_synthetic().
+this struct members' annotations are similar to those of function parameters
+*/
+struct synthetic_info
+{
+	/* the array of SYSTEM_PROCESS_INFORMATION structs that was traversed */
+	const char *begin;   // in
+	const char *end;   // in
+	
+	/* the number of processes and threads passed to the callback */
+	unsigned __int64 processes;   // in, out
+	unsigned __int64 threads;   // in, out
+	
+	/* the sum of the thread ids passed to the callback */
+	unsigned __int64 tid_sum;   // in, out
+	
+	/* the number of processes passed to the callback that weren't in the array */
+	unsigned __int64 out_of_range;   // in, out
+};
+
+/* build_synthetic_spi()
+Build a synthetic array of SYSTEM_PROCESS_INFORMATION structs.
+
+'buffer' receives the array. It must be aligned.
+'bcount' is the size of buffer in bytes.
+'thread_count' is an array with the number of thread infos for each process info.
+'process_count' is the number of elements in 'thread_count'.
+'flags' is TRAVERSE_FLAG_EXTENDED to build SYSTEM_EXTENDED_THREAD_INFORMATION thread infos.
+'offset' receives the offset of each process info if it's not NULL.
+
+Each process info is laid out the way NtQuerySystemInformation() does: the process info, its thread 
+infos, and then its image name. The process ids and thread ids are unique. The thread ids are 
+numbered in order from 4, and each process' id is 4 less than its first thread's id.
+
+returns the size of the array in bytes, or 0 if it doesn't fit in the buffer
+*/
+static ULONG build_synthetic_spi( 
+	void *buffer,   // out
+	const size_t bcount,   // in
+	const unsigned *const thread_count,   // in
+	const unsigned process_count,   // in
+	const DWORD flags,   // in
+	ULONG *const offset   // out, optional
+)
+{
+	const WCHAR name[] = L"synthetic.exe";
+	const size_t sti_bcount = ( ( flags & TRAVERSE_FLAG_EXTENDED ) ? 
+		sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) : sizeof( SYSTEM_THREAD_INFORMATION ) );
+	size_t used = 0;
+	unsigned i = 0, k = 0;
+	size_t tid = 4;
+	
+	FAIL_IF( !buffer );
+	FAIL_IF( !thread_count );
+	FAIL_IF( !process_count );
+	
+	
+	for( i = 0; i < process_count; ++i )
+	{
+		SYSTEM_PROCESS_INFORMATION *const spi = 
+			(SYSTEM_PROCESS_INFORMATION *)( (char *)buffer + used );
+		const size_t threads_bcount = thread_count[ i ] * sti_bcount;
+		
+		/* the size of the process info with its thread infos and image name, pointer aligned */
+		const size_t spi_bcount = ( offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) 
+			+ threads_bcount + sizeof( name ) + ( sizeof( void * ) - 1 ) ) & ~( sizeof( void * ) - 1 );
+		
+		
+		if( ( spi_bcount > ( bcount - used ) ) || ( ( used + spi_bcount ) > ULONG_MAX ) )
+			return 0;
+		
+		ZeroMemory( spi, spi_bcount );
+		
+		if( offset )
+			offset[ i ] = (ULONG)used;
+		
+		spi->NextEntryOffset = ( ( i + 1 ) < process_count ) ? (ULONG)spi_bcount : 0;
+		spi->NumberOfThreads = thread_count[ i ];
+		spi->UniqueProcessId = (HANDLE)tid;
+		spi->CreateTime.QuadPart = (LONGLONG)tid;
+		
+		spi->ImageName.Buffer = (PWSTR)( (char *)&spi->Threads + threads_bcount );
+		spi->ImageName.Length = (USHORT)( sizeof( name ) - sizeof( WCHAR ) );
+		spi->ImageName.MaximumLength = (USHORT)sizeof( name );
+		memcpy( spi->ImageName.Buffer, name, sizeof( name ) );
+		
+		for( k = 0; k < thread_count[ i ]; ++k )
+		{
+			SYSTEM_THREAD_INFORMATION *const sti = 
+				(SYSTEM_THREAD_INFORMATION *)( (char *)&spi->Threads + ( k * sti_bcount ) );
+			
+			tid += 4;
+			
+			sti->ClientId.UniqueProcess = spi->UniqueProcessId;
+			sti->ClientId.UniqueThread = (HANDLE)tid;
+			sti->CreateTime.QuadPart = (LONGLONG)tid;
+			sti->ThreadState = ( tid % 9 );
+			sti->WaitReason = ( tid % 37 );
+		}
+		
+		used += spi_bcount;
+	}
+	
+	return (ULONG)used;
+}
+
+
+
+/* synthetic_query()
+Write the synthetic array of SYSTEM_PROCESS_INFORMATION structs in synthetic_spi to a buffer.
+
+This is the query function that set_traverse_query() replaces NtQuerySystemInformation() with. It 
+returns the same status codes that NtQuerySystemInformation() does for a misaligned buffer and a 
+buffer that's too small.
+
+Each process info's image name pointer is moved by how far the array was copied, so it points to the 
+same place in the buffer that it did in the synthetic array. The process infos are found by their 
+offsets in synthetic_spi rather than by walking the array, which may have been corrupted.
+
+returns an NTSTATUS code
+*/
+static LONG __stdcall synthetic_query( 
+	int infotype,   // in
+	void *buffer,   // out
+	ULONG buffer_bcount,   // in
+	ULONG *retlen   // out
+)
+{
+	unsigned i = 0;
+	
+	
+	*retlen = synthetic_spi.bcount;
+	
+	if( ( (size_t)buffer % sizeof( void * ) ) )
+		return (LONG)0x80000002L; // STATUS_DATATYPE_MISALIGNMENT
+	
+	if( buffer_bcount < synthetic_spi.bcount )
+		return (LONG)0xC0000004L; // STATUS_INFO_LENGTH_MISMATCH
+	
+	memcpy( buffer, synthetic_spi.spi, synthetic_spi.bcount );
+	
+	for( i = 0; i < synthetic_spi.process_count; ++i )
+	{
+		SYSTEM_PROCESS_INFORMATION *const spi = 
+			(SYSTEM_PROCESS_INFORMATION *)( (char *)buffer + synthetic_spi.offset[ i ] );
+		
+		spi->ImageName.Buffer = (PWSTR)( (size_t)spi->ImageName.Buffer 
+			+ ( (size_t)buffer - (size_t)synthetic_spi.spi ) );
+	}
+	
+	return 0;
+}
+
+
+
+/* callback_check_synthetic()
+Count a process' threads and check that the process and its threads are in the array.
+
+traverse_threads_batch() callback: this function is called for every SYSTEM_PROCESS_INFORMATION with 
+its array of 'count' SYSTEM_THREAD_INFORMATION.
+
+The behavior of a traverse_threads_batch() callback is documented in traverse_threads.txt.
+*/
+static int callback_check_synthetic( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+	const ULONG count,   // in
+	const DWORD flags   // in, optional
+)
+{
+	struct synthetic_info *const info = (struct synthetic_info *)cb_param;
+	const size_t sti_bcount = ( ( flags & TRAVERSE_FLAG_EXTENDED ) ? 
+		sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) : sizeof( SYSTEM_THREAD_INFORMATION ) );
+	const char *current = (const char *)sti;
+	ULONG i = 0;
+	
+	
+	++info->processes;
+	
+	if( ( (const char *)spi < info->begin )
+		|| ( (const char *)&spi->Threads > info->end )
+		|| ( count && ( (const char *)sti != (const char *)&spi->Threads ) )
+		|| ( !count && sti )
+		|| ( ( (size_t)( info->end - (const char *)&spi->Threads ) / sti_bcount ) < count )
+	)
+	{
+		++info->out_of_range;
+		return TRAVERSE_CALLBACK_CONTINUE;
+	}
+	
+	for( i = 0; i < count; ++i, current += sti_bcount )
+		info->tid_sum += (size_t)( (const SYSTEM_THREAD_INFORMATION *)current )->ClientId.UniqueThread;
+	
+	info->threads += count;
+	
+	return TRAVERSE_CALLBACK_CONTINUE;
+}
+
+
+
+/* fuzz_traverse()
+Fuzz traverse_threads() with synthetic and corrupted arrays of SYSTEM_PROCESS_INFORMATION structs.
+
+NtQuerySystemInformation() is replaced by synthetic_query() so that traverse_threads() can be run 
+on any array. Each iteration builds a synthetic array with a random number of processes and threads. 
+Half of the iterations corrupt the array by setting a random member of a random process info to a 
+random or nearby value, and some pass in a buffer that's too small.
+
+These are checked:
+traverse_threads_batch() returns only TRAVERSE_SUCCESS, TRAVERSE_ERROR_CALCULATION or 
+TRAVERSE_ERROR_BUFFER_TOO_SMALL, and a buffer that's too small is always reported.
+Every process info and thread info passed to the callback is in the array.
+An array that isn't corrupted is traversed successfully and every process and thread is counted, and 
+so is the process index.
+A buffer that was traversed successfully can be recycled with the same counts, and it can't be 
+recycled with a different size or without the same EXTENDED flag.
+A misaligned buffer returns TRAVERSE_ERROR_ALIGNMENT.
+
+'count' is the number of iterations. default 100000, it can't be more than 100000000.
+
+returns nonzero if all the checks passed
+*/
+unsigned __int64 fuzz_traverse( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned __int64 state = 0x5EED1E55;
+	unsigned __int64 iteration = 0, iterations = 0, failures = 0;
+	unsigned __int64 successes = 0, calculation_errors = 0, too_small = 0;
+	unsigned thread_count[ 64 ];
+	ULONG offset[ 64 ];
+	const size_t max_bcount = 1048576;
+	void *spi = NULL;
+	void *buffer = NULL;
+	int ret = TRAVERSE_ERROR_GENERAL;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+		iterations = 100000;
+	else if( !count || ( count > 100000000 ) )
+	{
+		printf( "The number of iterations must be from 1 to 100000000.\n" );
+		return FALSE;
+	}
+	else
+		iterations = count;
+	
+	spi = must_calloc( max_bcount, 1 );
+	buffer = must_calloc( max_bcount * 2, 1 );
+	
+	set_traverse_query( synthetic_query );
+	
+	for( iteration = 0; iteration < iterations; ++iteration )
+	{
+		const unsigned process_count = 1 + ( get_benchmark_random( &state ) % 64 );
+		const int corrupt = ( iteration & 1 );
+		DWORD flags = TRAVERSE_FLAG_INDEX;
+		unsigned __int64 expected_processes = 0, expected_threads = 0;
+		size_t bcount = 0;
+		int is_too_small = FALSE;
+		unsigned i = 0;
+		struct synthetic_info info;
+		
+		
+		if( ( get_benchmark_random( &state ) & 1 ) )
+			flags |= TRAVERSE_FLAG_EXTENDED;
+		
+		if( ( get_benchmark_random( &state ) & 1 ) )
+			flags |= TRAVERSE_FLAG_ZERO_THREADS_OK;
+		
+		for( i = 0; i < process_count; ++i )
+		{
+			/* a quarter of the processes have no threads. the first process always has a thread, 
+			like the idle process, so the array isn't smaller than a SYSTEM_PROCESS_INFORMATION struct.
+			*/
+			const unsigned r = get_benchmark_random( &state );
+			
+			thread_count[ i ] = ( ( r % 4 ) ? ( ( r >> 8 ) % 32 ) : 0 );
+			
+			if( !i && !thread_count[ i ] )
+				thread_count[ i ] = 1;
+			
+			if( thread_count[ i ] || ( flags & TRAVERSE_FLAG_ZERO_THREADS_OK ) )
+				++expected_processes;
+			
+			expected_threads += thread_count[ i ];
+		}
+		
+		synthetic_spi.spi = spi;
+		synthetic_spi.bcount = 
+			build_synthetic_spi( spi, max_bcount, thread_count, process_count, flags, offset );
+		synthetic_spi.offset = offset;
+		synthetic_spi.process_count = process_count;
+		FAIL_IF( !synthetic_spi.bcount );
+		
+		if( corrupt )
+		{
+			SYSTEM_PROCESS_INFORMATION *const target = (SYSTEM_PROCESS_INFORMATION *)
+				( (char *)spi + offset[ get_benchmark_random( &state ) % process_count ] );
+			const unsigned r = get_benchmark_random( &state );
+			
+			/* a random value, or a value near the original to find off by one errors */
+			const unsigned value = ( ( r & 1 ) ? get_benchmark_random( &state ) 
+				: ( ( get_benchmark_random( &state ) % 17 ) - 8 ) );
+			
+			switch( ( r >> 1 ) % 5 )
+			{
+				case 0:
+					target->NextEntryOffset = 
+						( ( r & 1 ) ? value : ( target->NextEntryOffset + value ) );
+					break;
+				case 1:
+					target->NumberOfThreads = 
+						( ( r & 1 ) ? value : ( target->NumberOfThreads + value ) );
+					break;
+				case 2:
+					target->ImageName.Length = (USHORT)( ( r & 1 ) ? value 
+						: ( target->ImageName.Length + value ) );
+					break;
+				case 3:
+					target->ImageName.Buffer = (PWSTR)( ( r & 1 ) ? (size_t)value 
+						: ( (size_t)target->ImageName.Buffer + (int)value ) );
+					break;
+				default:
+					/* a random byte anywhere in the array */
+					( (unsigned char *)spi )[ value % synthetic_spi.bcount ] = 
+						(unsigned char)( r >> 8 );
+					break;
+			}
+		}
+		
+		/* room for the array, the process index and the sanity struct. some buffers are too small. */
+		bcount = synthetic_spi.bcount + ( 64 * sizeof( struct traverse_index_entry ) ) 
+			+ ( sizeof( void * ) * 2 ) + TRAVERSE_RESERVED_BCOUNT 
+			+ ( get_benchmark_random( &state ) % 4096 );
+		
+		if( ( get_benchmark_random( &state ) % 16 ) == 0 )
+		{
+			/* smaller than the array but larger than the reserved space */
+			bcount = TRAVERSE_RESERVED_BCOUNT + 1 + ( get_benchmark_random( &state ) 
+				% ( synthetic_spi.bcount - TRAVERSE_RESERVED_BCOUNT - 1 ) );
+			is_too_small = TRUE;
+		}
+		
+		ZeroMemory( &info, sizeof( info ) );
+		info.begin = (const char *)buffer;
+		info.end = (const char *)buffer + synthetic_spi.bcount;
+		
+		ret = traverse_threads_batch( callback_check_synthetic, &info, buffer, bcount, flags, NULL );
+		
+		if( ret == TRAVERSE_SUCCESS )
+			++successes;
+		else if( ret == TRAVERSE_ERROR_CALCULATION )
+			++calculation_errors;
+		else if( ret == TRAVERSE_ERROR_BUFFER_TOO_SMALL )
+			++too_small;
+		
+		if( ( ( ret != TRAVERSE_SUCCESS ) 
+				&& ( ret != TRAVERSE_ERROR_CALCULATION ) 
+				&& ( ret != TRAVERSE_ERROR_BUFFER_TOO_SMALL ) 
+			)
+			|| ( is_too_small != ( ret == TRAVERSE_ERROR_BUFFER_TOO_SMALL ) )
+			|| info.out_of_range
+		)
+		{
+			printf( "Iteration %I64u: traverse_threads_batch() returned %s. Out of range: %I64u.\n", 
+				iteration, traverse_threads_retcode_to_cstr( ret ), info.out_of_range );
+			++failures;
+			continue;
+		}
+		
+		if( !corrupt && !is_too_small )
+		{
+			ULONG index_processes = 0, index_threads = 0;
+			
+			
+			if( ( ret != TRAVERSE_SUCCESS )
+				|| ( info.processes != expected_processes )
+				|| ( info.threads != expected_threads )
+				|| !get_traverse_index( buffer, bcount, &index_processes, &index_threads )
+				|| ( index_processes != process_count )
+				|| ( index_threads != expected_threads )
+			)
+			{
+				printf( "Iteration %I64u: the synthetic array wasn't traversed correctly.\n", 
+					iteration );
+				++failures;
+				continue;
+			}
+		}
+		
+		if( ret == TRAVERSE_SUCCESS )
+		{
+			struct synthetic_info recycled;
+			
+			
+			recycled = info;
+			recycled.processes = recycled.threads = recycled.tid_sum = 0;
+			
+			ret = traverse_threads_batch( callback_check_synthetic, &recycled, buffer, bcount, 
+				( flags | TRAVERSE_FLAG_RECYCLE ), NULL );
+			
+			if( ( ret != TRAVERSE_SUCCESS )
+				|| ( recycled.processes != info.processes )
+				|| ( recycled.threads != info.threads )
+				|| ( recycled.tid_sum != info.tid_sum )
+				|| recycled.out_of_range
+				|| ( traverse_threads_batch( callback_check_synthetic, &recycled, buffer, 
+					( bcount - sizeof( void * ) ), ( flags | TRAVERSE_FLAG_RECYCLE ), NULL ) 
+					!= TRAVERSE_ERROR_PARAMETER )
+				|| ( traverse_threads_batch( callback_check_synthetic, &recycled, buffer, bcount, 
+					( ( flags ^ TRAVERSE_FLAG_EXTENDED ) | TRAVERSE_FLAG_RECYCLE ), NULL ) 
+					!= TRAVERSE_ERROR_PARAMETER )
+			)
+			{
+				printf( "Iteration %I64u: the buffer wasn't recycled correctly.\n", iteration );
+				++failures;
+				continue;
+			}
+		}
+	}
+	
+	/* a misaligned buffer */
+	ret = traverse_threads_batch( callback_check_synthetic, NULL, 
+		( (char *)buffer + 1 ), max_bcount, 0, NULL );
+	
+	if( ret != TRAVERSE_ERROR_ALIGNMENT )
+	{
+		printf( "A misaligned buffer returned %s.\n", traverse_threads_retcode_to_cstr( ret ) );
+		++failures;
+	}
+	
+	set_traverse_query( NULL );
+	
+	printf( "Iterations: %I64u. Success: %I64u. Calculation error: %I64u. Buffer too small: %I64u.\n", 
+		iterations, successes, calculation_errors, too_small );
+	
+	if( failures )
+		MSG_ERROR( "traverse_threads() failed some of the checks." );
+	
+	free( buffer );
+	free( spi );
+	return !failures;
+}
+
+
+
+/* benchmark_parse()
+Benchmark how fast traverse_threads() parses a synthetic array of SYSTEM_PROCESS_INFORMATION structs.
+
+NtQuerySystemInformation() is replaced by synthetic_query() so that the array can be any size. Each 
+process has 16 threads. The array is traversed by original calls, which copy the array to the buffer 
+like NtQuerySystemInformation() would, and by recycle calls, which only parse it.
+
+'count' is the number of threads. default 10000 and then 100000, it can't be more than 1000000.
+
+returns nonzero if all the threads were counted
+*/
+unsigned __int64 benchmark_parse( 
+	unsigned __int64 count   // in, optional
+)
+{
+	unsigned i = 0, k = 0, n = 0, pass = 0, order = 0;
+	const unsigned passes = 50;
+	unsigned size[ 2 ];
+	unsigned size_count = 0;
+	int same = TRUE;
+	int ret = TRAVERSE_SUCCESS;
+	const DWORD flags = TRAVERSE_FLAG_EXTENDED;
+	
+	
+	if( count == UI64_MAX ) // user did not specify a parameter
+	{
+		size[ 0 ] = 10000;
+		size[ 1 ] = 100000;
+		size_count = 2;
+	}
+	else if( !count || ( count > 1000000 ) )
+	{
+		printf( "The number of threads must be from 1 to 1000000.\n" );
+		return FALSE;
+	}
+	else
+	{
+		size[ 0 ] = (unsigned)count;
+		size_count = 1;
+	}
+	
+	set_traverse_query( synthetic_query );
+	
+	printf( "Passes: %u. sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ): %u.\n", 
+		passes, (unsigned)sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) 
+	);
+	
+	for( k = 0; same && ( k < size_count ); ++k )
+	{
+		const unsigned process_count = ( size[ k ] + 15 ) / 16;
+		unsigned *thread_count = NULL;
+		ULONG *offset = NULL;
+		size_t bcount = 0;
+		void *spi = NULL;
+		void *buffer = NULL;
+		
+		
+		n = size[ k ];
+		
+		thread_count = must_calloc( process_count, sizeof( *thread_count ) );
+		offset = must_calloc( process_count, sizeof( *offset ) );
+		
+		for( i = 0; i < process_count; ++i )
+			thread_count[ i ] = ( ( ( i + 1 ) < process_count ) ? 16 : ( n - ( i * 16 ) ) );
+		
+		/* each process info's image name and padding takes less than its header again */
+		bcount = ( (size_t)n * sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) ) 
+			+ ( (size_t)process_count * sizeof( SYSTEM_PROCESS_INFORMATION ) * 2 );
+		
+		spi = must_calloc( bcount, 1 );
+		buffer = must_calloc( bcount + TRAVERSE_RESERVED_BCOUNT, 1 );
+		
+		synthetic_spi.spi = spi;
+		synthetic_spi.bcount = 
+			build_synthetic_spi( spi, bcount, thread_count, process_count, flags, offset );
+		synthetic_spi.offset = offset;
+		synthetic_spi.process_count = process_count;
+		FAIL_IF( !synthetic_spi.bcount );
+		
+		for( order = 0; same && ( order < 2 ); ++order )
+		{
+			double begin = 0, elapsed = 0;
+			struct synthetic_info info;
+			
+			
+			ZeroMemory( &info, sizeof( info ) );
+			info.begin = (const char *)buffer;
+			info.end = (const char *)buffer + synthetic_spi.bcount;
+			
+			begin = get_benchmark_time();
+			for( pass = 0; ( pass < passes ) && ( ret == TRAVERSE_SUCCESS ); ++pass )
+			{
+				ret = traverse_threads_batch( callback_check_synthetic, &info, 
+					buffer, ( bcount + TRAVERSE_RESERVED_BCOUNT ), 
+					( order ? ( flags | TRAVERSE_FLAG_RECYCLE ) : flags ), NULL );
+			}
+			elapsed = get_benchmark_time() - begin;
+			
+			same = ( ( ret == TRAVERSE_SUCCESS ) 
+				&& ( info.threads == ( (unsigned __int64)n * passes ) ) 
+				&& !info.out_of_range 
+			);
+			
+			printf( "%u threads, %s: %.0f threads/sec, %.1f MB/sec.\n", 
+				n, 
+				( order ? "recycle (parse only)" : "original (copy and parse)" ), 
+				( elapsed ? ( (double)n * passes / elapsed ) : 0 ), 
+				( elapsed ? ( (double)synthetic_spi.bcount * passes / elapsed / 1048576 ) : 0 ) 
+			);
+		}
+		
+		free( buffer );
+		free( spi );
+		free( offset );
+		free( thread_count );
+	}
+	
+	set_traverse_query( NULL );
+	
+	if( !same )
+		MSG_ERROR( "traverse_threads() didn't count all the synthetic threads." );
+	
+	return same;
+}
+
+
+
+const struct
+{
+	unsigned __int64 (*pfn)(unsigned __int64);
+	const WCHAR *name; // function name as it should be specified by the user
+	const WCHAR *description; // function description
+	const WCHAR *param_name; // parameter name
+	const BOOL param_required; // whether a parameter is required or not
+	const WCHAR *extra_info; // extra info 
+	const WCHAR *example_name; // an example of the command line parameters
+	const WCHAR *example_description; // a description of the example
+} function[] =
+{
+	{
+		print_handle_count,   // pfn
+		L"user",   // name
+		/* description */
+		L"Print counts of USER free, invalid, valid, menu, hook, and generic handles.",
+		L"seconds",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of seconds to enable polling.",   // extra_info
+		L"3",   // example_name
+		L"Print the count every 3 seconds."   // example_description
+	},
+	{
+		print_kernel_HOOK,   // pfn
+		L"hook",   // name
+		/* description */
+		L"Print a HOOK. Pass in a pointer to the kernel address of a HOOK.",
+		L"address",   // param_name
+		TRUE,   // param_required
+		NULL,   // extra_info
+		L"0xFE893E68 -v 6",   // example_name
+		L"Print HOOK at 0xFE893E68."   // example_description
+	},
+	{
+		print_kernel_HOOK_chain,   // pfn
+		L"chain",   // name
+		/* description */
+		L"Print a HOOK chain. Pass in a pointer to the kernel address of a HOOK.",
+		L"address",   // param_name
+		TRUE,   // param_required
+		NULL,   // extra_info
+		L"0xFE893E68",   // example_name
+		L"Print HOOK at 0xFE893E68 and any HOOKs after it in the chain.",   // example_description
+	},
+	{
+		print_kernel_HOOK_desktop_chains,   // pfn
+		L"deskhooks",   // name
+		/* description */
+		L"Print the HOOK chains in DESKTOPINFO.aphkStart[] for each attached to desktop.",
+		NULL,   // param_name
+		FALSE,   // param_required
+		L"Use the user-specified hook include/exclude list for filtering.",   // extra_info
+		L"-d -i WH_KEYBOARD_LL -v 1",   // example_name
+		L"Print the WH_KEYBOARD_LL chain on the current desktop.",   // example_description
+	},
+	{
+		dump_teb_wrapper,   // pfn
+		L"teb",   // name
+		/* description */
+		L"Dump to a file the thread environment block of a thread in another process.",
+		L"TID",   // param_name
+		TRUE,   // param_required
+		NULL,   // extra_info
+		L"148",   // example_name
+		L"Dump the TEB of thread id 148 to a file.",   // example_description
+	},
+	{
+		benchmark_gui_lookup,   // pfn
+		L"guibench",   // name
+		/* description */
+		L"Benchmark Win32ThreadInfo lookups in the gui index against qsort() and bsearch().",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of synthetic GUI threads. The default is 10000.",   // extra_info
+		L"50000 -t 50000",   // example_name
+		L"Benchmark lookups in 50000 synthetic GUI threads.",   // example_description
+	},
+	{
+		benchmark_desktop_range,   // pfn
+		L"rangebench",   // name
+		/* description */
+		L"Benchmark finding a HOOK's desktop in the desktop range array against the desktop list.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of synthetic desktops. The default is 16.",   // extra_info
+		L"64",   // example_name
+		L"Benchmark 64 synthetic desktops.",   // example_description
+	},
+	{
+		benchmark_handle_scan,   // pfn
+		L"scanbench",   // name
+		/* description */
+		L"Benchmark the scalar and SSE2 scans of a HANDLEENTRY table for HOOK entries.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of synthetic handle entries. The default is 65536.",   // extra_info
+		L"1000000",   // example_name
+		L"Benchmark scanning 1000000 synthetic handle entries.",   // example_description
+	},
+	{
+		benchmark_snapshot_file,   // pfn
+		L"filebench",   // name
+		/* description */
+		L"Benchmark writing a snapshot to a snapshot file and loading it.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of times to write the snapshot. The default is 100.",   // extra_info
+		L"1000",   // example_name
+		L"Write and load 1000 snapshots.",   // example_description
+	},
+	{
+		benchmark_output,   // pfn
+		L"outbench",   // name
+		/* description */
+		L"Benchmark printing HOOK notices to a memory output store.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of times to print the snapshot's HOOKs. The default is 100.",   // extra_info
+		L"1000",   // example_name
+		L"Print the HOOKs 1000 times.",   // example_description
+	},
+	{
+		benchmark_hook_compare,   // pfn
+		L"cmpbench",   // name
+		/* description */
+		L"Benchmark comparing HOOKs field by field against the masked compare.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of synthetic hooks. The default is 10000.",   // extra_info
+		L"100000 -c",   // example_name
+		L"Compare 100000 synthetic hooks and ignore lock counts.",   // example_description
+	},
+	{
+		benchmark_pool,   // pfn
+		L"poolbench",   // name
+		/* description */
+		L"Benchmark resolving work items on the worker pool, and check the partitioning.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of synthetic work items. The default is 100000.",   // extra_info
+		L"1000000 -j 8",   // example_name
+		L"Resolve 1000000 synthetic work items on 8 worker threads.",   // example_description
+	},
+	{
+		benchmark_arena,   // pfn
+		L"arenabench",   // name
+		/* description */
+		L"Benchmark allocating a snapshot's memory from its arena against the heap, and check the arena.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of passes. The default is 100.",   // extra_info
+		L"1000",   // example_name
+		L"Allocate and release a snapshot's memory 1000 times each way.",   // example_description
+	},
+	{
+		benchmark_hook_diff,   // pfn
+		L"diffbench",   // name
+		/* description */
+		L"Benchmark diffing desktops by their hook keys against by their hook structs.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of hooks. The default is 10000 and then 100000.",   // extra_info
+		L"50000",   // example_name
+		L"Diff a desktop with 50000 synthetic hooks both ways.",   // example_description
+	},
+	{
+		benchmark_hook_sort,   // pfn
+		L"sortbench",   // name
+		/* description */
+		L"Benchmark radix sorting a desktop's hooks against qsort(), and check the order.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of hooks. The default is 10000 and then 100000.",   // extra_info
+		L"50000",   // example_name
+		L"Sort a desktop with 50000 synthetic hooks both ways.",   // example_description
+	},
+	{
+		benchmark_traverse,   // pfn
+		L"traversebench",   // name
+		/* description */
+		L"Benchmark traversing threads with a callback per thread against per process.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of passes. The default is 1000.",   // extra_info
+		L"5000",   // example_name
+		L"Traverse the thread info 5000 times each way.",   // example_description
+	},
+	{
+		fuzz_traverse,   // pfn
+		L"traversefuzz",   // name
+		/* description */
+		L"Fuzz traverse_threads() with synthetic and corrupted process info arrays.",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of iterations. The default is 100000.",   // extra_info
+		L"1000000",   // example_name
+		L"Traverse 1000000 synthetic arrays, half of them corrupted.",   // example_description
+	},
+	{
+		benchmark_parse,   // pfn
+		L"parsebench",   // name
+		/* description */
+		L"Benchmark parsing a synthetic process info array with traverse_threads().",
+		L"count",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of threads. The default is 10000 and then 100000.",   // extra_info
+		L"50000",   // example_name
+		L"Parse a synthetic array of 50000 threads.",   // example_description
+	}
+};
+const unsigned function_count = sizeof( function ) / sizeof( function[ 0 ] );
+
+
+
+/* print_function_usage()
+Print an individual testmode function's usage.
+
+'i' is the index of the function in array
+*/
+static void print_function_usage( 
+	unsigned i   // in
+)
+{
+	FAIL_IF( i >= function_count );
+	FAIL_IF( !function[ i ].name );
+	
+	printf( "----------------------------------------------------------------------------[b]\n" );
+	
+	if( function[ i ].description )
+		printf( "%ls\n", function[ i ].description );
+	
+	printf( "%s -z %ls", G->prog->pszBasename, function[ i ].name );
+	if( function[ i ].param_name )
+	{
+		BOOL req = !!function[ i ].param_required;
+		printf( " " );
+		printf( "%c%ls%c", ( req ? '<' : '[' ), function[ i ].param_name, ( req ? '>' : ']' ) );
+	}
+	printf( "\n" );
+	
+	if( function[ i ].extra_info )
+	{
+		printf( "\n" );
+		printf( "%ls\n", function[ i ].extra_info );
+	}
+	
+	if( function[ i ].example_name )
+	{
+		printf( "\n" );
+		if( function[ i ].example_description )
+			printf( "Example: %ls\n", function[ i ].example_description );
+		
+		printf( "%s -z %ls %ls\n", 
+			G->prog->pszBasename, function[ i ].name, function[ i ].example_name 
+		);
+	}
+	
+	printf( "----------------------------------------------------------------------------[e]\n" );
+	printf( "\n" );
+	return;
+}
+
+
+
+/* print_testmode_usage()
+Print the testmode functions and their usage.
+*/
+void print_testmode_usage( void )
 {
 	unsigned i = 0;
 	
@@ -865,6 +3640,9 @@ int testmode( void )
 			printf( "\nUnknown function.\n", item->name );
 	}
 	
+	/* the test functions create and free snapshot stores. free the arena that was kept. */
+	free_spare_snapshot_arena();
+	
 	return TRUE;
 }
 
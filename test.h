@@ -53,6 +53,58 @@ unsigned __int64 dump_teb_wrapper(
 	unsigned __int64 tid   // in
 );
 
+unsigned __int64 benchmark_gui_lookup( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_desktop_range( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_handle_scan( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_snapshot_file( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_output( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_hook_compare( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_pool( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_arena( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_hook_diff( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_hook_sort( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_traverse( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 fuzz_traverse( 
+	unsigned __int64 count   // in, optional
+);
+
+unsigned __int64 benchmark_parse( 
+	unsigned __int64 count   // in, optional
+);
+
 void print_testmode_usage( void );
 
 int testmode( void );
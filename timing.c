@@ -0,0 +1,857 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a timing store, which times the phases of each poll.
+Each function is documented in the comment block above its definition.
+
+For now there is only one timing store implemented and it's a global store (G->timing).
+'G->timing' depends on the global program (G->prog) and configuration (G->config) stores.
+
+-
+create_timing_store()
+
+Create a timing store and its descendants or die.
+-
+
+-
+init_timing_store()
+
+Initialize a timing store.
+-
+
+-
+timing_ctrl_handler()
+
+Write the global timing store's summary when the console is closed or the program is interrupted.
+-
+
+-
+init_global_timing_store()
+
+Initialize the global timing store according to the user's configuration.
+-
+
+-
+get_timing_ticks()
+
+Get the current ticks of the performance counter, if the timing store is initialized.
+-
+
+-
+add_timing()
+
+Add the ticks since 'begin' to a phase of the current poll.
+-
+
+-
+add_timing_ticks()
+
+Add ticks that were counted elsewhere to a phase of the current poll.
+-
+
+-
+end_timing_poll()
+
+End the current poll and record the time taken by each of its phases.
+-
+
+-
+end_global_timing_poll()
+
+Flush the output and end the global timing store's current poll.
+-
+
+-
+get_timing_phase_name()
+
+Get the name of a timing phase.
+-
+
+-
+compare_ticks()
+
+Compare two tick counts.
+-
+
+-
+get_rolling_timing()
+
+Get the minimum, average and 99th percentile ticks of a phase in the most recent polls.
+-
+
+-
+ticks_to_ms()
+
+Convert ticks of the performance counter to milliseconds.
+-
+
+-
+print_timing_poll()
+
+Print the time taken by each phase in the most recent poll.
+-
+
+-
+print_timing_stats()
+
+Print the minimum, average and 99th percentile time of each phase in the most recent polls.
+-
+
+-
+write_timing_summary()
+
+Write the timing statistics of each phase to the timing store's file, as comma separated values.
+-
+
+-
+print_timing_store()
+
+Print a timing store.
+-
+
+-
+print_global_timing_store()
+
+Print the global timing store.
+-
+
+-
+free_timing_store()
+
+Free a timing store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "output.h"
+
+#include "timing.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+static BOOL WINAPI timing_ctrl_handler( 
+	DWORD dwCtrlType   // in
+);
+
+static int compare_ticks( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static unsigned get_rolling_timing( 
+	const struct timing *const store,   // in
+	const enum timing_phase phase,   // in
+	__int64 *const min,   // out
+	__int64 *const avg,   // out
+	__int64 *const p99   // out
+);
+
+static double ticks_to_ms( 
+	const struct timing *const store,   // in
+	const __int64 ticks   // in
+);
+
+
+
+/* create_timing_store()
+Create a timing store and its descendants or die.
+*/
+void create_timing_store( 
+	struct timing **const out   // out deref
+)
+{
+	struct timing *store = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a timing store */
+	store = must_calloc( 1, sizeof( *store ) );
+	
+	*out = store;
+	return;
+}
+
+
+
+/* init_timing_store()
+Initialize a timing store.
+
+'filename' is the name of the file that write_timing_summary() writes to, and is optional.
+
+returns nonzero on success
+*/
+int init_timing_store( 
+	struct timing *const store,   // in, out
+	const WCHAR *const filename   // in, optional
+)
+{
+	LARGE_INTEGER frequency;
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	if( !QueryPerformanceFrequency( &frequency ) || ( frequency.QuadPart <= 0 ) )
+	{
+		MSG_ERROR_GLE( "QueryPerformanceFrequency() failed." );
+		return FALSE;
+	}
+	
+	store->frequency = frequency.QuadPart;
+	
+	if( filename )
+	{
+		store->pwszFileName = must_wcsdup( filename );
+		InitializeCriticalSection( &store->lock );
+	}
+	
+	/* this store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* timing_ctrl_handler()
+Write the global timing store's summary when the console is closed or the program is interrupted.
+
+In monitor mode the program loops until it's interrupted, so this is the only chance to write the 
+summary. This is called on a thread created by the system.
+
+HandlerRoutine callback: this function is called by the system for each console control signal.
+
+returns FALSE so that the next handler, which by default exits the program, is called
+*/
+static BOOL WINAPI timing_ctrl_handler( 
+	DWORD dwCtrlType   // in
+)
+{
+	UNREFERENCED_PARAMETER( dwCtrlType );
+	
+	
+	if( G && G->timing && G->timing->init_time )
+		write_timing_summary( G->timing );
+	
+	return FALSE;
+}
+
+
+
+/* init_global_timing_store()
+Initialize the global timing store according to the user's configuration.
+
+The phases are only timed if the user specified verbosity level 3 or higher, or a timing summary 
+file with the 's' option. Otherwise the store isn't initialized, and add_timing() and 
+end_timing_poll() return without doing anything.
+
+This function must only be called from the main thread.
+'G->timing' depends on the global program (G->prog) and configuration (G->config) stores.
+*/
+void init_global_timing_store( void )
+{
+	FAIL_IF( !G );   // The global store must exist.
+	
+	FAIL_IF( G->timing->init_time );   // Fail if this store has already been initialized.
+	
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( ( G->config->verbose < 3 ) && !G->config->timing_file )
+		return;
+	
+	if( !init_timing_store( G->timing, G->config->timing_file ) )
+	{
+		MSG_FATAL( "init_timing_store() failed." );
+		exit( 1 );
+	}
+	
+	if( G->config->timing_file && !SetConsoleCtrlHandler( timing_ctrl_handler, TRUE ) )
+	{
+		MSG_WARNING_GLE( "SetConsoleCtrlHandler() failed." );
+		printf( "The timing summary will not be written if the program is interrupted.\n" );
+	}
+	
+	return;
+}
+
+
+
+/* get_timing_ticks()
+Get the current ticks of the performance counter, if the timing store is initialized.
+
+returns the ticks, or 0 if the timing store is NULL or not initialized
+*/
+__int64 get_timing_ticks( 
+	const struct timing *const store   // in, optional
+)
+{
+	LARGE_INTEGER count;
+	
+	
+	if( !store || !store->init_time )
+		return 0;
+	
+	QueryPerformanceCounter( &count );
+	return count.QuadPart;
+}
+
+
+
+/* add_timing()
+Add the ticks since 'begin' to a phase of the current poll.
+
+'begin' is the ticks returned by get_timing_ticks() or add_timing() when the phase began. The 
+return of this function can be passed as 'begin' for the phase that follows.
+
+If the current poll hasn't begun then it begins at 'begin'.
+
+returns the current ticks, or 0 if the timing store is NULL or not initialized
+*/
+__int64 add_timing( 
+	struct timing *const store,   // in, out, optional
+	const enum timing_phase phase,   // in
+	const __int64 begin   // in
+)
+{
+	__int64 now = 0;
+	
+	FAIL_IF( (unsigned)phase >= TIMING_TOTAL );
+	
+	
+	if( !store || !store->init_time )
+		return 0;
+	
+	now = get_timing_ticks( store );
+	
+	if( !store->current.poll )
+	{
+		store->current.poll = store->poll_count + 1;
+		store->begin = begin;
+	}
+	
+	store->current.ticks[ phase ] += now - begin;
+	return now;
+}
+
+
+
+/* add_timing_ticks()
+Add ticks that were counted elsewhere to a phase of the current poll.
+
+This is for a phase that wasn't timed by the main thread, for example a query made by the capture 
+thread. 'ticks' is the number of ticks of the performance counter that the phase took.
+
+If the current poll hasn't begun then it begins now.
+*/
+void add_timing_ticks( 
+	struct timing *const store,   // in, out, optional
+	const enum timing_phase phase,   // in
+	const __int64 ticks   // in
+)
+{
+	FAIL_IF( (unsigned)phase >= TIMING_TOTAL );
+	
+	
+	if( !store || !store->init_time )
+		return;
+	
+	if( !store->current.poll )
+	{
+		store->current.poll = store->poll_count + 1;
+		store->begin = get_timing_ticks( store );
+	}
+	
+	store->current.ticks[ phase ] += ticks;
+	return;
+}
+
+
+
+/* end_timing_poll()
+End the current poll and record the time taken by each of its phases.
+
+The current poll's record is added to the record array, overwriting the oldest record if the array 
+is full, and to the overall statistics. If no phase of the current poll was timed then this function 
+returns without doing anything.
+*/
+void end_timing_poll( 
+	struct timing *const store   // in, out, optional
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !store || !store->init_time || !store->current.poll )
+		return;
+	
+	store->current.ticks[ TIMING_TOTAL ] = get_timing_ticks( store ) - store->begin;
+	
+	if( store->pwszFileName )
+		EnterCriticalSection( &store->lock );
+	
+	for( i = 0; i < TIMING_PHASE_COUNT; ++i )
+	{
+		const __int64 ticks = store->current.ticks[ i ];
+		
+		if( !store->poll_count || ( ticks < store->min[ i ] ) )
+			store->min[ i ] = ticks;
+		
+		if( !store->poll_count || ( ticks > store->max[ i ] ) )
+			store->max[ i ] = ticks;
+		
+		store->sum[ i ] += ticks;
+	}
+	
+	store->record[ store->record_next ] = store->current;
+	store->record_next = ( store->record_next + 1 ) % TIMING_WINDOW;
+	
+	if( store->record_count < TIMING_WINDOW )
+		++store->record_count;
+	
+	++store->poll_count;
+	
+	if( store->pwszFileName )
+		LeaveCriticalSection( &store->lock );
+	
+	ZeroMemory( &store->current, sizeof( store->current ) );
+	return;
+}
+
+
+
+/* end_global_timing_poll()
+Flush the output and end the global timing store's current poll.
+
+This is called at the end of each poll instead of output_flush(). The flush is timed as part of the 
+output phase. If the user specified verbosity level 3 or higher then the time taken by each phase of 
+the poll is printed, and every TIMING_WINDOW polls the statistics of the most recent polls, and the 
+output is flushed again.
+*/
+void end_global_timing_poll( void )
+{
+	__int64 ticks = 0;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	
+	
+	ticks = get_timing_ticks( G->timing );
+	output_flush();
+	
+	if( !G->timing->init_time )
+		return;
+	
+	add_timing( G->timing, TIMING_OUTPUT, ticks );
+	end_timing_poll( G->timing );
+	
+	if( G->config->verbose >= 3 )
+	{
+		print_timing_poll( G->timing );
+		
+		if( !( G->timing->poll_count % TIMING_WINDOW ) )
+			print_timing_stats( G->timing );
+		
+		output_flush();
+	}
+	
+	return;
+}
+
+
+
+/* get_timing_phase_name()
+Get the name of a timing phase.
+
+returns the name, which is a single word in lowercase
+*/
+const char *get_timing_phase_name( 
+	const enum timing_phase phase   // in
+)
+{
+	switch( phase )
+	{
+		case TIMING_QUERY:
+			return "query";
+		case TIMING_RECYCLE:
+			return "recycle";
+		case TIMING_TEB:
+			return "teb";
+		case TIMING_SCAN:
+			return "scan";
+		case TIMING_COPY:
+			return "copy";
+		case TIMING_SORT:
+			return "sort";
+		case TIMING_DIFF:
+			return "diff";
+		case TIMING_OUTPUT:
+			return "output";
+		case TIMING_TOTAL:
+			return "total";
+		default:
+			return "unknown";
+	}
+}
+
+
+
+/* compare_ticks()
+Compare two tick counts.
+
+qsort() callback: this function is called to sort an array of tick counts
+
+returns -1 if p1's ticks are less than p2's ticks
+returns 1 if p1's ticks are greater than p2's ticks
+returns 0 if p1's ticks are the same as p2's ticks
+*/
+static int compare_ticks( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const __int64 a = *(const __int64 *)p1;
+	const __int64 b = *(const __int64 *)p2;
+	
+	
+	if( a < b )
+		return -1;
+	else if( a > b )
+		return 1;
+	else
+		return 0;
+}
+
+
+
+/* get_rolling_timing()
+Get the minimum, average and 99th percentile ticks of a phase in the most recent polls.
+
+The most recent polls are the ones in the record array, at most TIMING_WINDOW. The 99th percentile 
+is the nearest rank, so until there are 100 records it's the maximum.
+
+returns the number of polls, or 0 if there are none in which case the ticks are all set to 0
+*/
+static unsigned get_rolling_timing( 
+	const struct timing *const store,   // in
+	const enum timing_phase phase,   // in
+	__int64 *const min,   // out
+	__int64 *const avg,   // out
+	__int64 *const p99   // out
+)
+{
+	__int64 ticks[ TIMING_WINDOW ];
+	__int64 sum = 0;
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( (unsigned)phase >= TIMING_PHASE_COUNT );
+	FAIL_IF( !min );
+	FAIL_IF( !avg );
+	FAIL_IF( !p99 );
+	FAIL_IF( store->record_count > TIMING_WINDOW );
+	
+	
+	*min = *avg = *p99 = 0;
+	
+	if( !store->record_count )
+		return 0;
+	
+	for( i = 0; i < store->record_count; ++i )
+	{
+		ticks[ i ] = store->record[ i ].ticks[ phase ];
+		sum += ticks[ i ];
+	}
+	
+	qsort( ticks, store->record_count, sizeof( *ticks ), compare_ticks );
+	
+	*min = ticks[ 0 ];
+	*avg = sum / store->record_count;
+	*p99 = ticks[ ( ( store->record_count * 99 ) + 99 ) / 100 - 1 ];
+	
+	return store->record_count;
+}
+
+
+
+/* ticks_to_ms()
+Convert ticks of the performance counter to milliseconds.
+
+returns the milliseconds
+*/
+static double ticks_to_ms( 
+	const struct timing *const store,   // in
+	const __int64 ticks   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->frequency <= 0 );
+	
+	
+	return (double)ticks * 1000.0 / (double)store->frequency;
+}
+
+
+
+/* print_timing_poll()
+Print the time taken by each phase in the most recent poll.
+
+if 'store' is NULL or no poll has ended this function returns without having printed anything.
+*/
+void print_timing_poll( 
+	const struct timing *const store   // in
+)
+{
+	const struct timing_record *record = NULL;
+	unsigned i = 0;
+	
+	
+	if( !store || !store->init_time || !store->record_count )
+		return;
+	
+	record = &store->record[ ( store->record_next + TIMING_WINDOW - 1 ) % TIMING_WINDOW ];
+	
+	printf( "Poll %I64u timing (ms):", record->poll );
+	
+	for( i = 0; i < TIMING_PHASE_COUNT; ++i )
+	{
+		printf( "%s %s %.3f", 
+			( i ? "," : "" ), 
+			get_timing_phase_name( (enum timing_phase)i ), 
+			ticks_to_ms( store, record->ticks[ i ] ) 
+		);
+	}
+	
+	printf( ".\n" );
+	
+	return;
+}
+
+
+
+/* print_timing_stats()
+Print the minimum, average and 99th percentile time of each phase in the most recent polls.
+
+if 'store' is NULL or no poll has ended this function returns without having printed anything.
+*/
+void print_timing_stats( 
+	const struct timing *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !store || !store->init_time || !store->record_count )
+		return;
+	
+	printf( "Timing of the last %u of %I64u polls (ms):\n", store->record_count, store->poll_count );
+	printf( "%-8s %12s %12s %12s %12s\n", "phase", "min", "avg", "p99", "max overall" );
+	
+	for( i = 0; i < TIMING_PHASE_COUNT; ++i )
+	{
+		__int64 min = 0, avg = 0, p99 = 0;
+		
+		
+		get_rolling_timing( store, (enum timing_phase)i, &min, &avg, &p99 );
+		
+		printf( "%-8s %12.3f %12.3f %12.3f %12.3f\n", 
+			get_timing_phase_name( (enum timing_phase)i ), 
+			ticks_to_ms( store, min ), 
+			ticks_to_ms( store, avg ), 
+			ticks_to_ms( store, p99 ), 
+			ticks_to_ms( store, store->max[ i ] ) 
+		);
+	}
+	
+	return;
+}
+
+
+
+/* write_timing_summary()
+Write the timing statistics of each phase to the timing store's file, as comma separated values.
+
+The file is overwritten if it exists. The first line is the header:
+phase,polls,min_us,avg_us,max_us,recent_polls,recent_min_us,recent_avg_us,recent_p99_us
+and then there is a line for each phase, including the total. The times are in microseconds. The 
+overall statistics are for every poll and the recent statistics are for the most recent polls, at 
+most TIMING_WINDOW.
+
+The summary is only written once. This can be called from any thread.
+
+returns nonzero on success, or if the summary has already been written or there is no file
+*/
+int write_timing_summary( 
+	struct timing *const store   // in, out
+)
+{
+	FILE *fp = NULL;
+	unsigned i = 0;
+	int ret = TRUE;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The timing store must be initialized.
+	
+	
+	if( !store->pwszFileName )
+		return TRUE;
+	
+	EnterCriticalSection( &store->lock );
+	
+	if( store->is_summary_written )
+		goto cleanup;
+	
+	fp = _wfopen( store->pwszFileName, L"w" );
+	if( !fp )
+	{
+		MSG_ERROR( "_wfopen() failed." );
+		printf( "file: %ls\n", store->pwszFileName );
+		ret = FALSE;
+		goto cleanup;
+	}
+	
+	fprintf( fp, "phase,polls,min_us,avg_us,max_us,recent_polls,recent_min_us,recent_avg_us,"
+		"recent_p99_us\n" 
+	);
+	
+	for( i = 0; i < TIMING_PHASE_COUNT; ++i )
+	{
+		__int64 min = 0, avg = 0, p99 = 0;
+		unsigned count = 0;
+		
+		
+		count = get_rolling_timing( store, (enum timing_phase)i, &min, &avg, &p99 );
+		
+		fprintf( fp, "%s,%I64u,%.1f,%.1f,%.1f,%u,%.1f,%.1f,%.1f\n", 
+			get_timing_phase_name( (enum timing_phase)i ), 
+			store->poll_count, 
+			ticks_to_ms( store, store->min[ i ] ) * 1000, 
+			( store->poll_count 
+				? ( ticks_to_ms( store, store->sum[ i ] ) * 1000 / (double)store->poll_count ) 
+				: 0 
+			), 
+			ticks_to_ms( store, store->max[ i ] ) * 1000, 
+			count, 
+			ticks_to_ms( store, min ) * 1000, 
+			ticks_to_ms( store, avg ) * 1000, 
+			ticks_to_ms( store, p99 ) * 1000 
+		);
+	}
+	
+	if( fclose( fp ) )
+	{
+		MSG_ERROR( "fclose() failed." );
+		printf( "file: %ls\n", store->pwszFileName );
+		ret = FALSE;
+		goto cleanup;
+	}
+	
+	store->is_summary_written = TRUE;
+	
+cleanup:
+	LeaveCriticalSection( &store->lock );
+	return ret;
+}
+
+
+
+/* print_timing_store()
+Print a timing store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_timing_store( 
+	const struct timing *const store   // in
+)
+{
+	const char *const objname = "Timing Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->frequency: %I64d\n", store->frequency );
+	printf( "store->poll_count: %I64u\n", store->poll_count );
+	printf( "store->record_count: %u\n", store->record_count );
+	printf( "store->record_next: %u\n", store->record_next );
+	printf( "store->pwszFileName: %ls\n", 
+		( store->pwszFileName ? store->pwszFileName : L"<NULL>" ) 
+	);
+	printf( "store->is_summary_written: %s\n", ( store->is_summary_written ? "TRUE" : "FALSE" ) );
+	
+	if( store->init_time )
+		print_timing_stats( store );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* print_global_timing_store()
+Print the global timing store.
+*/
+void print_global_timing_store( void )
+{
+	print_timing_store( G->timing );
+	return;
+}
+
+
+
+/* free_timing_store()
+Free a timing store and all its descendants.
+
+this function then sets the timing store pointer to NULL and returns
+if( !in || !*in ) then this function returns.
+*/
+void free_timing_store( 
+	struct timing **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->pwszFileName )
+	{
+		DeleteCriticalSection( &(*in)->lock );
+		free( (*in)->pwszFileName );
+	}
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,214 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TIMING_H
+#define _TIMING_H
+
+#include <windows.h>
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The phases of taking and printing a snapshot that are timed.
+*/
+enum timing_phase
+{
+	/* NtQuerySystemInformation() writing the spi buffer, in traverse_threads(). if the spi was 
+	captured then this is the capture thread's query, which overlaps the wait before the poll.
+	*/
+	TIMING_QUERY, 
+	
+	/* waiting for a captured spi buffer and checking and indexing it so it can be recycled, in 
+	traverse_threads(). this is zero when the spi isn't captured.
+	*/
+	TIMING_RECYCLE, 
+	
+	/* finding the GUI threads by reading each thread's TEB, including any worker threads */
+	TIMING_TEB, 
+	
+	/* scanning the handle table for the HANDLEENTRYs of HOOKs */
+	TIMING_SCAN, 
+	
+	/* copying the HANDLEENTRYs and HOOKs to each desktop's hook array */
+	TIMING_COPY, 
+	
+	/* sorting each desktop's hook array and checking it for duplicate or invalid pHeads */
+	TIMING_SORT, 
+	
+	/* diffing the desktop hook lists of the previous and current snapshots */
+	TIMING_DIFF, 
+	
+	/* printing the diff events and flushing the output */
+	TIMING_OUTPUT, 
+	
+	/* the whole poll, from the beginning of its first timed phase until end_timing_poll(). this 
+	includes anything that isn't timed as a phase, and is only set by end_timing_poll().
+	*/
+	TIMING_TOTAL, 
+	
+	TIMING_PHASE_COUNT
+};
+
+
+
+/** The time taken by each phase in a poll.
+A poll is one snapshot taken and printed, or when polling is disabled the only snapshot.
+*/
+struct timing_record
+{
+	/* the number of this poll. the first poll is 1. */
+	unsigned __int64 poll;
+	
+	/* the ticks of the performance counter that each phase took in this poll */
+	__int64 ticks[ TIMING_PHASE_COUNT ];
+};
+
+
+
+/** The timing store.
+The timing store holds the time taken by each phase of the most recent polls, which is used for the 
+rolling statistics, and the overall statistics since the store was initialized.
+
+The phases are timed with the performance counter. A phase's time is added to the current poll by 
+add_timing(), which can be called more than once for each phase, for example when a snapshot is 
+retried. The current poll is ended by end_timing_poll().
+*/
+struct timing
+{
+	/* the frequency of the performance counter, in ticks per second */
+	__int64 frequency;
+	
+	/* the current poll. its 'poll' is zero until its first phase is timed. */
+	struct timing_record current;
+	
+	/* the ticks of the performance counter when the current poll began */
+	__int64 begin;
+	
+	/* an array of the records of the most recent polls. once the array is full the oldest record 
+	is overwritten by the next one.
+	*/
+	#define TIMING_WINDOW   100
+	struct timing_record record[ TIMING_WINDOW ];
+	
+	/* the number of records written to the record array, up to TIMING_WINDOW */
+	unsigned record_count;
+	
+	/* the index in the record array of the next record to be written */
+	unsigned record_next;
+	
+	/* the number of polls that have been ended */
+	unsigned __int64 poll_count;
+	
+	/* the overall minimum, maximum and total ticks of each phase for every poll */
+	__int64 min[ TIMING_PHASE_COUNT ];
+	__int64 max[ TIMING_PHASE_COUNT ];
+	__int64 sum[ TIMING_PHASE_COUNT ];
+	
+	/* the name of the file to write the summary to when the program exits, or NULL */
+	WCHAR *pwszFileName;   // must_wcsdup(), free()
+	
+	/* nonzero if the summary has been written to the file */
+	BOOL is_summary_written;
+	
+	/* the summary can be written by the console control handler while the main thread is ending 
+	a poll. this is only initialized if there's a file name.
+	*/
+	CRITICAL_SECTION lock;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in timing.c
+*/
+void create_timing_store( 
+	struct timing **const out   // out deref
+);
+
+int init_timing_store( 
+	struct timing *const store,   // in, out
+	const WCHAR *const filename   // in, optional
+);
+
+void init_global_timing_store( void );
+
+__int64 get_timing_ticks( 
+	const struct timing *const store   // in, optional
+);
+
+__int64 add_timing( 
+	struct timing *const store,   // in, out, optional
+	const enum timing_phase phase,   // in
+	const __int64 begin   // in
+);
+
+void add_timing_ticks( 
+	struct timing *const store,   // in, out, optional
+	const enum timing_phase phase,   // in
+	const __int64 ticks   // in
+);
+
+void end_timing_poll( 
+	struct timing *const store   // in, out, optional
+);
+
+void end_global_timing_poll( void );
+
+const char *get_timing_phase_name( 
+	const enum timing_phase phase   // in
+);
+
+void print_timing_poll( 
+	const struct timing *const store   // in
+);
+
+void print_timing_stats( 
+	const struct timing *const store   // in
+);
+
+int write_timing_summary( 
+	struct timing *const store   // in, out
+);
+
+void print_timing_store( 
+	const struct timing *const store   // in
+);
+
+void print_global_timing_store( void );
+
+void free_timing_store( 
+	struct timing **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _TIMING_H
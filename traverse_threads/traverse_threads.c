@@ -19,10 +19,54 @@ along with GetHooks.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 /**
-This file contains traverse_threads(). It is documented in traverse_threads.txt
+This file contains traverse_threads_batch() and traverse_threads(). They are documented in 
+traverse_threads.txt
+
+This file also contains the function that replaces NtQuerySystemInformation() for testing, the adapter 
+that traverse_threads() uses to pass each thread to its callback, and the functions that read the 
+process index that traverse_threads() writes to a buffer when TRAVERSE_FLAG_INDEX is specified. Each 
+of those functions is documented in the comment block above its definition.
+
+-
+set_traverse_query()
+
+Replace the function that traverse_threads() calls to query the system process information.
+-
+
+-
+callback_adapter()
+
+traverse_threads_batch() callback: call a traverse_threads() callback for each thread in a process.
+-
+
+-
+get_sanity_index()
+
+Get the process index and a copy of the sanity struct that traverse_threads() wrote to a buffer.
+-
+
+-
+get_traverse_index()
+
+Get the process index that traverse_threads() wrote to a buffer.
+-
+
+-
+get_indexed_process()
+
+Get a process info from a buffer by its ordinal.
+-
+
+-
+get_indexed_thread()
+
+Get a thread info from a buffer by its ordinal.
+-
+
 */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <windows.h>
 
 #include "nt_independent_sysprocinfo_structs.h"
@@ -32,16 +76,130 @@ This file contains traverse_threads(). It is documented in traverse_threads.txt
 
 
 
-/** traverse_threads()
-This function is well documented in traverse_threads.txt 
+/** special sanity struct for internal use only.
+this struct is used for validation on RECYCLE calls.
+it can also be used for diagnostic purposes. if a user sends me their 
+buffer I can easily RECYCLE it and see what went wrong.
+this sanity struct is not written to the user's buffer on return from a RECYCLE call.
+only on original calls (!RECYCLE) will this struct be written to the buffer.
 */
-int traverse_threads( 
+struct traverse_sanity
+{
+	/* the recycle_verify struct holds the information that must be verified as 
+	the exact same on a RECYCLE call.
+	This struct must be the first member of the sanity struct.
+	*/
+	struct
+	{
+		/* some magic number to signify the beginning of the sanity struct.
+		this must be the first member.
+		*/
+		char magic_begin[ TRAVERSE_MAGIC_LEN ];
+		
+		/* the sizeof the sanity struct */
+		DWORD sanity_size;
+		
+		/* these are the same as those parameters passed in to traverse_threads() */
+		void *buffer;
+		size_t buffer_bcount;
+	} recycle_must_verify;
+	
+	/* the rest of the sanity struct is just any variable I need available across calls, 
+	or for diagnostic purposes. Some of these variables might need to be verified, 
+	but not necessarily be exactly the same on a RECYCLE call.
+	*/
+	
+	/* a copy of 'flags' */
+	DWORD flags;
+	
+	/* a copy of 'retlen' */
+	ULONG retlen;
+	
+	/* a copy of 'error_code' */
+	int error_code;
+	
+	/* a copy of '*status' */
+	LONG status;
+	
+	/* a copy of 'dwVersion' */
+	DWORD dwVersion;
+	
+	/* a copy of 'reserved' */
+	void *reserved;
+	
+	/* the offset in bytes from the start of the buffer to the process index, or 0 if there is no 
+	index. the index is only written on a successful original call with TRAVERSE_FLAG_INDEX.
+	*/
+	ULONG index_offset;
+	
+	/* the number of processes and threads in the index */
+	ULONG index_process_count;
+	ULONG index_thread_count;
+	
+	/* some magic number to signify the end of struct.
+	this must be the last member. this must also be verified.
+	*/
+	char magic_end[ TRAVERSE_MAGIC_LEN ]; 
+};
+
+
+
+/** function pointer for NtQuerySystemInformation.
+this is resolved from ntdll the first time it's needed, unless set_traverse_query() has set it.
+*/
+static NTSTATUS (__stdcall *NtQuerySystemInformation)(
+	SYSTEM_INFORMATION_CLASS SystemInformationClass,
+	PVOID SystemInformation,
+	ULONG SystemInformationLength,
+	PULONG ReturnLength
+);
+
+
+
+/** stuff to be passed to callback_adapter().
+this is the callback that was passed in to traverse_threads() and its cb_param.
+*/
+struct traverse_adapter
+{
 	int ( __cdecl *callback )( 
 		void *cb_param,   // in, out, optional
 		SYSTEM_PROCESS_INFORMATION *const spi,   // in
 		SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
 		const ULONG remaining,   // in
 		const DWORD flags   // in, optional
+	);
+	
+	void *cb_param;
+};
+
+
+
+static int __cdecl callback_adapter( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+	const ULONG count,   // in
+	const DWORD flags   // in, optional
+);
+
+static struct traverse_index_entry *get_sanity_index( 
+	void *buffer,   // in
+	size_t buffer_bcount,   // in
+	struct traverse_sanity *sanity   // out
+);
+
+
+
+/** traverse_threads_batch()
+This function is well documented in traverse_threads.txt 
+*/
+int traverse_threads_batch( 
+	int ( __cdecl *callback )( 
+		void *cb_param,   // in, out, optional
+		SYSTEM_PROCESS_INFORMATION *const spi,   // in
+		SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+		const ULONG count,   // in
+		const DWORD flags   // in, optional
 	),   // in, optional
 	void *cb_param,   // in, out, optional
 	void *buffer,   // in, out, optional
@@ -55,14 +213,6 @@ int traverse_threads(
 	/* only print debug information when debugging */
 	#define dbg_printf   if( ( flags & TRAVERSE_FLAG_DEBUG ) )printf
 	
-	/* function pointer for NtQuerySystemInformation */
-	static NTSTATUS (__stdcall *NtQuerySystemInformation)(
-		SYSTEM_INFORMATION_CLASS SystemInformationClass,
-		PVOID SystemInformation,
-		ULONG SystemInformationLength,
-		PULONG ReturnLength
-	);
-	
 	/* a pointer to the current spi struct */
 	SYSTEM_PROCESS_INFORMATION *spi = NULL;
 	
@@ -94,63 +244,22 @@ int traverse_threads(
 	/* error_code is the variable returned by this function */
 	int error_code = TRAVERSE_ERROR_GENERAL;
 	
-	
-	/** special sanity struct for internal use only.
-	this struct is used for validation on RECYCLE calls.
-	it can also be used for diagnostic purposes. if a user sends me their 
-	buffer I can easily RECYCLE it and see what went wrong.
-	this sanity struct is not written to the user's buffer on return from a RECYCLE call.
-	only on original calls (!RECYCLE) will this struct be written to the buffer.
+	/* if TRAVERSE_FLAG_INDEX on an original call then this points to the process index in the 
+	unused space of the buffer, and index_max is the number of entries that fit there.
 	*/
-	struct 
-	{
-		/* the recycle_verify struct holds the information that must be verified as 
-		the exact same on a RECYCLE call.
-		This struct must be the first member of the sanity struct.
-		*/
-		struct
-		{
-			/* some magic number to signify the beginning of the sanity struct.
-			this must be the first member.
-			*/
-			char magic_begin[ TRAVERSE_MAGIC_LEN ];
-			
-			/* the sizeof the sanity struct */
-			DWORD sanity_size;
-			
-			/* these are the same as those parameters passed in to this function */
-			void *buffer;
-			size_t buffer_bcount;
-		} recycle_must_verify;
-		
-		/* the rest of the sanity struct is just any variable I need available across calls, 
-		or for diagnostic purposes. Some of these variables might need to be verified, 
-		but not necessarily be exactly the same on a RECYCLE call.
-		*/
-		
-		/* a copy of 'flags' */
-		DWORD flags;
-		
-		/* a copy of 'retlen' */
-		ULONG retlen;
-		
-		/* a copy of 'error_code' */
-		int error_code;
-		
-		/* a copy of '*status' */
-		LONG status;
-		
-		/* a copy of 'dwVersion' */
-		DWORD dwVersion;
-		
-		/* a copy of 'reserved' */
-		void *reserved;
-		
-		/* some magic number to signify the end of struct.
-		this must be the last member. this must also be verified.
-		*/
-		char magic_end[ TRAVERSE_MAGIC_LEN ]; 
-	} sanity;
+	struct traverse_index_entry *index = NULL;
+	ULONG index_max = 0;
+	
+	/* the number of processes and threads written to the process index */
+	ULONG index_process_count = 0;
+	ULONG index_thread_count = 0;
+	
+	
+	/* special sanity struct for internal use only. see struct traverse_sanity above */
+	struct traverse_sanity sanity;
+	
+	/* the default callback and its cb_param if there's no callback and no output buffer */
+	struct traverse_adapter adapter;
 	
 	/* pointer to the start of the reserved space in buffer. 
 	the sanity struct will stored in the reserved space on an original call
@@ -160,6 +269,8 @@ int traverse_threads(
 	/* the sanity struct's memory must be zeroed to make sure padding is zeroed */
 	ZeroMemory( &sanity, sizeof( sanity ) );
 	
+	ZeroMemory( &adapter, sizeof( adapter ) );
+	
 	/* set all 'sanity.recycle_must_verify' members to prepare for sanity check */
 	memcpy( 
 		sanity.recycle_must_verify.magic_begin, 
@@ -270,8 +381,11 @@ int traverse_threads(
 	*/
 	if( !callback && ( !buffer || ( flags & TRAVERSE_FLAG_RECYCLE ) ) )
 	{
-		callback = callback_print_thread_state;
-		cb_param = &sanity.dwVersion;
+		adapter.callback = callback_print_thread_state;
+		adapter.cb_param = &sanity.dwVersion;
+		
+		callback = callback_adapter;
+		cb_param = &adapter;
 	}
 	
 	
@@ -341,6 +455,15 @@ int traverse_threads(
 		buffer_bcount = memory_bcount;
 	}
 	
+	/* the sanity struct must fit in the space callers are told is reserved for it */
+	if( sizeof( sanity ) > TRAVERSE_RESERVED_BCOUNT )
+	{
+		dbg_printf( "Error: sizeof( sanity ) is larger than TRAVERSE_RESERVED_BCOUNT.\n" );
+		
+		error_code = TRAVERSE_ERROR_GENERAL;
+		goto quit;
+	}
+	
 	/* make sure there's space to allow for sanity struct contents at the end of the buffer */
 	if( buffer_bcount <= sizeof( sanity ) )
 	{
@@ -490,6 +613,27 @@ int traverse_threads(
 	
 	
 	
+	/** if TRAVERSE_FLAG_INDEX was specified on an original call then the process index is written 
+	to the unused space between the array of SYSTEM_PROCESS_INFORMATION structs and the reserved 
+	space. a temporary buffer is freed on return so it isn't indexed.
+	*/
+	if( ( flags & TRAVERSE_FLAG_INDEX ) && !( flags & TRAVERSE_FLAG_RECYCLE ) && !memory )
+	{
+		/* the index begins at the first pointer-aligned address after the array */
+		size_t index_begin = 
+			( (size_t)buffer + retlen + ( sizeof( size_t ) - 1 ) ) & ~( sizeof( size_t ) - 1 );
+		
+		if( index_begin < (size_t)reserved )
+		{
+			index = (struct traverse_index_entry *)index_begin;
+			index_max = (ULONG)( ( (size_t)reserved - index_begin ) / sizeof( *index ) );
+		}
+		
+		dbg_printf( "Process index: space for %lu entries.\n", index_max );
+	}
+	
+	
+	
 	/** main loop.
 	traverse the SYSTEM_THREAD_INFORMATION struct array in each 
 	SYSTEM_PROCESS_INFORMATION struct.
@@ -697,8 +841,12 @@ int traverse_threads(
 			/* position of terminating null in ImageName.Buffer */
 			unsigned epos = spi->ImageName.Length / sizeof( WCHAR );
 			
-			/* warn if there's no terminating null */
-			if( spi->ImageName.Buffer[ epos ] )
+			/* warn if there's no terminating null. 
+			the terminating null is only read if it's in the current process info (spi).
+			*/
+			if( ( ( (size_t)&spi->ImageName.Buffer[ epos ] + sizeof( WCHAR ) ) > spi_end )
+				|| spi->ImageName.Buffer[ epos ] 
+			)
 				dbg_printf( "Warning: <ImageName.Buffer[ %hu ] != 0>\n", epos );
 			
 			dbg_printf( "ImageName.Buffer: %.*ls\n", (int)epos, spi->ImageName.Buffer );
@@ -759,87 +907,87 @@ int traverse_threads(
 		
 		
 		
-		/** callback if there are threads to be processed, or zero threads is ok
+		/** add the process info to the process index. the index is abandoned if it runs out of space.
+		*/
+		if( index )
+		{
+			if( index_process_count < index_max )
+			{
+				index[ index_process_count ].offset = (ULONG)( (size_t)spi - (size_t)buffer );
+				index[ index_process_count ].thread_count = threads_ecount;
+				index[ index_process_count ].first_thread = index_thread_count;
+				
+				++index_process_count;
+				index_thread_count += threads_ecount;
+			}
+			else
+			{
+				dbg_printf( "Warning: not enough space in the buffer for the process index.\n" );
+				index = NULL;
+			}
+		}
+		
+		
+		
+		/** callback with the process and its array of thread infos if there are threads to be 
+		processed, or zero threads is ok
 		*/
 		if( callback 
 			&& ( threads_ecount || ( flags & TRAVERSE_FLAG_ZERO_THREADS_OK ) ) 
 		)
 		{
-			/* a pointer to the current thread info struct. cast size_t for pointer arithmetic */
-			SYSTEM_THREAD_INFORMATION *sti = NULL;
+			/* callback return code */
+			int ret;
 			
-			/* how many threads in this spi have not yet been processed */
-			ULONG remaining = 0;
 			
-			if( threads_ecount ) /* there are thread info structs to be processed */
-			{
-				sti = (SYSTEM_THREAD_INFORMATION *)&spi->Threads;
-				remaining = threads_ecount - 1;
-			}
+			dbg_printf( 
+				">>>Calling callback function on process id %Iu, thread count %lu.\n",
+				(size_t)spi->UniqueProcessId,
+				threads_ecount
+			);
 			
-			for( ;; ) /* for each thread info in the current spi */
-			{
-				/* callback return code */
-				int ret;
-				
-				
-				if( ( flags & TRAVERSE_FLAG_DEBUG ) )
-				{
-					printf( 
-						">>>Calling callback function on process id %Iu, thread id ",
-						(size_t)spi->UniqueProcessId
-					);
-					
-					if( sti )
-						printf( "%Iu.", (size_t)sti->ClientId.UniqueThread );
-					else
-						printf( "(null)." );
-					
-					printf( "\n" );
-				}
-				
-				ret = callback( 
-					cb_param, /* the cb_param that was passed in to traverse_threads()*/
-					spi, /* the current process info struct */
-					sti, /* the current thread info struct */
-					remaining, /* how many threads in this spi have not yet been processed */
-					flags /* the flags that were passed in to traverse_threads() */
+			ret = callback( 
+				cb_param, /* the cb_param that was passed in to traverse_threads_batch() */
+				spi, /* the current process info struct */
+				/* the first thread info struct in the current process info struct */
+				( threads_ecount ? (SYSTEM_THREAD_INFORMATION *)&spi->Threads : NULL ), 
+				threads_ecount, /* how many thread info structs are in the current spi */
+				flags /* the flags that were passed in to traverse_threads_batch() */
+			);
+			
+			if( ( ret != TRAVERSE_CALLBACK_CONTINUE ) && ( ret != TRAVERSE_CALLBACK_SKIP ) )
+			{ /* some problem. quit */
+				dbg_printf( 
+					"<<<Callback function returned: abort immediately. ret: %d\n",
+					ret 
 				);
 				
-				if( ret == TRAVERSE_CALLBACK_SKIP ) /* do not process spi's remaining threads */
-				{
-					dbg_printf( 
-						"<<<Callback function returned: skip process' remaining threads.\n" 
-					);
-					
-					break;
-				}
-				else if( ret != TRAVERSE_CALLBACK_CONTINUE ) /* some other problem. quit */
-				{
-					dbg_printf( 
-						"<<<Callback function returned: abort immediately. ret: %d\n",
-						ret 
-					);
-					
-					error_code = TRAVERSE_ERROR_CALLBACK;
-					goto quit;
-				}
-				
-				dbg_printf( "<<<Callback returned normally.\n\n" );
-				
-				
-				if( !remaining ) /* no more threads in this spi */
-					break;
-				
-				--remaining;
-				sti = (SYSTEM_THREAD_INFORMATION *)( (size_t)sti + sti_bcount );
+				error_code = TRAVERSE_ERROR_CALLBACK;
+				goto quit;
 			}
+			
+			dbg_printf( "<<<Callback returned normally.\n\n" );
 		}
 		
 		/* break if there are no more spi structs to process */
 		if( !spi->NextEntryOffset || spi_end == buffer_end )
 			break;
 		
+		/* the members of the next spi struct before its array of thread info structs are read 
+		before its endpoints are checked, so they must be in the array of spi structs. 
+		NtQuerySystemInformation() requires a ULONG aligned buffer and aligns each spi struct at least 
+		as strictly, so a misaligned offset is garbage data.
+		*/
+		if( ( spi_end + offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) ) > buffer_end 
+			|| ( spi->NextEntryOffset % sizeof( ULONG ) )
+		)
+		{
+			dbg_printf( "Error: the next process info is out of range, quitting...\n" );
+			
+			error_code = TRAVERSE_ERROR_CALCULATION;
+			goto quit;
+		}
+		
 		/* the endpoint of the current spi struct is a pointer to the next spi struct in the array 
 		*/
 		spi = (SYSTEM_PROCESS_INFORMATION *)spi_end;
@@ -888,6 +1036,14 @@ quit:
 		sanity.dwVersion = dwVersion;
 		sanity.reserved = reserved;
 		
+		/* the process index is only usable if every process info was indexed */
+		if( index && ( error_code == TRAVERSE_SUCCESS ) )
+		{
+			sanity.index_offset = (ULONG)( (size_t)index - (size_t)buffer );
+			sanity.index_process_count = index_process_count;
+			sanity.index_thread_count = index_thread_count;
+		}
+		
 		/* write the sanity struct to the end of the buffer in the location reserved earlier */
 		memcpy( 
 			reserved, /* location of reserved space */
@@ -900,3 +1056,350 @@ quit:
 }
 
 
+
+/** traverse_threads()
+This function is well documented in traverse_threads.txt 
+*/
+int traverse_threads( 
+	int ( __cdecl *callback )( 
+		void *cb_param,   // in, out, optional
+		SYSTEM_PROCESS_INFORMATION *const spi,   // in
+		SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+		const ULONG remaining,   // in
+		const DWORD flags   // in, optional
+	),   // in, optional
+	void *cb_param,   // in, out, optional
+	void *buffer,   // in, out, optional
+	size_t buffer_bcount,   // in, optional
+	const DWORD flags,   // in, optional
+	LONG *status   // out, optional
+)
+{
+	struct traverse_adapter adapter;
+	
+	
+	adapter.callback = callback;
+	adapter.cb_param = cb_param;
+	
+	/* if there's no callback then traverse_threads_batch() uses the default callback */
+	return traverse_threads_batch( 
+		( callback ? callback_adapter : NULL ), 
+		&adapter, 
+		buffer, 
+		buffer_bcount, 
+		flags, 
+		status 
+	);
+}
+
+
+
+/* set_traverse_query()
+Replace the function that traverse_threads() calls to query the system process information.
+
+'query' is called instead of NtQuerySystemInformation() with the same parameters. If 'query' is NULL 
+then NtQuerySystemInformation() is used again.
+
+This is for testing. A query function that writes a synthetic array of SYSTEM_PROCESS_INFORMATION 
+structs to the buffer can exercise traverse_threads() without a live system. It replaces the query 
+for traverse_threads() and traverse_threads_batch() only, not get_spi_bcount_estimate(). It must not 
+be called while another thread is in traverse_threads().
+*/
+void set_traverse_query( 
+	LONG ( __stdcall *query )( 
+		int infotype,   // in
+		void *buffer,   // out
+		ULONG buffer_bcount,   // in
+		ULONG *retlen   // out
+	)   // in, optional
+)
+{
+	/* if the query is NULL then traverse_threads() resolves NtQuerySystemInformation() again */
+	*(FARPROC *)&NtQuerySystemInformation = (FARPROC)query;
+	
+	return;
+}
+
+
+
+/* callback_adapter()
+traverse_threads_batch() callback: call a traverse_threads() callback for each thread in a process.
+
+'cb_param' is a pointer to a traverse_adapter struct that has the traverse_threads() callback and 
+the cb_param to pass to it. 'sti' is the first of 'count' thread infos in 'spi'.
+
+This is how traverse_threads() is implemented on top of traverse_threads_batch(). The callback is 
+passed each thread info and how many remain, the same as when traverse_threads() traversed the 
+threads itself.
+
+returns TRAVERSE_CALLBACK_CONTINUE if the callback continued or skipped the rest of the process' 
+threads, or what the callback returned if it aborted.
+*/
+static int __cdecl callback_adapter( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+	const ULONG count,   // in
+	const DWORD flags   // in, optional
+)
+{
+	const struct traverse_adapter *const adapter = (struct traverse_adapter *)cb_param;
+	
+	/* the size in bytes of SYSTEM_THREAD_INFORMATION, or if TRAVERSE_FLAG_EXTENDED 
+	then SYSTEM_EXTENDED_THREAD_INFORMATION */
+	const size_t sti_bcount = ( ( flags & TRAVERSE_FLAG_EXTENDED ) ? 
+		sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) : sizeof( SYSTEM_THREAD_INFORMATION ) );
+	
+	/* a pointer to the current thread info struct. cast size_t for pointer arithmetic */
+	SYSTEM_THREAD_INFORMATION *current = ( count ? sti : NULL );
+	
+	/* how many threads in this spi have not yet been processed */
+	ULONG remaining = ( count ? ( count - 1 ) : 0 );
+	
+	
+	for( ;; ) /* for each thread info in the current spi */
+	{
+		/* callback return code */
+		int ret;
+		
+		
+		if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+		{
+			printf( 
+				">>>Calling thread callback function on process id %Iu, thread id ",
+				(size_t)spi->UniqueProcessId
+			);
+			
+			if( current )
+				printf( "%Iu.", (size_t)current->ClientId.UniqueThread );
+			else
+				printf( "(null)." );
+			
+			printf( "\n" );
+		}
+		
+		ret = adapter->callback( 
+			adapter->cb_param, /* the cb_param that was passed in to traverse_threads() */
+			spi, /* the current process info struct */
+			current, /* the current thread info struct */
+			remaining, /* how many threads in this spi have not yet been processed */
+			flags /* the flags that were passed in to traverse_threads() */
+		);
+		
+		if( ret == TRAVERSE_CALLBACK_SKIP ) /* do not process spi's remaining threads */
+		{
+			dbg_printf( "<<<Thread callback function returned: skip process' remaining threads.\n" );
+			break;
+		}
+		else if( ret != TRAVERSE_CALLBACK_CONTINUE ) /* some other problem. quit */
+			return ret;
+		
+		dbg_printf( "<<<Thread callback returned normally.\n" );
+		
+		
+		if( !remaining ) /* no more threads in this spi */
+			break;
+		
+		--remaining;
+		current = (SYSTEM_THREAD_INFORMATION *)( (size_t)current + sti_bcount );
+	}
+	
+	return TRAVERSE_CALLBACK_CONTINUE;
+}
+
+
+
+/* get_sanity_index()
+Get the process index and a copy of the sanity struct that traverse_threads() wrote to a buffer.
+
+The sanity struct is copied rather than accessed in place since its location in the buffer may not 
+be aligned.
+
+returns the index, or NULL if the buffer doesn't have one
+*/
+static struct traverse_index_entry *get_sanity_index( 
+	void *buffer,   // in
+	size_t buffer_bcount,   // in
+	struct traverse_sanity *sanity   // out
+)
+{
+	size_t index_bcount = 0;
+	
+	
+	ZeroMemory( sanity, sizeof( *sanity ) );
+	
+	if( !buffer || ( buffer_bcount <= sizeof( *sanity ) ) )
+		return NULL;
+	
+	/* the sanity struct is in the reserved space at the end of the buffer */
+	memcpy( sanity, (void *)( (size_t)buffer + buffer_bcount - sizeof( *sanity ) ), sizeof( *sanity ) );
+	
+	if( memcmp( sanity->recycle_must_verify.magic_begin, TRAVERSE_MAGIC_BEGIN, TRAVERSE_MAGIC_LEN )
+		|| ( sanity->recycle_must_verify.sanity_size != sizeof( *sanity ) )
+		|| ( sanity->recycle_must_verify.buffer != buffer )
+		|| ( sanity->recycle_must_verify.buffer_bcount != buffer_bcount )
+		|| memcmp( sanity->magic_end, TRAVERSE_MAGIC_END, TRAVERSE_MAGIC_LEN )
+		|| !sanity->index_offset
+		|| ( sanity->index_offset % sizeof( ULONG ) )
+	)
+		return NULL;
+	
+	/* the index must be between the array and the reserved space */
+	index_bcount = (size_t)sanity->index_process_count * sizeof( struct traverse_index_entry );
+	
+	if( ( sanity->index_offset < sanity->retlen )
+		|| ( sanity->index_offset > ( buffer_bcount - sizeof( *sanity ) ) )
+		|| ( index_bcount > ( buffer_bcount - sizeof( *sanity ) - sanity->index_offset ) )
+	)
+		return NULL;
+	
+	return (struct traverse_index_entry *)( (size_t)buffer + sanity->index_offset );
+}
+
+
+
+/* get_traverse_index()
+Get the process index that traverse_threads() wrote to a buffer.
+
+traverse_threads() writes the index when TRAVERSE_FLAG_INDEX is passed in on an original call that 
+returns TRAVERSE_SUCCESS, if there's enough unused space at the end of the buffer. There is an entry 
+for each process info in the order they were traversed: the offset in bytes of the process info 
+from the start of the buffer, its number of thread infos, and the ordinal of its first thread info 
+among all the thread infos. Any number of passes can use the index to access the process infos 
+without walking the array again, as long as the buffer isn't modified.
+
+'buffer' and 'buffer_bcount' must be the same as passed in to the original call
+'process_count' receives the number of process infos in the index
+'thread_count' receives the number of thread infos in the index
+
+returns the index, or NULL if the buffer doesn't have one
+*/
+const struct traverse_index_entry *get_traverse_index( 
+	void *buffer,   // in
+	size_t buffer_bcount,   // in
+	ULONG *process_count,   // out, optional
+	ULONG *thread_count   // out, optional
+)
+{
+	struct traverse_sanity sanity;
+	const struct traverse_index_entry *index = NULL;
+	
+	
+	index = get_sanity_index( buffer, buffer_bcount, &sanity );
+	
+	if( process_count )
+		*process_count = ( index ? sanity.index_process_count : 0 );
+	
+	if( thread_count )
+		*thread_count = ( index ? sanity.index_thread_count : 0 );
+	
+	return index;
+}
+
+
+
+/* get_indexed_process()
+Get a process info from a buffer by its ordinal.
+
+'buffer' and 'buffer_bcount' must be the same as passed in to the original call
+'ordinal' is the ordinal of the process info, 0 for the first
+'thread_count' receives the number of thread infos in the process info
+
+returns the process info, or NULL if the buffer doesn't have an index or the ordinal is out of range
+*/
+SYSTEM_PROCESS_INFORMATION *get_indexed_process( 
+	void *buffer,   // in
+	size_t buffer_bcount,   // in
+	const ULONG ordinal,   // in
+	ULONG *thread_count   // out, optional
+)
+{
+	struct traverse_sanity sanity;
+	const struct traverse_index_entry *index = NULL;
+	
+	
+	if( thread_count )
+		*thread_count = 0;
+	
+	index = get_sanity_index( buffer, buffer_bcount, &sanity );
+	
+	if( !index || ( ordinal >= sanity.index_process_count ) )
+		return NULL;
+	
+	if( thread_count )
+		*thread_count = index[ ordinal ].thread_count;
+	
+	return (SYSTEM_PROCESS_INFORMATION *)( (size_t)buffer + index[ ordinal ].offset );
+}
+
+
+
+/* get_indexed_thread()
+Get a thread info from a buffer by its ordinal.
+
+The thread infos are numbered in the order they're traversed, across all process infos. The process 
+info is found by a binary search of the index.
+
+If the flag TRAVERSE_FLAG_EXTENDED was passed in for the original call then the thread info is a 
+SYSTEM_EXTENDED_THREAD_INFORMATION struct.
+
+'buffer' and 'buffer_bcount' must be the same as passed in to the original call
+'ordinal' is the ordinal of the thread info, 0 for the first
+'spi' receives the process info of the thread info
+
+returns the thread info, or NULL if the buffer doesn't have an index or the ordinal is out of range
+*/
+SYSTEM_THREAD_INFORMATION *get_indexed_thread( 
+	void *buffer,   // in
+	size_t buffer_bcount,   // in
+	const ULONG ordinal,   // in
+	SYSTEM_PROCESS_INFORMATION **spi   // out, optional
+)
+{
+	struct traverse_sanity sanity;
+	const struct traverse_index_entry *index = NULL;
+	SYSTEM_PROCESS_INFORMATION *process = NULL;
+	size_t sti_bcount = 0;
+	ULONG lo = 0, hi = 0;
+	
+	
+	if( spi )
+		*spi = NULL;
+	
+	index = get_sanity_index( buffer, buffer_bcount, &sanity );
+	
+	if( !index || ( ordinal >= sanity.index_thread_count ) )
+		return NULL;
+	
+	/* find the last process info whose first thread is at or before the ordinal. a process info 
+	with no threads has the same first thread as the one after it, so it's never the last.
+	*/
+	lo = 0;
+	hi = sanity.index_process_count - 1;
+	
+	while( lo < hi )
+	{
+		const ULONG mid = hi - ( ( hi - lo ) / 2 );
+		
+		if( index[ mid ].first_thread <= ordinal )
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	
+	if( ( ordinal - index[ lo ].first_thread ) >= index[ lo ].thread_count )
+		return NULL;
+	
+	sti_bcount = ( ( sanity.flags & TRAVERSE_FLAG_EXTENDED ) 
+		? sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) 
+		: sizeof( SYSTEM_THREAD_INFORMATION ) 
+	);
+	
+	process = (SYSTEM_PROCESS_INFORMATION *)( (size_t)buffer + index[ lo ].offset );
+	
+	if( spi )
+		*spi = process;
+	
+	return (SYSTEM_THREAD_INFORMATION *)
+		( (size_t)&process->Threads + ( ( ordinal - index[ lo ].first_thread ) * sti_bcount ) );
+}
@@ -41,6 +41,7 @@ extern "C" {
 #define TRAVERSE_FLAG_ZERO_THREADS_OK   (1u << 3)
 #define TRAVERSE_FLAG_RECYCLE   (1u << 4)
 #define TRAVERSE_FLAG_TEST_MEMORY   (1u << 5)
+#define TRAVERSE_FLAG_INDEX   (1u << 6)
 
 
 #define TRAVERSE_SUCCESS   (0)
@@ -56,6 +57,25 @@ extern "C" {
 #define TRAVERSE_ERROR_ACCESS_VIOLATION   (-9)
 
 
+/** traverse_threads_batch()
+This function is well documented in traverse_threads.txt 
+*/
+int traverse_threads_batch( 
+	int ( __cdecl *callback )( 
+		void *cb_param,   // in, out, optional
+		SYSTEM_PROCESS_INFORMATION *const spi,   // in
+		SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+		const ULONG count,   // in
+		const DWORD flags   // in, optional
+	),   // in, optional
+	void *cb_param,   // in, out, optional
+	void *buffer,   // in, out, optional
+	size_t buffer_bcount,   // in, optional
+	const DWORD flags,   // in, optional
+	LONG *status   // out, optional
+);
+
+
 /** traverse_threads()
 This function is well documented in traverse_threads.txt 
 */
@@ -76,6 +96,58 @@ int traverse_threads(
 
 
 
+/** An entry in the process index that traverse_threads() writes when TRAVERSE_FLAG_INDEX is 
+specified. There is one entry for each process info, in the order they were traversed.
+*/
+struct traverse_index_entry
+{
+	/* the offset in bytes of the process info from the start of the buffer */
+	ULONG offset;
+	
+	/* the number of thread infos in the process info */
+	ULONG thread_count;
+	
+	/* the ordinal of the process info's first thread info among all thread infos */
+	ULONG first_thread;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in traverse_threads.c
+*/
+void set_traverse_query( 
+	LONG ( __stdcall *query )( 
+		int infotype,   // in
+		void *buffer,   // out
+		ULONG buffer_bcount,   // in
+		ULONG *retlen   // out
+	)   // in, optional
+);
+
+const struct traverse_index_entry *get_traverse_index( 
+	void *buffer,   // in
+	size_t buffer_bcount,   // in
+	ULONG *process_count,   // out, optional
+	ULONG *thread_count   // out, optional
+);
+
+SYSTEM_PROCESS_INFORMATION *get_indexed_process( 
+	void *buffer,   // in
+	size_t buffer_bcount,   // in
+	const ULONG ordinal,   // in
+	ULONG *thread_count   // out, optional
+);
+
+SYSTEM_THREAD_INFORMATION *get_indexed_thread( 
+	void *buffer,   // in
+	size_t buffer_bcount,   // in
+	const ULONG ordinal,   // in
+	SYSTEM_PROCESS_INFORMATION **spi   // out, optional
+);
+
+
+
 /** 
 these supporting functions are documented in the comment block above their 
 definitions in traverse_threads__support.c
@@ -99,6 +171,11 @@ void *copy_teb_from_thread(
 	SIZE_T *bytes_written   // out
 );
 
+size_t get_spi_bcount_estimate( 
+	const DWORD flags,   // in, optional
+	LONG *status   // out, optional
+);
+
 int callback_print_thread_state( 
 	void *cb_param,   // in, out, optional
 	SYSTEM_PROCESS_INFORMATION *const spi,   // in
@@ -108,7 +185,8 @@ int callback_print_thread_state(
 );
 
 int print_filetime_as_local( 
-	const FILETIME *const ft   // in
+	const FILETIME *const ft,   // in
+	int ( *print )( const char *const format, ... )   // in, optional
 );
 
 char *traverse_threads_retcode_to_cstr( 
@@ -147,6 +225,11 @@ unsigned test_memory(
 #define TRAVERSE_MAGIC_END   "\x96\x50\xe6\xf0\xc5\xef\xd7\x4f"
 #define TRAVERSE_MAGIC_BAD   "\xaa\xaa\xaa\xaa\xaa\xaa\xaa\xaa"
 
+/* the maximum number of bytes traverse_threads() reserves at the end of a buffer for its sanity 
+struct. a buffer must be larger than the amount of data expected plus this many bytes.
+*/
+#define TRAVERSE_RESERVED_BCOUNT   256
+
 
 
 #ifdef __cplusplus
@@ -34,6 +34,12 @@ copy_teb()
 Copy the thread environment block of a thread in another process.
 -
 
+-
+get_spi_bcount_estimate()
+
+Get the approximate size in bytes of the buffer needed by traverse_threads().
+-
+
 -
 callback_print_thread_state()
 
@@ -337,6 +343,87 @@ cleanup:
 #pragma warning(disable:4100) /* disable unused parameter warning */
 #endif
 
+/* get_spi_bcount_estimate()
+Get the approximate size in bytes of the buffer needed by traverse_threads().
+
+This is the same size estimate that traverse_threads() gets when it is not passed a buffer: 
+NtQuerySystemInformation() is called with a stub to receive the approximate needed length.
+The estimate does not include TRAVERSE_RESERVED_BCOUNT, the space reserved by traverse_threads() 
+at the end of the buffer for its sanity struct.
+
+'flags' is the optional flags parameter that will be passed to traverse_threads().
+if TRAVERSE_FLAG_EXTENDED is set the estimate is for SystemExtendedProcessInformation.
+'*status' receives the status returned by NtQuerySystemInformation(), or -1 if it wasn't called.
+
+returns the approximate size in bytes on success, or 0 on failure
+*/
+size_t get_spi_bcount_estimate( 
+	const DWORD flags,   // in, optional
+	LONG *status   // out, optional
+)
+{
+	static NTSTATUS (__stdcall *NtQuerySystemInformation)(
+		SYSTEM_INFORMATION_CLASS SystemInformationClass,
+		PVOID SystemInformation,
+		ULONG SystemInformationLength,
+		PULONG ReturnLength
+	);
+	
+	/* stub address must be aligned, no char */
+	SYSTEM_PROCESS_INFORMATION stub;
+	
+	LONG status_placeholder = 0;
+	ULONG retlen = 0;
+	
+	
+	if( !status ) /* the caller did not specify a location to receive status. use placeholder */
+		status = &status_placeholder;
+	
+	*status = -1;
+	
+	if( !NtQuerySystemInformation )
+	{
+		SetLastError( 0 ); // error code is evaluated on success
+		*(FARPROC *)&NtQuerySystemInformation = 
+			(FARPROC)GetProcAddress( GetModuleHandleA( "ntdll" ), "NtQuerySystemInformation" );
+		
+		if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+		{
+			printf( "GetProcAddress() %s. GLE: %u, NtQuerySystemInformation: 0x%p.\n",
+				( NtQuerySystemInformation ? "success" : "error" ), 
+				GetLastError(), 
+				NtQuerySystemInformation 
+			);
+		}
+		
+		if( !NtQuerySystemInformation )
+			return 0;
+	}
+	
+	/* pass in a stub to receive the buffer's approximate needed size */
+	*status = (LONG)NtQuerySystemInformation( 
+		( ( flags & TRAVERSE_FLAG_EXTENDED ) 
+			? SystemExtendedProcessInformation 
+			: SystemProcessInformation 
+		), 
+		&stub, 
+		1, 
+		&retlen 
+	);
+	
+	if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+	{
+		printf( "NtQuerySystemInformation() status: 0x%08X retlen: %lu\n", 
+			(unsigned)*status, 
+			retlen 
+		);
+	}
+	
+	return retlen;
+}
+
+
+
 /* callback_print_thread_state()
 A default callback used by traverse_threads() if no callback was supplied by the caller.
 
@@ -429,7 +516,7 @@ int callback_print_thread_state(
 	
 	/* print the thread's CreateTime as user's local time */
 	printf( "CreateTime: " );
-	print_filetime_as_local( (FILETIME *)&sti->CreateTime );
+	print_filetime_as_local( (FILETIME *)&sti->CreateTime, NULL );
 	printf( "\n" );
 	
 	/* don't access extended members unless this flag was passed in: */
@@ -477,11 +564,15 @@ Print a FILETIME as local time and date. No newline.
 This function takes a pointer to a utc system time FILETIME ('ft') and prints it as local time.
 No newline is printed.
 
+'print' is the printf() style function to print with, eg an output function that writes somewhere 
+other than stdout. if it's NULL then printf() is used.
+
 returns nonzero if the conversion succeeded and printed the local time.
 returns zero if the conversion failed and printed "<conversion to local time failed>".
 */
 int print_filetime_as_local( 
-	const FILETIME *const ft   // in
+	const FILETIME *const ft,   // in
+	int ( *print )( const char *const format, ... )   // in, optional
 )
 {
 	SYSTEMTIME utc, local;
@@ -492,13 +583,16 @@ int print_filetime_as_local(
 	ZeroMemory( &utc, sizeof( utc ) );
 	ZeroMemory( &local, sizeof( local ) );
 	
+	if( !print )
+		print = printf;
+	
 	if( !ft
 		|| !FileTimeToSystemTime( ft, &utc ) 
 		|| !SystemTimeToTzSpecificLocalTime( NULL, &utc, &local ) 
 		|| ( local.wHour >= 24 ) 
 	)
 	{
-		printf( "<conversion to local time failed>" );
+		print( "<conversion to local time failed>" );
 		return FALSE;
 	}
 	
@@ -523,7 +617,7 @@ int print_filetime_as_local(
 		pm = 1;
 	}
 	
-	printf( "%u:%02u:%02u %s"
+	print( "%u:%02u:%02u %s"
 		"  %u/%u/%04u", 
 		hour, local.wMinute, local.wSecond, ( pm ? "PM" : "AM" ), 
 		local.wMonth, local.wDay, local.wYear
@@ -140,7 +140,8 @@ void print_more_options_and_exit( void )
 	printf( "\n"
 		"These options are compatible with all other options unless stated otherwise.\n"
 		"\n"
-		"[-t <num>]  [-f]  [-e]  [-u]  [-g]  [-z <func> [param]]\n"
+		"[-t <num>]  [-j <num>]  [-f]  [-e]  [-u]  [-g]  [-w <file>]  [-l <path>]\n"
+		"[-o <file>]  [-s <file>]  [-a <min> <max>]  [-q]  [-b]  [-z <func> [param]]\n"
 	);
 	
 	
@@ -149,7 +150,9 @@ void print_more_options_and_exit( void )
 		"\n"
 		"For each system snapshot this program allocates several buffers whose size is \n"
 		"based on the maximum number of threads in a snapshot. The default maximum \n"
-		"number of threads is currently %u, resulting in each snapshot taking ~%uMB.\n"
+		"number of threads is currently %u, resulting in each snapshot taking up to \n"
+		"~%uMB. The buffer that receives the system's thread info starts smaller and is \n"
+		"grown as needed, up to the size needed for the maximum number of threads.\n"
 		"Currently gethooks has memory allocated at any one time for 1 snapshot by \n"
 		"default, or 2 if in monitor mode, or maybe more if in test mode. Use this \n"
 		"option to specify a smaller or larger number of threads per snapshot, which \n"
@@ -166,6 +169,21 @@ void print_more_options_and_exit( void )
 	);
 	
 	
+	printf( "\n\n"
+		"   -j     the number of worker threads that find the GUI threads in a snapshot\n"
+		"\n"
+		"To find which threads are GUI threads this program reads the memory of each \n"
+		"process to get each thread's Win32ThreadInfo. By default that's done on the \n"
+		"main thread. Use this option to divide the processes among this many worker \n"
+		"threads instead, each reading the memory of its own processes. The maximum \n"
+		"number of worker threads is %u.\n"
+		"-Note that a thread whose Win32ThreadInfo was read in an earlier snapshot is \n"
+		"not read again, so in monitor mode worker threads mostly speed up the first \n"
+		"snapshot.\n", 
+		WORKER_THREADS_MAX 
+	);
+	
+	
 	printf( "\n\n"
 		"   -f     force successful completion of certain functions (continuous retry)\n"
 		"\n"
@@ -185,8 +203,10 @@ void print_more_options_and_exit( void )
 		"-Note that this option suppresses failure notices for functions it retries.\n"
 		"-Note that this option is only a workaround for intermittent failures. If you \n"
 		"enable this option and a failure *always* occurs then the code loops endlessly.\n"
-		"-Note that info length mismatch (buffer too small) failures are never retried. \n"
-		"To remedy a small buffer increase the number of threads using option 't'.\n"
+		"-Note that info length mismatch (buffer too small) failures are retried with a \n"
+		"larger buffer, but only up to the size allowed by the maximum number of \n"
+		"threads. To remedy a small buffer increase the number of threads using \n"
+		"option 't'.\n"
 	);
 	
 	
@@ -270,6 +290,105 @@ void print_more_options_and_exit( void )
 	);
 	
 	
+	printf( "\n\n"
+		"   -q     skip snapshots when no hook has changed (monitor mode)\n"
+		"\n"
+		"Most checks for changes find none, but each one still reads the info of every \n"
+		"thread in the system. With this option each check first fingerprints the \n"
+		"hook entries in the handle table and the hooks they point to. If the \n"
+		"fingerprint is the same as the last snapshot's then no snapshot is taken and \n"
+		"nothing is compared, which makes monitoring a quiet system nearly free.\n"
+		"-Note that a skipped check doesn't notice that a thread associated with a \n"
+		"hook has exited, until a hook changes. Skipped checks aren't written to a \n"
+		"snapshot file.\n"
+		"-Note that verbosity level 2 prints how many checks were skipped.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   -b     query the thread info in the background (monitor mode)\n"
+		"\n"
+		"Each snapshot starts by waiting for the system to list every thread, which \n"
+		"can take a large part of a snapshot that's taken every few milliseconds. With \n"
+		"this option a capture thread starts listing the threads %u milliseconds before \n"
+		"each check, and the check uses that list instead of waiting. A third thread \n"
+		"info buffer is allocated for the capture thread.\n"
+		"-Note that a list that's older than %u milliseconds isn't used. If a new hook's \n"
+		"thread isn't in the list then the threads are listed again.\n"
+		"-Note that verbosity level 2 prints how many captures were used.\n", 
+		CAPTURE_LEAD_MS, 
+		( CAPTURE_LEAD_MS * 2 ) 
+	);
+	
+	
+	printf( "\n\n"
+		"   -w     write each snapshot to the end of a binary snapshot file\n"
+		"\n"
+		"Each snapshot taken is appended to the file, which is created if it does not \n"
+		"exist. A snapshot in the file is this program's own structures (the threads, \n"
+		"desktops and hooks) and can be loaded to be printed and compared again later. \n"
+		"The file can only be read by a build of this program for the same platform.\n"
+		"-Note that in monitor mode a snapshot is written at every interval, whether or \n"
+		"not any hooks have changed.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   -l     replay the snapshots in a snapshot file or a directory of snapshot files\n"
+		"\n"
+		"No snapshots of the system are taken. Instead the snapshots that were written by \n"
+		"the 'w' option are loaded and compared in the order they were written, and the \n"
+		"differences printed as they were in monitor mode. If a directory is specified \n"
+		"then its files are replayed in name order. The snapshots are replayed as fast \n"
+		"as possible, the 'm' option is ignored.\n"
+		"The hook, program and desktop include/exclude options work as they normally do \n"
+		"except that the 'd' option without desktop names does not exclude any desktop.\n"
+		"This option is not compatible with the 'w' option.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   -o     write the output to a file instead of the console\n"
+		"\n"
+		"Everything that would have been printed to the console is written to the file \n"
+		"instead, including error messages. The file is overwritten if it exists.\n"
+		"-Note that the output is buffered, to the console or to the file, and is \n"
+		"written after each snapshot is printed and whenever an error is printed.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   -s     write a summary of the time taken by each phase of each poll to a file\n"
+		"\n"
+		"Each snapshot is timed in phases: NtQuerySystemInformation(), recycling a \n"
+		"captured query, reading the TEBs to find the GUI threads, scanning the handle \n"
+		"table, copying the HOOKs, sorting them, comparing them to the last snapshot and \n"
+		"printing the differences. When the program exits, or in monitor mode when it's \n"
+		"interrupted, the minimum, average and maximum time of each phase, and the 99th \n"
+		"percentile time of the last %u polls, are written to the file as comma \n"
+		"separated values. The file is overwritten if it exists.\n"
+		"-Note that verbosity level 3 prints the time of each phase after each poll.\n"
+		"-Note that with -b the query is timed on the capture thread while the program \n"
+		"waits for the poll, so the phases can add up to more than the total.\n", 
+		TIMING_WINDOW 
+	);
+	
+	
+	printf( "\n\n"
+		"   -a     adaptive monitor mode. specify the minimum and maximum interval.\n"
+		"\n"
+		"The interval between checks for changes adapts to how often hooks change. \n"
+		"When a check finds changes the next check is made after the minimum interval, \n"
+		"since more changes are likely to follow. Each check that finds no changes \n"
+		"doubles the interval, up to the maximum. Both intervals are in seconds, or in \n"
+		"milliseconds if ms is added. This option enables monitor mode. If the 'm' \n"
+		"option is also specified then its interval is the first interval, kept within \n"
+		"the minimum and maximum; otherwise the first interval is the maximum.\n"
+		"-Note that verbosity level 2 prints the current interval and the rate of \n"
+		"changes after each check.\n"
+	);
+	
+	
 	printf( "\n\n"
 		"   -z     run a test mode function with an optional or required parameter.\n"
 		"\n"
@@ -384,6 +503,25 @@ void print_more_examples_and_exit( void )
 	);
 	
 	
+	printf( "\n\n"
+		"Short-lived hooks can be missed when checking for changes every few seconds.\n"
+		"The interval can be specified in milliseconds instead by adding ms. The checks \n"
+		"are on a fixed schedule, so the time taken by each check is subtracted from \n"
+		"the wait for the next. If a check takes longer than the interval the next \n"
+		"check is made immediately, and at verbosity level 1 or higher the missed \n"
+		"deadlines are printed. For example, to check for changes every 100ms:\n"
+		"\n"
+		"          %s -m 100ms\n"
+		"\n"
+		"To check every 50ms while hooks are changing and back off to every 10 seconds \n"
+		"when they're not:\n"
+		"\n"
+		"          %s -a 50ms 10\n", 
+		G->prog->pszBasename, 
+		G->prog->pszBasename 
+	);
+	
+	
 	printf( "\n\n"
 		"Use the GNU 'tee' program to copy this program's output to a file.\n"
 		"For example, to monitor hooks and copy output to file \"outfile\":\n"
@@ -402,8 +540,13 @@ void print_more_examples_and_exit( void )
 	
 	printf( "\n"
 		"Level 1 shows additional statistics and warnings.\n"
-		"Level 2 is reserved for further development.\n"
-		"Level 3 is reserved for further development.\n"
+		"Level 2 shows the spi buffer size, the snapshot arena size, the thread cache hits and \n"
+		"misses, the number of processes opened and process handles reused, the number \n"
+		"of processes and threads skipped because they're in another session, and in \n"
+		"monitor mode the number of checks that overran the schedule, the current \n"
+		"interval and the rate of changes.\n"
+		"Level 3 shows the time taken by each phase of each snapshot, and every %u polls \n"
+		"the minimum, average and 99th percentile time of each phase.\n"
 		"Level 4 is reserved for further development.\n"
 		"Level 5 shows this program's global store (structures) and its descendants.\n"
 		"Level 6 shows the HOOK structs (Microsoft's internal hook structures).\n"
@@ -416,6 +559,7 @@ void print_more_examples_and_exit( void )
 		"For example, to print Microsoft's internal HOOK struct in each HOOK notice:\n"
 		"\n"
 		"          %s -v 6\n", 
+		TIMING_WINDOW, 
 		G->prog->pszBasename 
 	);
 	
@@ -443,6 +587,7 @@ void print_usage_and_exit( void )
 		"[-m [sec]]  [-v [num]]  [-d [desktop]]  [[-i]|[-x] <hook>]  [[-p]|[-r] <prog>]\n"
 		"\n"
 		"   -m     monitor mode. check for changes every n seconds (default %u).\n"
+		"          for milliseconds add ms to the number, eg -m 100ms.\n"
 		"   -v     verbosity. print more information (default level when enabled is %u).\n"
 		"   -d     include only these desktops: a list of desktops separated by space.\n"
 		"   -i     include only these hooks: a list of hooks separated by space.\n"
@@ -55,7 +55,7 @@ Print an initialization utc time as local time and date.
 -
 print_time()
 
-Print the local time and date. No newline.
+Print a utc time as local time and date, to the output store. No newline.
 -
 
 */
@@ -73,6 +73,8 @@ Print the local time and date. No newline.
 
 #include "util.h"
 
+#include "output.h"
+
 
 
 /* must_calloc()
@@ -248,7 +250,7 @@ void print_init_time(
 		printf( "%s: ", msg );
 	
 	if( utc )
-		print_filetime_as_local( (FILETIME *)&utc );
+		print_filetime_as_local( (FILETIME *)&utc, printf );
 	else
 		printf( "<uninitialized>" );
 	
@@ -260,15 +262,21 @@ void print_init_time(
 
 
 /* print_time()
-Print the local time and date. No newline.
+Print a utc time as local time and date, to the output store. No newline.
+
+This is print_filetime_as_local() written to the output store, so that it can be part of a HOOK 
+notice.
+
+'utc' is the utc time in FILETIME format. if it's zero then the current time is printed.
 */
-void print_time( void )
+void print_time( 
+	__int64 utc   // in, optional
+)
 {
-	__int64 utc = 0;
-	
+	if( !utc )
+		GetSystemTimeAsFileTime( (FILETIME *)&utc );
 	
-	GetSystemTimeAsFileTime( (FILETIME *)&utc );
-	print_filetime_as_local( (FILETIME *)&utc );
+	print_filetime_as_local( (FILETIME *)&utc, output_printf );
 	
 	return;
 }
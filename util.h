@@ -44,7 +44,10 @@ https://github.com/yestein/dream-of-idle/blob/4e362ab/Dream/CELayoutEditor-0.7.1
 typedef uintptr_t size_t;
 #endif
 
-/* this is a basic function-like macro to print an error message and its location in code */
+/* this is a basic function-like macro to print an error message and its location in code.
+stdout is flushed before and after the message, so the buffered output is written ahead of it and 
+the message is written at once.
+*/
 #define MSG_LOCATION(type,msg)   \
 	do \
 	{ \
@@ -192,7 +195,9 @@ void print_init_time(
 	const __int64 utc   // in
 );
 
-void print_time( void );
+void print_time( 
+	__int64 utc   // in, optional
+);
 
 
 #ifdef __cplusplus